@@ -0,0 +1,142 @@
+/*
+ * 64-bit xxHash (XXH64) routine, a fast non-cryptographic hash.
+ *
+ * This follows the reference algorithm by Yann Collet
+ * (https://github.com/Cyan4973/xxHash, BSD 2-Clause License).
+ */
+
+#include <string.h>
+#include "xxhash.h"
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define XXH_ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline uint64_t xxh_read64(const unsigned char* p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+static inline uint32_t xxh_read32(const unsigned char* p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input)
+{
+	acc += input * XXH_PRIME64_2;
+	acc = XXH_ROTL64(acc, 31);
+	return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh_merge_round(uint64_t acc, uint64_t v)
+{
+	acc ^= xxh_round(0, v);
+	return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+static inline void xxh_stripe(uint64_t v[4], const unsigned char* p)
+{
+	v[0] = xxh_round(v[0], xxh_read64(p));
+	v[1] = xxh_round(v[1], xxh_read64(p + 8));
+	v[2] = xxh_round(v[2], xxh_read64(p + 16));
+	v[3] = xxh_round(v[3], xxh_read64(p + 24));
+}
+
+void xxh64_init(xxh64_ctx_t* ctx, uint64_t seed)
+{
+	ctx->size = 0;
+	ctx->memsize = 0;
+	ctx->v[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+	ctx->v[1] = seed + XXH_PRIME64_2;
+	ctx->v[2] = seed;
+	ctx->v[3] = seed - XXH_PRIME64_1;
+}
+
+void xxh64_update(xxh64_ctx_t* ctx, const void* data, size_t len)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	const unsigned char* end = p + len;
+	ctx->size += len;
+	if (ctx->memsize + len < 32)
+	{
+		memcpy(ctx->mem + ctx->memsize, p, len);
+		ctx->memsize += len;
+		return;
+	}
+	if (ctx->memsize)
+	{
+		memcpy(ctx->mem + ctx->memsize, p, 32 - ctx->memsize);
+		xxh_stripe(ctx->v, ctx->mem);
+		p += 32 - ctx->memsize;
+		ctx->memsize = 0;
+	}
+	for (; p + 32 <= end; p += 32)
+		xxh_stripe(ctx->v, p);
+	if (p < end)
+	{
+		memcpy(ctx->mem, p, end - p);
+		ctx->memsize = end - p;
+	}
+}
+
+uint64_t xxh64_final(xxh64_ctx_t* ctx)
+{
+	uint64_t h;
+	if (ctx->size >= 32)
+	{
+		h = XXH_ROTL64(ctx->v[0], 1) + XXH_ROTL64(ctx->v[1], 7) + XXH_ROTL64(ctx->v[2], 12) + XXH_ROTL64(ctx->v[3], 18);
+		h = xxh_merge_round(h, ctx->v[0]);
+		h = xxh_merge_round(h, ctx->v[1]);
+		h = xxh_merge_round(h, ctx->v[2]);
+		h = xxh_merge_round(h, ctx->v[3]);
+	} else
+		h = ctx->v[2] /* seed */ + XXH_PRIME64_5;
+	h += ctx->size;
+	const unsigned char* p = ctx->mem;
+	const unsigned char* end = p + ctx->memsize;
+	for (; p + 8 <= end; p += 8)
+	{
+		h ^= xxh_round(0, xxh_read64(p));
+		h = XXH_ROTL64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+	}
+	if (p + 4 <= end)
+	{
+		h ^= (uint64_t)xxh_read32(p) * XXH_PRIME64_1;
+		h = XXH_ROTL64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+	}
+	for (; p < end; p++)
+	{
+		h ^= (*p) * XXH_PRIME64_5;
+		h = XXH_ROTL64(h, 11) * XXH_PRIME64_1;
+	}
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+uint64_t xxh64(const void* data, size_t len, uint64_t seed)
+{
+	xxh64_ctx_t ctx;
+	xxh64_init(&ctx, seed);
+	xxh64_update(&ctx, data, len);
+	return xxh64_final(&ctx);
+}
@@ -0,0 +1,27 @@
+/*
+ * 64-bit xxHash (XXH64) routine, a fast non-cryptographic hash.
+ *
+ * This follows the reference algorithm by Yann Collet
+ * (https://github.com/Cyan4973/xxHash, BSD 2-Clause License),
+ * with a streaming interface shaped after the blk_SHA1 one.
+ */
+
+#ifndef GUARD_xxhash_h
+#define GUARD_xxhash_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct {
+	uint64_t size;
+	uint64_t v[4];
+	unsigned char mem[32];
+	unsigned int memsize;
+} xxh64_ctx_t;
+
+void xxh64_init(xxh64_ctx_t* ctx, uint64_t seed);
+void xxh64_update(xxh64_ctx_t* ctx, const void* data, size_t len);
+uint64_t xxh64_final(xxh64_ctx_t* ctx);
+uint64_t xxh64(const void* data, size_t len, uint64_t seed);
+
+#endif
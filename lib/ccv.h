@@ -46,6 +46,8 @@ enum {
 	CCV_32F = 0x04000,
 	CCV_64S = 0x08000,
 	CCV_64F = 0x10000,
+	CCV_16F = 0x20000, // IEEE half precision, a storage type: element access reads and writes it as float
+	CCV_16BF = 0x40000, // bfloat16, the upper 16 bits of a float, a storage type as CCV_16F
 };
 
 enum {
@@ -55,13 +57,22 @@ enum {
 	CCV_C4 = 0x004,
 };
 
-static const int _ccv_get_data_type_size[] = { -1, 1, 4, -1, 4, -1, -1, -1, 8, -1, -1, -1, -1, -1, -1, -1, 8 };
+static const int _ccv_get_data_type_size[] = {
+	-1, 1, 4, -1, 4, -1, -1, -1, 8, -1, -1, -1, -1, -1, -1, -1,
+	8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	2
+};
 
 #define CCV_GET_DATA_TYPE(x) ((x) & 0xFF000)
 #define CCV_GET_DATA_TYPE_SIZE(x) _ccv_get_data_type_size[CCV_GET_DATA_TYPE(x) >> 12]
 #define CCV_MAX_CHANNEL (0xFFF)
 #define CCV_GET_CHANNEL(x) ((x) & 0xFFF)
 #define CCV_ALL_DATA_TYPE (CCV_8U | CCV_32S | CCV_32F | CCV_64S | CCV_64F)
+/* half precision types are only accepted by the functions that say so (ccv_shift, ccv_visualize, ccv_gemm and
+ * the generic element access), they are not part of CCV_ALL_DATA_TYPE */
+#define CCV_HALF_DATA_TYPE (CCV_16F | CCV_16BF)
 
 enum {
 	CCV_MATRIX_DENSE  = 0x0100000,
@@ -75,8 +86,14 @@ enum {
 	CCV_REUSABLE      = 0x40000000, // matrix can be recycled
 	CCV_UNMANAGED     = 0x20000000, // matrix is allocated by user, therefore, cannot be freed by ccv_matrix_free/ccv_matrix_free_immediately
 	CCV_NO_DATA_ALLOC = 0x10000000, // matrix is allocated as header only, but with no data section, therefore, you have to free the data section separately
+	CCV_POOLED        = 0x08000000, // matrix is allocated from the matrix pool, it will be returned to the pool rather than freed
+	CCV_ARENA         = 0x04000000, // matrix / array is allocated from an arena, free does nothing, it is released when the arena scope pops
+	CCV_ALIGNED       = 0x01000000, // dense matrix only (the same bit is CCV_SPARSE_VECTOR for sparse matrix), its data is aligned to CCV_MATRIX_ALIGNMENT and its step is padded to CCV_MATRIX_ALIGNMENT
+	CCV_VIEW          = 0x02000000, // dense matrix only (the same bit is CCV_DENSE_VECTOR for sparse matrix), header only, its data is a region of a parent matrix it holds a reference to
 };
 
+#define CCV_MATRIX_ALIGNMENT (64)
+
 typedef union 
 {
 	unsigned char* u8;
@@ -84,6 +101,7 @@ typedef union
 	float* f32;
 	int64_t* i64;
 	double* f64;
+	uint16_t* f16;
 } ccv_matrix_cell_t;
 
 typedef struct 
@@ -129,6 +147,7 @@ enum
 {
 	CCV_SPARSE_ROW_MAJOR = 0x00,
 	CCV_SPARSE_COL_MAJOR = 0x01,
+	CCV_SPARSE_OPEN_ADDRESSING = 0x02, // combined with the major, keep all cells in one open addressing hash table over a contiguous slab rather than in a hash table of vectors
 };
 
 typedef struct 
@@ -152,6 +171,11 @@ typedef struct
 	} tag;
 
 	ccv_dense_vector_t* vector;
+	/* the open addressing backend (CCV_SPARSE_OPEN_ADDRESSING), the slab has capacity keys followed by the cells */
+	int capacity; // a power of 2, 0 if the hash table of vectors is used
+	int size; // number of cells set
+	uint64_t* keys;
+	ccv_matrix_cell_t data;
 } ccv_sparse_matrix_t;
 
 extern int _ccv_get_sparse_prime[];
@@ -166,6 +190,7 @@ typedef void ccv_matrix_t;
  */
 
 typedef void(*ccv_cache_index_free_f)(void*);
+typedef void(*ccv_cache_index_evict_f)(uint64_t, void*, uint8_t);
 
 typedef union {
 	struct {
@@ -180,13 +205,34 @@ typedef union {
 	} terminal;
 } ccv_cache_index_t;
 
+typedef struct {
+	uint64_t hit; // objects found by ccv_cache_get / ccv_cache_out
+	uint64_t miss; // lookups found nothing, only the application-wide cache counts it, because it knows the type it looks for
+	uint64_t put; // objects put into cache
+	uint64_t evict; // objects evicted to make room for others
+	uint64_t rnum; // objects currently resident in cache
+	size_t size; // bytes currently resident in cache
+} ccv_cache_stats_t;
+
+typedef struct ccv_cache_node_t {
+	struct ccv_cache_node_t* prev; // the less recently used one
+	struct ccv_cache_node_t* next; // the more recently used one
+	uint64_t sign;
+	void* object;
+} ccv_cache_node_t;
+
 typedef struct {
 	ccv_cache_index_t origin;
 	uint32_t rnum;
 	uint32_t age;
 	size_t up;
+	size_t low; // the low watermark, when a put overflows the cache, it evicts until the cache is under it
 	size_t size;
+	ccv_cache_node_t* lru; // the recency list, terminals in the trie point to its nodes
+	ccv_cache_node_t* mru;
 	ccv_cache_index_free_f ffree[16];
+	ccv_cache_index_evict_f fevict; // if set, it is called with signature, object and type instead of ffree for the evicted ones, and has to free the object
+	ccv_cache_stats_t stats[16]; // per cache type
 } ccv_cache_t;
 
 /* I made it as generic as possible */
@@ -232,6 +278,19 @@ void* ccv_cache_out(ccv_cache_t* cache, uint64_t sign, uint8_t* type);
  * @return -1 if cannot find the object, otherwise return 0.
  */
 int ccv_cache_delete(ccv_cache_t* cache, uint64_t sign);
+/**
+ * Evict the least recently used objects until there are at least the given bytes free under the upper limit.
+ * @param cache The cache.
+ * @param size The bytes to make available.
+ * @return The number of objects evicted.
+ */
+int ccv_cache_evict(ccv_cache_t* cache, size_t size);
+/**
+ * Set the low watermark of the cache (it is the upper limit by default). When a put overflows the upper limit, the cache evicts in one batch until it is under the low watermark, thus, the following puts don't have to evict again.
+ * @param cache The cache.
+ * @param low The low watermark in bytes, no more than the upper limit.
+ */
+void ccv_cache_set_watermark(ccv_cache_t* cache, size_t low);
 /**
  * Clean up the cache, free all objects inside and other memory space occupied.
  * @param cache The cache.
@@ -242,6 +301,47 @@ void ccv_cache_cleanup(ccv_cache_t* cache);
  * @param cache The cache.
  */
 void ccv_cache_close(ccv_cache_t* cache);
+
+typedef struct {
+	int fd;
+	size_t size; // the file size
+	unsigned char* map;
+	uint64_t reserved; // the bytes reserved by the last ccv_disk_cache_reserve, 0 if nothing is pending
+} ccv_disk_cache_t;
+
+/**
+ * Open (or create) a persistent cache file, it is memory-mapped and keyed by 64-bit signatures. Objects are appended to a ring, the oldest ones are overwritten when the file is full. The index is validated against a checksum of every object, thus, a torn write from a crash reads as a miss rather than garbage. It is not thread-safe.
+ * @param path The file path.
+ * @param size The size of the file in bytes, an existing file of a different size is rebuilt.
+ * @return The opened cache, 0 if the file cannot be opened / mapped.
+ */
+CCV_WARN_UNUSED(ccv_disk_cache_t*) ccv_disk_cache_open(const char* path, size_t size);
+/**
+ * Reserve space for an object in the cache, the object is not visible until ccv_disk_cache_commit.
+ * @param cache The cache.
+ * @param sign The signature.
+ * @param size The size of the object in bytes.
+ * @return The pointer to write the object to, 0 if the object is too large.
+ */
+void* ccv_disk_cache_reserve(ccv_disk_cache_t* cache, uint64_t sign, size_t size);
+/**
+ * Commit the object written to the space from the last ccv_disk_cache_reserve.
+ * @param cache The cache.
+ */
+void ccv_disk_cache_commit(ccv_disk_cache_t* cache);
+/**
+ * Get an object from the cache for its signature. The returned memory is valid until the next ccv_disk_cache_reserve.
+ * @param cache The cache.
+ * @param sign The signature.
+ * @param size The size of the object in bytes.
+ * @return The pointer to the object, 0 if cannot find the object.
+ */
+const void* ccv_disk_cache_get(ccv_disk_cache_t* cache, uint64_t sign, size_t* size);
+/**
+ * Flush and close the cache.
+ * @param cache The cache.
+ */
+void ccv_disk_cache_close(ccv_disk_cache_t* cache);
 /** @} */
 
 /* deprecated methods, often these implemented in another way and no longer suitable for newer computer architecture */
@@ -279,6 +379,7 @@ typedef struct
  * @{
  */
 #define ccv_compute_dense_matrix_size(rows, cols, type) (sizeof(ccv_dense_matrix_t) + (((cols) * CCV_GET_DATA_TYPE_SIZE(type) * CCV_GET_CHANNEL(type) + 3) & -4) * (rows))
+#define ccv_compute_aligned_dense_matrix_size(rows, cols, type) (sizeof(ccv_dense_matrix_t) + CCV_MATRIX_ALIGNMENT - 1 + (((cols) * CCV_GET_DATA_TYPE_SIZE(type) * CCV_GET_CHANNEL(type) + CCV_MATRIX_ALIGNMENT - 1) & -CCV_MATRIX_ALIGNMENT) * (rows))
 /**
  * Check the input matrix, if it is the allowed type, return it, otherwise create one with prefer_type.
  * @param x The matrix to check.
@@ -294,12 +395,23 @@ CCV_WARN_UNUSED(ccv_dense_matrix_t*) ccv_dense_matrix_renew(ccv_dense_matrix_t*
  * Create a dense matrix with rows, cols, and type.
  * @param rows Rows of the matrix.
  * @param cols Columns of the matrix.
- * @param type Matrix supports 4 data types - CCV_8U, CCV_32S, CCV_64S, CCV_32F, CCV_64F and up to 255 channels. e.g. CCV_32F | 31 will create a matrix with float (32-bit float point) data type with 31 channels (the default type for ccv_hog).
- * @param data If 0, ccv will create the matrix by allocating memory itself. Otherwise, it will use the memory region referenced by 'data'.
+ * @param type Matrix supports 4 data types - CCV_8U, CCV_32S, CCV_64S, CCV_32F, CCV_64F and up to 255 channels. e.g. CCV_32F | 31 will create a matrix with float (32-bit float point) data type with 31 channels (the default type for ccv_hog). Add CCV_ALIGNED to have 64-byte aligned data and rows.
+ * @param data If 0, ccv will create the matrix by allocating memory itself. Otherwise, it will use the memory region referenced by 'data', which should be ccv_compute_dense_matrix_size in size (ccv_compute_aligned_dense_matrix_size with CCV_ALIGNED).
  * @param sig The signature, using 0 if you don't know what it is.
  * @return The newly created matrix object.
  */
 CCV_WARN_UNUSED(ccv_dense_matrix_t*) ccv_dense_matrix_new(int rows, int cols, int type, void* data, uint64_t sig);
+enum {
+	CCV_MATRIX_ALIGN_NONE = 0x00, // data follows the matrix header, step is padded to 4 bytes (the default)
+	CCV_MATRIX_ALIGN_DATA = 0x01, // data is aligned to CCV_MATRIX_ALIGNMENT, step is unchanged
+	CCV_MATRIX_ALIGN_ROWS = 0x02, // data is aligned and step is padded to CCV_MATRIX_ALIGNMENT, as if every matrix is created with CCV_ALIGNED
+};
+
+/**
+ * Select the layout of the dense matrices ccv allocates itself, matrices on user-supplied memory are not affected. With CCV_MATRIX_ALIGN_ROWS, rows are no longer contiguous, only code that honors step can work on these matrices (the ccv functions that walk data as one run, e.g. the full connect layer of ccv_convnet, requires CCV_MATRIX_ALIGN_NONE or CCV_MATRIX_ALIGN_DATA).
+ * @param mode CCV_MATRIX_ALIGN_NONE, CCV_MATRIX_ALIGN_DATA or CCV_MATRIX_ALIGN_ROWS.
+ */
+void ccv_set_matrix_alignment_mode(int mode);
 /**
  * This method will return a dense matrix allocated on stack, with a data pointer to a custom memory region.
  * @param rows Rows of the matrix.
@@ -310,6 +422,16 @@ CCV_WARN_UNUSED(ccv_dense_matrix_t*) ccv_dense_matrix_new(int rows, int cols, in
  * @return static matrix structs.
  */
 ccv_dense_matrix_t ccv_dense_matrix(int rows, int cols, int type, void* data, uint64_t sig);
+/**
+ * Create a view on a region of the given matrix without copying, the view has the same step as the given matrix and holds a reference to it until the view is freed with ccv_matrix_free. A view can be the input of any ccv function that honors step, it has the same signature as the ccv_slice of the same region would have. Passed as an output, the view is copied on write (see ccv_matrix_retain), thus, the parent is never written through.
+ * @param a The parent matrix.
+ * @param y The top point of the region.
+ * @param x The left point of the region.
+ * @param rows The number of rows of the region.
+ * @param cols The number of cols of the region.
+ * @return The view matrix object.
+ */
+CCV_WARN_UNUSED(ccv_dense_matrix_t*) ccv_dense_matrix_view(ccv_dense_matrix_t* a, int y, int x, int rows, int cols);
 /**
  * Mark the current matrix as mutable. Under the hood, it will set matrix signature to 0, and mark the matrix as non-collectable.
  * @param mat The supplied matrix that will be marked as mutable.
@@ -325,7 +447,7 @@ void ccv_make_matrix_immutable(ccv_matrix_t* mat);
  * @param rows Rows of the matrix.
  * @param cols Columns of the matrix.
  * @param type The type of the matrix, the same as dense matrix.
- * @param major Either CCV_SPARSE_ROW_MAJOR or CCV_SPARSE_COL_MAJOR, it determines the underlying data structure of the sparse matrix (either using row or column as the first-level hash table).
+ * @param major Either CCV_SPARSE_ROW_MAJOR or CCV_SPARSE_COL_MAJOR, it determines the underlying data structure of the sparse matrix (either using row or column as the first-level hash table). Add CCV_SPARSE_OPEN_ADDRESSING to keep all cells in one contiguous open addressing table instead, which inserts without per-vector allocations and compresses without sorting, but has no vectors.
  * @param sig The signature, using 0 if you don't know what it is.
  * @return The newly created sparse matrix object.
  */
@@ -336,10 +458,15 @@ CCV_WARN_UNUSED(ccv_sparse_matrix_t*) ccv_sparse_matrix_new(int rows, int cols,
  */
 void ccv_matrix_free_immediately(ccv_matrix_t* mat);
 /**
- * In principal, you should always use this method to free a matrix. If you enabled cache in ccv, this method won't immediately free up memory space of the matrix. Instead, it will push the matrix to a cache if applicable so that if you want to create the same matrix again, ccv can shortcut the required matrix/image processing and return it from the cache.
+ * In principal, you should always use this method to free a matrix. If you enabled cache in ccv, this method won't immediately free up memory space of the matrix. Instead, it will push the matrix to a cache if applicable so that if you want to create the same matrix again, ccv can shortcut the required matrix/image processing and return it from the cache. If the matrix is shared (see ccv_matrix_retain), this only drops one reference.
  * @param mat The matrix.
  */
 void ccv_matrix_free(ccv_matrix_t* mat);
+/**
+ * Take one more reference to the matrix, so that several consumers (possibly on different threads) can read one buffer, each of them calls ccv_matrix_free once it is done. The reference count is atomic. A shared dense matrix is copy-on-write: passed as the output of a ccv function, the output will be a private copy, and the caller's reference to the shared one is dropped.
+ * @param mat The matrix.
+ */
+void ccv_matrix_retain(ccv_matrix_t* mat);
 
 /**
  * Generate a matrix signature based on input message and other signatures. This is the core method for ccv cache. In short, ccv does a given image processing by first generating an appropriate signature for that operation. It requires 1). an operation-specific message, which can be generated by concatenate the operation name and parameters. 2). the signature of input matrix(es). After that, ccv will look-up matrix in cache with the newly generated signature. If it exists, ccv will return that matrix and skip the whole operation.
@@ -350,14 +477,39 @@ void ccv_matrix_free(ccv_matrix_t* mat);
  */
 uint64_t ccv_cache_generate_signature(const char* msg, int len, uint64_t sig_start, ...);
 
+enum {
+	CCV_SIGNATURE_SHA1   = 0x00, // signatures are the first 64-bit of SHA-1 (the default)
+	CCV_SIGNATURE_XXHASH = 0x01, // signatures are 64-bit xxHash, much faster, but not cryptographic
+	CCV_SIGNATURE_LAZY   = 0x10, // modifier, ccv_make_matrix_immutable only hashes matrix content when a derived signature is asked while cache is enabled
+};
+
+/**
+ * Select how signatures are computed. Call it before any signature is generated, signatures from different modes don't match.
+ * @param mode CCV_SIGNATURE_SHA1 or CCV_SIGNATURE_XXHASH, optionally combined with CCV_SIGNATURE_LAZY.
+ */
+void ccv_set_signature_mode(int mode);
+
 #define CCV_DEFAULT_CACHE_SIZE (1024 * 1024 * 64)
 
+enum {
+	CCV_CACHE_GLOBAL       = 0x00, // one application-wide cache, it is not safe to use ccv from multiple threads in this mode
+	CCV_CACHE_THREAD_LOCAL = 0x01, // every thread has its own cache, each bounded by the given size
+	CCV_CACHE_SHARDED      = 0x02, // one application-wide cache split into lock-striped shards, each bounded by size / CCV_CACHE_SHARD_NUM
+};
+
+#define CCV_CACHE_SHARD_NUM (16) // has to be power of 2 and no more than 16, shards are picked by the highest 4 bits of the signature
+
+enum {
+	CCV_CACHE_MATRIX = 0x00, // the cache type of dense matrices in the application-wide cache
+	CCV_CACHE_ARRAY  = 0x01, // the cache type of arrays in the application-wide cache
+};
+
 /**
- * Drain up the cache.
+ * Drain up the cache. In CCV_CACHE_THREAD_LOCAL mode, only the cache of the calling thread is drained.
  */
 void ccv_drain_cache(void);
 /**
- * Drain up and disable the application-wide cache.
+ * Drain up and disable the application-wide cache. In CCV_CACHE_THREAD_LOCAL mode, only the cache of the calling thread is drained here, other threads drain theirs the next time they use the cache, or when they exit.
  */
 void ccv_disable_cache(void);
 /**
@@ -369,13 +521,97 @@ void ccv_enable_default_cache(void);
  * @param size The upper limit of the cache, in bytes.
  */
 void ccv_enable_cache(size_t size);
+/**
+ * Enable a application-wide cache for ccv with a given concurrency mode. Without pthread support, every mode falls back to CCV_CACHE_GLOBAL.
+ * @param size The upper limit of the cache, in bytes. For CCV_CACHE_THREAD_LOCAL, it is the upper limit of each thread's cache, for CCV_CACHE_SHARDED, it is divided evenly among shards.
+ * @param mode CCV_CACHE_GLOBAL, CCV_CACHE_THREAD_LOCAL or CCV_CACHE_SHARDED.
+ */
+void ccv_enable_cache_with_mode(size_t size, int mode);
+/**
+ * Collect statistics of the application-wide cache, summed over all shards / threads and over dense matrices and arrays.
+ * @param stats The statistics structure to fill.
+ */
+void ccv_cache_stats(ccv_cache_stats_t* stats);
+/**
+ * Collect statistics of one type of objects in the application-wide cache, summed over all shards / threads.
+ * @param type CCV_CACHE_MATRIX or CCV_CACHE_ARRAY.
+ * @param stats The statistics structure to fill.
+ */
+void ccv_cache_type_stats(int type, ccv_cache_stats_t* stats);
+/**
+ * Reset the hit / miss / put / evict counters of the application-wide cache, resident objects and bytes are kept.
+ */
+void ccv_cache_stats_reset(void);
+/**
+ * Enable a persistent on-disk tier under the application-wide cache. Dense matrices evicted from the cache are spilled to the file, and read back when ccv_dense_matrix_new asks for the same signature, in this or a later process. Arrays are not spilled.
+ * @param path The file path.
+ * @param size The upper limit of the file in bytes.
+ * @return 0 on success, -1 if the file cannot be opened.
+ */
+int ccv_enable_disk_cache(const char* path, size_t size);
+/**
+ * Flush and close the on-disk tier.
+ */
+void ccv_disable_disk_cache(void);
+/**
+ * Enable the matrix pool. Dense matrix allocated by ccv_dense_matrix_new will be taken from per-thread size-class free lists, and go back to them when freed, thus, repeated work on same-sized images does no heap allocation after warm-up. Blocks are 64-byte aligned, and matrix larger than 64MiB is not pooled.
+ * @param size The upper limit of bytes kept in free lists of all threads.
+ */
+void ccv_enable_matrix_pool(size_t size);
+/**
+ * Disable the matrix pool and free the blocks in the free lists of the calling thread. Other threads free theirs the next time they allocate or free a dense matrix, or when they exit. Matrices allocated from the pool remain valid.
+ */
+void ccv_disable_matrix_pool(void);
+
+typedef struct ccv_arena_block_t {
+	struct ccv_arena_block_t* next;
+	size_t size;
+	size_t rnum; // bytes used in this block
+} ccv_arena_block_t;
+
+typedef struct {
+	ccv_arena_block_t* head;
+	ccv_arena_block_t* block; // the block we are allocating from, blocks after it are all free
+	size_t size; // the default block size
+	void* scope; // the innermost scope
+} ccv_arena_t;
+
+/**
+ * Create an arena, a bump allocator for short-lived intermediates. While a scope of the arena is active on a thread, ccv_dense_matrix_new and ccv_array_new on that thread draw from the arena, and ccv_matrix_free / ccv_array_free on these objects do nothing.
+ * @param size The default block size in bytes, the arena grows with more blocks when needed.
+ * @return The newly created arena.
+ */
+CCV_WARN_UNUSED(ccv_arena_t*) ccv_arena_new(size_t size);
+/**
+ * Open a new scope of the arena, and make it the active arena of the calling thread.
+ * @param arena The arena.
+ */
+void ccv_arena_push(ccv_arena_t* arena);
+/**
+ * Close the innermost scope of the arena, release everything allocated in the scope at once, and restore the previously active arena of the calling thread. Objects allocated in the scope, including the ones returned to you, e.g. the ccv_array_t from ccv_dpm_detect_objects, are no longer valid.
+ * @param arena The arena.
+ */
+void ccv_arena_pop(ccv_arena_t* arena);
+/**
+ * Allocate memory from an arena, it is 16-byte aligned.
+ * @param arena The arena.
+ * @param size The size in bytes.
+ * @return The pointer to the memory.
+ */
+void* ccv_arena_alloc(ccv_arena_t* arena, size_t size);
+/**
+ * Free the arena and all its blocks.
+ * @param arena The arena.
+ */
+void ccv_arena_free(ccv_arena_t* arena);
 
 #define ccv_get_dense_matrix_cell_by(type, x, row, col, ch) \
 	(((type) & CCV_32S) ? (void*)((x)->data.i32 + ((row) * (x)->cols + (col)) * CCV_GET_CHANNEL(type) + (ch)) : \
 	(((type) & CCV_32F) ? (void*)((x)->data.f32+ ((row) * (x)->cols + (col)) * CCV_GET_CHANNEL(type) + (ch)) : \
 	(((type) & CCV_64S) ? (void*)((x)->data.i64+ ((row) * (x)->cols + (col)) * CCV_GET_CHANNEL(type) + (ch)) : \
 	(((type) & CCV_64F) ? (void*)((x)->data.f64 + ((row) * (x)->cols + (col)) * CCV_GET_CHANNEL(type) + (ch)) : \
-	(void*)((x)->data.u8 + (row) * (x)->step + (col) * CCV_GET_CHANNEL(type) + (ch))))))
+	(((type) & CCV_HALF_DATA_TYPE) ? (void*)((uint16_t*)((x)->data.u8 + (row) * (x)->step) + (col) * CCV_GET_CHANNEL(type) + (ch)) : \
+	(void*)((x)->data.u8 + (row) * (x)->step + (col) * CCV_GET_CHANNEL(type) + (ch)))))))
 
 #define ccv_get_dense_matrix_cell(x, row, col, ch) ccv_get_dense_matrix_cell_by((x)->type, x, row, col, ch)
 
@@ -386,7 +622,9 @@ void ccv_enable_cache(size_t size);
 	(((type) & CCV_32F) ? (x)->data.f32[((row) * (x)->cols + (col)) * CCV_GET_CHANNEL(type) + (ch)] : \
 	(((type) & CCV_64S) ? (x)->data.i64[((row) * (x)->cols + (col)) * CCV_GET_CHANNEL(type) + (ch)] : \
 	(((type) & CCV_64F) ? (x)->data.f64[((row) * (x)->cols + (col)) * CCV_GET_CHANNEL(type) + (ch)] : \
-	(x)->data.u8[(row) * (x)->step + (col) * CCV_GET_CHANNEL(type) + (ch)]))))
+	(((type) & CCV_16F) ? ccv_half_to_float(((uint16_t*)((x)->data.u8 + (row) * (x)->step))[(col) * CCV_GET_CHANNEL(type) + (ch)]) : \
+	(((type) & CCV_16BF) ? ccv_bfloat_to_float(((uint16_t*)((x)->data.u8 + (row) * (x)->step))[(col) * CCV_GET_CHANNEL(type) + (ch)]) : \
+	(x)->data.u8[(row) * (x)->step + (col) * CCV_GET_CHANNEL(type) + (ch)]))))))
 
 #define ccv_get_dense_matrix_cell_value(x, row, col, ch) ccv_get_dense_matrix_cell_value_by((x)->type, x, row, col, ch)
 
@@ -395,16 +633,61 @@ void ccv_enable_cache(size_t size);
 	(((type) & CCV_32F) ? ((float*)(ptr))[(i)] : \
 	(((type) & CCV_64S) ? ((int64_t*)(ptr))[(i)] : \
 	(((type) & CCV_64F) ? ((double*)(ptr))[(i)] : \
-	((unsigned char*)(ptr))[(i)]))))
+	(((type) & CCV_16F) ? ccv_half_to_float(((uint16_t*)(ptr))[(i)]) : \
+	(((type) & CCV_16BF) ? ccv_bfloat_to_float(((uint16_t*)(ptr))[(i)]) : \
+	((unsigned char*)(ptr))[(i)]))))))
 
 #define ccv_set_value(type, ptr, i, value, factor) switch (CCV_GET_DATA_TYPE((type))) { \
 	case CCV_32S: ((int*)(ptr))[(i)] = (int)(value) >> factor; break; \
 	case CCV_32F: ((float*)(ptr))[(i)] = (float)value; break; \
 	case CCV_64S: ((int64_t*)(ptr))[(i)] = (int64_t)(value) >> factor; break; \
 	case CCV_64F: ((double*)(ptr))[(i)] = (double)value; break; \
+	case CCV_16F: ((uint16_t*)(ptr))[(i)] = ccv_float_to_half((float)(value)); break; \
+	case CCV_16BF: ((uint16_t*)(ptr))[(i)] = ccv_float_to_bfloat((float)(value)); break; \
 	default: ((unsigned char*)(ptr))[(i)] = ccv_clamp((int)(value) >> factor, 0, 255); }
 /** @} */
 
+/**
+ * @defgroup ccv_parallel parallel loops and SIMD dispatch
+ * @{
+ */
+/**
+ * Set the number of threads (including the calling one) that run parallel loops. Without calling this, it is the CCV_NUM_THREADS environment variable, or the number of online cores. Shouldn't be called while a parallel loop is running.
+ * @param thread_num The number of threads, 0 to go back to the default.
+ */
+void ccv_set_parallel_thread_num(int thread_num);
+/**
+ * Get the number of threads that run parallel loops.
+ * @return The number of threads.
+ */
+int ccv_get_parallel_thread_num(void);
+/**
+ * Run block for every index in [0, n) on a pthread pool with work stealing, and return once all are done. The calling thread takes a share of the work. Called from within a block, or while another thread has the pool, it runs serially on the calling thread.
+ * @param n The number of iterations.
+ * @param block The loop body, takes the index and the context.
+ * @param context The context passed to block.
+ */
+void ccv_parallel_for(size_t n, void (*block)(size_t, void*), void* context);
+
+enum {
+	CCV_SIMD_NONE   = 0,
+	CCV_SIMD_SSE2   = 1,
+	CCV_SIMD_AVX2   = 2, // AVX2, FMA and F16C
+	CCV_SIMD_AVX512 = 3,
+	CCV_SIMD_LEVEL_NUM,
+};
+/**
+ * Get the SIMD level that kernels with several variants (e.g. the gemm fallback, the convolutional layer of ccv_convnet) run at. It is detected with cpuid on first use, the CCV_SIMD environment variable (none, sse2, avx2 or avx512) can lower it, e.g. for benchmarking.
+ * @return One of CCV_SIMD_NONE, CCV_SIMD_SSE2, CCV_SIMD_AVX2 or CCV_SIMD_AVX512.
+ */
+int ccv_get_simd_level(void);
+/**
+ * Set the SIMD level, it is capped at what the CPU supports.
+ * @param level The SIMD level, -1 to go back to the detected one (with CCV_SIMD applied).
+ */
+void ccv_set_simd_level(int level);
+/** @} */
+
 /**
  * @defgroup ccv_io basic IO utilities
  * @{
@@ -530,6 +813,12 @@ enum {
 	CCV_UNSIGNED = 0x01,
 };
 
+/**
+ * Compute the norm of a matrix, treating all its elements as one vector.
+ * @param mat The input matrix.
+ * @param type CCV_L1_NORM or CCV_L2_NORM.
+ * @return L1 or L2 norm.
+ */
 double ccv_norm(ccv_matrix_t* mat, int type);
 /**
  * Normalize a matrix and return the normalize factor.
@@ -548,6 +837,14 @@ double ccv_normalize(ccv_matrix_t* a, ccv_matrix_t** b, int btype, int flag);
  * @param padding_pattern CCV_NO_PADDING - the first row and the first column in the output matrix is the same as the input matrix. CCV_PADDING_ZERO - the first row and the first column in the output matrix is zero, thus, the output matrix size is 1 larger than the input matrix.
  */
 void ccv_sat(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, int padding_pattern);
+/**
+ * Generate the summed area table and the summed area table of squares in one pass, for box mean and variance.
+ * @param a The input matrix, 8U or 32F.
+ * @param b The output summed area table, the same as what ccv_sat returns with type 0.
+ * @param c The output summed area table of squares, 64S for 8U input and 64F for 32F input.
+ * @param padding_pattern CCV_NO_PADDING or CCV_PADDING_ZERO, as with ccv_sat.
+ */
+void ccv_sat_square(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, ccv_dense_matrix_t** c, int padding_pattern);
 /**
  * Dot product of two matrix.
  * @param a The input matrix.
@@ -561,14 +858,30 @@ double ccv_dot(ccv_matrix_t* a, ccv_matrix_t* b);
  * @param flag CCV_UNSIGNED - compute fabs(x) of the elements first and then sum up. CCV_SIGNED - compute the sum normally.
  */
 double ccv_sum(ccv_matrix_t* mat, int flag);
+typedef struct {
+	double sum; /**< The sum of all elements. */
+	double sumsq; /**< The sum of squares, sqrt(sumsq) is the L2 norm. */
+	double l1; /**< The sum of absolute values, which is the L1 norm. */
+	double min; /**< The smallest element. */
+	double max; /**< The largest element. */
+	int count; /**< The number of elements (rows * cols * channels). */
+} ccv_matrix_stat_t;
+/**
+ * Compute the statistics of all elements in the matrix in one vectorized pass. 8U is accumulated exactly, the
+ * floating-point types in double with compensated summation. ccv_sum, ccv_norm, ccv_normalize and ccv_variance are
+ * computed from these.
+ * @param mat The input matrix.
+ * @param stat The statistics.
+ */
+void ccv_stat(ccv_matrix_t* mat, ccv_matrix_stat_t* stat);
 /**
- * Return the sum of all elements in the matrix.
+ * Return the variance of all elements in the matrix.
  * @param mat The input matrix.
  * @return Element variance of the input matrix.
  */
 double ccv_variance(ccv_matrix_t* mat);
 /**
- * Do element-wise matrix multiplication.
+ * Do element-wise matrix multiplication. When the inputs and the output are all 8U, 32F or 64F, a vectorized path is taken (8U saturates), and the output can be one of the inputs (*c == a) to do it in place.
  * @param a The input matrix.
  * @param b The input matrix.
  * @param c The output matrix.
@@ -576,7 +889,7 @@ double ccv_variance(ccv_matrix_t* mat);
  */
 void ccv_multiply(ccv_matrix_t* a, ccv_matrix_t* b, ccv_matrix_t** c, int type);
 /**
- * Matrix addition.
+ * Matrix addition. Same-type 8U, 32F and 64F are vectorized and can be done in place, as with ccv_multiply.
  * @param a The input matrix.
  * @param b The input matrix.
  * @param c The output matrix.
@@ -584,7 +897,7 @@ void ccv_multiply(ccv_matrix_t* a, ccv_matrix_t* b, ccv_matrix_t** c, int type);
  */
 void ccv_add(ccv_matrix_t* a, ccv_matrix_t* b, ccv_matrix_t** c, int type);
 /**
- * Matrix subtraction.
+ * Matrix subtraction. Same-type 8U, 32F and 64F are vectorized and can be done in place, as with ccv_multiply.
  * @param a The input matrix.
  * @param b The input matrix.
  * @param c The output matrix.
@@ -620,6 +933,8 @@ enum {
  * @param alpha The multiplication factor.
  * @param c The input matrix.
  * @param beta The multiplication factor.
+ * A and B can be stored in CCV_16F or CCV_16BF (mixed with CCV_32F), they are widened to float as they are packed, thus, weights can stay in half precision in memory. C and the output are CCV_32F then.
+ *
  * @param transpose CCV_A_TRANSPOSE, CCV_B_TRANSPOSE to indicate if matrix A or B need to be transposed first before multiplication.
  * @param d The output matrix.
  * @param type The type of output matrix, if 0, ccv will try to match the input matrix for appropriate type.
@@ -664,7 +979,7 @@ ccv_dense_matrix_t* ccv_get_dense_matrix(ccv_matrix_t* mat);
  */
 ccv_sparse_matrix_t* ccv_get_sparse_matrix(ccv_matrix_t* mat);
 /**
- * Get vector for a sparse matrix.
+ * Get vector for a sparse matrix, not available for CCV_SPARSE_OPEN_ADDRESSING.
  * @param mat The sparse matrix.
  * @param index The index of that vector.
  */
@@ -731,7 +1046,7 @@ void ccv_slice(ccv_matrix_t* a, ccv_matrix_t** b, int btype, int y, int x, int r
  */
 void ccv_border(ccv_matrix_t* a, ccv_matrix_t** b, int type, ccv_margin_t margin);
 /**
- * Convert a input matrix into a matrix within visual range, so that one can output it into PNG file for inspection.
+ * Convert a input matrix into a matrix within visual range, so that one can output it into PNG file for inspection. The input matrix can be of half precision types as well.
  * @param a The input matrix.
  * @param b The output matrix.
  * @param type The type of output matrix, if 0, ccv will try to match the input matrix for appropriate type.
@@ -751,7 +1066,7 @@ void ccv_flatten(ccv_matrix_t* a, ccv_matrix_t** b, int type, int flag);
  */
 void ccv_zero(ccv_matrix_t* mat);
 /**
- * Compute a new matrix that each element is first left shifted and then right shifted.
+ * Compute a new matrix that each element is first left shifted and then right shifted. This is also how to convert from and to the half precision types CCV_16F and CCV_16BF (shifts do nothing to floating point values), CCV_32F to and from CCV_16F is vectorized.
  * @param a The input matrix.
  * @param b The output matrix.
  * @param type The type of output matrix, if 0, ccv will try to match the input matrix for appropriate type.
@@ -774,8 +1089,79 @@ int ccv_any_nan(ccv_matrix_t *a);
  */
 ccv_dense_matrix_t ccv_reshape(ccv_dense_matrix_t* a, int y, int x, int rows, int cols);
 
-// 32-bit float to 16-bit float
+/**
+ * Convert a 16-bit half precision float (CCV_16F) to a 32-bit float, exactly.
+ * @param h The half precision float.
+ * @return The 32-bit float.
+ */
+inline static float ccv_half_to_float(uint16_t h)
+{
+	union { uint32_t u; float f; } v, magic = { (127 - 14) << 23 };
+	uint32_t a = h & 0x7fff;
+	v.u = (a << 13) + ((127 - 15) << 23);
+	if (a > 0x7bff) // infinity and NaN
+		v.u += (127 - 15) << 23;
+	else if (a < 0x0400) { // denormal, normalized by the float subtraction
+		v.u += 1 << 23;
+		v.f -= magic.f;
+	}
+	v.u |= (uint32_t)(h & 0x8000) << 16;
+	return v.f;
+}
+
+/**
+ * Convert a 32-bit float to a 16-bit half precision float (CCV_16F), truncating as ccv_float_to_half_precision does.
+ * @param f The 32-bit float.
+ * @return The half precision float.
+ */
+inline static uint16_t ccv_float_to_half(float f)
+{
+	union { float f; uint32_t u; } v = { f };
+	uint32_t sign = (v.u >> 16) & 0x8000, a = v.u & 0x7fffffff;
+	if (a >= 0x47800000) // too large, infinity or NaN
+		return sign | 0x7c00 | (a >= 0x7f800000 ? (a & 0x007fffff) >> 13 : 0);
+	if (a < 0x33800000) // too small
+		return sign;
+	if (a < 0x38800000) // denormal
+		return sign | ((0x00800000 | (a & 0x007fffff)) >> (126 - (a >> 23)));
+	return sign | ((a - (112 << 23)) >> 13);
+}
+
+/**
+ * Convert a bfloat16 (CCV_16BF) to a 32-bit float, exactly.
+ * @param h The bfloat16.
+ * @return The 32-bit float.
+ */
+inline static float ccv_bfloat_to_float(uint16_t h)
+{
+	union { uint32_t u; float f; } v = { (uint32_t)h << 16 };
+	return v.f;
+}
+
+/**
+ * Convert a 32-bit float to a bfloat16 (CCV_16BF) by truncation, NaN stays NaN.
+ * @param f The 32-bit float.
+ * @return The bfloat16.
+ */
+inline static uint16_t ccv_float_to_bfloat(float f)
+{
+	union { float f; uint32_t u; } v = { f };
+	return (v.u >> 16) | ((v.u & 0x7fffffff) > 0x7f800000 ? 0x40 : 0);
+}
+
+/**
+ * Convert 32-bit floats to 16-bit half precision floats, truncating the mantissa. Values too large for half precision become infinity. Runs with F16C if ccv_get_simd_level() is CCV_SIMD_AVX2 or above, the result is the same bit for bit at any level.
+ * @param f The array of 32-bit floats.
+ * @param h The array of 16-bit half precision floats to write to.
+ * @param len The number of elements.
+ */
 void ccv_float_to_half_precision(float* f, uint16_t* h, size_t len);
+/**
+ * Convert 16-bit half precision floats to 32-bit floats, this is exact. Vectorized with SSE2 or AVX2 depending on ccv_get_simd_level(), NaN payloads are kept at any level.
+ * @param h The array of 16-bit half precision floats.
+ * @param f The array of 32-bit floats to write to.
+ * @param len The number of elements.
+ */
 void ccv_half_precision_to_float(uint16_t* h, float* f, size_t len);
 
 /* basic data structures ccv_util.c */
@@ -853,6 +1239,25 @@ typedef int(*ccv_array_group_f)(const void*, const void*, void*);
  * @param data Any extra user data.
  */
 int ccv_array_group(ccv_array_t* array, ccv_array_t** index, ccv_array_group_f gfunc, void* data);
+typedef ccv_rect_t(*ccv_array_rect_f)(const void*, void*);
+/**
+ * Group elements in the array from its similarity, the same as ccv_array_group, but only compares the elements whose
+ * extents overlap, thus, it takes about O(n log n) rather than O(n^2) for a large number of scattered elements.
+ * @param array The array.
+ * @param index The output index, same group element will have the same index.
+ * @param gfunc int ccv_array_group_f(const void* a, const void* b, void* data). Return 1 if a and b are in the same group.
+ * @param rfunc ccv_rect_t ccv_array_rect_f(const void* a, void* data). Return the extent of a, two elements can only be in the same group if their extents overlap.
+ * @param data Any extra user data.
+ * @return The number of groups.
+ */
+int ccv_array_group_rect(ccv_array_t* array, ccv_array_t** index, ccv_array_group_f gfunc, ccv_array_rect_f rfunc, void* data);
+/**
+ * The extent function of ccv_array_group_rect for elements that start with a ccv_rect_t (ccv_comp_t, ccv_root_comp_t). With data of 0, the extent is the rectangle itself, for grouping functions that need the rectangles to intersect. Otherwise, the extent is the square of factor * max(width, height) around the top-left corner, for grouping functions that need the corners within that distance.
+ * @param r The element.
+ * @param data 0, or the pointer to the distance factor (float).
+ * @return The extent of the element.
+ */
+ccv_rect_t ccv_comp_extent(const void* r, void* data);
 void ccv_make_array_immutable(ccv_array_t* array);
 void ccv_make_array_mutable(ccv_array_t* array);
 /**
@@ -1043,7 +1448,7 @@ void ccv_compressive_sensing_reconstruct(ccv_matrix_t* a, ccv_matrix_t* x, ccv_m
  */
 void ccv_sobel(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, int dx, int dy);
 /**
- * Compute the gradient (angle and magnitude) at each pixel.
+ * Compute the gradient (angle and magnitude) at each pixel. For dx = dy = 1 and a CCV_8U or CCV_32F input, the derivatives and the angle are computed in one pass over the input, on multiple threads.
  * @param a The input matrix.
  * @param theta The output matrix of angle at each pixel.
  * @param ttype The type of output matrix, if 0, ccv will defaults to CCV_32F.
@@ -1053,6 +1458,13 @@ void ccv_sobel(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, int dx,
  * @param dy The window size of the underlying Sobel operator used on y-axis, specially optimized for 1, 3
  */
 void ccv_gradient(ccv_dense_matrix_t* a, ccv_dense_matrix_t** theta, int ttype, ccv_dense_matrix_t** m, int mtype, int dx, int dy);
+/**
+ * Compute the gradient at each pixel with its orientation quantized into bins, as ccv_hog takes it. The gradient is the one of ccv_gradient with dx = dy = 1, for a multi-channel input, the channel with the largest magnitude is taken.
+ * @param a The input matrix.
+ * @param b The output matrix, CCV_32F | CCV_C2. The first channel is the position of the angle in bins, from 0 to nbins, its integer part is the bin and its fractional part is how far it is toward the next bin. The second channel is the magnitude.
+ * @param nbins The number of orientation bins over 0 to 360 degrees.
+ */
+void ccv_gradient_bins(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int nbins);
 
 enum {
 	CCV_FLIP_X = 0x01,
@@ -1066,14 +1478,29 @@ enum {
  * @param type CCV_FLIP_X - flip around x-axis, CCV_FLIP_Y - flip around y-axis.
  */
 void ccv_flip(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int btype, int type);
+
 /**
- * Using [Gaussian blur](https://en.wikipedia.org/wiki/Gaussian_blur) on a given matrix. It implements a O(n * sqrt(m)) algorithm, n is the size of input matrix, m is the size of Gaussian filtering kernel.
+ * Using [Gaussian blur](https://en.wikipedia.org/wiki/Gaussian_blur) on a given matrix. It implements a O(n * sqrt(m)) algorithm, n is the size of input matrix, m is the size of Gaussian filtering kernel. It is separable, 8U to 8U and 8U / 32F to 32F are vectorized and run on multiple threads.
  * @param a The input matrix.
  * @param b The output matrix.
  * @param type The type of output matrix, if 0, ccv will try to match the input matrix for appropriate type.
  * @param sigma The sigma factor in Gaussian filtering kernel.
  */
 void ccv_blur(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, double sigma);
+
+enum {
+	CCV_BLUR_GAUSSIAN = 0x00,
+	CCV_BLUR_RECURSIVE = 0x01,
+};
+/**
+ * Gaussian blur with a choice of the filter. CCV_BLUR_GAUSSIAN is the same as ccv_blur. CCV_BLUR_RECURSIVE uses the recursive (IIR) Gaussian of Young and van Vliet instead, its cost is independent of sigma, thus, it is much faster for large sigma, at the price of a slight approximation of the Gaussian. It works for sigma of at least 0.5, for smaller sigma, the FIR filter is used anyway.
+ * @param a The input matrix.
+ * @param b The output matrix.
+ * @param type The type of output matrix, if 0, ccv will try to match the input matrix for appropriate type.
+ * @param sigma The sigma factor in Gaussian filtering kernel.
+ * @param mode CCV_BLUR_GAUSSIAN or CCV_BLUR_RECURSIVE.
+ */
+void ccv_blur_with_mode(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, double sigma, int mode);
 /** @} */
 
 /**
@@ -1134,6 +1561,45 @@ enum {
  * @param type For now, ccv supports CCV_INTER_AREA, which is an extension to [bilinear resampling](https://en.wikipedia.org/wiki/Bilinear_filtering) for downsampling and CCV_INTER_CUBIC [bicubic resampling](https://en.wikipedia.org/wiki/Bicubic_interpolation) for upsampling.
  */
 void ccv_resample(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int btype, int rows, int cols, int type);
+
+typedef struct {
+	int type; // the interpolation method the plan was built for
+	int rows, cols; // the source size
+	int brows, bcols; // the destination size
+	int yn; // taps per destination row
+	int* xofs; // the first tap of each destination column, bcols + 1 of them
+	int* xsi; // source index of each tap
+	int* ysi; // brows * yn of them
+	int* xcoeffs; // fixed-point weights
+	int* ycoeffs;
+	float* xfcoeffs; // floating-point weights
+	float* yfcoeffs;
+	int inv_scale; // the fixed-point area normalization
+} ccv_resample_plan_t;
+
+/**
+ * Compute the resampling coefficients for a given source and destination size once, so that resampling many frames of the same geometry does not recompute them.
+ * @param rows The source row.
+ * @param cols The source column.
+ * @param brows The destination row.
+ * @param bcols The destination column.
+ * @param type The same interpolation flags ccv_resample accepts.
+ * @return A resample plan, free it with ccv_resample_plan_free.
+ */
+CCV_WARN_UNUSED(ccv_resample_plan_t*) ccv_resample_plan_new(int rows, int cols, int brows, int bcols, int type);
+/**
+ * Resample a given matrix with a precomputed plan, the result is identical to ccv_resample with the same arguments.
+ * @param a The input matrix, must have the source size of the plan.
+ * @param b The output matrix.
+ * @param btype The type of output matrix, if 0, ccv will try to match the input matrix for appropriate type.
+ * @param plan The resample plan.
+ */
+void ccv_resample_with_plan(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int btype, const ccv_resample_plan_t* plan);
+/**
+ * Free a resample plan.
+ * @param plan The resample plan.
+ */
+void ccv_resample_plan_free(ccv_resample_plan_t* plan);
 /**
  * Downsample a given matrix to exactly half size with a [Gaussian filter](https://en.wikipedia.org/wiki/Gaussian_filter). The half size is approximated by floor(rows * 0.5) x floor(cols * 0.5).
  * @param a The input matrix.
@@ -1143,6 +1609,14 @@ void ccv_resample(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int btype, int
  * @param src_y Shift the start point by src_y.
  */
 void ccv_sample_down(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, int src_x, int src_y);
+/**
+ * Downsample a given matrix by several octaves in one pass: b[0] is the given matrix sampled down once, b[i] is b[i - 1] sampled down once, exactly as chaining ccv_sample_down without source offset. The octaves are row buffered, thus, each one is filtered from rows of the one above while they are still in cache.
+ * @param a The input matrix.
+ * @param b The array of count output matrices.
+ * @param type The type of output matrices, if 0, ccv will try to match the input matrix for appropriate type.
+ * @param count The number of octaves, the source of the last one has to be at least 3 columns and 2 rows.
+ */
+void ccv_sample_down_octaves(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, int count);
 /**
  * Upsample a given matrix to exactly double size with a [Gaussian filter](https://en.wikipedia.org/wiki/Gaussian_filter).
  * @param a The input matrix.
@@ -1152,6 +1626,42 @@ void ccv_sample_down(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, in
  * @param src_y Shift the start point by src_y.
  */
 void ccv_sample_up(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, int src_x, int src_y);
+
+typedef struct {
+	int interval; // the number of levels between two octaves
+	double scale; // the ratio between two adjacent levels, pow(2, 1 / (interval + 1))
+	int count; // the number of levels, the last one is at least 1x1
+	ccv_dense_matrix_t** levels; // 4 per level: the level, and the ones sampled down with source offset (1, 0), (0, 1), (1, 1)
+} ccv_pyramid_t;
+
+/**
+ * Create a multi-scale image pyramid that several detectors can share. The level i is 1 / pow(scale, i) the size of the given matrix: the first interval + 1 levels are resampled from it with CCV_INTER_AREA, and the following ones are sampled down (ccv_sample_down) from the level one octave above. The last level is the last one sampled down from at least 3 columns and 2 rows. It is the pyramid ccv_bbf_detect_objects and ccv_dpm_detect_objects build, and ccv_icf_detect_objects / ccv_scd_detect_objects use its octaves. Levels are built on demand (a sampled down level together with the ones between it and the closest level built above, see ccv_sample_down_octaves), thus, a pyramid shouldn't be read from several threads unless all the levels in use are built.
+ * @param a The base of the pyramid, the pyramid takes a reference to it (see ccv_matrix_retain).
+ * @param interval The number of levels between two octaves.
+ * @return An image pyramid.
+ */
+CCV_WARN_UNUSED(ccv_pyramid_t*) ccv_pyramid_new(ccv_dense_matrix_t* a, int interval);
+/**
+ * Get a level of the pyramid, build it if it is not yet. The pyramid owns the level, call ccv_matrix_retain to keep it beyond the pyramid.
+ * @param pyramid The image pyramid.
+ * @param i The level, 0 is the base.
+ * @return The matrix of the level.
+ */
+ccv_dense_matrix_t* ccv_pyramid_level(ccv_pyramid_t* pyramid, int i);
+/**
+ * Get a level of the pyramid sampled down from the level one octave above with a source offset, as ccv_sample_down(a, b, 0, src_x, src_y) does.
+ * @param pyramid The image pyramid.
+ * @param i The level, it has to be at least interval + 1 if there is an offset, and the level one octave above has to be at least 6 columns wide if src_x is 1.
+ * @param src_x The source offset on x-axis, 0 or 1.
+ * @param src_y The source offset on y-axis, 0 or 1.
+ * @return The matrix of the level.
+ */
+ccv_dense_matrix_t* ccv_pyramid_level_with_offset(ccv_pyramid_t* pyramid, int i, int src_x, int src_y);
+/**
+ * Free the pyramid and drop its references to the levels and the base.
+ * @param pyramid The image pyramid.
+ */
+void ccv_pyramid_free(ccv_pyramid_t* pyramid);
 /** @} */
 
 /**
@@ -1578,6 +2088,15 @@ void ccv_dpm_mixture_model_new(char** posfiles, ccv_rect_t* bboxes, int posnum,
  * @return A **ccv_array_t** of **ccv_root_comp_t** that contains the root bounding box as well as its parts.
  */
 CCV_WARN_UNUSED(ccv_array_t*) ccv_dpm_detect_objects(ccv_dense_matrix_t* a, ccv_dpm_mixture_model_t** model, int count, ccv_dpm_param_t params);
+/**
+ * Using a DPM mixture model to detect objects in a shared image pyramid (see ccv_pyramid_new), so that other detectors on the same image don't build their own.
+ * @param pyramid The image pyramid, its interval has to be the same as params.interval.
+ * @param model An array of mixture models.
+ * @param count How many mixture models you've passed in.
+ * @param params A **ccv_dpm_param_t** structure that defines various aspects of the detector.
+ * @return A **ccv_array_t** of **ccv_root_comp_t** that contains the root bounding box as well as its parts.
+ */
+CCV_WARN_UNUSED(ccv_array_t*) ccv_dpm_detect_objects_with_pyramid(ccv_pyramid_t* pyramid, ccv_dpm_mixture_model_t** model, int count, ccv_dpm_param_t params);
 /**
  * Read DPM mixture model from a model file.
  * @param directory The model file for DPM mixture model.
@@ -1679,6 +2198,15 @@ void ccv_bbf_classifier_cascade_new(ccv_dense_matrix_t** posimg, int posnum, cha
  * @return A **ccv_array_t** of **ccv_comp_t** for detection results.
  */
 CCV_WARN_UNUSED(ccv_array_t*) ccv_bbf_detect_objects(ccv_dense_matrix_t* a, ccv_bbf_classifier_cascade_t** cascade, int count, ccv_bbf_param_t params);
+/**
+ * Using a BBF classifier cascade to detect objects in a shared image pyramid (see ccv_pyramid_new), so that other detectors on the same image don't build their own.
+ * @param pyramid The image pyramid, its interval has to be the same as params.interval. Its base is the input image scaled by the cascade size over params.size, that is the input image itself if params.size is the cascade size.
+ * @param cascade An array of classifier cascades.
+ * @param count How many classifier cascades you've passed in.
+ * @param params A **ccv_bbf_param_t** structure that defines various aspects of the detector.
+ * @return A **ccv_array_t** of **ccv_comp_t** for detection results.
+ */
+CCV_WARN_UNUSED(ccv_array_t*) ccv_bbf_detect_objects_with_pyramid(ccv_pyramid_t* pyramid, ccv_bbf_classifier_cascade_t** cascade, int count, ccv_bbf_param_t params);
 /**
  * Read BBF classifier cascade from working directory.
  * @param directory The working directory that trains a BBF classifier cascade.
@@ -1992,6 +2520,15 @@ void ccv_icf_multiscale_classifier_cascade_free(ccv_icf_multiscale_classifier_ca
  * @return A **ccv_array_t** of **ccv_comp_t** with detection results.
  */
 CCV_WARN_UNUSED(ccv_array_t*) ccv_icf_detect_objects(ccv_dense_matrix_t* a, void* cascade, int count, ccv_icf_param_t params);
+/**
+ * Using a ICF classifier cascade to detect objects in a shared image pyramid (see ccv_pyramid_new). Only the octaves of the pyramid are used, thus, its interval doesn't matter.
+ * @param pyramid The image pyramid.
+ * @param cascade An array of classifier cascades.
+ * @param count How many classifier cascades you've passed in.
+ * @param params A **ccv_icf_param_t** structure that defines various aspects of the detector.
+ * @return A **ccv_array_t** of **ccv_comp_t** with detection results.
+ */
+CCV_WARN_UNUSED(ccv_array_t*) ccv_icf_detect_objects_with_pyramid(ccv_pyramid_t* pyramid, void* cascade, int count, ccv_icf_param_t params);
 /** @} */
 
 /* SCD: SURF-Cascade Detector
@@ -2134,6 +2671,15 @@ void ccv_scd(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type);
  * @return A **ccv_array_t** of **ccv_comp_t** with detection results.
  */
 CCV_WARN_UNUSED(ccv_array_t*) ccv_scd_detect_objects(ccv_dense_matrix_t* a, ccv_scd_classifier_cascade_t** cascades, int count, ccv_scd_param_t params);
+/**
+ * Using a SCD classifier cascade to detect objects in a shared image pyramid (see ccv_pyramid_new). Only the octaves of the pyramid are used, thus, its interval doesn't matter.
+ * @param pyramid The image pyramid. Its base is the input image upsampled (CCV_INTER_CUBIC) by the largest cascade size over params.size if that is more than 1, otherwise the input image itself.
+ * @param cascades An array of classifier cascades.
+ * @param count How many classifier cascades you've passed in.
+ * @param params A **ccv_scd_param_t** structure that defines various aspects of the detector.
+ * @return A **ccv_array_t** of **ccv_comp_t** with detection results.
+ */
+CCV_WARN_UNUSED(ccv_array_t*) ccv_scd_detect_objects_with_pyramid(ccv_pyramid_t* pyramid, ccv_scd_classifier_cascade_t** cascades, int count, ccv_scd_param_t params);
 /** @} */
 
 /* categorization types and methods for training */
@@ -5,6 +5,14 @@
 #elif HAVE_CBLAS
 #include <cblas.h>
 #endif
+#if defined(HAVE_SSE2)
+#include <emmintrin.h>
+#define _ccv_load_si128(p) _mm_loadu_si128((const __m128i*)(p))
+#define _ccv_store_si128(p, x) _mm_storeu_si128((__m128i*)(p), (x))
+#if defined(CCV_SIMD_X86)
+#include <immintrin.h>
+#endif
+#endif
 
 double ccv_trace(ccv_matrix_t* mat)
 {
@@ -13,7 +21,9 @@ double ccv_trace(ccv_matrix_t* mat)
 
 double ccv_norm(ccv_matrix_t* mat, int type)
 {
-	return 0;
+	ccv_matrix_stat_t stat;
+	ccv_stat(mat, &stat);
+	return (type == CCV_L1_NORM) ? stat.l1 : sqrt(stat.sumsq);
 }
 
 double ccv_normalize(ccv_matrix_t* a, ccv_matrix_t** b, int btype, int flag)
@@ -32,36 +42,10 @@ double ccv_normalize(ccv_matrix_t* a, ccv_matrix_t** b, int btype, int flag)
 	switch (flag)
 	{
 		case CCV_L1_NORM:
-#define for_block(_for_set, _for_get) \
-			for (i = 0; i < da->rows; i++) \
-			{ \
-				for (j = 0; j < da->cols; j++) \
-					sum += fabs((double)_for_get(a_ptr, j, 0)); \
-				a_ptr += da->step; \
-			} \
-			inv = 1.0 / sum; \
-			a_ptr = da->data.u8; \
-			for (i = 0; i < da->rows; i++) \
-			{ \
-				for (j = 0; j < da->cols; j++) \
-					_for_set(b_ptr, j, _for_get(a_ptr, j, 0) * inv, 0); \
-				a_ptr += da->step; \
-				b_ptr += db->step; \
-			}
-			ccv_matrix_setter(db->type, ccv_matrix_getter, da->type, for_block);
-#undef for_block
-			break;
 		case CCV_L2_NORM:
+			sum = ccv_norm(da, flag);
+			inv = 1.0 / sum;
 #define for_block(_for_set, _for_get) \
-			for (i = 0; i < da->rows; i++) \
-			{ \
-				for (j = 0; j < da->cols; j++) \
-					sum += _for_get(a_ptr, j, 0) * _for_get(a_ptr, j, 0); \
-				a_ptr += da->step; \
-			} \
-			sum = sqrt(sum); \
-			inv = 1.0 / sum; \
-			a_ptr = da->data.u8; \
 			for (i = 0; i < da->rows; i++) \
 			{ \
 				for (j = 0; j < da->cols; j++) \
@@ -76,21 +60,252 @@ double ccv_normalize(ccv_matrix_t* a, ccv_matrix_t** b, int btype, int flag)
 	return db->tag.f64 = sum;
 }
 
+/* fast paths of ccv_sat, the rows are split into blocks, every block computes its own summed area table in parallel,
+ * then the bottom row of every block is carried over to the next serially, and at last, the other rows of every block
+ * but the first add the bottom row of the block above in parallel */
+#define CCV_SAT_BLOCK_ROWS (32)
+
+typedef struct {
+	void (*prefix)(const unsigned char* a, unsigned char* b, int n, int ch); // b = horizontal prefix sum of a
+	void (*vertical)(unsigned char* b, const unsigned char* prev, int n); // b += prev
+	unsigned char* data; // where the table of a starts, after the padding
+	int step;
+} ccv_sat_table_t;
+
+#define CCV_SAT_PREFIX(_name, _itype, _otype, _f) \
+static void _name(const unsigned char* _a, unsigned char* _b, int n, int ch) \
+{ \
+	const _itype* a = (const _itype*)_a; \
+	_otype* b = (_otype*)_b; \
+	int j; \
+	for (j = 0; j < ccv_min(ch, n); j++) \
+		b[j] = _f(a[j]); \
+	for (; j < n; j++) \
+		b[j] = b[j - ch] + _f(a[j]); \
+}
+
+#define _ccv_sat_value(x) (x)
+#define _ccv_sat_square(x) ((x) * (x))
+#define _ccv_sat_square_64f(x) ((double)(x) * (x))
+CCV_SAT_PREFIX(_ccv_sat_prefix_8u_64s, unsigned char, int64_t, _ccv_sat_value)
+CCV_SAT_PREFIX(_ccv_sat_prefix_square_8u_64s, unsigned char, int64_t, _ccv_sat_square)
+CCV_SAT_PREFIX(_ccv_sat_prefix_square_32f_64f, float, double, _ccv_sat_square_64f)
+
+static void _ccv_sat_prefix_8u_32s(const unsigned char* a, unsigned char* _b, int n, int ch)
+{
+	int* b = (int*)_b;
+	int j = 0;
+#if defined(HAVE_SSE2)
+	__m128i z = _mm_setzero_si128();
+	if (ch <= 2)
+	{
+		// prefix sum in register with the shifts, and carry over the last channel(s)
+		__m128i carry = z;
+		for (; j <= n - 4; j += 4)
+		{
+			int v;
+			memcpy(&v, a + j, sizeof(v));
+			__m128i x = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), z), z);
+			if (ch == 1)
+				x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+			x = _mm_add_epi32(carry, _mm_add_epi32(x, _mm_slli_si128(x, 8)));
+			_mm_storeu_si128((__m128i*)(b + j), x);
+			carry = (ch == 1) ? _mm_shuffle_epi32(x, 0xff) : _mm_shuffle_epi32(x, 0xee);
+		}
+	} else if (ch >= 4) {
+		// the dependency is at least a register away
+		for (; j < ccv_min(ch, n); j++)
+			b[j] = a[j];
+		for (; j <= n - 4; j += 4)
+		{
+			int v;
+			memcpy(&v, a + j, sizeof(v));
+			__m128i x = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), z), z);
+			_mm_storeu_si128((__m128i*)(b + j), _mm_add_epi32(x, _mm_loadu_si128((const __m128i*)(b + j - ch))));
+		}
+	}
+#endif
+	for (; j < n; j++)
+		b[j] = (j < ch) ? a[j] : b[j - ch] + a[j];
+}
+
+static void _ccv_sat_prefix_32f(const unsigned char* _a, unsigned char* _b, int n, int ch)
+{
+	const float* a = (const float*)_a;
+	float* b = (float*)_b;
+	int j = 0;
+#if defined(HAVE_SSE2)
+	if (ch <= 2)
+	{
+		__m128 carry = _mm_setzero_ps();
+		for (; j <= n - 4; j += 4)
+		{
+			__m128 x = _mm_loadu_ps(a + j);
+			if (ch == 1)
+				x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+			x = _mm_add_ps(carry, _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8))));
+			_mm_storeu_ps(b + j, x);
+			carry = (ch == 1) ? _mm_shuffle_ps(x, x, 0xff) : _mm_shuffle_ps(x, x, 0xee);
+		}
+	} else if (ch >= 4) {
+		for (; j < ccv_min(ch, n); j++)
+			b[j] = a[j];
+		for (; j <= n - 4; j += 4)
+			_mm_storeu_ps(b + j, _mm_add_ps(_mm_loadu_ps(a + j), _mm_loadu_ps(b + j - ch)));
+	}
+#endif
+	for (; j < n; j++)
+		b[j] = (j < ch) ? a[j] : b[j - ch] + a[j];
+}
+
+#if defined(HAVE_SSE2)
+#define CCV_SAT_VERTICAL(_name, _type, _width, _load, _store, _vadd) \
+static void _name(unsigned char* _b, const unsigned char* _prev, int n) \
+{ \
+	_type* b = (_type*)_b; \
+	const _type* prev = (const _type*)_prev; \
+	int j = 0; \
+	for (; j <= n - _width; j += _width) \
+		_store(b + j, _vadd(_load(b + j), _load(prev + j))); \
+	for (; j < n; j++) \
+		b[j] += prev[j]; \
+}
+#else
+#define CCV_SAT_VERTICAL(_name, _type, _width, _load, _store, _vadd) \
+static void _name(unsigned char* _b, const unsigned char* _prev, int n) \
+{ \
+	_type* b = (_type*)_b; \
+	const _type* prev = (const _type*)_prev; \
+	int j; \
+	for (j = 0; j < n; j++) \
+		b[j] += prev[j]; \
+}
+#endif
+
+CCV_SAT_VERTICAL(_ccv_sat_vertical_32s, int, 4, _ccv_load_si128, _ccv_store_si128, _mm_add_epi32)
+CCV_SAT_VERTICAL(_ccv_sat_vertical_64s, int64_t, 2, _ccv_load_si128, _ccv_store_si128, _mm_add_epi64)
+CCV_SAT_VERTICAL(_ccv_sat_vertical_32f, float, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_add_ps)
+CCV_SAT_VERTICAL(_ccv_sat_vertical_64f, double, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_add_pd)
+
+/* return 0 if there is no fast path from atype to the type of db, otherwise, set up the table and zero the padding */
+static int _ccv_sat_table(ccv_sat_table_t* table, int atype, ccv_dense_matrix_t* db, int padding_pattern, int square)
+{
+	int itype = CCV_GET_DATA_TYPE(atype), otype = CCV_GET_DATA_TYPE(db->type);
+	table->prefix = 0;
+	if (square)
+	{
+		if (itype == CCV_8U && otype == CCV_64S)
+			table->prefix = _ccv_sat_prefix_square_8u_64s, table->vertical = _ccv_sat_vertical_64s;
+		else if (itype == CCV_32F && otype == CCV_64F)
+			table->prefix = _ccv_sat_prefix_square_32f_64f, table->vertical = _ccv_sat_vertical_64f;
+	} else {
+		if (itype == CCV_8U && otype == CCV_32S)
+			table->prefix = _ccv_sat_prefix_8u_32s, table->vertical = _ccv_sat_vertical_32s;
+		else if (itype == CCV_8U && otype == CCV_64S)
+			table->prefix = _ccv_sat_prefix_8u_64s, table->vertical = _ccv_sat_vertical_64s;
+		else if (itype == CCV_32F && otype == CCV_32F)
+			table->prefix = _ccv_sat_prefix_32f, table->vertical = _ccv_sat_vertical_32f;
+	}
+	if (!table->prefix)
+		return 0;
+	table->step = db->step;
+	table->data = db->data.u8;
+	if (padding_pattern == CCV_PADDING_ZERO)
+	{
+		int i, ch = CCV_GET_CHANNEL(db->type), size = CCV_GET_DATA_TYPE_SIZE(db->type);
+		memset(db->data.u8, 0, db->step);
+		for (i = 1; i < db->rows; i++)
+			memset(db->data.u8 + i * db->step, 0, ch * size);
+		table->data += db->step + ch * size;
+	}
+	return 1;
+}
+
+typedef struct {
+	ccv_dense_matrix_t* a;
+	ccv_sat_table_t* tables;
+	int table_num;
+} ccv_sat_context_t;
+
+static void _ccv_sat_block(size_t k, void* context)
+{
+	ccv_sat_context_t* sat = (ccv_sat_context_t*)context;
+	ccv_dense_matrix_t* a = sat->a;
+	int ch = CCV_GET_CHANNEL(a->type);
+	int n = a->cols * ch;
+	int i, t;
+	int begin = k * CCV_SAT_BLOCK_ROWS;
+	int end = ccv_min(a->rows, begin + CCV_SAT_BLOCK_ROWS);
+	for (i = begin; i < end; i++)
+		for (t = 0; t < sat->table_num; t++)
+		{
+			ccv_sat_table_t* table = sat->tables + t;
+			table->prefix(a->data.u8 + i * a->step, table->data + i * table->step, n, ch);
+			if (i > begin)
+				table->vertical(table->data + i * table->step, table->data + (i - 1) * table->step, n);
+		}
+}
+
+static void _ccv_sat_fixup(size_t k, void* context)
+{
+	ccv_sat_context_t* sat = (ccv_sat_context_t*)context;
+	int n = sat->a->cols * CCV_GET_CHANNEL(sat->a->type);
+	int i, t;
+	int begin = (k + 1) * CCV_SAT_BLOCK_ROWS;
+	int end = ccv_min(sat->a->rows, begin + CCV_SAT_BLOCK_ROWS) - 1; // the bottom row is carried already
+	for (i = begin; i < end; i++)
+		for (t = 0; t < sat->table_num; t++)
+			sat->tables[t].vertical(sat->tables[t].data + i * sat->tables[t].step, sat->tables[t].data + (begin - 1) * sat->tables[t].step, n);
+}
+
+static void _ccv_sat_tables(ccv_dense_matrix_t* a, ccv_sat_table_t* tables, int table_num)
+{
+	ccv_sat_context_t context = {
+		.a = a,
+		.tables = tables,
+		.table_num = table_num,
+	};
+	int n = a->cols * CCV_GET_CHANNEL(a->type);
+	int block_num = (a->rows + CCV_SAT_BLOCK_ROWS - 1) / CCV_SAT_BLOCK_ROWS;
+	ccv_parallel_for(block_num, _ccv_sat_block, &context);
+	int i, t;
+	for (i = 1; i < block_num; i++)
+	{
+		int bottom = ccv_min(a->rows, (i + 1) * CCV_SAT_BLOCK_ROWS) - 1;
+		int above = i * CCV_SAT_BLOCK_ROWS - 1; // the bottom row of the block above, which is final now
+		for (t = 0; t < table_num; t++)
+			tables[t].vertical(tables[t].data + bottom * tables[t].step, tables[t].data + above * tables[t].step, n);
+	}
+	if (block_num > 1)
+		ccv_parallel_for(block_num - 1, _ccv_sat_fixup, &context);
+}
+
+static int _ccv_sat_safe_type(ccv_dense_matrix_t* a)
+{
+	return (a->type & CCV_8U) ? ((a->rows * a->cols >= 0x808080) ? CCV_64S : CCV_32S) : ((a->type & CCV_32S) ? CCV_64S : a->type);
+}
+
 void ccv_sat(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, int padding_pattern)
 {
 	ccv_declare_derived_signature(sig, a->sig != 0, ccv_sign_with_format(20, "ccv_sat(%d)", padding_pattern), a->sig, CCV_EOF_SIGN);
-	int safe_type = (a->type & CCV_8U) ? ((a->rows * a->cols >= 0x808080) ? CCV_64S : CCV_32S) : ((a->type & CCV_32S) ? CCV_64S : a->type);
+	int safe_type = _ccv_sat_safe_type(a);
 	type = (type == 0) ? CCV_GET_DATA_TYPE(safe_type) | CCV_GET_CHANNEL(a->type) : CCV_GET_DATA_TYPE(type) | CCV_GET_CHANNEL(a->type);
 	int ch = CCV_GET_CHANNEL(a->type);
 	int i, j;
 	unsigned char* a_ptr = a->data.u8;
 	ccv_dense_matrix_t* db;
 	unsigned char* b_ptr;
+	ccv_sat_table_t table;
 	switch (padding_pattern)
 	{
 		case CCV_NO_PADDING:
 			db = *b = ccv_dense_matrix_renew(*b, a->rows, a->cols, CCV_ALL_DATA_TYPE | CCV_GET_CHANNEL(a->type), type, sig);
 			ccv_object_return_if_cached(, db);
+			if (_ccv_sat_table(&table, a->type, db, padding_pattern, 0))
+			{
+				_ccv_sat_tables(a, &table, 1);
+				break;
+			}
 			b_ptr = db->data.u8;
 #define for_block(_for_set_b, _for_get_b, _for_get) \
 			for (j = 0; j < ch; j++) \
@@ -114,6 +329,11 @@ void ccv_sat(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, int paddin
 		case CCV_PADDING_ZERO:
 			db = *b = ccv_dense_matrix_renew(*b, a->rows + 1, a->cols + 1, CCV_ALL_DATA_TYPE | CCV_GET_CHANNEL(a->type), type, sig);
 			ccv_object_return_if_cached(, db);
+			if (_ccv_sat_table(&table, a->type, db, padding_pattern, 0))
+			{
+				_ccv_sat_tables(a, &table, 1);
+				break;
+			}
 			b_ptr = db->data.u8;
 #define for_block(_for_set_b, _for_get_b, _for_get) \
 			for (j = 0; j < db->cols * ch; j++) \
@@ -134,58 +354,500 @@ void ccv_sat(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, int paddin
 	}
 }
 
-double ccv_sum(ccv_matrix_t* mat, int flag)
+void ccv_sat_square(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, ccv_dense_matrix_t** c, int padding_pattern)
 {
-	ccv_dense_matrix_t* dmt = ccv_get_dense_matrix(mat);
-	double sum = 0;
-	unsigned char* m_ptr = dmt->data.u8;
-	int i, j, ch = CCV_GET_CHANNEL(dmt->type);
+	assert(CCV_GET_DATA_TYPE(a->type) == CCV_8U || CCV_GET_DATA_TYPE(a->type) == CCV_32F);
+	assert(padding_pattern == CCV_NO_PADDING || padding_pattern == CCV_PADDING_ZERO);
+	// the summed area table is exactly what ccv_sat would return, thus, shares its signature
+	ccv_declare_derived_signature(bsig, a->sig != 0, ccv_sign_with_format(20, "ccv_sat(%d)", padding_pattern), a->sig, CCV_EOF_SIGN);
+	ccv_declare_derived_signature(csig, a->sig != 0, ccv_sign_with_format(32, "ccv_sat_square(%d)", padding_pattern), a->sig, CCV_EOF_SIGN);
+	int ch = CCV_GET_CHANNEL(a->type);
+	int btype = CCV_GET_DATA_TYPE(_ccv_sat_safe_type(a)) | ch;
+	int ctype = ((CCV_GET_DATA_TYPE(a->type) == CCV_8U) ? CCV_64S : CCV_64F) | ch;
+	int pad = (padding_pattern == CCV_PADDING_ZERO) ? 1 : 0;
+	ccv_dense_matrix_t* db = *b = ccv_dense_matrix_renew(*b, a->rows + pad, a->cols + pad, btype, btype, bsig);
+	ccv_dense_matrix_t* dc = *c = ccv_dense_matrix_renew(*c, a->rows + pad, a->cols + pad, ctype, ctype, csig);
+	assert(db && dc);
+	ccv_object_return_if_cached(, db, dc);
+	ccv_revive_object_if_cached(db, dc);
+	ccv_sat_table_t tables[2];
+	int fast = _ccv_sat_table(tables, a->type, db, padding_pattern, 0) && _ccv_sat_table(tables + 1, a->type, dc, padding_pattern, 1);
+	assert(fast);
+	_ccv_sat_tables(a, tables, 2);
+}
+
+/* reductions go through runs of at most CCV_STAT_RUN elements, a run is accumulated in double lanes (or exactly in
+ * integers for 8U), and is then added to the total with Kahan-Babuska compensation, thus, the error stays at the
+ * level of one run rather than growing with the size of the matrix */
+#define CCV_STAT_RUN (256)
+
+typedef struct {
+	double sum;
+	double sumsq;
+	double l1;
+	double min;
+	double max;
+} ccv_stat_run_t;
+
+static inline void _ccv_kahan_add(double* sum, double* c, double x)
+{
+	double t = *sum + x;
+	if (fabs(*sum) >= fabs(x))
+		*c += (*sum - t) + x;
+	else
+		*c += (x - t) + *sum;
+	*sum = t;
+}
+
+static void _ccv_stat_run_8u(const unsigned char* a, int n, ccv_stat_run_t* run)
+{
+	// at most 256 elements, 255 * 255 * 256 fits in 32-bit
+	unsigned int sum = 0, sumsq = 0;
+	unsigned char min = 255, max = 0;
+	int i = 0;
+#if defined(HAVE_SSE2)
+	if (n >= 16)
+	{
+		__m128i z = _mm_setzero_si128();
+		__m128i sum4 = z, sumsq4 = z, min16 = _mm_set1_epi8((char)0xff), max16 = z;
+		for (; i <= n - 16; i += 16)
+		{
+			__m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+			__m128i lo = _mm_unpacklo_epi8(x, z);
+			__m128i hi = _mm_unpackhi_epi8(x, z);
+			sum4 = _mm_add_epi64(sum4, _mm_sad_epu8(x, z));
+			sumsq4 = _mm_add_epi32(sumsq4, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+			min16 = _mm_min_epu8(min16, x);
+			max16 = _mm_max_epu8(max16, x);
+		}
+		unsigned int s[4];
+		unsigned char m[2][16];
+		_mm_storeu_si128((__m128i*)s, sum4);
+		sum = s[0] + s[2];
+		_mm_storeu_si128((__m128i*)s, sumsq4);
+		sumsq = s[0] + s[1] + s[2] + s[3];
+		_mm_storeu_si128((__m128i*)m[0], min16);
+		_mm_storeu_si128((__m128i*)m[1], max16);
+		int j;
+		for (j = 0; j < 16; j++)
+			min = ccv_min(min, m[0][j]), max = ccv_max(max, m[1][j]);
+	}
+#endif
+	for (; i < n; i++)
+	{
+		sum += a[i];
+		sumsq += a[i] * a[i];
+		min = ccv_min(min, a[i]);
+		max = ccv_max(max, a[i]);
+	}
+	run->sum = run->l1 = sum;
+	run->sumsq = sumsq;
+	run->min = min;
+	run->max = max;
+}
+
+static void _ccv_stat_run_32f(const float* a, int n, ccv_stat_run_t* run)
+{
+	double sum = 0, sumsq = 0, l1 = 0;
+	float min = a[0], max = a[0];
+	int i = 0;
+#if defined(HAVE_SSE2)
+	if (n >= 4)
+	{
+		__m128d sign = _mm_set1_pd(-0.0);
+		__m128d sum2 = _mm_setzero_pd(), sumsq2 = sum2, l12 = sum2;
+		__m128 min4 = _mm_set1_ps(a[0]), max4 = min4;
+		for (; i <= n - 4; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(a + i);
+			__m128d lo = _mm_cvtps_pd(x);
+			__m128d hi = _mm_cvtps_pd(_mm_movehl_ps(x, x));
+			sum2 = _mm_add_pd(sum2, _mm_add_pd(lo, hi));
+			sumsq2 = _mm_add_pd(sumsq2, _mm_add_pd(_mm_mul_pd(lo, lo), _mm_mul_pd(hi, hi)));
+			l12 = _mm_add_pd(l12, _mm_add_pd(_mm_andnot_pd(sign, lo), _mm_andnot_pd(sign, hi)));
+			min4 = _mm_min_ps(min4, x);
+			max4 = _mm_max_ps(max4, x);
+		}
+		double s[2];
+		float m[2][4];
+		_mm_storeu_pd(s, sum2);
+		sum = s[0] + s[1];
+		_mm_storeu_pd(s, sumsq2);
+		sumsq = s[0] + s[1];
+		_mm_storeu_pd(s, l12);
+		l1 = s[0] + s[1];
+		_mm_storeu_ps(m[0], min4);
+		_mm_storeu_ps(m[1], max4);
+		int j;
+		for (j = 0; j < 4; j++)
+			min = ccv_min(min, m[0][j]), max = ccv_max(max, m[1][j]);
+	}
+#endif
+	for (; i < n; i++)
+	{
+		sum += a[i];
+		sumsq += (double)a[i] * a[i];
+		l1 += fabsf(a[i]);
+		min = ccv_min(min, a[i]);
+		max = ccv_max(max, a[i]);
+	}
+	run->sum = sum;
+	run->sumsq = sumsq;
+	run->l1 = l1;
+	run->min = min;
+	run->max = max;
+}
+
+static void _ccv_stat_run_64f(const double* a, int n, ccv_stat_run_t* run)
+{
+	double sum = 0, sumsq = 0, l1 = 0;
+	double min = a[0], max = a[0];
+	int i = 0;
+#if defined(HAVE_SSE2)
+	if (n >= 2)
+	{
+		__m128d sign = _mm_set1_pd(-0.0);
+		__m128d sum2 = _mm_setzero_pd(), sumsq2 = sum2, l12 = sum2;
+		__m128d min2 = _mm_set1_pd(a[0]), max2 = min2;
+		for (; i <= n - 2; i += 2)
+		{
+			__m128d x = _mm_loadu_pd(a + i);
+			sum2 = _mm_add_pd(sum2, x);
+			sumsq2 = _mm_add_pd(sumsq2, _mm_mul_pd(x, x));
+			l12 = _mm_add_pd(l12, _mm_andnot_pd(sign, x));
+			min2 = _mm_min_pd(min2, x);
+			max2 = _mm_max_pd(max2, x);
+		}
+		double s[2];
+		_mm_storeu_pd(s, sum2);
+		sum = s[0] + s[1];
+		_mm_storeu_pd(s, sumsq2);
+		sumsq = s[0] + s[1];
+		_mm_storeu_pd(s, l12);
+		l1 = s[0] + s[1];
+		_mm_storeu_pd(s, min2);
+		min = ccv_min(s[0], s[1]);
+		_mm_storeu_pd(s, max2);
+		max = ccv_max(s[0], s[1]);
+	}
+#endif
+	for (; i < n; i++)
+	{
+		sum += a[i];
+		sumsq += a[i] * a[i];
+		l1 += fabs(a[i]);
+		min = ccv_min(min, a[i]);
+		max = ccv_max(max, a[i]);
+	}
+	run->sum = sum;
+	run->sumsq = sumsq;
+	run->l1 = l1;
+	run->min = min;
+	run->max = max;
+}
+
+static void _ccv_stat_run(const unsigned char* a, int type, int n, ccv_stat_run_t* run)
+{
+	int i;
+	double sum = 0, sumsq = 0, l1 = 0, min = 0, max = 0;
+	switch (CCV_GET_DATA_TYPE(type))
+	{
+		case CCV_8U:
+			_ccv_stat_run_8u(a, n, run);
+			return;
+		case CCV_32F:
+			_ccv_stat_run_32f((const float*)a, n, run);
+			return;
+		case CCV_64F:
+			_ccv_stat_run_64f((const double*)a, n, run);
+			return;
+	}
 #define for_block(_, _for_get) \
-	switch (flag) \
+	min = max = _for_get(a, 0, 0); \
+	for (i = 0; i < n; i++) \
 	{ \
-		case CCV_UNSIGNED: \
-			for (i = 0; i < dmt->rows; i++) \
-			{ \
-				for (j = 0; j < dmt->cols * ch; j++) \
-					sum += fabs((double)(_for_get(m_ptr, j, 0))); \
-				m_ptr += dmt->step; \
-			} \
-			break; \
-		case CCV_SIGNED: \
-		default: \
-			for (i = 0; i < dmt->rows; i++) \
-			{ \
-				for (j = 0; j < dmt->cols * ch; j++) \
-					sum += _for_get(m_ptr, j, 0); \
-				m_ptr += dmt->step; \
-			} \
+		double x = _for_get(a, i, 0); \
+		sum += x; \
+		sumsq += x * x; \
+		l1 += fabs(x); \
+		min = ccv_min(min, x); \
+		max = ccv_max(max, x); \
 	}
-	ccv_matrix_getter(dmt->type, for_block);
+	ccv_matrix_getter(type, for_block);
 #undef for_block
-	return sum;
+	run->sum = sum;
+	run->sumsq = sumsq;
+	run->l1 = l1;
+	run->min = min;
+	run->max = max;
 }
 
-double ccv_variance(ccv_matrix_t* mat)
+void ccv_stat(ccv_matrix_t* mat, ccv_matrix_stat_t* stat)
 {
 	ccv_dense_matrix_t* dmt = ccv_get_dense_matrix(mat);
-	double mean = 0, variance = 0;
-	unsigned char* m_ptr = dmt->data.u8;
-	int i, j, ch = CCV_GET_CHANNEL(dmt->type);
-#define for_block(_, _for_get) \
-	for (i = 0; i < dmt->rows; i++) \
-	{ \
-		for (j = 0; j < dmt->cols * ch; j++) \
-		{ \
-			mean += _for_get(m_ptr, j, 0); \
-			variance += _for_get(m_ptr, j, 0) * _for_get(m_ptr, j, 0); \
-		} \
-		m_ptr += dmt->step; \
+	int i, j, size = CCV_GET_DATA_TYPE_SIZE(dmt->type);
+	int rows = dmt->rows, cols = dmt->cols * CCV_GET_CHANNEL(dmt->type);
+	if (dmt->step == cols * size) // contiguous, one long row
+		cols *= rows, rows = 1;
+	double sum = 0, sumsq = 0, l1 = 0, sum_c = 0, sumsq_c = 0, l1_c = 0;
+	double min = DBL_MAX, max = -DBL_MAX;
+	for (i = 0; i < rows; i++)
+		for (j = 0; j < cols; j += CCV_STAT_RUN)
+		{
+			ccv_stat_run_t run;
+			_ccv_stat_run(dmt->data.u8 + i * dmt->step + j * size, dmt->type, ccv_min(CCV_STAT_RUN, cols - j), &run);
+			_ccv_kahan_add(&sum, &sum_c, run.sum);
+			_ccv_kahan_add(&sumsq, &sumsq_c, run.sumsq);
+			_ccv_kahan_add(&l1, &l1_c, run.l1);
+			min = ccv_min(min, run.min);
+			max = ccv_max(max, run.max);
+		}
+	stat->sum = sum + sum_c;
+	stat->sumsq = sumsq + sumsq_c;
+	stat->l1 = l1 + l1_c;
+	stat->min = min;
+	stat->max = max;
+	stat->count = dmt->rows * dmt->cols * CCV_GET_CHANNEL(dmt->type);
+}
+
+static double _ccv_dot_run_8u(const unsigned char* a, const unsigned char* b, int n)
+{
+	unsigned int sum = 0;
+	int i = 0;
+#if defined(HAVE_SSE2)
+	if (n >= 16)
+	{
+		__m128i z = _mm_setzero_si128();
+		__m128i sum4 = z;
+		for (; i <= n - 16; i += 16)
+		{
+			__m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+			__m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+			sum4 = _mm_add_epi32(sum4, _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(x, z), _mm_unpacklo_epi8(y, z)), _mm_madd_epi16(_mm_unpackhi_epi8(x, z), _mm_unpackhi_epi8(y, z))));
+		}
+		unsigned int s[4];
+		_mm_storeu_si128((__m128i*)s, sum4);
+		sum = s[0] + s[1] + s[2] + s[3];
 	}
-	ccv_matrix_getter(dmt->type, for_block);
+#endif
+	for (; i < n; i++)
+		sum += a[i] * b[i];
+	return sum;
+}
+
+static double _ccv_dot_run_32f(const float* a, const float* b, int n)
+{
+	double sum = 0;
+	int i = 0;
+#if defined(HAVE_SSE2)
+	__m128d sum2 = _mm_setzero_pd();
+	for (; i <= n - 4; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(a + i);
+		__m128 y = _mm_loadu_ps(b + i);
+		sum2 = _mm_add_pd(sum2, _mm_add_pd(_mm_mul_pd(_mm_cvtps_pd(x), _mm_cvtps_pd(y)), _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(x, x)), _mm_cvtps_pd(_mm_movehl_ps(y, y)))));
+	}
+	double s[2];
+	_mm_storeu_pd(s, sum2);
+	sum = s[0] + s[1];
+#endif
+	for (; i < n; i++)
+		sum += (double)a[i] * b[i];
+	return sum;
+}
+
+static double _ccv_dot_run_64f(const double* a, const double* b, int n)
+{
+	double sum = 0;
+	int i = 0;
+#if defined(HAVE_SSE2)
+	__m128d sum2 = _mm_setzero_pd();
+	for (; i <= n - 2; i += 2)
+		sum2 = _mm_add_pd(sum2, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+	double s[2];
+	_mm_storeu_pd(s, sum2);
+	sum = s[0] + s[1];
+#endif
+	for (; i < n; i++)
+		sum += a[i] * b[i];
+	return sum;
+}
+
+static double _ccv_dot_run(const unsigned char* a, const unsigned char* b, int type, int n)
+{
+	int i;
+	double sum = 0;
+	switch (CCV_GET_DATA_TYPE(type))
+	{
+		case CCV_8U:
+			return _ccv_dot_run_8u(a, b, n);
+		case CCV_32F:
+			return _ccv_dot_run_32f((const float*)a, (const float*)b, n);
+		case CCV_64F:
+			return _ccv_dot_run_64f((const double*)a, (const double*)b, n);
+	}
+#define for_block(_, _for_get) \
+	for (i = 0; i < n; i++) \
+		sum += (double)_for_get(a, i, 0) * _for_get(b, i, 0);
+	ccv_matrix_getter(type, for_block);
 #undef for_block
-	mean = mean / (dmt->rows * dmt->cols * ch);
-	variance = variance / (dmt->rows * dmt->cols * ch);
-	return variance - mean * mean;
+	return sum;
+}
+
+double ccv_dot(ccv_matrix_t* a, ccv_matrix_t* b)
+{
+	ccv_dense_matrix_t* da = ccv_get_dense_matrix(a);
+	ccv_dense_matrix_t* db = ccv_get_dense_matrix(b);
+	assert(da->rows == db->rows && da->cols == db->cols && CCV_GET_DATA_TYPE(da->type) == CCV_GET_DATA_TYPE(db->type) && CCV_GET_CHANNEL(da->type) == CCV_GET_CHANNEL(db->type));
+	int i, j, size = CCV_GET_DATA_TYPE_SIZE(da->type);
+	int rows = da->rows, cols = da->cols * CCV_GET_CHANNEL(da->type);
+	if (da->step == cols * size && db->step == cols * size)
+		cols *= rows, rows = 1;
+	double sum = 0, sum_c = 0;
+	for (i = 0; i < rows; i++)
+		for (j = 0; j < cols; j += CCV_STAT_RUN)
+			_ccv_kahan_add(&sum, &sum_c, _ccv_dot_run(da->data.u8 + i * da->step + j * size, db->data.u8 + i * db->step + j * size, da->type, ccv_min(CCV_STAT_RUN, cols - j)));
+	return sum + sum_c;
+}
+
+double ccv_sum(ccv_matrix_t* mat, int flag)
+{
+	ccv_matrix_stat_t stat;
+	ccv_stat(mat, &stat);
+	return (flag == CCV_UNSIGNED) ? stat.l1 : stat.sum;
+}
+
+double ccv_variance(ccv_matrix_t* mat)
+{
+	ccv_matrix_stat_t stat;
+	ccv_stat(mat, &stat);
+	double mean = stat.sum / stat.count;
+	return stat.sumsq / stat.count - mean * mean;
+}
+
+/* same-type fast paths of the element-wise functions, results are the same as the generic path's (8U saturates,
+ * 32F / 64F are computed in their own precision, except ccv_scale, which is in double), they go through rows
+ * position by position, thus, the output can be one of the inputs */
+typedef void (*ccv_binary_row_f)(const void*, const void*, void*, int);
+
+#define CCV_BINARY_SCALAR_ROW(_name, _type, _op) \
+static void _name(const void* _a, const void* _b, void* _c, int n) \
+{ \
+	const _type* a = (const _type*)_a; \
+	const _type* b = (const _type*)_b; \
+	_type* c = (_type*)_c; \
+	int i; \
+	for (i = 0; i < n; i++) \
+		c[i] = _op(a[i], b[i]); \
+}
+
+#if defined(HAVE_SSE2)
+#define CCV_BINARY_ROW(_name, _type, _width, _load, _store, _vop, _op) \
+static void _name(const void* _a, const void* _b, void* _c, int n) \
+{ \
+	const _type* a = (const _type*)_a; \
+	const _type* b = (const _type*)_b; \
+	_type* c = (_type*)_c; \
+	int i = 0; \
+	for (; i <= n - _width; i += _width) \
+		_store(c + i, _vop(_load(a + i), _load(b + i))); \
+	for (; i < n; i++) \
+		c[i] = _op(a[i], b[i]); \
+}
+
+static inline __m128i _ccv_mul_epu8_sat(__m128i a, __m128i b)
+{
+	__m128i z = _mm_setzero_si128();
+	__m128i max = _mm_set1_epi16(255);
+	__m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(a, z), _mm_unpacklo_epi8(b, z));
+	__m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(a, z), _mm_unpackhi_epi8(b, z));
+	// min(x, 255) for unsigned 16-bit, SSE2 doesn't have _mm_min_epu16
+	lo = _mm_sub_epi16(lo, _mm_subs_epu16(lo, max));
+	hi = _mm_sub_epi16(hi, _mm_subs_epu16(hi, max));
+	return _mm_packus_epi16(lo, hi);
+}
+#else
+#define CCV_BINARY_ROW(_name, _type, _width, _load, _store, _vop, _op) CCV_BINARY_SCALAR_ROW(_name, _type, _op)
+#endif
+
+#define _ccv_add_8u(a, b) ((unsigned char)ccv_min((int)(a) + (int)(b), 255))
+#define _ccv_subtract_8u(a, b) ((unsigned char)ccv_max((int)(a) - (int)(b), 0))
+#define _ccv_multiply_8u(a, b) ((unsigned char)ccv_min((int)(a) * (int)(b), 255))
+#define _ccv_add(a, b) ((a) + (b))
+#define _ccv_subtract(a, b) ((a) - (b))
+#define _ccv_multiply(a, b) ((a) * (b))
+
+CCV_BINARY_ROW(_ccv_add_row_8u, unsigned char, 16, _ccv_load_si128, _ccv_store_si128, _mm_adds_epu8, _ccv_add_8u)
+CCV_BINARY_ROW(_ccv_subtract_row_8u, unsigned char, 16, _ccv_load_si128, _ccv_store_si128, _mm_subs_epu8, _ccv_subtract_8u)
+CCV_BINARY_ROW(_ccv_multiply_row_8u, unsigned char, 16, _ccv_load_si128, _ccv_store_si128, _ccv_mul_epu8_sat, _ccv_multiply_8u)
+CCV_BINARY_ROW(_ccv_add_row_32f, float, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_add_ps, _ccv_add)
+CCV_BINARY_ROW(_ccv_subtract_row_32f, float, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_sub_ps, _ccv_subtract)
+CCV_BINARY_ROW(_ccv_multiply_row_32f, float, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_mul_ps, _ccv_multiply)
+CCV_BINARY_ROW(_ccv_add_row_64f, double, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_add_pd, _ccv_add)
+CCV_BINARY_ROW(_ccv_subtract_row_64f, double, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_sub_pd, _ccv_subtract)
+CCV_BINARY_ROW(_ccv_multiply_row_64f, double, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_mul_pd, _ccv_multiply)
+
+// indexed by 8U, 32F, 64F
+static const ccv_binary_row_f ccv_add_row[] = { _ccv_add_row_8u, _ccv_add_row_32f, _ccv_add_row_64f };
+static const ccv_binary_row_f ccv_subtract_row[] = { _ccv_subtract_row_8u, _ccv_subtract_row_32f, _ccv_subtract_row_64f };
+static const ccv_binary_row_f ccv_multiply_row[] = { _ccv_multiply_row_8u, _ccv_multiply_row_32f, _ccv_multiply_row_64f };
+
+static inline int _ccv_same_type_index(int type)
+{
+	switch (CCV_GET_DATA_TYPE(type))
+	{
+		case CCV_8U:
+			return 0;
+		case CCV_32F:
+			return 1;
+		case CCV_64F:
+			return 2;
+	}
+	return -1;
+}
+
+/* return 0 if there is no fast path for the types of da, db and dc */
+static int _ccv_binary_same_type(ccv_dense_matrix_t* da, ccv_dense_matrix_t* db, ccv_dense_matrix_t* dc, const ccv_binary_row_f* row)
+{
+	int index = _ccv_same_type_index(da->type);
+	if (index < 0 || CCV_GET_DATA_TYPE(db->type) != CCV_GET_DATA_TYPE(da->type) || CCV_GET_DATA_TYPE(dc->type) != CCV_GET_DATA_TYPE(da->type))
+		return 0;
+	int i, n = da->cols * CCV_GET_CHANNEL(da->type);
+	if (da->step == db->step && da->step == dc->step && da->step == n * CCV_GET_DATA_TYPE_SIZE(da->type))
+		row[index](da->data.u8, db->data.u8, dc->data.u8, n * da->rows); // contiguous, one run
+	else
+		for (i = 0; i < da->rows; i++)
+			row[index](da->data.u8 + i * da->step, db->data.u8 + i * db->step, dc->data.u8 + i * dc->step, n);
+	return 1;
+}
+
+static void _ccv_scale_row_32f(const float* a, float* b, int n, double ds)
+{
+	int i = 0;
+#if defined(HAVE_SSE2)
+	__m128d ds2 = _mm_set1_pd(ds);
+	for (; i <= n - 4; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(a + i);
+		__m128 lo = _mm_cvtpd_ps(_mm_mul_pd(_mm_cvtps_pd(x), ds2));
+		__m128 hi = _mm_cvtpd_ps(_mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(x, x)), ds2));
+		_mm_storeu_ps(b + i, _mm_movelh_ps(lo, hi));
+	}
+#endif
+	for (; i < n; i++)
+		b[i] = (float)(ds * a[i]);
+}
+
+static void _ccv_scale_row_64f(const double* a, double* b, int n, double ds)
+{
+	int i = 0;
+#if defined(HAVE_SSE2)
+	__m128d ds2 = _mm_set1_pd(ds);
+	for (; i <= n - 2; i += 2)
+		_mm_storeu_pd(b + i, _mm_mul_pd(_mm_loadu_pd(a + i), ds2));
+#endif
+	for (; i < n; i++)
+		b[i] = ds * a[i];
 }
 
 void ccv_multiply(ccv_matrix_t* a, ccv_matrix_t* b, ccv_matrix_t** c, int type)
@@ -198,6 +860,8 @@ void ccv_multiply(ccv_matrix_t* a, ccv_matrix_t* b, ccv_matrix_t** c, int type)
 	type = (type == 0) ? CCV_GET_DATA_TYPE(no_8u_type) | CCV_GET_CHANNEL(da->type) : CCV_GET_DATA_TYPE(type) | CCV_GET_CHANNEL(da->type);
 	ccv_dense_matrix_t* dc = *c = ccv_dense_matrix_renew(*c, da->rows, da->cols, CCV_ALL_DATA_TYPE | CCV_GET_CHANNEL(da->type), type, sig);
 	ccv_object_return_if_cached(, dc);
+	if (_ccv_binary_same_type(da, db, dc, ccv_multiply_row))
+		return;
 	int i, j, ch = CCV_GET_CHANNEL(da->type);
 	unsigned char* aptr = da->data.u8;
 	unsigned char* bptr = db->data.u8;
@@ -225,6 +889,8 @@ void ccv_add(ccv_matrix_t* a, ccv_matrix_t* b, ccv_matrix_t** c, int type)
 	type = (type == 0) ? CCV_GET_DATA_TYPE(no_8u_type) | CCV_GET_CHANNEL(da->type) : CCV_GET_DATA_TYPE(type) | CCV_GET_CHANNEL(da->type);
 	ccv_dense_matrix_t* dc = *c = ccv_dense_matrix_renew(*c, da->rows, da->cols, CCV_ALL_DATA_TYPE | CCV_GET_CHANNEL(da->type), type, sig);
 	ccv_object_return_if_cached(, dc);
+	if (_ccv_binary_same_type(da, db, dc, ccv_add_row))
+		return;
 	int i, j, ch = CCV_GET_CHANNEL(da->type);
 	unsigned char* aptr = da->data.u8;
 	unsigned char* bptr = db->data.u8;
@@ -254,6 +920,8 @@ void ccv_subtract(ccv_matrix_t* a, ccv_matrix_t* b, ccv_matrix_t** c, int type)
 	type = (type == 0) ? CCV_GET_DATA_TYPE(no_8u_type) | CCV_GET_CHANNEL(da->type) : CCV_GET_DATA_TYPE(type) | CCV_GET_CHANNEL(da->type);
 	ccv_dense_matrix_t* dc = *c = ccv_dense_matrix_renew(*c, da->rows, da->cols, CCV_ALL_DATA_TYPE | CCV_GET_CHANNEL(da->type), type, sig);
 	ccv_object_return_if_cached(, dc);
+	if (_ccv_binary_same_type(da, db, dc, ccv_subtract_row))
+		return;
 	int i, j, ch = CCV_GET_CHANNEL(da->type);
 	unsigned char* aptr = da->data.u8;
 	unsigned char* bptr = db->data.u8;
@@ -295,6 +963,12 @@ void ccv_scale(ccv_matrix_t* a, ccv_matrix_t** b, int type, double ds)
 			aptr += da->step;
 			bptr += db->step;
 		}
+	} else if (CCV_GET_DATA_TYPE(da->type) == CCV_32F && CCV_GET_DATA_TYPE(db->type) == CCV_32F) {
+		for (i = 0; i < da->rows; i++)
+			_ccv_scale_row_32f((float*)(da->data.u8 + i * da->step), (float*)(db->data.u8 + i * db->step), da->cols * ch, ds);
+	} else if (CCV_GET_DATA_TYPE(da->type) == CCV_64F && CCV_GET_DATA_TYPE(db->type) == CCV_64F) {
+		for (i = 0; i < da->rows; i++)
+			_ccv_scale_row_64f((double*)(da->data.u8 + i * da->step), (double*)(db->data.u8 + i * db->step), da->cols * ch, ds);
 	} else {
 #define for_block(_for_get, _for_set) \
 		for (i = 0; i < da->rows; i++) \
@@ -325,6 +999,419 @@ void cblas_sgemm(const enum CBLAS_ORDER Order,
 				 float  *C, const int ldc)
 
 */
+#if !(defined HAVE_CBLAS || defined HAVE_ACCELERATE_FRAMEWORK)
+/* without BLAS, ccv_gemm runs a cache-blocked gemm: op(B) is packed into kc x nc panels made of nr-wide strips,
+ * op(A) into mc x kc blocks made of mr-tall strips, and a register-tiled micro-kernel multiplies a pair of strips
+ * into a mr x nr tile. Blocks of C are independent, they run in parallel. */
+#define CCV_GEMM_KC (256)
+#define CCV_GEMM_MC (96) // a multiple of every mr
+#define CCV_GEMM_MB (64) // blocks of op(A) packed at once
+#define CCV_GEMM_NC (2048)
+#define CCV_GEMM_NB (256) // columns of C in one parallel task, a multiple of every nr
+#define CCV_GEMM_MAX_TILE (6 * 16)
+
+typedef struct {
+	int mr;
+	int nr;
+	// ab = a strip (kc x mr) times b strip (kc x nr), ab is mr x nr row-major
+	void (*kernel)(int kc, const void* a, const void* b, void* ab);
+} ccv_gemm_kernel_t;
+
+static void _ccv_sgemm_kernel_4x8(int kc, const void* _a, const void* _b, void* _ab)
+{
+	const float* a = (const float*)_a;
+	const float* b = (const float*)_b;
+	float* ab = (float*)_ab;
+	int i, j, k;
+	for (i = 0; i < 4 * 8; i++)
+		ab[i] = 0;
+	for (k = 0; k < kc; k++, a += 4, b += 8)
+		for (i = 0; i < 4; i++)
+			for (j = 0; j < 8; j++)
+				ab[i * 8 + j] += a[i] * b[j];
+}
+
+static void _ccv_dgemm_kernel_4x4(int kc, const void* _a, const void* _b, void* _ab)
+{
+	const double* a = (const double*)_a;
+	const double* b = (const double*)_b;
+	double* ab = (double*)_ab;
+	int i, j, k;
+	for (i = 0; i < 4 * 4; i++)
+		ab[i] = 0;
+	for (k = 0; k < kc; k++, a += 4, b += 4)
+		for (i = 0; i < 4; i++)
+			for (j = 0; j < 4; j++)
+				ab[i * 4 + j] += a[i] * b[j];
+}
+
+#if defined(HAVE_SSE2)
+static void _ccv_sgemm_kernel_4x8_sse2(int kc, const void* _a, const void* _b, void* _ab)
+{
+	const float* a = (const float*)_a;
+	const float* b = (const float*)_b;
+	float* ab = (float*)_ab;
+	__m128 c00 = _mm_setzero_ps(), c01 = _mm_setzero_ps();
+	__m128 c10 = _mm_setzero_ps(), c11 = _mm_setzero_ps();
+	__m128 c20 = _mm_setzero_ps(), c21 = _mm_setzero_ps();
+	__m128 c30 = _mm_setzero_ps(), c31 = _mm_setzero_ps();
+	int k;
+	for (k = 0; k < kc; k++, a += 4, b += 8)
+	{
+		__m128 b0 = _mm_load_ps(b);
+		__m128 b1 = _mm_load_ps(b + 4);
+		__m128 a0 = _mm_set1_ps(a[0]);
+		c00 = _mm_add_ps(c00, _mm_mul_ps(a0, b0));
+		c01 = _mm_add_ps(c01, _mm_mul_ps(a0, b1));
+		__m128 a1 = _mm_set1_ps(a[1]);
+		c10 = _mm_add_ps(c10, _mm_mul_ps(a1, b0));
+		c11 = _mm_add_ps(c11, _mm_mul_ps(a1, b1));
+		__m128 a2 = _mm_set1_ps(a[2]);
+		c20 = _mm_add_ps(c20, _mm_mul_ps(a2, b0));
+		c21 = _mm_add_ps(c21, _mm_mul_ps(a2, b1));
+		__m128 a3 = _mm_set1_ps(a[3]);
+		c30 = _mm_add_ps(c30, _mm_mul_ps(a3, b0));
+		c31 = _mm_add_ps(c31, _mm_mul_ps(a3, b1));
+	}
+	_mm_storeu_ps(ab, c00);
+	_mm_storeu_ps(ab + 4, c01);
+	_mm_storeu_ps(ab + 8, c10);
+	_mm_storeu_ps(ab + 12, c11);
+	_mm_storeu_ps(ab + 16, c20);
+	_mm_storeu_ps(ab + 20, c21);
+	_mm_storeu_ps(ab + 24, c30);
+	_mm_storeu_ps(ab + 28, c31);
+}
+
+static void _ccv_dgemm_kernel_4x4_sse2(int kc, const void* _a, const void* _b, void* _ab)
+{
+	const double* a = (const double*)_a;
+	const double* b = (const double*)_b;
+	double* ab = (double*)_ab;
+	__m128d c00 = _mm_setzero_pd(), c01 = _mm_setzero_pd();
+	__m128d c10 = _mm_setzero_pd(), c11 = _mm_setzero_pd();
+	__m128d c20 = _mm_setzero_pd(), c21 = _mm_setzero_pd();
+	__m128d c30 = _mm_setzero_pd(), c31 = _mm_setzero_pd();
+	int k;
+	for (k = 0; k < kc; k++, a += 4, b += 4)
+	{
+		__m128d b0 = _mm_load_pd(b);
+		__m128d b1 = _mm_load_pd(b + 2);
+		__m128d a0 = _mm_set1_pd(a[0]);
+		c00 = _mm_add_pd(c00, _mm_mul_pd(a0, b0));
+		c01 = _mm_add_pd(c01, _mm_mul_pd(a0, b1));
+		__m128d a1 = _mm_set1_pd(a[1]);
+		c10 = _mm_add_pd(c10, _mm_mul_pd(a1, b0));
+		c11 = _mm_add_pd(c11, _mm_mul_pd(a1, b1));
+		__m128d a2 = _mm_set1_pd(a[2]);
+		c20 = _mm_add_pd(c20, _mm_mul_pd(a2, b0));
+		c21 = _mm_add_pd(c21, _mm_mul_pd(a2, b1));
+		__m128d a3 = _mm_set1_pd(a[3]);
+		c30 = _mm_add_pd(c30, _mm_mul_pd(a3, b0));
+		c31 = _mm_add_pd(c31, _mm_mul_pd(a3, b1));
+	}
+	_mm_storeu_pd(ab, c00);
+	_mm_storeu_pd(ab + 2, c01);
+	_mm_storeu_pd(ab + 4, c10);
+	_mm_storeu_pd(ab + 6, c11);
+	_mm_storeu_pd(ab + 8, c20);
+	_mm_storeu_pd(ab + 10, c21);
+	_mm_storeu_pd(ab + 12, c30);
+	_mm_storeu_pd(ab + 14, c31);
+}
+#endif
+
+#if defined(HAVE_SSE2) && defined(CCV_SIMD_X86)
+#define CCV_GEMM_AVX2
+/* compiled for AVX2 / FMA regardless of the flags of the rest, only called if the CPU has them */
+__attribute__((target("avx2,fma"))) static void _ccv_sgemm_kernel_6x16_avx2(int kc, const void* _a, const void* _b, void* _ab)
+{
+	const float* a = (const float*)_a;
+	const float* b = (const float*)_b;
+	float* ab = (float*)_ab;
+	__m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+	__m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+	__m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+	__m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+	__m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+	__m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+	int k;
+	for (k = 0; k < kc; k++, a += 6, b += 16)
+	{
+		__m256 b0 = _mm256_load_ps(b);
+		__m256 b1 = _mm256_load_ps(b + 8);
+		__m256 a0 = _mm256_broadcast_ss(a);
+		c00 = _mm256_fmadd_ps(a0, b0, c00);
+		c01 = _mm256_fmadd_ps(a0, b1, c01);
+		__m256 a1 = _mm256_broadcast_ss(a + 1);
+		c10 = _mm256_fmadd_ps(a1, b0, c10);
+		c11 = _mm256_fmadd_ps(a1, b1, c11);
+		__m256 a2 = _mm256_broadcast_ss(a + 2);
+		c20 = _mm256_fmadd_ps(a2, b0, c20);
+		c21 = _mm256_fmadd_ps(a2, b1, c21);
+		__m256 a3 = _mm256_broadcast_ss(a + 3);
+		c30 = _mm256_fmadd_ps(a3, b0, c30);
+		c31 = _mm256_fmadd_ps(a3, b1, c31);
+		__m256 a4 = _mm256_broadcast_ss(a + 4);
+		c40 = _mm256_fmadd_ps(a4, b0, c40);
+		c41 = _mm256_fmadd_ps(a4, b1, c41);
+		__m256 a5 = _mm256_broadcast_ss(a + 5);
+		c50 = _mm256_fmadd_ps(a5, b0, c50);
+		c51 = _mm256_fmadd_ps(a5, b1, c51);
+	}
+	_mm256_storeu_ps(ab, c00);
+	_mm256_storeu_ps(ab + 8, c01);
+	_mm256_storeu_ps(ab + 16, c10);
+	_mm256_storeu_ps(ab + 24, c11);
+	_mm256_storeu_ps(ab + 32, c20);
+	_mm256_storeu_ps(ab + 40, c21);
+	_mm256_storeu_ps(ab + 48, c30);
+	_mm256_storeu_ps(ab + 56, c31);
+	_mm256_storeu_ps(ab + 64, c40);
+	_mm256_storeu_ps(ab + 72, c41);
+	_mm256_storeu_ps(ab + 80, c50);
+	_mm256_storeu_ps(ab + 88, c51);
+}
+
+__attribute__((target("avx2,fma"))) static void _ccv_dgemm_kernel_6x8_avx2(int kc, const void* _a, const void* _b, void* _ab)
+{
+	const double* a = (const double*)_a;
+	const double* b = (const double*)_b;
+	double* ab = (double*)_ab;
+	__m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+	__m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+	__m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+	__m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+	__m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+	__m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+	int k;
+	for (k = 0; k < kc; k++, a += 6, b += 8)
+	{
+		__m256d b0 = _mm256_load_pd(b);
+		__m256d b1 = _mm256_load_pd(b + 4);
+		__m256d a0 = _mm256_broadcast_sd(a);
+		c00 = _mm256_fmadd_pd(a0, b0, c00);
+		c01 = _mm256_fmadd_pd(a0, b1, c01);
+		__m256d a1 = _mm256_broadcast_sd(a + 1);
+		c10 = _mm256_fmadd_pd(a1, b0, c10);
+		c11 = _mm256_fmadd_pd(a1, b1, c11);
+		__m256d a2 = _mm256_broadcast_sd(a + 2);
+		c20 = _mm256_fmadd_pd(a2, b0, c20);
+		c21 = _mm256_fmadd_pd(a2, b1, c21);
+		__m256d a3 = _mm256_broadcast_sd(a + 3);
+		c30 = _mm256_fmadd_pd(a3, b0, c30);
+		c31 = _mm256_fmadd_pd(a3, b1, c31);
+		__m256d a4 = _mm256_broadcast_sd(a + 4);
+		c40 = _mm256_fmadd_pd(a4, b0, c40);
+		c41 = _mm256_fmadd_pd(a4, b1, c41);
+		__m256d a5 = _mm256_broadcast_sd(a + 5);
+		c50 = _mm256_fmadd_pd(a5, b0, c50);
+		c51 = _mm256_fmadd_pd(a5, b1, c51);
+	}
+	_mm256_storeu_pd(ab, c00);
+	_mm256_storeu_pd(ab + 4, c01);
+	_mm256_storeu_pd(ab + 8, c10);
+	_mm256_storeu_pd(ab + 12, c11);
+	_mm256_storeu_pd(ab + 16, c20);
+	_mm256_storeu_pd(ab + 20, c21);
+	_mm256_storeu_pd(ab + 24, c30);
+	_mm256_storeu_pd(ab + 28, c31);
+	_mm256_storeu_pd(ab + 32, c40);
+	_mm256_storeu_pd(ab + 36, c41);
+	_mm256_storeu_pd(ab + 40, c50);
+	_mm256_storeu_pd(ab + 44, c51);
+}
+#endif
+
+/* the best kernel at every SIMD level */
+#define CCV_SGEMM_KERNEL_NONE { 4, 8, _ccv_sgemm_kernel_4x8 }
+#define CCV_DGEMM_KERNEL_NONE { 4, 4, _ccv_dgemm_kernel_4x4 }
+#if defined(HAVE_SSE2)
+#define CCV_SGEMM_KERNEL_SSE2 { 4, 8, _ccv_sgemm_kernel_4x8_sse2 }
+#define CCV_DGEMM_KERNEL_SSE2 { 4, 4, _ccv_dgemm_kernel_4x4_sse2 }
+#else
+#define CCV_SGEMM_KERNEL_SSE2 CCV_SGEMM_KERNEL_NONE
+#define CCV_DGEMM_KERNEL_SSE2 CCV_DGEMM_KERNEL_NONE
+#endif
+#ifdef CCV_GEMM_AVX2
+#define CCV_SGEMM_KERNEL_AVX2 { 6, 16, _ccv_sgemm_kernel_6x16_avx2 }
+#define CCV_DGEMM_KERNEL_AVX2 { 6, 8, _ccv_dgemm_kernel_6x8_avx2 }
+#else
+#define CCV_SGEMM_KERNEL_AVX2 CCV_SGEMM_KERNEL_SSE2
+#define CCV_DGEMM_KERNEL_AVX2 CCV_DGEMM_KERNEL_SSE2
+#endif
+
+static const ccv_gemm_kernel_t ccv_sgemm_kernel[CCV_SIMD_LEVEL_NUM] = {
+	CCV_SGEMM_KERNEL_NONE, CCV_SGEMM_KERNEL_SSE2, CCV_SGEMM_KERNEL_AVX2, CCV_SGEMM_KERNEL_AVX2,
+};
+
+static const ccv_gemm_kernel_t ccv_dgemm_kernel[CCV_SIMD_LEVEL_NUM] = {
+	CCV_DGEMM_KERNEL_NONE, CCV_DGEMM_KERNEL_SSE2, CCV_DGEMM_KERNEL_AVX2, CCV_DGEMM_KERNEL_AVX2,
+};
+
+typedef struct {
+	const ccv_gemm_kernel_t* kernel;
+	int m, n, kc, nc;
+	int lda, ldb, ldc;
+	int transpose;
+	int atype, btype; // the data types A and B are stored in
+	double alpha;
+	const unsigned char* a; // at row ic, column pc of op(A)
+	const unsigned char* b; // at row pc, column jc of op(B)
+	unsigned char* c; // at row ic, column jc of C
+	unsigned char* ap; // packed blocks of op(A), CCV_GEMM_MC x kc each
+	unsigned char* bp; // packed panel of op(B)
+	int mb; // number of blocks of C in the row direction
+} ccv_gemm_context_t;
+
+/* sgemm also takes A and B in half precision, they are widened to float as they are packed */
+#define _ccv_gemm_get(_type, type, p, x) \
+	(((type) == CCV_16F) ? (_type)ccv_half_to_float(((const uint16_t*)(p))[(x)]) : \
+	(((type) == CCV_16BF) ? (_type)ccv_bfloat_to_float(((const uint16_t*)(p))[(x)]) : ((const _type*)(p))[(x)]))
+
+/* the packing and the per-block multiplication for both float and double */
+#define CCV_GEMM_DEFINE(_type, _name) \
+static void _ccv_##_name##_pack_b(size_t s, void* _context) \
+{ \
+	ccv_gemm_context_t* context = (ccv_gemm_context_t*)_context; \
+	const unsigned char* b = context->b; \
+	int nr = context->kernel->nr, kc = context->kc, ldb = context->ldb, btype = context->btype; \
+	int i, j, j0 = s * CCV_GEMM_NB, j1 = ccv_min(j0 + CCV_GEMM_NB, context->nc); \
+	for (; j0 < j1; j0 += nr) \
+	{ \
+		_type* bp = (_type*)context->bp + (size_t)j0 * kc; \
+		int w = ccv_min(nr, j1 - j0); \
+		if (context->transpose & CCV_B_TRANSPOSE) \
+			for (i = 0; i < kc; i++, bp += nr) \
+			{ \
+				for (j = 0; j < w; j++) \
+					bp[j] = _ccv_gemm_get(_type, btype, b, (size_t)(j0 + j) * ldb + i); \
+				for (; j < nr; j++) \
+					bp[j] = 0; \
+			} \
+		else \
+			for (i = 0; i < kc; i++, bp += nr) \
+			{ \
+				for (j = 0; j < w; j++) \
+					bp[j] = _ccv_gemm_get(_type, btype, b, (size_t)i * ldb + j0 + j); \
+				for (; j < nr; j++) \
+					bp[j] = 0; \
+			} \
+	} \
+} \
+static void _ccv_##_name##_pack_a(size_t s, void* _context) \
+{ \
+	ccv_gemm_context_t* context = (ccv_gemm_context_t*)_context; \
+	const unsigned char* a = context->a; \
+	int mr = context->kernel->mr, kc = context->kc, lda = context->lda, atype = context->atype; \
+	int i, k, ir, i0 = s * CCV_GEMM_MC, i1 = ccv_min(i0 + CCV_GEMM_MC, context->m); \
+	_type* ap = (_type*)context->ap + (size_t)i0 * kc; \
+	/* pack the block of op(A) into mr-tall strips, padded with zeros */ \
+	for (ir = i0; ir < i1; ir += mr) \
+	{ \
+		_type* p = ap + (size_t)(ir - i0) * kc; \
+		int h = ccv_min(mr, i1 - ir); \
+		if (context->transpose & CCV_A_TRANSPOSE) \
+			for (k = 0; k < kc; k++, p += mr) \
+			{ \
+				for (i = 0; i < h; i++) \
+					p[i] = _ccv_gemm_get(_type, atype, a, (size_t)k * lda + ir + i); \
+				for (; i < mr; i++) \
+					p[i] = 0; \
+			} \
+		else \
+			for (k = 0; k < kc; k++, p += mr) \
+			{ \
+				for (i = 0; i < h; i++) \
+					p[i] = _ccv_gemm_get(_type, atype, a, (size_t)(ir + i) * lda + k); \
+				for (; i < mr; i++) \
+					p[i] = 0; \
+			} \
+	} \
+} \
+static void _ccv_##_name##_block(size_t s, void* _context) \
+{ \
+	ccv_gemm_context_t* context = (ccv_gemm_context_t*)_context; \
+	int mr = context->kernel->mr, nr = context->kernel->nr, kc = context->kc, ldc = context->ldc; \
+	int i0 = (s % context->mb) * CCV_GEMM_MC, i1 = ccv_min(i0 + CCV_GEMM_MC, context->m); \
+	int j0 = (s / context->mb) * CCV_GEMM_NB, j1 = ccv_min(j0 + CCV_GEMM_NB, context->nc); \
+	const _type* ap = (const _type*)context->ap + (size_t)i0 * kc; \
+	_type alpha = (_type)context->alpha; \
+	_type ab[CCV_GEMM_MAX_TILE] __attribute__((__aligned__(32))); \
+	int i, j, ir, jr; \
+	for (jr = j0; jr < j1; jr += nr) \
+	{ \
+		const _type* bp = (const _type*)context->bp + (size_t)jr * kc; \
+		int w = ccv_min(nr, j1 - jr); \
+		for (ir = i0; ir < i1; ir += mr) \
+		{ \
+			context->kernel->kernel(kc, ap + (size_t)(ir - i0) * kc, bp, ab); \
+			int h = ccv_min(mr, i1 - ir); \
+			for (i = 0; i < h; i++) \
+			{ \
+				_type* c = (_type*)context->c + (size_t)(ir + i) * ldc + jr; \
+				for (j = 0; j < w; j++) \
+					c[j] += alpha * ab[i * nr + j]; \
+			} \
+		} \
+	} \
+} \
+static void _ccv_##_name(int m, int n, int k, double alpha, const void* a, int atype, int lda, const void* b, int btype, int ldb, double beta, _type* c, int ldc, int transpose) \
+{ \
+	int i, j, ic, jc, pc; \
+	/* C = beta * C first, thus, every panel of k only accumulates */ \
+	if (beta != 1) \
+		for (i = 0; i < m; i++) \
+			for (j = 0; j < n; j++) \
+				c[(size_t)i * ldc + j] = (beta == 0) ? 0 : (_type)beta * c[(size_t)i * ldc + j]; \
+	if (alpha == 0 || k == 0) \
+		return; \
+	ccv_gemm_context_t context; \
+	context.kernel = (sizeof(_type) == sizeof(float) ? ccv_sgemm_kernel : ccv_dgemm_kernel) + ccv_get_simd_level(); \
+	context.lda = lda; \
+	context.ldb = ldb; \
+	context.ldc = ldc; \
+	context.transpose = transpose; \
+	context.atype = atype; \
+	context.btype = btype; \
+	context.alpha = alpha; \
+	int nr = context.kernel->nr; \
+	/* both packing buffers are allocated once, every block task reads its packed op(A) by the block index */ \
+	_type* ap = 0; \
+	ccmemalign((void**)&ap, 64, sizeof(_type) * CCV_GEMM_KC * CCV_GEMM_MC * ccv_min((m + CCV_GEMM_MC - 1) / CCV_GEMM_MC, CCV_GEMM_MB)); \
+	context.ap = (unsigned char*)ap; \
+	_type* bp = 0; \
+	ccmemalign((void**)&bp, 64, sizeof(_type) * CCV_GEMM_KC * ((ccv_min(n, CCV_GEMM_NC) + nr - 1) / nr * nr)); \
+	context.bp = (unsigned char*)bp; \
+	for (jc = 0; jc < n; jc += CCV_GEMM_NC) \
+	{ \
+		context.nc = ccv_min(CCV_GEMM_NC, n - jc); \
+		int nb = (context.nc + CCV_GEMM_NB - 1) / CCV_GEMM_NB; \
+		for (pc = 0; pc < k; pc += CCV_GEMM_KC) \
+		{ \
+			context.kc = ccv_min(CCV_GEMM_KC, k - pc); \
+			context.b = (const unsigned char*)b + ((transpose & CCV_B_TRANSPOSE) ? (size_t)jc * ldb + pc : (size_t)pc * ldb + jc) * CCV_GET_DATA_TYPE_SIZE(btype); \
+			ccv_parallel_for(nb, _ccv_##_name##_pack_b, &context); \
+			for (ic = 0; ic < m; ic += CCV_GEMM_MC * CCV_GEMM_MB) \
+			{ \
+				context.m = ccv_min(CCV_GEMM_MC * CCV_GEMM_MB, m - ic); \
+				context.mb = (context.m + CCV_GEMM_MC - 1) / CCV_GEMM_MC; \
+				context.a = (const unsigned char*)a + ((transpose & CCV_A_TRANSPOSE) ? (size_t)pc * lda + ic : (size_t)ic * lda + pc) * CCV_GET_DATA_TYPE_SIZE(atype); \
+				context.c = (unsigned char*)(c + (size_t)ic * ldc + jc); \
+				ccv_parallel_for(context.mb, _ccv_##_name##_pack_a, &context); \
+				ccv_parallel_for((size_t)context.mb * nb, _ccv_##_name##_block, &context); \
+			} \
+		} \
+	} \
+	ccfree(ap); \
+	ccfree(bp); \
+}
+
+CCV_GEMM_DEFINE(float, sgemm)
+CCV_GEMM_DEFINE(double, dgemm)
+#undef CCV_GEMM_DEFINE
+#endif
+
 void ccv_gemm(ccv_matrix_t* a, 
 			  ccv_matrix_t* b, 
 			  double alpha, 
@@ -338,13 +1425,19 @@ void ccv_gemm(ccv_matrix_t* a,
 	ccv_dense_matrix_t* db = ccv_get_dense_matrix(b);
 	ccv_dense_matrix_t* dc = (c == 0) ? 0 : ccv_get_dense_matrix(c);
 
-	assert(CCV_GET_DATA_TYPE(da->type) == CCV_GET_DATA_TYPE(db->type) && CCV_GET_CHANNEL(da->type) == 1 && CCV_GET_CHANNEL(db->type) == 1 && ((transpose & CCV_A_TRANSPOSE) ? da->rows : da->cols) == ((transpose & CCV_B_TRANSPOSE) ? db->cols : db->rows));
+	// A and B in half precision multiply as float, and they can mix with float
+	int half = (da->type & CCV_HALF_DATA_TYPE) || (db->type & CCV_HALF_DATA_TYPE);
+	if (half)
+		assert((da->type & (CCV_32F | CCV_HALF_DATA_TYPE)) && (db->type & (CCV_32F | CCV_HALF_DATA_TYPE)));
+	else
+		assert(CCV_GET_DATA_TYPE(da->type) == CCV_GET_DATA_TYPE(db->type));
+	assert(CCV_GET_CHANNEL(da->type) == 1 && CCV_GET_CHANNEL(db->type) == 1 && ((transpose & CCV_A_TRANSPOSE) ? da->rows : da->cols) == ((transpose & CCV_B_TRANSPOSE) ? db->cols : db->rows));
+	type = (half ? CCV_32F : CCV_GET_DATA_TYPE(da->type)) | CCV_C1;
 
 	if (dc != 0)
-		assert(CCV_GET_DATA_TYPE(dc->type) == CCV_GET_DATA_TYPE(da->type) && CCV_GET_CHANNEL(dc->type) == 1 && ((transpose & CCV_A_TRANSPOSE) ? da->cols : da->rows) == dc->rows && ((transpose & CCV_B_TRANSPOSE) ? db->rows : db->cols) == dc->cols);
+		assert(CCV_GET_DATA_TYPE(dc->type) == CCV_GET_DATA_TYPE(type) && CCV_GET_CHANNEL(dc->type) == 1 && ((transpose & CCV_A_TRANSPOSE) ? da->cols : da->rows) == dc->rows && ((transpose & CCV_B_TRANSPOSE) ? db->rows : db->cols) == dc->cols);
 
 	ccv_declare_derived_signature_case(sig, ccv_sign_with_format(20, "ccv_gemm(%d)", transpose), ccv_sign_if(dc == 0 && da->sig != 0 && db->sig != 0, da->sig, db->sig, CCV_EOF_SIGN), ccv_sign_if(dc != 0 && da->sig != 0 && db->sig != 0 && dc->sig != 0, da->sig, db->sig, dc->sig, CCV_EOF_SIGN));
-	type = CCV_GET_DATA_TYPE(da->type) | CCV_GET_CHANNEL(da->type);
 	ccv_dense_matrix_t* dd = *d = ccv_dense_matrix_renew(*d, (transpose & CCV_A_TRANSPOSE) ? da->cols : da->rows, (transpose & CCV_B_TRANSPOSE) ? db->rows : db->cols, type, type, sig);
 	ccv_object_return_if_cached(, dd);
 
@@ -354,6 +1447,13 @@ void ccv_gemm(ccv_matrix_t* a,
 		memset(dd->data.u8, 0, dd->step * dd->rows);
 
 #if (defined HAVE_CBLAS || defined HAVE_ACCELERATE_FRAMEWORK)
+	// cblas has no half precision, widen them first
+	ccv_dense_matrix_t* wa = 0;
+	ccv_dense_matrix_t* wb = 0;
+	if (da->type & CCV_HALF_DATA_TYPE)
+		ccv_shift(da, (ccv_matrix_t**)&wa, CCV_32F, 0, 0), da = wa;
+	if (db->type & CCV_HALF_DATA_TYPE)
+		ccv_shift(db, (ccv_matrix_t**)&wb, CCV_32F, 0, 0), db = wb;
 	switch (CCV_GET_DATA_TYPE(dd->type))
 	{
 	case CCV_32F:
@@ -374,7 +1474,20 @@ void ccv_gemm(ccv_matrix_t* a,
 		cblas_dgemm(CblasRowMajor, (transpose & CCV_A_TRANSPOSE) ? CblasTrans : CblasNoTrans, (transpose & CCV_B_TRANSPOSE) ? CblasTrans : CblasNoTrans, dd->rows, dd->cols, (transpose & CCV_A_TRANSPOSE) ? da->rows : da->cols, alpha, da->data.f64, da->cols, db->data.f64, db->cols, beta, dd->data.f64, dd->cols);
 		break;
 	}
+	if (wa)
+		ccv_matrix_free(wa);
+	if (wb)
+		ccv_matrix_free(wb);
 #else
-	assert(0 && "You need a BLAS compatible library for this function, e.g. libatlas.");
+	int k = (transpose & CCV_A_TRANSPOSE) ? da->rows : da->cols;
+	switch (CCV_GET_DATA_TYPE(dd->type))
+	{
+	case CCV_32F:
+		_ccv_sgemm(dd->rows, dd->cols, k, alpha, da->data.u8, CCV_GET_DATA_TYPE(da->type), da->step / CCV_GET_DATA_TYPE_SIZE(da->type), db->data.u8, CCV_GET_DATA_TYPE(db->type), db->step / CCV_GET_DATA_TYPE_SIZE(db->type), beta, dd->data.f32, dd->step / sizeof(float), transpose);
+		break;
+	case CCV_64F:
+		_ccv_dgemm(dd->rows, dd->cols, k, alpha, da->data.u8, CCV_64F, da->step / sizeof(double), db->data.u8, CCV_64F, db->step / sizeof(double), beta, dd->data.f64, dd->step / sizeof(double), transpose);
+		break;
+	}
 #endif
 }
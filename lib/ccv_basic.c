@@ -1,7 +1,7 @@
 #include "ccv.h"
 #include "ccv_internal.h"
 #if defined(HAVE_SSE2)
-#include <xmmintrin.h>
+#include <emmintrin.h>
 #elif defined(HAVE_NEON)
 #include <arm_neon.h>
 #endif
@@ -283,46 +283,58 @@ void ccv_sobel(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, int dx,
 }
 
 /* the fast arctan function adopted from OpenCV */
-static void _ccv_atan2(float* x, float* y, float* angle, float* mag, int len)
+#if defined(HAVE_SSE2) && !defined(_WIN32)
+static inline void _ccv_atan2_ps(__m128 x4, __m128 y4, float* angle, float* mag)
 {
-	int i = 0;
-	float scale = (float)(180.0 / CCV_PI);
-#ifdef HAVE_SSE2
-#ifndef _WIN32
 	union { int i; float fl; } iabsmask; iabsmask.i = 0x7fffffff;
 	__m128 eps = _mm_set1_ps((float)1e-6), absmask = _mm_set1_ps(iabsmask.fl);
 	__m128 _90 = _mm_set1_ps((float)(3.141592654 * 0.5)), _180 = _mm_set1_ps((float)3.141592654), _360 = _mm_set1_ps((float)(3.141592654 * 2));
-	__m128 zero = _mm_setzero_ps(), _0_28 = _mm_set1_ps(0.28f), scale4 = _mm_set1_ps(scale);
-	
-	for(; i <= len - 4; i += 4)
+	__m128 zero = _mm_setzero_ps(), _0_28 = _mm_set1_ps(0.28f), scale4 = _mm_set1_ps((float)(180.0 / CCV_PI));
+	__m128 xq4 = _mm_mul_ps(x4, x4), yq4 = _mm_mul_ps(y4, y4);
+	__m128 xly = _mm_cmplt_ps(xq4, yq4);
+	__m128 z4 = _mm_div_ps(_mm_mul_ps(x4, y4), _mm_add_ps(_mm_add_ps(_mm_max_ps(xq4, yq4), _mm_mul_ps(_mm_min_ps(xq4, yq4), _0_28)), eps));
+
+	// a4 <- x < y ? 90 : 0;
+	__m128 a4 = _mm_and_ps(xly, _90);
+	// a4 <- (y < 0 ? 360 - a4 : a4) == ((x < y ? y < 0 ? 270 : 90) : (y < 0 ? 360 : 0))
+	__m128 mask = _mm_cmplt_ps(y4, zero);
+	a4 = _mm_or_ps(_mm_and_ps(_mm_sub_ps(_360, a4), mask), _mm_andnot_ps(mask, a4));
+	// a4 <- (x < 0 && !(x < y) ? 180 : a4)
+	mask = _mm_andnot_ps(xly, _mm_cmplt_ps(x4, zero));
+	a4 = _mm_or_ps(_mm_and_ps(_180, mask), _mm_andnot_ps(mask, a4));
+
+	// a4 <- (x < y ? a4 - z4 : a4 + z4)
+	a4 = _mm_mul_ps(_mm_add_ps(_mm_xor_ps(z4, _mm_andnot_ps(absmask, xly)), a4), scale4);
+	__m128 m4 = _mm_sqrt_ps(_mm_add_ps(xq4, yq4));
+	_mm_storeu_ps(angle, a4);
+	_mm_storeu_ps(mag, m4);
+}
+#endif
+
+static void _ccv_atan2(float* x, float* y, float* angle, float* mag, int len)
+{
+	int i = 0;
+#if defined(HAVE_SSE2) && !defined(_WIN32)
+	for (; i <= len - 4; i += 4)
+		_ccv_atan2_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i), angle + i, mag + i);
+	if (i < len)
 	{
-		__m128 x4 = _mm_loadu_ps(x + i), y4 = _mm_loadu_ps(y + i);
-		__m128 xq4 = _mm_mul_ps(x4, x4), yq4 = _mm_mul_ps(y4, y4);
-		__m128 xly = _mm_cmplt_ps(xq4, yq4);
-		__m128 z4 = _mm_div_ps(_mm_mul_ps(x4, y4), _mm_add_ps(_mm_add_ps(_mm_max_ps(xq4, yq4), _mm_mul_ps(_mm_min_ps(xq4, yq4), _0_28)), eps));
-
-		// a4 <- x < y ? 90 : 0;
-		__m128 a4 = _mm_and_ps(xly, _90);
-		// a4 <- (y < 0 ? 360 - a4 : a4) == ((x < y ? y < 0 ? 270 : 90) : (y < 0 ? 360 : 0))
-		__m128 mask = _mm_cmplt_ps(y4, zero);
-		a4 = _mm_or_ps(_mm_and_ps(_mm_sub_ps(_360, a4), mask), _mm_andnot_ps(mask, a4));
-		// a4 <- (x < 0 && !(x < y) ? 180 : a4)
-		mask = _mm_andnot_ps(xly, _mm_cmplt_ps(x4, zero));
-		a4 = _mm_or_ps(_mm_and_ps(_180, mask), _mm_andnot_ps(mask, a4));
-		
-		// a4 <- (x < y ? a4 - z4 : a4 + z4)
-		a4 = _mm_mul_ps(_mm_add_ps(_mm_xor_ps(z4, _mm_andnot_ps(absmask, xly)), a4), scale4);
-		__m128 m4 = _mm_sqrt_ps(_mm_add_ps(xq4, yq4));
-		_mm_storeu_ps(angle + i, a4);
-		_mm_storeu_ps(mag + i, m4);
+		// the tail goes through the same approximation, padded to 4
+		float xt[4] = {0}, yt[4] = {0}, at[4], mt[4];
+		memcpy(xt, x + i, sizeof(float) * (len - i));
+		memcpy(yt, y + i, sizeof(float) * (len - i));
+		_ccv_atan2_ps(_mm_loadu_ps(xt), _mm_loadu_ps(yt), at, mt);
+		memcpy(angle + i, at, sizeof(float) * (len - i));
+		memcpy(mag + i, mt, sizeof(float) * (len - i));
+		i = len;
 	}
 #endif
-#endif
-	for(; i < len; i++)
+	float scale = (float)(180.0 / CCV_PI);
+	for (; i < len; i++)
 	{
 		float xf = x[i], yf = y[i];
 		float a, x2 = xf * xf, y2 = yf * yf;
-		if(y2 <= x2)
+		if (y2 <= x2)
 			a = xf * yf / (x2 + 0.28f * y2 + (float)1e-6) + (float)(xf < 0 ? CCV_PI : yf >= 0 ? 0 : CCV_PI * 2);
 		else
 			a = (float)(yf >= 0 ? CCV_PI * 0.5 : CCV_PI * 1.5) - xf * yf / (y2 + 0.28f * x2 + (float)1e-6);
@@ -331,6 +343,64 @@ static void _ccv_atan2(float* x, float* y, float* angle, float* mag, int len)
 	}
 }
 
+/* ccv_gradient with dx = dy = 1 (the one ccv_hog, ccv_icf and ccv_sift take) is fused: a block of the 1x3 / 3x1
+ * derivatives goes into a small buffer on the stack and straight through the arctan, dx and dy are never a matrix.
+ * The derivatives are the same as ccv_sobel's (one sided and doubled at the borders) */
+#define CCV_GRADIENT_ROWS (16)
+#define CCV_GRADIENT_BLOCK (256)
+
+typedef struct {
+	ccv_dense_matrix_t* a;
+	ccv_dense_matrix_t* theta;
+	ccv_dense_matrix_t* m;
+	ccv_dense_matrix_t* bins; // for ccv_gradient_bins, the bin position and the magnitude
+	int nbins;
+} ccv_gradient_context_t;
+
+static void _ccv_gradient_row(ccv_dense_matrix_t* a, int i, float* angle, float* mag)
+{
+	int j, k, ch = CCV_GET_CHANNEL(a->type), w = a->cols * ch;
+	unsigned char* p_ptr = a->data.u8 + ccv_max(i - 1, 0) * a->step;
+	unsigned char* a_ptr = a->data.u8 + i * a->step;
+	unsigned char* n_ptr = a->data.u8 + ccv_min(i + 1, a->rows - 1) * a->step;
+	float sy = (i == 0 || i == a->rows - 1) ? 2 : 1;
+	float dx[CCV_GRADIENT_BLOCK], dy[CCV_GRADIENT_BLOCK];
+	for (j = 0; j < w; j += CCV_GRADIENT_BLOCK)
+	{
+		int n = ccv_min(CCV_GRADIENT_BLOCK, w - j);
+		int k0 = ccv_max(ch - j, 0), k1 = ccv_min(w - ch - j, n);
+#define for_block(_for_type) \
+		{ \
+			_for_type* ap = (_for_type*)a_ptr + j; \
+			_for_type* pp = (_for_type*)p_ptr + j; \
+			_for_type* np = (_for_type*)n_ptr + j; \
+			for (k = 0; k < k0; k++) \
+				dx[k] = (float)(ap[k + ch] - ap[k]) * 2; \
+			for (k = k0; k < k1; k++) \
+				dx[k] = (float)(ap[k + ch] - ap[k - ch]); \
+			for (k = ccv_max(k1, k0); k < n; k++) \
+				dx[k] = (float)(ap[k] - ap[k - ch]) * 2; \
+			for (k = 0; k < n; k++) \
+				dy[k] = (float)(np[k] - pp[k]) * sy; \
+		}
+		if (a->type & CCV_8U)
+			for_block(unsigned char)
+		else
+			for_block(float)
+#undef for_block
+		_ccv_atan2(dx, dy, angle + j, mag + j, n);
+	}
+}
+
+static void _ccv_gradient_rows(size_t s, void* _context)
+{
+	ccv_gradient_context_t* context = (ccv_gradient_context_t*)_context;
+	ccv_dense_matrix_t* a = context->a;
+	int i, i0 = s * CCV_GRADIENT_ROWS, i1 = ccv_min(i0 + CCV_GRADIENT_ROWS, a->rows);
+	for (i = i0; i < i1; i++)
+		_ccv_gradient_row(a, i, (float*)(context->theta->data.u8 + i * context->theta->step), (float*)(context->m->data.u8 + i * context->m->step));
+}
+
 void ccv_gradient(ccv_dense_matrix_t* a, ccv_dense_matrix_t** theta, int ttype, ccv_dense_matrix_t** m, int mtype, int dx, int dy)
 {
 	ccv_declare_derived_signature(tsig, a->sig != 0, ccv_sign_with_format(64, "ccv_gradient(theta,%d,%d)", dx, dy), a->sig, CCV_EOF_SIGN);
@@ -341,6 +411,16 @@ void ccv_gradient(ccv_dense_matrix_t* a, ccv_dense_matrix_t** theta, int ttype,
 	assert(dtheta && dm);
 	ccv_object_return_if_cached(, dtheta, dm);
 	ccv_revive_object_if_cached(dtheta, dm);
+	if (dx == 1 && dy == 1 && (a->type & (CCV_8U | CCV_32F)))
+	{
+		assert(a->rows >= 3 && a->cols >= 3);
+		ccv_gradient_context_t context;
+		context.a = a;
+		context.theta = dtheta;
+		context.m = dm;
+		ccv_parallel_for((a->rows + CCV_GRADIENT_ROWS - 1) / CCV_GRADIENT_ROWS, _ccv_gradient_rows, &context);
+		return;
+	}
 	ccv_dense_matrix_t* tx = 0;
 	ccv_dense_matrix_t* ty = 0;
 	ccv_sobel(a, &tx, CCV_32F | ch, dx, 0);
@@ -350,6 +430,67 @@ void ccv_gradient(ccv_dense_matrix_t* a, ccv_dense_matrix_t** theta, int ttype,
 	ccv_matrix_free(ty);
 }
 
+static void _ccv_gradient_bins_row(const float* angle, const float* mag, int cols, int ch, int nbins, float* b_ptr)
+{
+	int j, k;
+	for (j = 0; j < cols; j++)
+	{
+		// the channel with the largest magnitude (the first one on ties) carries the pixel
+		float agv = angle[j * ch];
+		float mgv = mag[j * ch];
+		for (k = 1; k < ch; k++)
+			if (mag[j * ch + k] > mgv)
+			{
+				mgv = mag[j * ch + k];
+				agv = angle[j * ch + k];
+			}
+		b_ptr[j * 2] = (ccv_clamp(agv, 0, 359.99) / 360.0) * nbins;
+		b_ptr[j * 2 + 1] = mgv;
+	}
+}
+
+static void _ccv_gradient_bins_rows(size_t s, void* _context)
+{
+	ccv_gradient_context_t* context = (ccv_gradient_context_t*)_context;
+	ccv_dense_matrix_t* a = context->a;
+	int i, ch = CCV_GET_CHANNEL(a->type);
+	int i0 = s * CCV_GRADIENT_ROWS, i1 = ccv_min(i0 + CCV_GRADIENT_ROWS, a->rows);
+	float* angle = (float*)ccmalloc(sizeof(float) * a->cols * ch * 2);
+	float* mag = angle + a->cols * ch;
+	for (i = i0; i < i1; i++)
+	{
+		_ccv_gradient_row(a, i, angle, mag);
+		_ccv_gradient_bins_row(angle, mag, a->cols, ch, context->nbins, (float*)(context->bins->data.u8 + i * context->bins->step));
+	}
+	ccfree(angle);
+}
+
+void ccv_gradient_bins(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int nbins)
+{
+	assert(a->rows >= 3 && a->cols >= 3 && nbins > 0);
+	ccv_declare_derived_signature(sig, a->sig != 0, ccv_sign_with_format(64, "ccv_gradient_bins(%d)", nbins), a->sig, CCV_EOF_SIGN);
+	ccv_dense_matrix_t* db = *b = ccv_dense_matrix_renew(*b, a->rows, a->cols, CCV_32F | CCV_C2, CCV_32F | CCV_C2, sig);
+	ccv_object_return_if_cached(, db);
+	if (!(a->type & (CCV_8U | CCV_32F)))
+	{
+		// other types go through the full gradient first
+		ccv_dense_matrix_t* ag = 0;
+		ccv_dense_matrix_t* mg = 0;
+		ccv_gradient(a, &ag, 0, &mg, 0, 1, 1);
+		int i, ch = CCV_GET_CHANNEL(a->type);
+		for (i = 0; i < a->rows; i++)
+			_ccv_gradient_bins_row((float*)(ag->data.u8 + i * ag->step), (float*)(mg->data.u8 + i * mg->step), a->cols, ch, nbins, (float*)(db->data.u8 + i * db->step));
+		ccv_matrix_free(ag);
+		ccv_matrix_free(mg);
+		return;
+	}
+	ccv_gradient_context_t context;
+	context.a = a;
+	context.bins = db;
+	context.nbins = nbins;
+	ccv_parallel_for((a->rows + CCV_GRADIENT_ROWS - 1) / CCV_GRADIENT_ROWS, _ccv_gradient_bins_rows, &context);
+}
+
 static void _ccv_flip_y_self(ccv_dense_matrix_t* a)
 {
 	int i;
@@ -415,16 +556,317 @@ void ccv_flip(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int btype, int type
 		_ccv_flip_x_self(db);
 }
 
-void ccv_blur(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, double sigma)
+/* the FIR filter of ccv_blur runs a row at a time: the horizontal pass filters a copy of the row padded with its
+ * borders, the vertical pass sums whole rows (every column at once) rather than walking down one column at a time.
+ * Both go through the same tap kernel, which sums the taps in order, thus it is bit exact with the scalar code */
+#define CCV_BLUR_ROWS (16)
+
+typedef struct {
+	ccv_dense_matrix_t* a;
+	ccv_dense_matrix_t* db;
+	unsigned char* t; // the result of the horizontal pass, in the type of db
+	int tstep;
+	const void* filter; // int (scaled by 256) for 8U, float for 32F
+	int fsz;
+} ccv_blur_context_t;
+
+static void _ccv_blur_taps_8u(const unsigned char** src, const int* filter, int fsz, unsigned char* out, int w)
 {
-	ccv_declare_derived_signature(sig, a->sig != 0, ccv_sign_with_format(64, "ccv_blur(%la)", sigma), a->sig, CCV_EOF_SIGN);
+	int i = 0, k;
+#ifdef HAVE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= w; i += 8)
+	{
+		__m128i sum0 = _mm_setzero_si128();
+		__m128i sum1 = _mm_setzero_si128();
+		/* two taps at a time, interleaved, so a multiply-add does both of them */
+		for (k = 0; k < fsz; k += 2)
+		{
+			__m128i x0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(src[k] + i)), zero);
+			__m128i x1 = (k + 1 < fsz) ? _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(src[k + 1] + i)), zero) : zero;
+			__m128i f = _mm_set1_epi32((filter[k] & 0xffff) | ((k + 1 < fsz ? filter[k + 1] : 0) << 16));
+			sum0 = _mm_add_epi32(sum0, _mm_madd_epi16(_mm_unpacklo_epi16(x0, x1), f));
+			sum1 = _mm_add_epi32(sum1, _mm_madd_epi16(_mm_unpackhi_epi16(x0, x1), f));
+		}
+		sum0 = _mm_packs_epi32(_mm_srai_epi32(sum0, 8), _mm_srai_epi32(sum1, 8));
+		_mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(sum0, sum0));
+	}
+#endif
+	for (; i < w; i++)
+	{
+		int sum = 0;
+		for (k = 0; k < fsz; k++)
+			sum += src[k][i] * filter[k];
+		out[i] = ccv_clamp(sum >> 8, 0, 255);
+	}
+}
+
+static void _ccv_blur_taps_32f(const float** src, const float* filter, int fsz, float* out, int w)
+{
+	int i = 0, k;
+#ifdef HAVE_SSE2
+	for (; i + 8 <= w; i += 8)
+	{
+		__m128 sum0 = _mm_setzero_ps();
+		__m128 sum1 = _mm_setzero_ps();
+		for (k = 0; k < fsz; k++)
+		{
+			__m128 f = _mm_set1_ps(filter[k]);
+			sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(src[k] + i), f));
+			sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(src[k] + i + 4), f));
+		}
+		_mm_storeu_ps(out + i, sum0);
+		_mm_storeu_ps(out + i + 4, sum1);
+	}
+#endif
+	for (; i < w; i++)
+	{
+		float sum = 0;
+		for (k = 0; k < fsz; k++)
+			sum += src[k][i] * filter[k];
+		out[i] = sum;
+	}
+}
+
+static void _ccv_blur_horizontal(size_t s, void* _context)
+{
+	ccv_blur_context_t* context = (ccv_blur_context_t*)_context;
+	ccv_dense_matrix_t* a = context->a;
+	int i, j, k, ch = CCV_GET_CHANNEL(a->type), fsz = context->fsz, hfz = fsz / 2, w = a->cols * ch;
+	int i0 = s * CCV_BLUR_ROWS, i1 = ccv_min(i0 + CCV_BLUR_ROWS, a->rows);
+	int single = (context->db->type & CCV_8U);
+	const void** src = (const void**)ccmalloc(sizeof(void*) * fsz);
+	unsigned char* buf = (unsigned char*)ccmalloc((single ? sizeof(unsigned char) : sizeof(float)) * (w + hfz * 2 * ch));
+	for (k = 0; k < fsz; k++)
+		src[k] = buf + k * ch * (single ? sizeof(unsigned char) : sizeof(float));
+	for (i = i0; i < i1; i++)
+	{
+		unsigned char* a_ptr = a->data.u8 + i * a->step;
+		unsigned char* t_ptr = context->t + i * context->tstep;
+#define for_block(_for_type, _for_get) \
+		for (j = 0; j < hfz; j++) \
+			for (k = 0; k < ch; k++) \
+			{ \
+				((_for_type*)buf)[j * ch + k] = _for_get(a_ptr, k, 0); \
+				((_for_type*)buf)[(hfz + a->cols + j) * ch + k] = _for_get(a_ptr, w - ch + k, 0); \
+			} \
+		for (j = 0; j < w; j++) \
+			((_for_type*)buf)[hfz * ch + j] = _for_get(a_ptr, j, 0);
+		if (single)
+		{
+			for_block(unsigned char, _ccv_get_8u_value);
+			_ccv_blur_taps_8u((const unsigned char**)src, (const int*)context->filter, fsz, t_ptr, w);
+		} else {
+			ccv_matrix_getter(a->type, for_block, float);
+			_ccv_blur_taps_32f((const float**)src, (const float*)context->filter, fsz, (float*)t_ptr, w);
+		}
+#undef for_block
+	}
+	ccfree(buf);
+	ccfree(src);
+}
+
+static void _ccv_blur_vertical(size_t s, void* _context)
+{
+	ccv_blur_context_t* context = (ccv_blur_context_t*)_context;
+	ccv_dense_matrix_t* db = context->db;
+	int i, k, fsz = context->fsz, hfz = fsz / 2, w = db->cols * CCV_GET_CHANNEL(db->type);
+	int i0 = s * CCV_BLUR_ROWS, i1 = ccv_min(i0 + CCV_BLUR_ROWS, db->rows);
+	const void** src = (const void**)ccmalloc(sizeof(void*) * fsz);
+	for (i = i0; i < i1; i++)
+	{
+		for (k = 0; k < fsz; k++)
+			src[k] = context->t + ccv_clamp(i + k - hfz, 0, db->rows - 1) * context->tstep;
+		if (db->type & CCV_8U)
+			_ccv_blur_taps_8u((const unsigned char**)src, (const int*)context->filter, fsz, db->data.u8 + i * db->step, w);
+		else
+			_ccv_blur_taps_32f((const float**)src, (const float*)context->filter, fsz, (float*)(db->data.u8 + i * db->step), w);
+	}
+	ccfree(src);
+}
+
+/* Young and van Vliet's recursive Gaussian, a causal and an anti-causal 3rd order filter, its cost doesn't depend on
+ * sigma. The borders are replicated, the anti-causal filter starts from the state it would have on an infinitely
+ * replicated border (as Triggs and Sdika do), which is worked out numerically here rather than in closed form */
+typedef struct {
+	double b, a[3];
+	double m[9]; // the initial anti-causal state from the deviation of the last 3 causal outputs to the border value
+} ccv_blur_iir_t;
+
+static void _ccv_blur_iir_coefficients(double sigma, ccv_blur_iir_t* iir)
+{
+	double q = (sigma >= 2.5) ? 0.98711 * sigma - 0.96330 : 3.97156 - 4.14554 * sqrt(1 - 0.26891 * sigma);
+	double b0 = 1.57825 + 2.44413 * q + 1.4281 * q * q + 0.422205 * q * q * q;
+	iir->a[0] = (2.44413 * q + 2.85619 * q * q + 1.26661 * q * q * q) / b0;
+	iir->a[1] = -(1.4281 * q * q + 1.26661 * q * q * q) / b0;
+	iir->a[2] = 0.422205 * q * q * q / b0;
+	iir->b = 1 - (iir->a[0] + iir->a[1] + iir->a[2]);
+	/* run the causal filter past the end on a zero input, long enough for it to die out, and the anti-causal one back */
+	int i, n, len = 64 + (int)(32 * sigma);
+	double* w = (double*)ccmalloc(sizeof(double) * (len + 3) * 2);
+	double* y = w + len + 3;
+	for (i = 0; i < 3; i++)
+	{
+		w[0] = w[1] = w[2] = 0;
+		w[2 - i] = 1;
+		for (n = 3; n < len; n++)
+			w[n] = iir->a[0] * w[n - 1] + iir->a[1] * w[n - 2] + iir->a[2] * w[n - 3];
+		y[len] = y[len + 1] = y[len + 2] = 0;
+		for (n = len - 1; n >= 3; n--)
+			y[n] = iir->b * w[n] + iir->a[0] * y[n + 1] + iir->a[1] * y[n + 2] + iir->a[2] * y[n + 3];
+		iir->m[i] = y[3];
+		iir->m[3 + i] = y[4];
+		iir->m[6 + i] = y[5];
+	}
+	ccfree(w);
+}
+
+/* filters in place n values x[0], x[stride], ... */
+static void _ccv_blur_iir_line(float* x, int n, int stride, const ccv_blur_iir_t* iir)
+{
+	int i;
+	const double b = iir->b, a0 = iir->a[0], a1 = iir->a[1], a2 = iir->a[2];
+	double u = x[(n - 1) * stride]; // the right border, before it is overwritten
+	double w1 = x[0], w2 = w1, w3 = w1;
+	for (i = 0; i < n; i++)
+	{
+		double w0 = b * x[i * stride] + a0 * w1 + a1 * w2 + a2 * w3;
+		x[i * stride] = w0;
+		w3 = w2, w2 = w1, w1 = w0;
+	}
+	double d0 = w1 - u, d1 = w2 - u, d2 = w3 - u;
+	double y1 = u + iir->m[0] * d0 + iir->m[1] * d1 + iir->m[2] * d2;
+	double y2 = u + iir->m[3] * d0 + iir->m[4] * d1 + iir->m[5] * d2;
+	double y3 = u + iir->m[6] * d0 + iir->m[7] * d1 + iir->m[8] * d2;
+	for (i = n - 1; i >= 0; i--)
+	{
+		double y0 = b * x[i * stride] + a0 * y1 + a1 * y2 + a2 * y3;
+		x[i * stride] = y0;
+		y3 = y2, y2 = y1, y1 = y0;
+	}
+}
+
+#define CCV_BLUR_IIR_COLS (64)
+
+typedef struct {
+	ccv_blur_iir_t iir;
+	ccv_dense_matrix_t* a;
+	ccv_dense_matrix_t* db;
+	float* f; // the image in floats, w floats a row
+	int w;
+} ccv_blur_iir_context_t;
+
+static void _ccv_blur_iir_horizontal(size_t s, void* _context)
+{
+	ccv_blur_iir_context_t* context = (ccv_blur_iir_context_t*)_context;
+	ccv_dense_matrix_t* a = context->a;
+	int i, j, ch = CCV_GET_CHANNEL(a->type), w = context->w;
+	int i0 = s * CCV_BLUR_ROWS, i1 = ccv_min(i0 + CCV_BLUR_ROWS, a->rows);
+	for (i = i0; i < i1; i++)
+	{
+		unsigned char* a_ptr = a->data.u8 + i * a->step;
+		float* f = context->f + (size_t)i * w;
+#define for_block(_, _for_get) \
+		for (j = 0; j < w; j++) \
+			f[j] = _for_get(a_ptr, j, 0);
+		ccv_matrix_getter(a->type, for_block);
+#undef for_block
+		for (j = 0; j < ch; j++)
+			_ccv_blur_iir_line(f + j, a->cols, ch, &context->iir);
+	}
+}
+
+/* r = b * r + a0 * p[0] + a1 * p[1] + a2 * p[2] over a tile of columns, it is the same for both directions */
+static void _ccv_blur_iir_row(float* r, const float** p, const ccv_blur_iir_t* iir, int tw)
+{
+	int x = 0;
+	const float b = iir->b, a0 = iir->a[0], a1 = iir->a[1], a2 = iir->a[2];
+#ifdef HAVE_SSE2
+	const __m128 b4 = _mm_set1_ps(b), a04 = _mm_set1_ps(a0), a14 = _mm_set1_ps(a1), a24 = _mm_set1_ps(a2);
+	for (; x + 4 <= tw; x += 4)
+		_mm_storeu_ps(r + x, _mm_add_ps(_mm_add_ps(_mm_mul_ps(b4, _mm_loadu_ps(r + x)), _mm_mul_ps(a04, _mm_loadu_ps(p[0] + x))),
+			_mm_add_ps(_mm_mul_ps(a14, _mm_loadu_ps(p[1] + x)), _mm_mul_ps(a24, _mm_loadu_ps(p[2] + x)))));
+#endif
+	for (; x < tw; x++)
+		r[x] = (b * r[x] + a0 * p[0][x]) + (a1 * p[1][x] + a2 * p[2][x]);
+}
+
+/* the vertical pass goes down and up a tile of columns a row at a time, and writes the tile out */
+static void _ccv_blur_iir_vertical(size_t s, void* _context)
+{
+	ccv_blur_iir_context_t* context = (ccv_blur_iir_context_t*)_context;
+	ccv_dense_matrix_t* db = context->db;
+	const ccv_blur_iir_t* iir = &context->iir;
+	int i, k, x, rows = db->rows, w = context->w;
+	int x0 = s * CCV_BLUR_IIR_COLS, tw = ccv_min(x0 + CCV_BLUR_IIR_COLS, w) - x0;
+	float* f = context->f + x0;
+	float top[CCV_BLUR_IIR_COLS], bottom[CCV_BLUR_IIR_COLS], y[3][CCV_BLUR_IIR_COLS];
+	memcpy(top, f, sizeof(float) * tw);
+	memcpy(bottom, f + (size_t)(rows - 1) * w, sizeof(float) * tw);
+	const float* p[3];
+	for (i = 0; i < rows; i++)
+	{
+		for (k = 0; k < 3; k++)
+			p[k] = (i - 1 - k >= 0) ? f + (size_t)(i - 1 - k) * w : top;
+		_ccv_blur_iir_row(f + (size_t)i * w, p, iir, tw);
+	}
+	for (k = 0; k < 3; k++)
+		p[k] = (rows - 1 - k >= 0) ? f + (size_t)(rows - 1 - k) * w : top;
+	for (x = 0; x < tw; x++)
+	{
+		float u = bottom[x], d0 = p[0][x] - u, d1 = p[1][x] - u, d2 = p[2][x] - u;
+		for (k = 0; k < 3; k++)
+			y[k][x] = u + iir->m[k * 3] * d0 + iir->m[k * 3 + 1] * d1 + iir->m[k * 3 + 2] * d2;
+	}
+	for (i = rows - 1; i >= 0; i--)
+	{
+		for (k = 0; k < 3; k++)
+			p[k] = (i + 1 + k < rows) ? f + (size_t)(i + 1 + k) * w : y[i + 1 + k - rows];
+		_ccv_blur_iir_row(f + (size_t)i * w, p, iir, tw);
+	}
+	/* integer types are rounded */
+	float rnd = (db->type & (CCV_32F | CCV_64F)) ? 0 : 0.5;
+	for (i = 0; i < rows; i++)
+	{
+		unsigned char* b_ptr = db->data.u8 + i * db->step;
+		float* r = f + (size_t)i * w;
+#define for_block(_, _for_set) \
+		for (x = 0; x < tw; x++) \
+			_for_set(b_ptr, x0 + x, r[x] + rnd, 0);
+		ccv_matrix_setter(db->type, for_block);
+#undef for_block
+	}
+}
+
+static void _ccv_blur_recursive(ccv_dense_matrix_t* a, ccv_dense_matrix_t* db, double sigma)
+{
+	ccv_blur_iir_context_t context;
+	_ccv_blur_iir_coefficients(sigma, &context.iir);
+	context.a = a;
+	context.db = db;
+	context.w = a->cols * CCV_GET_CHANNEL(a->type);
+	context.f = (float*)ccmalloc(sizeof(float) * a->rows * context.w);
+	ccv_parallel_for((a->rows + CCV_BLUR_ROWS - 1) / CCV_BLUR_ROWS, _ccv_blur_iir_horizontal, &context);
+	ccv_parallel_for((context.w + CCV_BLUR_IIR_COLS - 1) / CCV_BLUR_IIR_COLS, _ccv_blur_iir_vertical, &context);
+	ccfree(context.f);
+}
+
+void ccv_blur_with_mode(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, double sigma, int mode)
+{
+	assert(mode == CCV_BLUR_GAUSSIAN || mode == CCV_BLUR_RECURSIVE);
+	int recursive = (mode == CCV_BLUR_RECURSIVE) && sigma >= 0.5; // the recursive filter is only fit from 0.5
+	ccv_declare_derived_signature(sig, a->sig != 0, ccv_sign_with_format(64, recursive ? "ccv_blur(%la,%d)" : "ccv_blur(%la)", sigma, mode), a->sig, CCV_EOF_SIGN);
 	type = (type == 0) ? CCV_GET_DATA_TYPE(a->type) | CCV_GET_CHANNEL(a->type) : CCV_GET_DATA_TYPE(type) | CCV_GET_CHANNEL(a->type);
 	ccv_dense_matrix_t* db = *b = ccv_dense_matrix_renew(*b, a->rows, a->cols, CCV_ALL_DATA_TYPE | CCV_GET_CHANNEL(a->type), type, sig);
 	ccv_object_return_if_cached(, db);
+	if (recursive)
+	{
+		_ccv_blur_recursive(a, db, sigma);
+		return;
+	}
 	int fsz = ccv_max(1, (int)(4.0 * sigma + 1.0 - 1e-8)) * 2 + 1;
 	int hfz = fsz / 2;
 	assert(hfz > 0);
-	unsigned char* buf = (unsigned char*)alloca(sizeof(double) * ccv_max(hfz * 2 + a->rows, (hfz * 2 + a->cols) * CCV_GET_CHANNEL(a->type)));
 	unsigned char* filter = (unsigned char*)alloca(sizeof(double) * fsz);
 	double tw = 0;
 	int i, j, k, ch = CCV_GET_CHANNEL(a->type);
@@ -442,6 +884,21 @@ void ccv_blur(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, double si
 		for (i = 0; i < fsz; i++)
 			ccv_set_value(no_8u_type, filter, i, ((double*)filter)[i] * tw, 0);
 	}
+	if (((a->type & CCV_8U) && (db->type & CCV_8U)) || ((a->type & (CCV_8U | CCV_32F)) && (db->type & CCV_32F)))
+	{
+		ccv_blur_context_t context;
+		context.a = a;
+		context.db = db;
+		context.t = (unsigned char*)ccmalloc(db->step * db->rows);
+		context.tstep = db->step;
+		context.filter = filter;
+		context.fsz = fsz;
+		ccv_parallel_for((a->rows + CCV_BLUR_ROWS - 1) / CCV_BLUR_ROWS, _ccv_blur_horizontal, &context);
+		ccv_parallel_for((a->rows + CCV_BLUR_ROWS - 1) / CCV_BLUR_ROWS, _ccv_blur_vertical, &context);
+		ccfree(context.t);
+		return;
+	}
+	unsigned char* buf = (unsigned char*)alloca(sizeof(double) * ccv_max(hfz * 2 + a->rows, (hfz * 2 + a->cols) * CCV_GET_CHANNEL(a->type)));
 	/* horizontal */
 	unsigned char* a_ptr = a->data.u8;
 	unsigned char* b_ptr = db->data.u8;
@@ -495,3 +952,8 @@ void ccv_blur(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, double si
 	ccv_matrix_typeof_setter_getter(no_8u_type, ccv_matrix_setter_getter, db->type, for_block);
 #undef for_block
 }
+
+void ccv_blur(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, double sigma)
+{
+	ccv_blur_with_mode(a, b, type, sigma, CCV_BLUR_GAUSSIAN);
+}
@@ -1188,30 +1188,28 @@ static int _ccv_is_equal_same_class(const void* _r1, const void* _r2, void* data
 		   (int)(r2->rect.width * 1.5 + 0.5) >= r1->rect.width;
 }
 
-ccv_array_t* ccv_bbf_detect_objects(ccv_dense_matrix_t* a, ccv_bbf_classifier_cascade_t** _cascade, int count, ccv_bbf_param_t params)
+ccv_array_t* ccv_bbf_detect_objects_with_pyramid(ccv_pyramid_t* pyramid, ccv_bbf_classifier_cascade_t** _cascade, int count, ccv_bbf_param_t params)
 {
-	int hr = a->rows / params.size.height;
-	int wr = a->cols / params.size.width;
+	assert(pyramid->interval == params.interval);
+	ccv_dense_matrix_t* a = ccv_pyramid_level(pyramid, 0);
+	/* the base is already scaled to the cascade size, hence the same ratio as the source to params.size */
+	int hr = a->rows / _cascade[0]->size.height;
+	int wr = a->cols / _cascade[0]->size.width;
 	double scale = pow(2., 1. / (params.interval + 1.));
 	int next = params.interval + 1;
 	int scale_upto = (int)(log((double)ccv_min(hr, wr)) / log(scale));
+	assert(scale_upto + next * 2 <= pyramid->count);
 	ccv_dense_matrix_t** pyr = (ccv_dense_matrix_t**)alloca((scale_upto + next * 2) * 4 * sizeof(ccv_dense_matrix_t*));
 	memset(pyr, 0, (scale_upto + next * 2) * 4 * sizeof(ccv_dense_matrix_t*));
-	if (params.size.height != _cascade[0]->size.height || params.size.width != _cascade[0]->size.width)
-		ccv_resample(a, &pyr[0], 0, a->rows * _cascade[0]->size.height / params.size.height, a->cols * _cascade[0]->size.width / params.size.width, CCV_INTER_AREA);
-	else
-		pyr[0] = a;
 	int i, j, k, t, x, y, q;
-	for (i = 1; i < ccv_min(params.interval + 1, scale_upto + next * 2); i++)
-		ccv_resample(pyr[0], &pyr[i * 4], 0, (int)(pyr[0]->rows / pow(scale, i)), (int)(pyr[0]->cols / pow(scale, i)), CCV_INTER_AREA);
-	for (i = next; i < scale_upto + next * 2; i++)
-		ccv_sample_down(pyr[i * 4 - next * 4], &pyr[i * 4], 0, 0, 0);
+	for (i = 0; i < scale_upto + next * 2; i++)
+		pyr[i * 4] = ccv_pyramid_level(pyramid, i);
 	if (params.accurate)
 		for (i = next * 2; i < scale_upto + next * 2; i++)
 		{
-			ccv_sample_down(pyr[i * 4 - next * 4], &pyr[i * 4 + 1], 0, 1, 0);
-			ccv_sample_down(pyr[i * 4 - next * 4], &pyr[i * 4 + 2], 0, 0, 1);
-			ccv_sample_down(pyr[i * 4 - next * 4], &pyr[i * 4 + 3], 0, 1, 1);
+			pyr[i * 4 + 1] = ccv_pyramid_level_with_offset(pyramid, i, 1, 0);
+			pyr[i * 4 + 2] = ccv_pyramid_level_with_offset(pyramid, i, 0, 1);
+			pyr[i * 4 + 3] = ccv_pyramid_level_with_offset(pyramid, i, 1, 1);
 		}
 	ccv_array_t* idx_seq;
 	ccv_array_t* seq = ccv_array_new(sizeof(ccv_comp_t), 64, 0);
@@ -1290,8 +1288,9 @@ ccv_array_t* ccv_bbf_detect_objects(ccv_dense_matrix_t* a, ccv_bbf_classifier_ca
 		} else {
 			idx_seq = 0;
 			ccv_array_clear(seq2);
+			float distance = 0.25; // the distance factor of _ccv_is_equal
 			// group retrieved rectangles in order to filter out noise
-			int ncomp = ccv_array_group(seq, &idx_seq, _ccv_is_equal_same_class, 0);
+			int ncomp = ccv_array_group_rect(seq, &idx_seq, _ccv_is_equal_same_class, ccv_comp_extent, &distance);
 			ccv_comp_t* comps = (ccv_comp_t*)ccmalloc((ncomp + 1) * sizeof(ccv_comp_t));
 			memset(comps, 0, (ncomp + 1) * sizeof(ccv_comp_t));
 
@@ -1373,8 +1372,9 @@ ccv_array_t* ccv_bbf_detect_objects(ccv_dense_matrix_t* a, ccv_bbf_classifier_ca
 	{
 		result_seq2 = ccv_array_new(sizeof(ccv_comp_t), 64, 0);
 		idx_seq = 0;
+		float distance = 0.25; // the distance factor of _ccv_is_equal
 		// group retrieved rectangles in order to filter out noise
-		int ncomp = ccv_array_group(result_seq, &idx_seq, _ccv_is_equal, 0);
+		int ncomp = ccv_array_group_rect(result_seq, &idx_seq, _ccv_is_equal, ccv_comp_extent, &distance);
 		ccv_comp_t* comps = (ccv_comp_t*)ccmalloc((ncomp + 1) * sizeof(ccv_comp_t));
 		memset(comps, 0, (ncomp + 1) * sizeof(ccv_comp_t));
 
@@ -1405,21 +1405,22 @@ ccv_array_t* ccv_bbf_detect_objects(ccv_dense_matrix_t* a, ccv_bbf_classifier_ca
 		result_seq2 = result_seq;
 	}
 
-	for (i = 1; i < scale_upto + next * 2; i++)
-		ccv_matrix_free(pyr[i * 4]);
-	if (params.accurate)
-		for (i = next * 2; i < scale_upto + next * 2; i++)
-		{
-			ccv_matrix_free(pyr[i * 4 + 1]);
-			ccv_matrix_free(pyr[i * 4 + 2]);
-			ccv_matrix_free(pyr[i * 4 + 3]);
-		}
-	if (params.size.height != _cascade[0]->size.height || params.size.width != _cascade[0]->size.width)
-		ccv_matrix_free(pyr[0]);
-
 	return result_seq2;
 }
 
+ccv_array_t* ccv_bbf_detect_objects(ccv_dense_matrix_t* a, ccv_bbf_classifier_cascade_t** _cascade, int count, ccv_bbf_param_t params)
+{
+	ccv_dense_matrix_t* resized = 0;
+	if (params.size.height != _cascade[0]->size.height || params.size.width != _cascade[0]->size.width)
+		ccv_resample(a, &resized, 0, a->rows * _cascade[0]->size.height / params.size.height, a->cols * _cascade[0]->size.width / params.size.width, CCV_INTER_AREA);
+	ccv_pyramid_t* pyramid = ccv_pyramid_new(resized ? resized : a, params.interval);
+	ccv_array_t* result_seq = ccv_bbf_detect_objects_with_pyramid(pyramid, _cascade, count, params);
+	ccv_pyramid_free(pyramid);
+	if (resized)
+		ccv_matrix_free(resized);
+	return result_seq;
+}
+
 ccv_bbf_classifier_cascade_t* ccv_bbf_read_classifier_cascade(const char* directory)
 {
 	char buf[1024];
@@ -6,23 +6,6 @@
 #define CCV_GET_TERMINAL_SIZE(x) ((x) & 0xFFFFFFFF)
 #define CCV_SET_TERMINAL_TYPE(x, y, z) (((uint64_t)(x) << 60) | ((uint64_t)(y) << 32) | (z))
 
-void ccv_cache_init(ccv_cache_t* cache, size_t up, int cache_types, ccv_cache_index_free_f ffree, ...)
-{
-	cache->rnum = 0;
-	cache->age = 0;
-	cache->up = up;
-	cache->size = 0;
-	assert(cache_types > 0 && cache_types <= 16);
-	va_list arguments;
-	va_start(arguments, ffree);
-	int i;
-	cache->ffree[0] = ffree;
-	for (i = 1; i < cache_types; i++)
-		cache->ffree[i] = va_arg(arguments, ccv_cache_index_free_f);
-	va_end(arguments);
-	memset(&cache->origin, 0, sizeof(ccv_cache_index_t));
-}
-
 static int bits_in_16bits[0x1u << 16];
 static int bits_in_16bits_init = 0;
 
@@ -47,65 +30,64 @@ static void precomputed_16bits() {
 	bits_in_16bits_init = 1;
 }
 
+void ccv_cache_init(ccv_cache_t* cache, size_t up, int cache_types, ccv_cache_index_free_f ffree, ...)
+{
+	cache->rnum = 0;
+	cache->age = 0;
+	cache->up = up;
+	cache->low = up;
+	cache->size = 0;
+	cache->lru = cache->mru = 0;
+	cache->fevict = 0;
+	memset(cache->stats, 0, sizeof(cache->stats));
+	// initialize the bit count table here rather than lazily, thus, caches can be used from different threads
+	if (!bits_in_16bits_init)
+		precomputed_16bits();
+	assert(cache_types > 0 && cache_types <= 16);
+	va_list arguments;
+	va_start(arguments, ffree);
+	int i;
+	cache->ffree[0] = ffree;
+	for (i = 1; i < cache_types; i++)
+		cache->ffree[i] = va_arg(arguments, ccv_cache_index_free_f);
+	va_end(arguments);
+	memset(&cache->origin, 0, sizeof(ccv_cache_index_t));
+}
+
 static uint32_t compute_bits(uint64_t m) {
 	return (bits_in_16bits[m & 0xffff] + bits_in_16bits[(m >> 16) & 0xffff] +
 			bits_in_16bits[(m >> 32) & 0xffff] + bits_in_16bits[(m >> 48) & 0xffff]);
 }
 
-/* update age along a path in the radix tree */
-static void _ccv_cache_aging(ccv_cache_index_t* branch, uint64_t sign)
+#define CCV_GET_TERMINAL_NODE(x) ((ccv_cache_node_t*)((x).terminal.off - ((x).terminal.off & 0x3)))
+
+/* the recency list is an intrusive doubly-linked list, the least recently used one is at the head */
+static ccv_cache_node_t* _ccv_cache_node_new(ccv_cache_t* cache, uint64_t sign, void* x)
 {
-	if (!bits_in_16bits_init)
-		precomputed_16bits();
-	int i;
-	uint64_t j = 63;
-	ccv_cache_index_t* breadcrumb[10];
-	for (i = 0; i < 10; i++)
-	{
-		breadcrumb[i] = branch;
-		int leaf = branch->terminal.off & 0x1;
-		int full = branch->terminal.off & 0x2;
-		if (leaf)
-		{
-			break;
-		} else {
-			ccv_cache_index_t* set = (ccv_cache_index_t*)(branch->branch.set - (branch->branch.set & 0x3));
-			int dice = (sign & j) >> (i * 6);
-			if (full)
-			{
-				branch = set + dice;
-			} else {
-				uint64_t k = 1;
-				k = k << dice;
-				if (k & branch->branch.bitmap) {
-					uint64_t m = (k - 1) & branch->branch.bitmap;
-					branch = set + compute_bits(m);
-				} else {
-					break;
-				}
-			}
-			j <<= 6;
-		}
-	}
-	assert(i < 10);
-	for (; i >= 0; i--)
-	{
-		branch = breadcrumb[i];
-		int leaf = branch->terminal.off & 0x1;
-		if (!leaf)
-		{
-			ccv_cache_index_t* set = (ccv_cache_index_t*)(branch->branch.set - (branch->branch.set & 0x3));
-			uint32_t total = compute_bits(branch->branch.bitmap);
-			uint32_t min_age = (set[0].terminal.off & 0x1) ? CCV_GET_TERMINAL_AGE(set[0].terminal.type) : set[0].branch.age;
-			for (j = 1; j < total; j++)
-			{
-				uint32_t age = (set[j].terminal.off & 0x1) ? CCV_GET_TERMINAL_AGE(set[j].terminal.type) : set[j].branch.age;
-				if (age < min_age)
-					min_age = age;
-			}
-			branch->branch.age = min_age;
-		}
-	}
+	ccv_cache_node_t* node = (ccv_cache_node_t*)ccmalloc(sizeof(ccv_cache_node_t));
+	assert(((uint64_t)node & 0x3) == 0);
+	node->sign = sign;
+	node->object = x;
+	node->prev = cache->mru;
+	node->next = 0;
+	if (cache->mru)
+		cache->mru->next = node;
+	else
+		cache->lru = node;
+	cache->mru = node;
+	return node;
+}
+
+static void _ccv_cache_node_unlink(ccv_cache_t* cache, ccv_cache_node_t* node)
+{
+	if (node->prev)
+		node->prev->next = node->next;
+	else
+		cache->lru = node->next;
+	if (node->next)
+		node->next->prev = node->prev;
+	else
+		cache->mru = node->prev;
 }
 
 static ccv_cache_index_t* _ccv_cache_seek(ccv_cache_index_t* branch, uint64_t sign, int* depth)
@@ -161,60 +143,41 @@ void* ccv_cache_get(ccv_cache_t* cache, uint64_t sign, uint8_t* type)
 		return 0;
 	if (type)
 		*type = CCV_GET_CACHE_TYPE(branch->terminal.type);
-	return (void*)(branch->terminal.off - (branch->terminal.off & 0x3));
+	++cache->stats[CCV_GET_CACHE_TYPE(branch->terminal.type)].hit;
+	return CCV_GET_TERMINAL_NODE(*branch)->object;
 }
 
-// only call this function when the cache space is delpeted
-static void _ccv_cache_lru(ccv_cache_t* cache)
+static void* _ccv_cache_out(ccv_cache_t* cache, uint64_t sign, uint8_t* type);
+
+// evict from the least recently used end until the cache size is no more than the given size
+static int _ccv_cache_depleted(ccv_cache_t* cache, size_t size)
 {
-	ccv_cache_index_t* branch = &cache->origin;
-	int leaf = branch->terminal.off & 0x1;
-	if (leaf)
+	int evicted = 0;
+	while (cache->size > size && cache->lru)
 	{
-		void* result = (void*)(branch->terminal.off - (branch->terminal.off & 0x3));
-		uint8_t type = CCV_GET_CACHE_TYPE(branch->terminal.type);
-		if (result != 0)
-		{
-			assert(type >= 0 && type < 16);
+		uint8_t type = 0;
+		uint64_t sign = cache->lru->sign;
+		void* result = _ccv_cache_out(cache, sign, &type);
+		assert(result && type < 16);
+		if (cache->fevict)
+			cache->fevict(sign, result, type);
+		else
 			cache->ffree[type](result);
-		}
-		cache->rnum = 0;
-		cache->size = 0;
-		return;
-	}
-	uint32_t min_age = branch->branch.age;
-	int i, j;
-	for (i = 0; i < 10; i++)
-	{
-		ccv_cache_index_t* old_branch = branch;
-		int leaf = branch->terminal.off & 0x1;
-		if (leaf)
-		{
-			ccv_cache_delete(cache, branch->terminal.sign);
-			break;
-		} else {
-			ccv_cache_index_t* set = (ccv_cache_index_t*)(branch->branch.set - (branch->branch.set & 0x3));
-			uint32_t total = compute_bits(branch->branch.bitmap);
-			for (j = 0; j < total; j++)
-			{
-				uint32_t age = (set[j].terminal.off & 0x1) ? CCV_GET_TERMINAL_AGE(set[j].terminal.type) : set[j].branch.age;
-				assert(age >= min_age);
-				if (age == min_age)
-				{
-					branch = set + j;
-					break;
-				}
-			}
-			assert(old_branch != branch);
-		}
+		++cache->stats[type].evict;
+		++evicted;
 	}
-	assert(i < 10);
+	return evicted;
 }
 
-static void _ccv_cache_depleted(ccv_cache_t* cache, size_t size)
+int ccv_cache_evict(ccv_cache_t* cache, size_t size)
 {
-	while (cache->size > size)
-		_ccv_cache_lru(cache);
+	return _ccv_cache_depleted(cache, cache->up > size ? cache->up - size : 0);
+}
+
+void ccv_cache_set_watermark(ccv_cache_t* cache, size_t low)
+{
+	assert(low <= cache->up);
+	cache->low = low;
 }
 
 int ccv_cache_put(ccv_cache_t* cache, uint64_t sign, void* x, uint32_t size, uint8_t type)
@@ -223,15 +186,24 @@ int ccv_cache_put(ccv_cache_t* cache, uint64_t sign, void* x, uint32_t size, uin
 	if (size > cache->up)
 		return -1;
 	if (size + cache->size > cache->up)
-		_ccv_cache_depleted(cache, cache->up - size);
+	{
+		// replacing an object only needs space for the difference
+		ccv_cache_index_t* branch = (cache->rnum > 0) ? _ccv_cache_seek(&cache->origin, sign, 0) : 0;
+		uint32_t old_size = (branch && (branch->terminal.off & 0x1) && branch->terminal.sign == sign) ? CCV_GET_TERMINAL_SIZE(branch->terminal.type) : 0;
+		if (size + cache->size - old_size > cache->up)
+			_ccv_cache_depleted(cache, cache->low > size ? cache->low - size : 0);
+	}
 	if (cache->rnum == 0)
 	{
 		cache->age = 1;
-		cache->origin.terminal.off = (uint64_t)x | 0x1;
+		cache->origin.terminal.off = (uint64_t)_ccv_cache_node_new(cache, sign, x) | 0x1;
 		cache->origin.terminal.sign = sign;
 		cache->origin.terminal.type = CCV_SET_TERMINAL_TYPE(type, cache->age, size);
 		cache->size = size;
 		cache->rnum = 1;
+		++cache->stats[type].put;
+		cache->stats[type].rnum = 1;
+		cache->stats[type].size = size;
 		return 0;
 	}
 	++cache->age;
@@ -246,12 +218,27 @@ int ccv_cache_put(ccv_cache_t* cache, uint64_t sign, void* x, uint32_t size, uin
 	{
 		if (sign == branch->terminal.sign)
 		{
-			cache->ffree[CCV_GET_CACHE_TYPE(branch->terminal.type)]((void*)(branch->terminal.off - (branch->terminal.off & 0x3)));
-			branch->terminal.off = (uint64_t)x | 0x1;
+			ccv_cache_node_t* node = CCV_GET_TERMINAL_NODE(*branch);
+			cache->ffree[CCV_GET_CACHE_TYPE(branch->terminal.type)](node->object);
+			node->object = x;
+			// move it to the most recently used end
+			if (node != cache->mru)
+			{
+				_ccv_cache_node_unlink(cache, node);
+				node->prev = cache->mru;
+				node->next = 0;
+				cache->mru->next = node;
+				cache->mru = node;
+			}
 			uint32_t old_size = CCV_GET_TERMINAL_SIZE(branch->terminal.type);
 			cache->size = cache->size + size - old_size;
+			ccv_cache_stats_t* old_stats = cache->stats + CCV_GET_CACHE_TYPE(branch->terminal.type);
+			--old_stats->rnum;
+			old_stats->size -= old_size;
+			++cache->stats[type].put;
+			++cache->stats[type].rnum;
+			cache->stats[type].size += size;
 			branch->terminal.type = CCV_SET_TERMINAL_TYPE(type, cache->age, size);
-			_ccv_cache_aging(&cache->origin, sign);
 			return 1;
 		} else {
 			ccv_cache_index_t t = *branch;
@@ -284,7 +271,7 @@ int ccv_cache_put(ccv_cache_t* cache, uint64_t sign, void* x, uint32_t size, uin
 			branch->branch.age = age;
 			int u = dice < udice;
 			set[u].terminal.sign = sign;
-			set[u].terminal.off = (uint64_t)x | 0x1;
+			set[u].terminal.off = (uint64_t)_ccv_cache_node_new(cache, sign, x) | 0x1;
 			set[u].terminal.type = CCV_SET_TERMINAL_TYPE(type, cache->age, size);
 			set[1 - u] = t;
 		}
@@ -299,7 +286,7 @@ int ccv_cache_put(ccv_cache_t* cache, uint64_t sign, void* x, uint32_t size, uin
 		assert(((uint64_t)set & 0x3) == 0);
 		for (i = total; i > start; i--)
 			set[i] = set[i - 1];
-		set[start].terminal.off = (uint64_t)x | 0x1;
+		set[start].terminal.off = (uint64_t)_ccv_cache_node_new(cache, sign, x) | 0x1;
 		set[start].terminal.sign = sign;
 		set[start].terminal.type = CCV_SET_TERMINAL_TYPE(type, cache->age, size);
 		branch->branch.set = (uint64_t)set;
@@ -309,6 +296,9 @@ int ccv_cache_put(ccv_cache_t* cache, uint64_t sign, void* x, uint32_t size, uin
 	}
 	cache->rnum++;
 	cache->size += size;
+	++cache->stats[type].put;
+	++cache->stats[type].rnum;
+	cache->stats[type].size += size;
 	return 0;
 }
 
@@ -342,11 +332,13 @@ static void _ccv_cache_cleanup_and_free(ccv_cache_index_t* branch, ccv_cache_ind
 		ccfree(set);
 	} else {
 		assert(CCV_GET_CACHE_TYPE(branch->terminal.type) >= 0 && CCV_GET_CACHE_TYPE(branch->terminal.type) < 16);
-		ffree[CCV_GET_CACHE_TYPE(branch->terminal.type)]((void*)(branch->terminal.off - (branch->terminal.off & 0x3)));
+		ccv_cache_node_t* node = CCV_GET_TERMINAL_NODE(*branch);
+		ffree[CCV_GET_CACHE_TYPE(branch->terminal.type)](node->object);
+		ccfree(node);
 	}
 }
 
-void* ccv_cache_out(ccv_cache_t* cache, uint64_t sign, uint8_t* type)
+static void* _ccv_cache_out(ccv_cache_t* cache, uint64_t sign, uint8_t* type)
 {
 	if (!bits_in_16bits_init)
 		precomputed_16bits();
@@ -395,10 +387,14 @@ void* ccv_cache_out(ccv_cache_t* cache, uint64_t sign, uint8_t* type)
 		return 0;
 	if (branch->terminal.sign != sign)
 		return 0;
-	void* result = (void*)(branch->terminal.off - (branch->terminal.off & 0x3));
+	ccv_cache_node_t* node = CCV_GET_TERMINAL_NODE(*branch);
+	void* result = node->object;
+	_ccv_cache_node_unlink(cache, node);
+	ccfree(node);
 	if (type)
 		*type = CCV_GET_CACHE_TYPE(branch->terminal.type);
 	uint32_t size = CCV_GET_TERMINAL_SIZE(branch->terminal.type);
+	ccv_cache_stats_t* stats = cache->stats + CCV_GET_CACHE_TYPE(branch->terminal.type); // branch will be moved
 	if (branch != &cache->origin)
 	{
 		uint64_t k = 1, j = 63;
@@ -421,20 +417,32 @@ void* ccv_cache_out(ccv_cache_t* cache, uint64_t sign, uint8_t* type)
 			_ccv_cache_cleanup(uncle);
 			*uncle = t;
 		}
-		_ccv_cache_aging(&cache->origin, sign);
 	} else {
 		// if I only have one item, reset age to 1
 		cache->age = 1;
 	}
 	cache->rnum--;
 	cache->size -= size;
+	--stats->rnum;
+	stats->size -= size;
+	return result;
+}
+
+void* ccv_cache_out(ccv_cache_t* cache, uint64_t sign, uint8_t* type)
+{
+	uint8_t t = 0;
+	void* result = _ccv_cache_out(cache, sign, &t);
+	if (result)
+		++cache->stats[t].hit;
+	if (type)
+		*type = t;
 	return result;
 }
 
 int ccv_cache_delete(ccv_cache_t* cache, uint64_t sign)
 {
 	uint8_t type = 0;
-	void* result = ccv_cache_out(cache, sign, &type);
+	void* result = _ccv_cache_out(cache, sign, &type);
 	if (result != 0)
 	{
 		assert(type >= 0 && type < 16);
@@ -452,6 +460,10 @@ void ccv_cache_cleanup(ccv_cache_t* cache)
 		cache->size = 0;
 		cache->age = 0;
 		cache->rnum = 0;
+		cache->lru = cache->mru = 0;
+		int i;
+		for (i = 0; i < 16; i++)
+			cache->stats[i].rnum = cache->stats[i].size = 0;
 		memset(&cache->origin, 0, sizeof(ccv_cache_index_t));
 	}
 }
@@ -2,6 +2,9 @@
 #include "ccv_internal.h"
 #if defined(HAVE_SSE2)
 #include <xmmintrin.h>
+#if defined(CCV_SIMD_X86)
+#include <immintrin.h>
+#endif
 #elif defined(HAVE_NEON)
 #include <arm_neon.h>
 #endif
@@ -252,241 +255,304 @@ static void _ccv_convnet_layer_simd_alloc_reserved(ccv_convnet_layer_t* layer)
 
 #define SIMD(x) ((float*)((x)->reserved))
 
+/* the convolutional forward propagation runs a block per 4 output channels (1 without SIMD) through ccv_parallel_for */
+typedef struct {
+	ccv_convnet_layer_t* layer;
+	ccv_dense_matrix_t* a;
+	ccv_dense_matrix_t* db;
+	int ch;
+	int count;
+	int strides;
+	int border;
+	int kernel_rows;
+	int kernel_cols;
+	int ch_per_partition;
+	int count_per_partition;
+} ccv_convnet_convolutional_context_t;
+
+#define ccv_convnet_convolutional_context_unpack(_context) \
+	ccv_convnet_convolutional_context_t* context = (ccv_convnet_convolutional_context_t*)(_context); \
+	ccv_convnet_layer_t* layer = context->layer; \
+	ccv_dense_matrix_t* a = context->a; \
+	ccv_dense_matrix_t* db = context->db; \
+	int ch = context->ch; \
+	int count = context->count; \
+	int strides = context->strides; \
+	int border = context->border; \
+	int kernel_rows = context->kernel_rows; \
+	int kernel_cols = context->kernel_cols; \
+	int ch_per_partition = context->ch_per_partition; \
+	int count_per_partition = context->count_per_partition
+
 #if defined(HAVE_SSE2)
-static inline void _ccv_convnet_convolutional_forward_propagate_sse2(ccv_convnet_layer_t* layer, ccv_dense_matrix_t* a, ccv_dense_matrix_t* db, int rows, int cols, int ch, int count, int strides, int border, int kernel_rows, int kernel_cols, int ch_per_partition, int count_per_partition)
-{
-	assert(SIMD(layer));
-#define main_for(block) \
-	parallel_for(k, (count >> 2)) { \
-		int i, j, x, y, c; \
-		int p = k * 4 / count_per_partition; \
-		float* ap = a->data.f32 + p * ch_per_partition; \
-		float* bp = db->data.f32 + k * 4; \
-		float* layer_w = SIMD(layer) + k * 4 * kernel_rows * kernel_cols * ch_per_partition; \
-		float bias[4] __attribute__ ((__aligned__(16))); \
-		memcpy(bias, layer->bias + k * 4, sizeof(float) * 4); \
-		/* 4 accumulators */ \
-		__m128 z4 = _mm_setzero_ps(); \
-		for (i = 0; i < db->rows; i++) \
+#define main_for(_func, _madd, block) \
+static void _func(size_t _k, void* _context) \
+{ \
+	ccv_convnet_convolutional_context_unpack(_context); \
+	int k = (int)_k; \
+	int i, j, x, y, c; \
+	int p = k * 4 / count_per_partition; \
+	float* ap = a->data.f32 + p * ch_per_partition; \
+	float* bp = db->data.f32 + k * 4; \
+	float* layer_w = SIMD(layer) + k * 4 * kernel_rows * kernel_cols * ch_per_partition; \
+	float bias[4] __attribute__ ((__aligned__(16))); \
+	memcpy(bias, layer->bias + k * 4, sizeof(float) * 4); \
+	/* 4 accumulators */ \
+	__m128 z4 = _mm_setzero_ps(); \
+	for (i = 0; i < db->rows; i++) \
+	{ \
+		int comy = ccv_max(i * strides - border, 0) - (i * strides - border); \
+		int maxy = kernel_rows - comy - (i * strides + kernel_rows - ccv_min(a->rows + border, i * strides + kernel_rows)); \
+		comy *= ch_per_partition * kernel_cols; \
+		for (j = 0; j < db->cols; j++) \
 		{ \
-			int comy = ccv_max(i * strides - border, 0) - (i * strides - border); \
-			int maxy = kernel_rows - comy - (i * strides + kernel_rows - ccv_min(a->rows + border, i * strides + kernel_rows)); \
-			comy *= ch_per_partition * kernel_cols; \
-			for (j = 0; j < db->cols; j++) \
+			__m128 v40 = _mm_load_ps(bias); \
+			__m128 v41 = _mm_setzero_ps(); \
+			__m128 v42 = _mm_setzero_ps(); \
+			__m128 v43 = _mm_setzero_ps(); \
+			int comx = ccv_max(j * strides - border, 0) - (j * strides - border); \
+			int maxx = kernel_cols - comx - (j * strides + kernel_cols - ccv_min(a->cols + border, j * strides + kernel_cols)); \
+			float* w = layer_w + (comx * ch_per_partition + comy) * 4; \
+			float* apz = ap + ccv_max(j * strides - border, 0) * ch; \
+			/* when we have border, we simply do zero padding */ \
+			for (y = 0; y < maxy; y++) \
 			{ \
-				__m128 v40 = _mm_load_ps(bias); \
-				__m128 v41 = _mm_setzero_ps(); \
-				__m128 v42 = _mm_setzero_ps(); \
-				__m128 v43 = _mm_setzero_ps(); \
-				int comx = ccv_max(j * strides - border, 0) - (j * strides - border); \
-				int maxx = kernel_cols - comx - (j * strides + kernel_cols - ccv_min(a->cols + border, j * strides + kernel_cols)); \
-				float* w = layer_w + (comx * ch_per_partition + comy) * 4; \
-				float* apz = ap + ccv_max(j * strides - border, 0) * ch; \
-				/* when we have border, we simply do zero padding */ \
-				for (y = 0; y < maxy; y++) \
+				/* special casing for these cases to speed up SIMD computation */ \
+				for (x = 0; x < maxx; x++) \
 				{ \
-					/* special casing for these cases to speed up SIMD computation */ \
-					for (x = 0; x < maxx; x++) \
+					c = 0; \
+					for (; c < ch_per_partition - 3; c += 4) \
 					{ \
-						c = 0; \
-						for (; c < ch_per_partition - 3; c += 4) \
-						{ \
-							__m128 apz4 = _mm_loadu_ps(apz + x * ch + c); \
-							__m128 w40 = _mm_loadu_ps(w + (x * ch_per_partition + c) * 4); \
-							__m128 w41 = _mm_loadu_ps(w + (x * ch_per_partition + c + 1) * 4); \
-							__m128 w42 = _mm_loadu_ps(w + (x * ch_per_partition + c + 2) * 4); \
-							__m128 w43 = _mm_loadu_ps(w + (x * ch_per_partition + c + 3) * 4); \
-							__m128 apz40 = _mm_shuffle_ps(apz4, apz4, 0x00); \
-							__m128 apz41 = _mm_shuffle_ps(apz4, apz4, 0x55); \
-							__m128 apz42 = _mm_shuffle_ps(apz4, apz4, 0xAA); \
-							__m128 apz43 = _mm_shuffle_ps(apz4, apz4, 0xFF); \
-							v40 =_mm_add_ps(_mm_mul_ps(w40, apz40), v40); \
-							v41 =_mm_add_ps(_mm_mul_ps(w41, apz41), v41); \
-							v42 =_mm_add_ps(_mm_mul_ps(w42, apz42), v42); \
-							v43 =_mm_add_ps(_mm_mul_ps(w43, apz43), v43); \
-						} \
-						block /* insert executions for tail partition */ \
+						__m128 apz4 = _mm_loadu_ps(apz + x * ch + c); \
+						__m128 w40 = _mm_loadu_ps(w + (x * ch_per_partition + c) * 4); \
+						__m128 w41 = _mm_loadu_ps(w + (x * ch_per_partition + c + 1) * 4); \
+						__m128 w42 = _mm_loadu_ps(w + (x * ch_per_partition + c + 2) * 4); \
+						__m128 w43 = _mm_loadu_ps(w + (x * ch_per_partition + c + 3) * 4); \
+						__m128 apz40 = _mm_shuffle_ps(apz4, apz4, 0x00); \
+						__m128 apz41 = _mm_shuffle_ps(apz4, apz4, 0x55); \
+						__m128 apz42 = _mm_shuffle_ps(apz4, apz4, 0xAA); \
+						__m128 apz43 = _mm_shuffle_ps(apz4, apz4, 0xFF); \
+						v40 = _madd(w40, apz40, v40); \
+						v41 = _madd(w41, apz41, v41); \
+						v42 = _madd(w42, apz42, v42); \
+						v43 = _madd(w43, apz43, v43); \
 					} \
-					w += kernel_cols * ch_per_partition * 4; \
-					apz += a->cols * ch; \
+					block /* insert executions for tail partition */ \
 				} \
-				__m128 v4 = _mm_max_ps(z4, _mm_add_ps(_mm_add_ps(v40, v41), _mm_add_ps(v42, v43))); \
-				_mm_storeu_ps(bp + j * count, v4); /* ReLU */ \
+				w += kernel_cols * ch_per_partition * 4; \
+				apz += a->cols * ch; \
 			} \
-			bp += db->cols * count; \
-			ap += a->cols * ch * (ccv_max((i + 1) * strides - border, 0) - ccv_max(i * strides - border, 0)); \
+			__m128 v4 = _mm_max_ps(z4, _mm_add_ps(_mm_add_ps(v40, v41), _mm_add_ps(v42, v43))); \
+			_mm_storeu_ps(bp + j * count, v4); /* ReLU */ \
 		} \
-	} parallel_endfor
-	if (ch_per_partition % 4 == 0)
-	{
-		main_for();
-	} else if (ch_per_partition % 4 == 3) { // unroll the last for-loops
-#define block \
-		__m128 apz40 = _mm_load1_ps(apz + x * ch + c); \
-		__m128 apz41 = _mm_load1_ps(apz + x * ch + c + 1); \
-		__m128 apz42 = _mm_load1_ps(apz + x * ch + c + 2); \
-		__m128 w40 = _mm_loadu_ps(w + (x * ch_per_partition + c) * 4); \
-		__m128 w41 = _mm_loadu_ps(w + (x * ch_per_partition + c + 1) * 4); \
-		__m128 w42 = _mm_loadu_ps(w + (x * ch_per_partition + c + 2) * 4); \
-		v40 = _mm_add_ps(_mm_mul_ps(w40, apz40), v40); \
-		v41 = _mm_add_ps(_mm_mul_ps(w41, apz41), v41); \
-		v42 = _mm_add_ps(_mm_mul_ps(w42, apz42), v42);
-		main_for(block);
-#undef block
-	} else if (ch_per_partition % 4 == 2) { // unroll the last for-loops
-#define block \
-		__m128 apz40 = _mm_load1_ps(apz + x * ch + c); \
-		__m128 apz41 = _mm_load1_ps(apz + x * ch + c + 1); \
-		__m128 w40 = _mm_loadu_ps(w + (x * ch_per_partition + c) * 4); \
-		__m128 w41 = _mm_loadu_ps(w + (x * ch_per_partition + c + 1) * 4); \
-		v40 = _mm_add_ps(_mm_mul_ps(w40, apz40), v40); \
-		v41 = _mm_add_ps(_mm_mul_ps(w41, apz41), v41);
-		main_for(block);
-#undef block
-	} else {
-#define block \
-		__m128 apz4 = _mm_load1_ps(apz + x * ch + c); \
-		__m128 w4 = _mm_loadu_ps(w + (x * ch_per_partition + c) * 4); \
-		v40 = _mm_add_ps(_mm_mul_ps(w4, apz4), v40);
-		main_for(block);
-#undef block
-	}
-#undef main_for
+		bp += db->cols * count; \
+		ap += a->cols * ch * (ccv_max((i + 1) * strides - border, 0) - ccv_max(i * strides - border, 0)); \
+	} \
+}
+// unroll the last for-loops
+#define block_3(_madd) \
+	__m128 apz40 = _mm_load1_ps(apz + x * ch + c); \
+	__m128 apz41 = _mm_load1_ps(apz + x * ch + c + 1); \
+	__m128 apz42 = _mm_load1_ps(apz + x * ch + c + 2); \
+	__m128 w40 = _mm_loadu_ps(w + (x * ch_per_partition + c) * 4); \
+	__m128 w41 = _mm_loadu_ps(w + (x * ch_per_partition + c + 1) * 4); \
+	__m128 w42 = _mm_loadu_ps(w + (x * ch_per_partition + c + 2) * 4); \
+	v40 = _madd(w40, apz40, v40); \
+	v41 = _madd(w41, apz41, v41); \
+	v42 = _madd(w42, apz42, v42);
+#define block_2(_madd) \
+	__m128 apz40 = _mm_load1_ps(apz + x * ch + c); \
+	__m128 apz41 = _mm_load1_ps(apz + x * ch + c + 1); \
+	__m128 w40 = _mm_loadu_ps(w + (x * ch_per_partition + c) * 4); \
+	__m128 w41 = _mm_loadu_ps(w + (x * ch_per_partition + c + 1) * 4); \
+	v40 = _madd(w40, apz40, v40); \
+	v41 = _madd(w41, apz41, v41);
+#define block_1(_madd) \
+	__m128 apz4 = _mm_load1_ps(apz + x * ch + c); \
+	__m128 w4 = _mm_loadu_ps(w + (x * ch_per_partition + c) * 4); \
+	v40 = _madd(w4, apz4, v40);
+/* one block function for each ch_per_partition % 4, and the entry that picks from them */
+#define main_for_all(_name, _madd) \
+main_for(_name##_0, _madd, ) \
+main_for(_name##_1, _madd, block_1(_madd)) \
+main_for(_name##_2, _madd, block_2(_madd)) \
+main_for(_name##_3, _madd, block_3(_madd)) \
+static void _name(ccv_convnet_convolutional_context_t* context) \
+{ \
+	assert(SIMD(context->layer)); \
+	static void (* const blocks[4])(size_t, void*) = { \
+		_name##_0, \
+		_name##_1, \
+		_name##_2, \
+		_name##_3, \
+	}; \
+	ccv_parallel_for(context->count >> 2, blocks[context->ch_per_partition % 4], context); \
 }
+#define _ccv_mm_madd_ps(a, b, c) _mm_add_ps(_mm_mul_ps(a, b), c)
+main_for_all(_ccv_convnet_convolutional_forward_propagate_sse2, _ccv_mm_madd_ps)
+#undef _ccv_mm_madd_ps
+
+#if defined(CCV_SIMD_X86) && !defined(__clang__)
+#define CCV_CONVNET_FMA
+/* the same kernels with fused multiply-add, the pragma covers the block functions as well */
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+main_for_all(_ccv_convnet_convolutional_forward_propagate_fma, _mm_fmadd_ps)
+#pragma GCC pop_options
+#endif
+#undef main_for_all
+#undef block_1
+#undef block_2
+#undef block_3
+#undef main_for
 #elif defined(HAVE_NEON)
-static inline void _ccv_convnet_convolutional_forward_propagate_neon(ccv_convnet_layer_t* layer, ccv_dense_matrix_t* a, ccv_dense_matrix_t* db, int rows, int cols, int ch, int count, int strides, int border, int kernel_rows, int kernel_cols, int ch_per_partition, int count_per_partition)
-{
-	assert(SIMD(layer));
-#define main_for(block) \
-	parallel_for(k, (count >> 2)) { \
-		int i, j, x, y, c; \
-		int p = k * 4 / count_per_partition; \
-		float* ap = a->data.f32 + p * ch_per_partition; \
-		float* bp = db->data.f32 + k * 4; \
-		float* layer_w = SIMD(layer) + k * 4 * kernel_rows * kernel_cols * ch_per_partition; \
-		float bias[4] __attribute__ ((__aligned__(16))); \
-		memcpy(bias, layer->bias + k * 4, sizeof(float) * 4); \
-		float32x4_t z4 = vmovq_n_f32(0); \
-		for (i = 0; i < db->rows; i++) \
+#define main_for(_func, block) \
+static void _func(size_t _k, void* _context) \
+{ \
+	ccv_convnet_convolutional_context_unpack(_context); \
+	int k = (int)_k; \
+	int i, j, x, y, c; \
+	int p = k * 4 / count_per_partition; \
+	float* ap = a->data.f32 + p * ch_per_partition; \
+	float* bp = db->data.f32 + k * 4; \
+	float* layer_w = SIMD(layer) + k * 4 * kernel_rows * kernel_cols * ch_per_partition; \
+	float bias[4] __attribute__ ((__aligned__(16))); \
+	memcpy(bias, layer->bias + k * 4, sizeof(float) * 4); \
+	float32x4_t z4 = vmovq_n_f32(0); \
+	for (i = 0; i < db->rows; i++) \
+	{ \
+		int comy = ccv_max(i * strides - border, 0) - (i * strides - border); \
+		int maxy = kernel_rows - comy - (i * strides + kernel_rows - ccv_min(a->rows + border, i * strides + kernel_rows)); \
+		comy *= ch_per_partition * kernel_cols; \
+		for (j = 0; j < db->cols; j++) \
 		{ \
-			int comy = ccv_max(i * strides - border, 0) - (i * strides - border); \
-			int maxy = kernel_rows - comy - (i * strides + kernel_rows - ccv_min(a->rows + border, i * strides + kernel_rows)); \
-			comy *= ch_per_partition * kernel_cols; \
-			for (j = 0; j < db->cols; j++) \
+			float32x4_t v40 = vld1q_f32(bias); \
+			float32x4_t v41 = vmovq_n_f32(0); \
+			int comx = ccv_max(j * strides - border, 0) - (j * strides - border); \
+			int maxx = kernel_cols - comx - (j * strides + kernel_cols - ccv_min(a->cols + border, j * strides + kernel_cols)); \
+			float* w = layer_w + (comx * ch_per_partition + comy) * 4; \
+			float* apz = ap + ccv_max(j * strides - border, 0) * ch; \
+			/* when we have border, we simply do zero padding */ \
+			for (y = 0; y < maxy; y++) \
 			{ \
-				float32x4_t v40 = vld1q_f32(bias); \
-				float32x4_t v41 = vmovq_n_f32(0); \
-				int comx = ccv_max(j * strides - border, 0) - (j * strides - border); \
-				int maxx = kernel_cols - comx - (j * strides + kernel_cols - ccv_min(a->cols + border, j * strides + kernel_cols)); \
-				float* w = layer_w + (comx * ch_per_partition + comy) * 4; \
-				float* apz = ap + ccv_max(j * strides - border, 0) * ch; \
-				/* when we have border, we simply do zero padding */ \
-				for (y = 0; y < maxy; y++) \
+				for (x = 0; x < maxx; x++) \
 				{ \
-					for (x = 0; x < maxx; x++) \
+					c = 0; \
+					for (; c < ch_per_partition - 1; c += 2) \
 					{ \
-						c = 0; \
-						for (; c < ch_per_partition - 1; c += 2) \
-						{ \
-							float32x2_t apz4 = vld1_f32(apz + x * ch + c); \
-							float32x4_t apz40 = vdupq_lane_f32(apz4, 0); \
-							float32x4_t apz41 = vdupq_lane_f32(apz4, 1); \
-							float32x4_t w40 = vld1q_f32(w + (x * ch_per_partition + c) * 4); \
-							float32x4_t w41 = vld1q_f32(w + (x * ch_per_partition + c + 1) * 4); \
-							v40 = vmlaq_f32(v40, w40, apz40); \
-							v41 = vmlaq_f32(v41, w41, apz41); \
-						} \
-						block /* insert executions for tail partition */ \
+						float32x2_t apz4 = vld1_f32(apz + x * ch + c); \
+						float32x4_t apz40 = vdupq_lane_f32(apz4, 0); \
+						float32x4_t apz41 = vdupq_lane_f32(apz4, 1); \
+						float32x4_t w40 = vld1q_f32(w + (x * ch_per_partition + c) * 4); \
+						float32x4_t w41 = vld1q_f32(w + (x * ch_per_partition + c + 1) * 4); \
+						v40 = vmlaq_f32(v40, w40, apz40); \
+						v41 = vmlaq_f32(v41, w41, apz41); \
 					} \
-					w += kernel_cols * ch_per_partition * 4; \
-					apz += a->cols * ch; \
+					block /* insert executions for tail partition */ \
 				} \
-				float32x4_t v4 = vmaxq_f32(z4, vaddq_f32(v40, v41)); \
-				vst1q_f32(bp + j * count, v4); /* ReLU */ \
+				w += kernel_cols * ch_per_partition * 4; \
+				apz += a->cols * ch; \
 			} \
-			bp += db->cols * count; \
-			ap += a->cols * ch * (ccv_max((i + 1) * strides - border, 0) - ccv_max(i * strides - border, 0)); \
+			float32x4_t v4 = vmaxq_f32(z4, vaddq_f32(v40, v41)); \
+			vst1q_f32(bp + j * count, v4); /* ReLU */ \
 		} \
-	} parallel_endfor
-	if (ch_per_partition % 2 == 0)
-	{
-		main_for();
-	} else { // unroll the last for-loops
+		bp += db->cols * count; \
+		ap += a->cols * ch * (ccv_max((i + 1) * strides - border, 0) - ccv_max(i * strides - border, 0)); \
+	} \
+}
+main_for(_ccv_convnet_convolutional_forward_propagate_neon_0, )
+// unroll the last for-loops
 #define block \
-		float32x4_t apz4 = vmovq_n_f32(apz[x * ch + c]); \
-		float32x4_t w4 = vld1q_f32(w + (x * ch_per_partition + c) * 4); \
-		v40 = vmlaq_f32(v40, w4, apz4);
-		main_for(block);
+	float32x4_t apz4 = vmovq_n_f32(apz[x * ch + c]); \
+	float32x4_t w4 = vld1q_f32(w + (x * ch_per_partition + c) * 4); \
+	v40 = vmlaq_f32(v40, w4, apz4);
+main_for(_ccv_convnet_convolutional_forward_propagate_neon_1, block)
 #undef block
-	}
 #undef main_for
+
+static void _ccv_convnet_convolutional_forward_propagate_neon(ccv_convnet_convolutional_context_t* context)
+{
+	assert(SIMD(context->layer));
+	static void (* const blocks[2])(size_t, void*) = {
+		_ccv_convnet_convolutional_forward_propagate_neon_0,
+		_ccv_convnet_convolutional_forward_propagate_neon_1,
+	};
+	ccv_parallel_for(context->count >> 2, blocks[context->ch_per_partition % 2], context);
 }
-#else
-static inline void 
-_ccv_convnet_convolutional_forward_propagate_fallback(ccv_convnet_layer_t* layer, 
-													  ccv_dense_matrix_t* a, 
-													  ccv_dense_matrix_t* db, 
-													  int rows, 
-													  int cols, 
-													  int ch, 
-													  int count, 
-													  int strides, 
-													  int border, 
-													  int kernel_rows, 
-													  int kernel_cols, 
-													  int ch_per_partition, 
-													  int count_per_partition)
+#endif
+
+static void _ccv_convnet_convolutional_forward_propagate_fallback_block(size_t _k, void* _context)
 {
-	// k0~count-1ѭ
-	parallel_for(k, count) 
+	ccv_convnet_convolutional_context_unpack(_context);
+	int k = (int)_k;
+	int i, j, x, y, c;
+	int p = k / count_per_partition;
+	float* ap = a->data.f32 + p * ch_per_partition;
+	float* bp = db->data.f32 + k;
+	float* layer_w = layer->w + k * kernel_rows * kernel_cols * ch_per_partition;
+	float bias = layer->bias[k];
+
+	for (i = 0; i < db->rows; i++)
 	{
-		int i, j, x, y, c;
-		int p = k / count_per_partition;
-		float* ap = a->data.f32 + p * ch_per_partition;
-		float* bp = db->data.f32 + k;
-		float* layer_w = layer->w + k * kernel_rows * kernel_cols * ch_per_partition;
-		float bias = layer->bias[k];
+		int comy = ccv_max(i * strides - border, 0) - (i * strides - border);
+		int maxy = kernel_rows - comy - (i * strides + kernel_rows 
+				  - ccv_min(a->rows + border, i * strides + kernel_rows));
+		comy *= ch_per_partition * kernel_cols;
 
-		for (i = 0; i < db->rows; i++)
+		for (j = 0; j < db->cols; j++)
 		{
-			int comy = ccv_max(i * strides - border, 0) - (i * strides - border);
-			int maxy = kernel_rows - comy - (i * strides + kernel_rows 
-					  - ccv_min(a->rows + border, i * strides + kernel_rows));
-			comy *= ch_per_partition * kernel_cols;
-
-			for (j = 0; j < db->cols; j++)
+			float v = bias;
+			int comx = ccv_max(j * strides - border, 0) - (j * strides - border);
+			int maxx = kernel_cols - comx 
+				- (j * strides + kernel_cols - ccv_min(a->cols + border, j * strides + kernel_cols));
+			float* w = layer_w + comx * ch_per_partition + comy;
+			float* apz = ap + ccv_max(j * strides - border, 0) * ch;
+
+			// ˱߽ʱ򵥵
+			// when we have border, we simply do zero padding
+			for (y = 0; y < maxy; y++)
 			{
-				float v = bias;
-				int comx = ccv_max(j * strides - border, 0) - (j * strides - border);
-				int maxx = kernel_cols - comx 
-					- (j * strides + kernel_cols - ccv_min(a->cols + border, j * strides + kernel_cols));
-				float* w = layer_w + comx * ch_per_partition + comy;
-				float* apz = ap + ccv_max(j * strides - border, 0) * ch;
-
-				// ˱߽ʱ򵥵
-				// when we have border, we simply do zero padding
-				for (y = 0; y < maxy; y++)
+				for (x = 0; x < maxx; x++)
 				{
-					for (x = 0; x < maxx; x++)
+					for (c = 0; c < ch_per_partition; c++)
 					{
-						for (c = 0; c < ch_per_partition; c++)
-						{
-							v += w[x * ch_per_partition + c] * apz[x * ch + c];
-						}
+						v += w[x * ch_per_partition + c] * apz[x * ch + c];
 					}
-
-					w += kernel_cols * ch_per_partition;
-					apz += a->cols * ch;
 				}
-				
-				bp[j * count] = ccv_max(0, v); // ReLU
+
+				w += kernel_cols * ch_per_partition;
+				apz += a->cols * ch;
 			}
 			
-			bp += db->cols * count;
-			ap += a->cols * ch * (ccv_max((i + 1) * strides - border, 0) - ccv_max(i * strides - border, 0));
+			bp[j * count] = ccv_max(0, v); // ReLU
 		}
-	} parallel_endfor
+		
+		bp += db->cols * count;
+		ap += a->cols * ch * (ccv_max((i + 1) * strides - border, 0) - ccv_max(i * strides - border, 0));
+	}
+}
+
+static void _ccv_convnet_convolutional_forward_propagate_fallback(ccv_convnet_convolutional_context_t* context)
+{
+	// k0~count-1ѭ
+	ccv_parallel_for(context->count, _ccv_convnet_convolutional_forward_propagate_fallback_block, context);
 }
+
+#if defined(HAVE_SSE2)
+typedef void (*ccv_convnet_convolutional_forward_propagate_f)(ccv_convnet_convolutional_context_t*);
+#ifdef CCV_CONVNET_FMA
+#define _ccv_convnet_convolutional_forward_propagate_avx2 _ccv_convnet_convolutional_forward_propagate_fma
+#else
+#define _ccv_convnet_convolutional_forward_propagate_avx2 _ccv_convnet_convolutional_forward_propagate_sse2
+#endif
+// the best one at every SIMD level
+static const ccv_convnet_convolutional_forward_propagate_f ccv_convnet_convolutional_forward_propagate[CCV_SIMD_LEVEL_NUM] = {
+	_ccv_convnet_convolutional_forward_propagate_fallback,
+	_ccv_convnet_convolutional_forward_propagate_sse2,
+	_ccv_convnet_convolutional_forward_propagate_avx2,
+	_ccv_convnet_convolutional_forward_propagate_avx2,
+};
+#undef _ccv_convnet_convolutional_forward_propagate_avx2
 #endif
 
 static void 
@@ -528,18 +594,24 @@ _ccv_convnet_convolutional_forward_propagate(ccv_convnet_layer_t* layer,
 	_ccv_convnet_layer_simd_alloc_reserved(layer);
 #endif
 
+	ccv_convnet_convolutional_context_t context;
+	context.layer = layer;
+	context.a = a;
+	context.db = db;
+	context.ch = ch;
+	context.count = count;
+	context.strides = strides;
+	context.border = border;
+	context.kernel_rows = kernel_rows;
+	context.kernel_cols = kernel_cols;
+	context.ch_per_partition = ch_per_partition;
+	context.count_per_partition = count_per_partition;
 #if defined(HAVE_SSE2)
-	_ccv_convnet_convolutional_forward_propagate_sse2(layer, a, db, rows, cols, ch, count, strides, border, kernel_rows, kernel_cols, ch_per_partition, count_per_partition);
+	ccv_convnet_convolutional_forward_propagate[ccv_get_simd_level()](&context);
 #elif defined(HAVE_NEON)
-	_ccv_convnet_convolutional_forward_propagate_neon(layer, a, db, rows, cols, ch, count, strides, border, kernel_rows, kernel_cols, ch_per_partition, count_per_partition);
+	_ccv_convnet_convolutional_forward_propagate_neon(&context);
 #else
-	_ccv_convnet_convolutional_forward_propagate_fallback(layer, 
-														  a, 
-														  db, 
-														  rows, cols, ch, 
-														  count, strides, border, 
-														  kernel_rows, kernel_cols, 
-														  ch_per_partition, count_per_partition);
+	_ccv_convnet_convolutional_forward_propagate_fallback(&context);
 #endif
 }
 
@@ -1037,7 +1109,10 @@ void ccv_convnet_classify(ccv_convnet_t* convnet,
 		ccv_dense_matrix_t* slice = 0;
 
 		// ͼaֵslice
-		ccv_slice(a[i], (ccv_matrix_t**)&slice, CCV_32F, (a[i]->rows - rows) / 2, (a[i]->cols - cols) / 2, rows, cols);
+		if (CCV_GET_DATA_TYPE(a[i]->type) == CCV_32F) // it is only read by ccv_subtract, no need to copy
+			slice = ccv_dense_matrix_view(a[i], (a[i]->rows - rows) / 2, (a[i]->cols - cols) / 2, rows, cols);
+		else
+			ccv_slice(a[i], (ccv_matrix_t**)&slice, CCV_32F, (a[i]->rows - rows) / 2, (a[i]->cols - cols) / 2, rows, cols);
 		ccv_dense_matrix_t* mean_activity = 0;
 
 		// Ŵƽ󵽿ɼ
@@ -1209,6 +1284,82 @@ void ccv_convnet_classify(ccv_convnet_t* convnet,
 
 #ifdef HAVE_GSL
 
+typedef struct {
+	ccv_dense_matrix_t* a;
+	ccv_dense_matrix_t* n;
+	ccv_dense_matrix_t* m;
+	ccv_convnet_layer_t* update_params;
+	int rows;
+	int cols;
+	int ch;
+	int count;
+	int strides;
+	int border;
+	int kernel_rows;
+	int kernel_cols;
+	int ch_per_partition;
+	int count_per_partition;
+} ccv_convnet_convolutional_backward_context_t;
+
+// the weight gradient of the k-th kernel
+static void _ccv_convnet_convolutional_backward_propagate_weight(size_t _k, void* _context)
+{
+	ccv_convnet_convolutional_backward_context_t* context = (ccv_convnet_convolutional_backward_context_t*)_context;
+	ccv_dense_matrix_t* a = context->a;
+	ccv_dense_matrix_t* n = context->n;
+	ccv_dense_matrix_t* m = context->m;
+	ccv_convnet_layer_t* update_params = context->update_params;
+	int rows = context->rows;
+	int cols = context->cols;
+	int ch = context->ch;
+	int count = context->count;
+	int strides = context->strides;
+	int border = context->border;
+	int kernel_rows = context->kernel_rows;
+	int kernel_cols = context->kernel_cols;
+	int ch_per_partition = context->ch_per_partition;
+	int count_per_partition = context->count_per_partition;
+	int k = (int)_k;
+	int i, j, x, y, c;
+	int p = k / count_per_partition;
+	float* mp = m->data.f32 + p * ch_per_partition;
+	float* ap = a->data.f32 + k;
+	float* np = n->data.f32 + k;
+	float* update_w = update_params->w + k * kernel_rows * kernel_cols * ch_per_partition;
+	float bias = 0;
+	for (i = 0; i < rows; i++)
+	{
+		int comy = ccv_max(i * strides - border, 0) - (i * strides - border);
+		int maxy = kernel_rows - comy - (i * strides + kernel_rows - ccv_min(m->rows + border, i * strides + kernel_rows));
+		comy *= ch_per_partition * kernel_cols;
+		for (j = 0; j < cols; j++)
+		{
+			if (np[j * count] > 0)
+			{ /* when np is bigger than 0, relu continues to update the weight, otherwise it stops */
+				float v = ap[j * count];
+				bias += v;
+				int comx = ccv_max(j * strides - border, 0) - (j * strides - border);
+				int maxx = kernel_cols - comx - (j * strides + kernel_cols - ccv_min(m->cols + border, j * strides + kernel_cols));
+				float* w = update_w + comx * ch_per_partition + comy;
+				float* mpz = mp + ccv_max(j * strides - border, 0) * ch;
+				/* when we have border, we simply do zero padding */
+				for (y = 0; y < maxy; y++)
+				{
+					for (x = 0; x < maxx; x++)
+						for (c = 0; c < ch_per_partition; c++)
+							w[x * ch_per_partition + c] += v * mpz[x * ch + c];
+					w += kernel_cols * ch_per_partition;
+					mpz += m->cols * ch;
+				}
+			}
+		}
+		ap += a->cols * count;
+		np += n->cols * count;
+		mp += m->cols * ch * (ccv_max((i + 1) * strides - border, 0) - ccv_max(i * strides - border, 0));
+	}
+	update_params->bias[k] += bias;
+}
+
 // compute back propagated gradient & weight update delta
 static void _ccv_convnet_convolutional_backward_propagate(ccv_convnet_layer_t* layer, ccv_dense_matrix_t* a, ccv_dense_matrix_t* n, ccv_dense_matrix_t* m, ccv_dense_matrix_t** b, ccv_convnet_layer_t* update_params)
 {
@@ -1234,46 +1385,22 @@ static void _ccv_convnet_convolutional_backward_propagate(ccv_convnet_layer_t* l
 	int ch_per_partition = ch / partition;
 	
 	// update weight gradient
-	parallel_for(k, count) {
-		int i, j, x, y, c;
-		int p = k / count_per_partition;
-		float* mp = m->data.f32 + p * ch_per_partition;
-		float* ap = a->data.f32 + k;
-		float* np = n->data.f32 + k;
-		float* update_w = update_params->w + k * kernel_rows * kernel_cols * ch_per_partition;
-		float bias = 0;
-		for (i = 0; i < rows; i++)
-		{
-			int comy = ccv_max(i * strides - border, 0) - (i * strides - border);
-			int maxy = kernel_rows - comy - (i * strides + kernel_rows - ccv_min(m->rows + border, i * strides + kernel_rows));
-			comy *= ch_per_partition * kernel_cols;
-			for (j = 0; j < cols; j++)
-			{
-				if (np[j * count] > 0)
-				{ /* when np is bigger than 0, relu continues to update the weight, otherwise it stops */
-					float v = ap[j * count];
-					bias += v;
-					int comx = ccv_max(j * strides - border, 0) - (j * strides - border);
-					int maxx = kernel_cols - comx - (j * strides + kernel_cols - ccv_min(m->cols + border, j * strides + kernel_cols));
-					float* w = update_w + comx * ch_per_partition + comy;
-					float* mpz = mp + ccv_max(j * strides - border, 0) * ch;
-					/* when we have border, we simply do zero padding */
-					for (y = 0; y < maxy; y++)
-					{
-						for (x = 0; x < maxx; x++)
-							for (c = 0; c < ch_per_partition; c++)
-								w[x * ch_per_partition + c] += v * mpz[x * ch + c];
-						w += kernel_cols * ch_per_partition;
-						mpz += m->cols * ch;
-					}
-				}
-			}
-			ap += a->cols * count;
-			np += n->cols * count;
-			mp += m->cols * ch * (ccv_max((i + 1) * strides - border, 0) - ccv_max(i * strides - border, 0));
-		}
-		update_params->bias[k] += bias;
-	} parallel_endfor
+	ccv_convnet_convolutional_backward_context_t context;
+	context.a = a;
+	context.n = n;
+	context.m = m;
+	context.update_params = update_params;
+	context.rows = rows;
+	context.cols = cols;
+	context.ch = ch;
+	context.count = count;
+	context.strides = strides;
+	context.border = border;
+	context.kernel_rows = kernel_rows;
+	context.kernel_cols = kernel_cols;
+	context.ch_per_partition = ch_per_partition;
+	context.count_per_partition = count_per_partition;
+	ccv_parallel_for(count, _ccv_convnet_convolutional_backward_propagate_weight, &context);
 	if (b)
 	{
 		ccv_dense_matrix_t* db = *b = ccv_dense_matrix_renew(*b, m->rows, m->cols, CCV_32F | CCV_GET_CHANNEL(m->type), CCV_32F | CCV_GET_CHANNEL(m->type), 0);
@@ -2286,24 +2413,12 @@ ccv_convnet_t* ccv_convnet_read(int use_cwc_accel, const char* filename)
 					// if weights available, load weights
 					if (wnum == layer->wnum)
 					{
+						// half precision weights are converted straight into the layer, without a scratch copy
 						const void* w = sqlite3_column_blob(layer_data_stmt, 1);
 						if (half_precision)
-						{
-							float* f = (float*)ccmalloc(sizeof(float) * layer->wnum);
-							ccv_half_precision_to_float((uint16_t*)w, f, layer->wnum);
-							w = f;
-						}
-						switch (layer->type)
-						{
-							case CCV_CONVNET_CONVOLUTIONAL:
-								memcpy(layer->w, w, sizeof(float) * layer->wnum);
-								break;
-							case CCV_CONVNET_FULL_CONNECT:
-								memcpy(layer->w, w, sizeof(float) * layer->wnum);
-								break;
-						}
-						if (half_precision)
-							ccfree((void*)w);
+							ccv_half_precision_to_float((uint16_t*)w, layer->w, layer->wnum);
+						else
+							memcpy(layer->w, w, sizeof(float) * layer->wnum);
 					}
 					int bnum = sqlite3_column_bytes(layer_data_stmt, 2) / (half_precision ? sizeof(uint16_t) : sizeof(float));
 					// if bias available, load bias
@@ -2311,22 +2426,9 @@ ccv_convnet_t* ccv_convnet_read(int use_cwc_accel, const char* filename)
 					{
 						const void* bias = sqlite3_column_blob(layer_data_stmt, 2);
 						if (half_precision)
-						{
-							float* f = (float*)ccmalloc(sizeof(float) * (layer->type == CCV_CONVNET_CONVOLUTIONAL ? layer->net.convolutional.count : layer->net.full_connect.count));
-							ccv_half_precision_to_float((uint16_t*)bias, f, layer->type == CCV_CONVNET_CONVOLUTIONAL ? layer->net.convolutional.count : layer->net.full_connect.count);
-							bias = f;
-						}
-						switch (layer->type)
-						{
-							case CCV_CONVNET_CONVOLUTIONAL:
-								memcpy(layer->bias, bias, sizeof(float) * layer->net.convolutional.count);
-								break;
-							case CCV_CONVNET_FULL_CONNECT:
-								memcpy(layer->bias, bias, sizeof(float) * layer->net.full_connect.count);
-								break;
-						}
-						if (half_precision)
-							ccfree((void*)bias);
+							ccv_half_precision_to_float((uint16_t*)bias, layer->bias, bnum);
+						else
+							memcpy(layer->bias, bias, sizeof(float) * bnum);
 					}
 				}
 				sqlite3_finalize(layer_data_stmt);
@@ -0,0 +1,200 @@
+#include "ccv.h"
+#include "ccv_internal.h"
+#include "3rdparty/xxhash/xxhash.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/* the file is a header page, an index of 4-way buckets, then a ring of records. The index is only a hint,
+ * every record carries its signature, sequence number and a checksum of its content, a slot is trusted
+ * only if the record it points to still matches, thus, records overwritten by the ring or torn by a
+ * crash read as misses. */
+#define CCV_DISK_CACHE_MAGIC (0x31454843414356ccull) // "\xccVCACHE1"
+#define CCV_DISK_CACHE_PAGE (4096)
+#define CCV_DISK_CACHE_WAY (4)
+#define CCV_DISK_CACHE_ALIGN (64)
+
+typedef struct {
+	uint64_t magic;
+	uint64_t size; // the file size
+	uint64_t bucket_num; // power of 2
+	uint64_t head; // the offset in ring that next record goes to
+	uint64_t seq; // the sequence number of next record, starts from 1
+} ccv_disk_cache_header_t;
+
+typedef struct {
+	uint64_t sign;
+	uint64_t offset;
+	uint64_t size;
+	uint64_t seq; // 0 if the slot is empty
+} ccv_disk_cache_slot_t;
+
+typedef struct {
+	uint64_t sign;
+	uint64_t size;
+	uint64_t seq;
+	uint64_t checksum;
+} ccv_disk_cache_record_t;
+
+#define CCV_DISK_CACHE_HEADER(cache) ((ccv_disk_cache_header_t*)(cache)->map)
+#define CCV_DISK_CACHE_INDEX(cache) ((ccv_disk_cache_slot_t*)((cache)->map + CCV_DISK_CACHE_PAGE))
+
+static inline uint64_t _ccv_disk_cache_ring_offset(uint64_t bucket_num)
+{
+	return (CCV_DISK_CACHE_PAGE + bucket_num * CCV_DISK_CACHE_WAY * sizeof(ccv_disk_cache_slot_t) + CCV_DISK_CACHE_PAGE - 1) & -(uint64_t)CCV_DISK_CACHE_PAGE;
+}
+
+static inline uint64_t _ccv_disk_cache_ring_size(ccv_disk_cache_t* cache)
+{
+	return cache->size - _ccv_disk_cache_ring_offset(CCV_DISK_CACHE_HEADER(cache)->bucket_num);
+}
+
+static inline ccv_disk_cache_slot_t* _ccv_disk_cache_bucket(ccv_disk_cache_t* cache, uint64_t sign)
+{
+	uint64_t bucket_num = CCV_DISK_CACHE_HEADER(cache)->bucket_num;
+	return CCV_DISK_CACHE_INDEX(cache) + ((sign ^ (sign >> 32)) & (bucket_num - 1)) * CCV_DISK_CACHE_WAY;
+}
+
+static inline ccv_disk_cache_record_t* _ccv_disk_cache_record(ccv_disk_cache_t* cache, uint64_t offset)
+{
+	return (ccv_disk_cache_record_t*)(cache->map + _ccv_disk_cache_ring_offset(CCV_DISK_CACHE_HEADER(cache)->bucket_num) + offset);
+}
+
+#ifndef _WIN32
+ccv_disk_cache_t* ccv_disk_cache_open(const char* path, size_t size)
+{
+	// one bucket (4 slots) for every 64KiB of ring, it is the typical size of matrices worth spilling
+	uint64_t bucket_num = 64;
+	while (bucket_num * 65536 < size)
+		bucket_num <<= 1;
+	if (size < _ccv_disk_cache_ring_offset(bucket_num) + CCV_DISK_CACHE_PAGE)
+		return 0;
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		return 0;
+	struct stat st;
+	int reuse = (fstat(fd, &st) == 0 && st.st_size == size);
+	if (!reuse && ftruncate(fd, size) != 0)
+	{
+		close(fd);
+		return 0;
+	}
+	unsigned char* map = (unsigned char*)mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+	{
+		close(fd);
+		return 0;
+	}
+	ccv_disk_cache_t* cache = (ccv_disk_cache_t*)ccmalloc(sizeof(ccv_disk_cache_t));
+	cache->fd = fd;
+	cache->size = size;
+	cache->map = map;
+	cache->reserved = 0;
+	ccv_disk_cache_header_t* header = CCV_DISK_CACHE_HEADER(cache);
+	if (!reuse || header->magic != CCV_DISK_CACHE_MAGIC || header->size != size || header->bucket_num != bucket_num || header->head >= _ccv_disk_cache_ring_size(cache))
+	{
+		// rebuild, the magic goes last, thus, a crash in between leaves a file that will be rebuilt again
+		header->magic = 0;
+		header->size = size;
+		header->bucket_num = bucket_num;
+		header->head = 0;
+		header->seq = 1;
+		memset(CCV_DISK_CACHE_INDEX(cache), 0, bucket_num * CCV_DISK_CACHE_WAY * sizeof(ccv_disk_cache_slot_t));
+		header->magic = CCV_DISK_CACHE_MAGIC;
+	}
+	return cache;
+}
+
+void ccv_disk_cache_close(ccv_disk_cache_t* cache)
+{
+	msync(cache->map, cache->size, MS_SYNC);
+	munmap(cache->map, cache->size);
+	close(cache->fd);
+	ccfree(cache);
+}
+#else
+ccv_disk_cache_t* ccv_disk_cache_open(const char* path, size_t size)
+{
+	return 0;
+}
+
+void ccv_disk_cache_close(ccv_disk_cache_t* cache)
+{
+}
+#endif
+
+void* ccv_disk_cache_reserve(ccv_disk_cache_t* cache, uint64_t sign, size_t size)
+{
+	ccv_disk_cache_header_t* header = CCV_DISK_CACHE_HEADER(cache);
+	uint64_t ring_size = _ccv_disk_cache_ring_size(cache);
+	uint64_t reserved = (sizeof(ccv_disk_cache_record_t) + size + CCV_DISK_CACHE_ALIGN - 1) & -(uint64_t)CCV_DISK_CACHE_ALIGN;
+	// a single object shouldn't wipe out more than half of the ring
+	if (reserved > ring_size / 2)
+		return 0;
+	if (header->head + reserved > ring_size)
+		header->head = 0;
+	ccv_disk_cache_record_t* record = _ccv_disk_cache_record(cache, header->head);
+	record->sign = sign;
+	record->size = size;
+	record->seq = 0; // not committed yet
+	cache->reserved = reserved;
+	return record + 1;
+}
+
+void ccv_disk_cache_commit(ccv_disk_cache_t* cache)
+{
+	assert(cache->reserved > 0);
+	ccv_disk_cache_header_t* header = CCV_DISK_CACHE_HEADER(cache);
+	ccv_disk_cache_record_t* record = _ccv_disk_cache_record(cache, header->head);
+	uint64_t seq = header->seq;
+	record->checksum = xxh64(record + 1, record->size, record->sign ^ seq);
+	record->seq = seq;
+	// take the slot of the same signature, or an empty one, or the oldest one in the bucket
+	ccv_disk_cache_slot_t* bucket = _ccv_disk_cache_bucket(cache, record->sign);
+	ccv_disk_cache_slot_t* slot = bucket;
+	int i;
+	for (i = 0; i < CCV_DISK_CACHE_WAY; i++)
+		if (bucket[i].seq == 0 || bucket[i].sign == record->sign)
+		{
+			slot = bucket + i;
+			break;
+		} else if (bucket[i].seq < slot->seq)
+			slot = bucket + i;
+	slot->seq = 0;
+	slot->sign = record->sign;
+	slot->offset = header->head;
+	slot->size = record->size;
+	slot->seq = seq;
+	header->seq = seq + 1;
+	header->head += cache->reserved;
+	cache->reserved = 0;
+}
+
+const void* ccv_disk_cache_get(ccv_disk_cache_t* cache, uint64_t sign, size_t* size)
+{
+	ccv_disk_cache_slot_t* bucket = _ccv_disk_cache_bucket(cache, sign);
+	uint64_t ring_size = _ccv_disk_cache_ring_size(cache);
+	int i;
+	for (i = 0; i < CCV_DISK_CACHE_WAY; i++)
+		if (bucket[i].seq != 0 && bucket[i].sign == sign)
+		{
+			ccv_disk_cache_slot_t* slot = bucket + i;
+			if (slot->offset + sizeof(ccv_disk_cache_record_t) + slot->size <= ring_size)
+			{
+				ccv_disk_cache_record_t* record = _ccv_disk_cache_record(cache, slot->offset);
+				if (record->sign == sign && record->seq == slot->seq && record->size == slot->size &&
+					record->checksum == xxh64(record + 1, record->size, sign ^ record->seq))
+				{
+					if (size)
+						*size = record->size;
+					return record + 1;
+				}
+			}
+			// the record is gone (overwritten or torn), free the slot
+			slot->seq = 0;
+			return 0;
+		}
+	return 0;
+}
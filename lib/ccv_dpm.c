@@ -116,25 +116,16 @@ _ccv_dpm_scale_upto(ccv_dense_matrix_t* a,
 FʾFеȨ˳򴮽õ˺ʹF(H,p)
 F(H, p, w, h)ΪӴڵĴС˲FС
 */
-static void _ccv_dpm_feature_pyramid(ccv_dense_matrix_t* a, 
+static void _ccv_dpm_feature_pyramid(ccv_pyramid_t* pyramid, 
 									 ccv_dense_matrix_t** pyr, 
-									 int scale_upto, 
-									 int interval)
+									 int scale_upto)
 {
 	// Ϊ˻ĳһֱʶҪڽߵĲ
 	// .interval = 8, next ==  == 9
-	int next = interval + 1;
-	double scale = pow(2.0, 1.0 / (interval + 1.0));
+	int next = pyramid->interval + 1;
 	memset(pyr, 0, (scale_upto + next * 2) * sizeof(ccv_dense_matrix_t*));
-	pyr[next] = a;
+	assert(scale_upto + next <= pyramid->count);
 	int i;
-	
-	for (i = 1; i <= interval; i++)
-		ccv_resample(pyr[next], &pyr[next + i], 0, (int)(pyr[next]->rows / pow(scale, i)), (int)(pyr[next]->cols / pow(scale, i)), CCV_INTER_AREA);
-
-	for (i = next; i < scale_upto + next; i++)
-		ccv_sample_down(pyr[i], &pyr[i + next], 0, 0, 0);
-
 	ccv_dense_matrix_t* hog;
 
 	// һһHOGĸЧķ(øСĳߴ)
@@ -142,19 +133,14 @@ static void _ccv_dpm_feature_pyramid(ccv_dense_matrix_t* a,
 	for (i = 0; i < next; i++)
 	{
 		hog = 0;
-		ccv_hog(pyr[i + next], &hog, 0, 9, CCV_DPM_WINDOW_SIZE / 2 /* this is */);
+		ccv_hog(ccv_pyramid_level(pyramid, i), &hog, 0, 9, CCV_DPM_WINDOW_SIZE / 2 /* this is */);
 		pyr[i] = hog;
 	}
 	
-	hog = 0;
-	ccv_hog(pyr[next], &hog, 0, 9, CCV_DPM_WINDOW_SIZE);
-	pyr[next] = hog;
-	
-	for (i = next + 1; i < scale_upto + next * 2; i++)
+	for (i = next; i < scale_upto + next * 2; i++)
 	{
 		hog = 0;
-		ccv_hog(pyr[i], &hog, 0, 9, CCV_DPM_WINDOW_SIZE);
-		ccv_matrix_free(pyr[i]);
+		ccv_hog(ccv_pyramid_level(pyramid, i - next), &hog, 0, 9, CCV_DPM_WINDOW_SIZE);
 		pyr[i] = hog;
 	}
 }
@@ -1363,7 +1349,9 @@ _ccv_dpm_collect_best(ccv_dense_matrix_t* image,
 	ccv_dense_matrix_t** pyr = (ccv_dense_matrix_t**)alloca((scale_upto + next * 2) * sizeof(ccv_dense_matrix_t*));
 
 	// pyr
-	_ccv_dpm_feature_pyramid(image, pyr, scale_upto, params.interval);
+	ccv_pyramid_t* pyramid = ccv_pyramid_new(image, params.interval);
+	_ccv_dpm_feature_pyramid(pyramid, pyr, scale_upto);
+	ccv_pyramid_free(pyramid);
 
 	float best = -FLT_MAX;
 	ccv_dpm_feature_vector_t* v = 0;
@@ -1506,7 +1494,9 @@ _ccv_dpm_collect_all(gsl_rng* rng,
 		return 0;
 
 	ccv_dense_matrix_t** pyr = (ccv_dense_matrix_t**)alloca((scale_upto + next * 2) * sizeof(ccv_dense_matrix_t*));
-	_ccv_dpm_feature_pyramid(image, pyr, scale_upto, params.interval);
+	ccv_pyramid_t* pyramid = ccv_pyramid_new(image, params.interval);
+	_ccv_dpm_feature_pyramid(pyramid, pyr, scale_upto);
+	ccv_pyramid_free(pyramid);
 	ccv_array_t* av = ccv_array_new(sizeof(ccv_dpm_feature_vector_t*), 64, 0);
 	int enough = 64 / model->count;
 	int* order = (int*)alloca(sizeof(int) * model->count);
@@ -3550,11 +3540,13 @@ params: A ccv_dpm_param_t structure that defines various aspects of the detector
 return: A ccv_array_t of ccv_root_comp_t that contains the root bounding box as 
 well as its parts.
 */
-ccv_array_t* ccv_dpm_detect_objects(ccv_dense_matrix_t* a, 
-									ccv_dpm_mixture_model_t** _model, 
-									int count, 
-									ccv_dpm_param_t params)
+ccv_array_t* ccv_dpm_detect_objects_with_pyramid(ccv_pyramid_t* pyramid, 
+												 ccv_dpm_mixture_model_t** _model, 
+												 int count, 
+												 ccv_dpm_param_t params)
 {
+	assert(pyramid->interval == params.interval);
+	ccv_dense_matrix_t* a = ccv_pyramid_level(pyramid, 0);
 	int c, i, j, k, x, y;
 
 	// .interval = 8, .min_neighbors = 1, .flags = 0, .threshold = 0.6, // 0.8
@@ -3571,7 +3563,7 @@ ccv_array_t* ccv_dpm_detect_objects(ccv_dense_matrix_t* a,
 	// ͼaDPMpyr
 	ccv_dense_matrix_t** pyr = 
 		(ccv_dense_matrix_t**)alloca((scale_upto + next * 2) * sizeof(ccv_dense_matrix_t*));
-	_ccv_dpm_feature_pyramid(a, pyr, scale_upto, params.interval);
+	_ccv_dpm_feature_pyramid(pyramid, pyr, scale_upto);
 
 	ccv_array_t* idx_seq;
 	ccv_array_t* seq = ccv_array_new(sizeof(ccv_root_comp_t), 64, 0);
@@ -3756,9 +3748,10 @@ ccv_array_t* ccv_dpm_detect_objects(ccv_dense_matrix_t* a,
 			idx_seq = 0;
 			ccv_array_clear(seq2);
 
+			float distance = 0.25; // the distance factor of _ccv_is_equal
 			// ѻȡľ˳
 			// group retrieved rectangles in order to filter out noise
-			int ncomp = ccv_array_group(seq, &idx_seq, _ccv_is_equal_same_class, 0);
+			int ncomp = ccv_array_group_rect(seq, &idx_seq, _ccv_is_equal_same_class, ccv_comp_extent, &distance);
 			ccv_root_comp_t* comps = (ccv_root_comp_t*)ccmalloc((ncomp + 1) * sizeof(ccv_root_comp_t));
 			memset(comps, 0, (ncomp + 1) * sizeof(ccv_root_comp_t));
 
@@ -3884,9 +3877,10 @@ ccv_array_t* ccv_dpm_detect_objects(ccv_dense_matrix_t* a,
 		result_seq2 = ccv_array_new(sizeof(ccv_root_comp_t), 64, 0);
 		idx_seq = 0;
 
+		float distance = 0.25; // the distance factor of _ccv_is_equal
 		// Ϊ˹˵ѻõľ 
 		// group retrieved rectangles in order to filter out noise
-		int ncomp = ccv_array_group(result_seq, &idx_seq, _ccv_is_equal, 0);
+		int ncomp = ccv_array_group_rect(result_seq, &idx_seq, _ccv_is_equal, ccv_comp_extent, &distance);
 		ccv_root_comp_t* comps = (ccv_root_comp_t*)ccmalloc((ncomp + 1) * sizeof(ccv_root_comp_t));
 		memset(comps, 0, (ncomp + 1) * sizeof(ccv_root_comp_t));
 
@@ -3927,6 +3921,17 @@ ccv_array_t* ccv_dpm_detect_objects(ccv_dense_matrix_t* a,
 	return result_seq2;
 }
 
+ccv_array_t* ccv_dpm_detect_objects(ccv_dense_matrix_t* a, 
+									ccv_dpm_mixture_model_t** _model, 
+									int count, 
+									ccv_dpm_param_t params)
+{
+	ccv_pyramid_t* pyramid = ccv_pyramid_new(a, params.interval);
+	ccv_array_t* result_seq = ccv_dpm_detect_objects_with_pyramid(pyramid, _model, count, params);
+	ccv_pyramid_free(pyramid);
+	return result_seq;
+}
+
 // һģļжȡDPMģ
 /*
 directory: The model file for DPM mixture model.
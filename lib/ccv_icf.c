@@ -869,6 +869,68 @@ typedef struct {
 	int count[2];
 } ccv_icf_first_feature_find_t;
 
+typedef struct {
+	ccv_array_t* positives;
+	ccv_array_t* negatives;
+	uint8_t* precomputed;
+	size_t step;
+	ccv_icf_example_state_t* example_state;
+	double aweigh0;
+	double aweigh1;
+	ccv_icf_first_feature_find_t* feature_find;
+} ccv_icf_first_feature_find_context_t;
+
+// the split with the least error on the i-th feature
+static void _ccv_icf_find_first_feature_block(size_t _i, void* _context)
+{
+	ccv_icf_first_feature_find_context_t* context = (ccv_icf_first_feature_find_context_t*)_context;
+	ccv_array_t* positives = context->positives;
+	ccv_array_t* negatives = context->negatives;
+	uint8_t* precomputed = context->precomputed;
+	size_t step = context->step;
+	ccv_icf_example_state_t* example_state = context->example_state;
+	double aweigh0 = context->aweigh0;
+	double aweigh1 = context->aweigh1;
+	ccv_icf_first_feature_find_t* feature_find = context->feature_find;
+	int i = (int)_i;
+	ccv_icf_first_feature_find_t min_find = {
+		.error_rate = 1.0,
+		.error_index = 0,
+		.weigh = {0, 0},
+		.count = {0, 0},
+	};
+	double weigh[2] = {0, 0};
+	int count[2] = {0, 0};
+	int j;
+	uint8_t* computed = precomputed + step * i;
+	for (j = 0; j < positives->rnum + negatives->rnum; j++)
+	{
+		uint8_t skip;
+		uint32_t index;
+		_ccv_icf_3_uint8_to_1_uint1_1_uint23(computed + j * 3, &skip, &index);
+		conditional_assert(j == positives->rnum + negatives->rnum - 1, !skip);
+		assert(index >= 0 && index < positives->rnum + negatives->rnum);
+		weigh[index < positives->rnum] += example_state[index].weight;
+		assert(example_state[index].weight > 0);
+		assert(weigh[0] <= aweigh0 + 1e-10 && weigh[1] <= aweigh1 + 1e-10);
+		++count[index < positives->rnum];
+		if (skip) // the current index is equal to the next one, we cannot differentiate, therefore, skip
+			continue;
+		double error_rate = ccv_min(weigh[0] + aweigh1 - weigh[1], weigh[1] + aweigh0 - weigh[0]);
+		assert(error_rate > 0);
+		if (error_rate < min_find.error_rate)
+		{
+			min_find.error_index = j;
+			min_find.error_rate = error_rate;
+			min_find.weigh[0] = weigh[0];
+			min_find.weigh[1] = weigh[1];
+			min_find.count[0] = count[0];
+			min_find.count[1] = count[1];
+		}
+	}
+	feature_find[i] = min_find;
+}
+
 static ccv_icf_decision_tree_cache_t _ccv_icf_find_first_feature(ccv_icf_feature_t* features, int feature_size, ccv_array_t* positives, ccv_array_t* negatives, uint8_t* precomputed, ccv_icf_example_state_t* example_state, ccv_icf_feature_t* feature)
 {
 	int i;
@@ -881,44 +943,16 @@ static ccv_icf_decision_tree_cache_t _ccv_icf_find_first_feature(ccv_icf_feature
 		aweigh0 += example_state[i].weight, example_state[i].correct = 1; // assuming negative examples we get right
 	size_t step = (3 * (positives->rnum + negatives->rnum) + 3) & -4;
 	ccv_icf_first_feature_find_t* feature_find = (ccv_icf_first_feature_find_t*)ccmalloc(sizeof(ccv_icf_first_feature_find_t) * feature_size);
-	parallel_for(i, feature_size) {
-		ccv_icf_first_feature_find_t min_find = {
-			.error_rate = 1.0,
-			.error_index = 0,
-			.weigh = {0, 0},
-			.count = {0, 0},
-		};
-		double weigh[2] = {0, 0};
-		int count[2] = {0, 0};
-		int j;
-		uint8_t* computed = precomputed + step * i;
-		for (j = 0; j < positives->rnum + negatives->rnum; j++)
-		{
-			uint8_t skip;
-			uint32_t index;
-			_ccv_icf_3_uint8_to_1_uint1_1_uint23(computed + j * 3, &skip, &index);
-			conditional_assert(j == positives->rnum + negatives->rnum - 1, !skip);
-			assert(index >= 0 && index < positives->rnum + negatives->rnum);
-			weigh[index < positives->rnum] += example_state[index].weight;
-			assert(example_state[index].weight > 0);
-			assert(weigh[0] <= aweigh0 + 1e-10 && weigh[1] <= aweigh1 + 1e-10);
-			++count[index < positives->rnum];
-			if (skip) // the current index is equal to the next one, we cannot differentiate, therefore, skip
-				continue;
-			double error_rate = ccv_min(weigh[0] + aweigh1 - weigh[1], weigh[1] + aweigh0 - weigh[0]);
-			assert(error_rate > 0);
-			if (error_rate < min_find.error_rate)
-			{
-				min_find.error_index = j;
-				min_find.error_rate = error_rate;
-				min_find.weigh[0] = weigh[0];
-				min_find.weigh[1] = weigh[1];
-				min_find.count[0] = count[0];
-				min_find.count[1] = count[1];
-			}
-		}
-		feature_find[i] = min_find;
-	} parallel_endfor
+	ccv_icf_first_feature_find_context_t context;
+	context.positives = positives;
+	context.negatives = negatives;
+	context.precomputed = precomputed;
+	context.step = step;
+	context.example_state = example_state;
+	context.aweigh0 = aweigh0;
+	context.aweigh1 = aweigh1;
+	context.feature_find = feature_find;
+	ccv_parallel_for(feature_size, _ccv_icf_find_first_feature_block, &context);
 	ccv_icf_first_feature_find_t best = {
 		.error_rate = 1.0,
 		.error_index = -1,
@@ -982,58 +1016,95 @@ typedef struct {
 	double weigh[2];
 } ccv_icf_second_feature_find_t;
 
+typedef struct {
+	ccv_array_t* positives;
+	ccv_array_t* negatives;
+	uint8_t* precomputed;
+	size_t step;
+	ccv_icf_example_state_t* example_state;
+	uint8_t* lut;
+	int leaf;
+	double* aweigh;
+	ccv_icf_second_feature_find_t* feature_find;
+} ccv_icf_second_feature_find_context_t;
+
+// the split with the least error on the i-th feature, only the examples in the leaf count
+static void _ccv_icf_find_second_feature_block(size_t _i, void* _context)
+{
+	ccv_icf_second_feature_find_context_t* context = (ccv_icf_second_feature_find_context_t*)_context;
+	ccv_array_t* positives = context->positives;
+	ccv_array_t* negatives = context->negatives;
+	uint8_t* precomputed = context->precomputed;
+	size_t step = context->step;
+	ccv_icf_example_state_t* example_state = context->example_state;
+	uint8_t* lut = context->lut;
+	int leaf = context->leaf;
+	double* aweigh = context->aweigh;
+	ccv_icf_second_feature_find_t* feature_find = context->feature_find;
+	int i = (int)_i;
+	ccv_icf_second_feature_find_t min_find = {
+		.error_rate = 1.0,
+		.error_index = 0,
+		.weigh = {0, 0},
+	};
+	double weigh[2] = {0, 0};
+	uint8_t* computed = precomputed + step * i;
+	int j, k;
+	for (j = 0; j < positives->rnum + negatives->rnum; j++)
+	{
+		uint8_t skip;
+		uint32_t index;
+		_ccv_icf_3_uint8_to_1_uint1_1_uint23(computed + j * 3, &skip, &index);
+		conditional_assert(j == positives->rnum + negatives->rnum - 1, !skip);
+		assert(index >= 0 && index < positives->rnum + negatives->rnum);
+		// only care about part of the data
+		if (lut[index] == leaf)
+		{
+			uint8_t leaf_skip = 0;
+			for (k = j + 1; skip; k++)
+			{
+				uint32_t new_index;
+				_ccv_icf_3_uint8_to_1_uint1_1_uint23(computed + j * 3, &skip, &new_index);
+				// if the next equal one is the same leaf, we cannot distinguish them, skip
+				if ((leaf_skip = (lut[new_index] == leaf)))
+					break;
+				conditional_assert(k == positives->rnum + negatives->rnum - 1, !skip);
+			}
+			weigh[index < positives->rnum] += example_state[index].weight;
+			if (leaf_skip)
+				continue;
+			assert(example_state[index].weight > 0);
+			assert(weigh[0] <= aweigh[0] + 1e-10 && weigh[1] <= aweigh[1] + 1e-10);
+			double error_rate = ccv_min(weigh[0] + aweigh[1] - weigh[1], weigh[1] + aweigh[0] - weigh[0]);
+			if (error_rate < min_find.error_rate)
+			{
+				min_find.error_index = j;
+				min_find.error_rate = error_rate;
+				min_find.weigh[0] = weigh[0];
+				min_find.weigh[1] = weigh[1];
+			}
+		}
+	}
+	feature_find[i] = min_find;
+}
+
 static double _ccv_icf_find_second_feature(ccv_icf_decision_tree_cache_t intermediate_cache, int leaf, ccv_icf_feature_t* features, int feature_size, ccv_array_t* positives, ccv_array_t* negatives, uint8_t* precomputed, ccv_icf_example_state_t* example_state, ccv_icf_feature_t* feature)
 {
 	size_t step = (3 * (positives->rnum + negatives->rnum) + 3) & -4;
 	uint8_t* lut = intermediate_cache.lut;
 	double* aweigh = intermediate_cache.weigh + leaf * 2;
 	ccv_icf_second_feature_find_t* feature_find = (ccv_icf_second_feature_find_t*)ccmalloc(sizeof(ccv_icf_second_feature_find_t) * feature_size);
-	parallel_for(i, feature_size) {
-		ccv_icf_second_feature_find_t min_find = {
-			.error_rate = 1.0,
-			.error_index = 0,
-			.weigh = {0, 0},
-		};
-		double weigh[2] = {0, 0};
-		uint8_t* computed = precomputed + step * i;
-		int j, k;
-		for (j = 0; j < positives->rnum + negatives->rnum; j++)
-		{
-			uint8_t skip;
-			uint32_t index;
-			_ccv_icf_3_uint8_to_1_uint1_1_uint23(computed + j * 3, &skip, &index);
-			conditional_assert(j == positives->rnum + negatives->rnum - 1, !skip);
-			assert(index >= 0 && index < positives->rnum + negatives->rnum);
-			// only care about part of the data
-			if (lut[index] == leaf)
-			{
-				uint8_t leaf_skip = 0;
-				for (k = j + 1; skip; k++)
-				{
-					uint32_t new_index;
-					_ccv_icf_3_uint8_to_1_uint1_1_uint23(computed + j * 3, &skip, &new_index);
-					// if the next equal one is the same leaf, we cannot distinguish them, skip
-					if ((leaf_skip = (lut[new_index] == leaf)))
-						break;
-					conditional_assert(k == positives->rnum + negatives->rnum - 1, !skip);
-				}
-				weigh[index < positives->rnum] += example_state[index].weight;
-				if (leaf_skip)
-					continue;
-				assert(example_state[index].weight > 0);
-				assert(weigh[0] <= aweigh[0] + 1e-10 && weigh[1] <= aweigh[1] + 1e-10);
-				double error_rate = ccv_min(weigh[0] + aweigh[1] - weigh[1], weigh[1] + aweigh[0] - weigh[0]);
-				if (error_rate < min_find.error_rate)
-				{
-					min_find.error_index = j;
-					min_find.error_rate = error_rate;
-					min_find.weigh[0] = weigh[0];
-					min_find.weigh[1] = weigh[1];
-				}
-			}
-		}
-		feature_find[i] = min_find;
-	} parallel_endfor
+	ccv_icf_second_feature_find_context_t context;
+	context.positives = positives;
+	context.negatives = negatives;
+	context.precomputed = precomputed;
+	context.step = step;
+	context.example_state = example_state;
+	context.lut = lut;
+	context.leaf = leaf;
+	context.aweigh = aweigh;
+	context.feature_find = feature_find;
+	ccv_parallel_for(feature_size, _ccv_icf_find_second_feature_block, &context);
 	ccv_icf_second_feature_find_t best = {
 		.error_rate = 1.0,
 		.error_index = -1,
@@ -1962,19 +2033,17 @@ static int _ccv_is_equal_same_class(const void* _r1, const void* _r2, void* data
 		(int)(r2->rect.height * 1.5 + 0.5) >= r1->rect.height;
 }
 
-static void _ccv_icf_detect_objects_with_classifier_cascade(ccv_dense_matrix_t* a, ccv_icf_classifier_cascade_t** cascades, int count, ccv_icf_param_t params, ccv_array_t* seq[])
+static void _ccv_icf_detect_objects_with_classifier_cascade(ccv_pyramid_t* pyramid, ccv_icf_classifier_cascade_t** cascades, int count, ccv_icf_param_t params, ccv_array_t* seq[])
 {
 	int i, j, k, q, x, y;
+	ccv_dense_matrix_t* a = ccv_pyramid_level(pyramid, 0);
 	int scale_upto = 1;
 	for (i = 0; i < count; i++)
 		scale_upto = ccv_max(scale_upto, (int)(log(ccv_min((double)a->rows / (cascades[i]->size.height - cascades[i]->margin.top - cascades[i]->margin.bottom), (double)a->cols / (cascades[i]->size.width - cascades[i]->margin.left - cascades[i]->margin.right))) / log(2.) - DBL_MIN) + 1);
+	/* only the octaves of the pyramid, the scales in between are resampled from them */
 	ccv_dense_matrix_t** pyr = (ccv_dense_matrix_t**)alloca(sizeof(ccv_dense_matrix_t*) * scale_upto);
-	pyr[0] = a;
-	for (i = 1; i < scale_upto; i++)
-	{
-		pyr[i] = 0;
-		ccv_sample_down(pyr[i - 1], &pyr[i], 0, 0, 0);
-	}
+	for (i = 0; i < scale_upto; i++)
+		pyr[i] = ccv_pyramid_level(pyramid, i * (pyramid->interval + 1));
 	for (i = 0; i < scale_upto; i++)
 	{
 		// run it
@@ -2044,14 +2113,12 @@ static void _ccv_icf_detect_objects_with_classifier_cascade(ccv_dense_matrix_t*
 			}
 		}
 	}
-
-	for (i = 1; i < scale_upto; i++)
-		ccv_matrix_free(pyr[i]);
 }
 
-static void _ccv_icf_detect_objects_with_multiscale_classifier_cascade(ccv_dense_matrix_t* a, ccv_icf_multiscale_classifier_cascade_t** multiscale_cascade, int count, ccv_icf_param_t params, ccv_array_t* seq[])
+static void _ccv_icf_detect_objects_with_multiscale_classifier_cascade(ccv_pyramid_t* pyramid, ccv_icf_multiscale_classifier_cascade_t** multiscale_cascade, int count, ccv_icf_param_t params, ccv_array_t* seq[])
 {
 	int i, j, k, q, x, y, ix, iy, py;
+	ccv_dense_matrix_t* a = ccv_pyramid_level(pyramid, 0);
 	assert(multiscale_cascade[0]->count % multiscale_cascade[0]->octave == 0);
 	ccv_margin_t margin = multiscale_cascade[0]->cascade[multiscale_cascade[0]->count - 1].margin;
 	for (i = 1; i < count; i++)
@@ -2069,13 +2136,10 @@ static void _ccv_icf_detect_objects_with_multiscale_classifier_cascade(ccv_dense
 	int scale_upto = 1;
 	for (i = 0; i < count; i++)
 		scale_upto = ccv_max(scale_upto, (int)(log(ccv_min((double)a->rows / (multiscale_cascade[i]->cascade[0].size.height - multiscale_cascade[i]->cascade[0].margin.top - multiscale_cascade[i]->cascade[0].margin.bottom), (double)a->cols / (multiscale_cascade[i]->cascade[0].size.width - multiscale_cascade[i]->cascade[0].margin.left - multiscale_cascade[i]->cascade[0].margin.right))) / log(2.) - DBL_MIN) + 2 - multiscale_cascade[i]->octave);
+	/* only the octaves of the pyramid, the scales in between are resampled from them */
 	ccv_dense_matrix_t** pyr = (ccv_dense_matrix_t**)alloca(sizeof(ccv_dense_matrix_t*) * scale_upto);
-	pyr[0] = a;
-	for (i = 1; i < scale_upto; i++)
-	{
-		pyr[i] = 0;
-		ccv_sample_down(pyr[i - 1], &pyr[i], 0, 0, 0);
-	}
+	for (i = 0; i < scale_upto; i++)
+		pyr[i] = ccv_pyramid_level(pyramid, i * (pyramid->interval + 1));
 	for (i = 0; i < scale_upto; i++)
 	{
 		ccv_dense_matrix_t* bordered = 0;
@@ -2150,12 +2214,9 @@ static void _ccv_icf_detect_objects_with_multiscale_classifier_cascade(ccv_dense
 		}
 		ccv_matrix_free(sat);
 	}
-
-	for (i = 1; i < scale_upto; i++)
-		ccv_matrix_free(pyr[i]);
 }
 
-ccv_array_t* ccv_icf_detect_objects(ccv_dense_matrix_t* a, void* cascade, int count, ccv_icf_param_t params)
+ccv_array_t* ccv_icf_detect_objects_with_pyramid(ccv_pyramid_t* pyramid, void* cascade, int count, ccv_icf_param_t params)
 {
 	assert(count > 0);
 	int i, j, k;
@@ -2171,10 +2232,10 @@ ccv_array_t* ccv_icf_detect_objects(ccv_dense_matrix_t* a, void* cascade, int co
 	switch (type)
 	{
 		case CCV_ICF_CLASSIFIER_TYPE_A:
-			_ccv_icf_detect_objects_with_classifier_cascade(a, (ccv_icf_classifier_cascade_t**)cascade, count, params, seq);
+			_ccv_icf_detect_objects_with_classifier_cascade(pyramid, (ccv_icf_classifier_cascade_t**)cascade, count, params, seq);
 			break;
 		case CCV_ICF_CLASSIFIER_TYPE_B:
-			_ccv_icf_detect_objects_with_multiscale_classifier_cascade(a, (ccv_icf_multiscale_classifier_cascade_t**)cascade, count, params, seq);
+			_ccv_icf_detect_objects_with_multiscale_classifier_cascade(pyramid, (ccv_icf_multiscale_classifier_cascade_t**)cascade, count, params, seq);
 			break;
 	}
 	ccv_array_t* result_seq = ccv_array_new(sizeof(ccv_comp_t), 64, 0);
@@ -2192,8 +2253,9 @@ ccv_array_t* ccv_icf_detect_objects(ccv_dense_matrix_t* a, void* cascade, int co
 		} else {
 			ccv_array_t* idx_seq = 0;
 			ccv_array_clear(seq2);
+			float distance = 0.25; // the distance factor of _ccv_is_equal_same_class
 			// group retrieved rectangles in order to filter out noise
-			int ncomp = ccv_array_group(seq[k], &idx_seq, _ccv_is_equal_same_class, 0);
+			int ncomp = ccv_array_group_rect(seq[k], &idx_seq, _ccv_is_equal_same_class, ccv_comp_extent, &distance);
 			ccv_comp_t* comps = (ccv_comp_t*)cccalloc(ncomp + 1, sizeof(ccv_comp_t));
 
 			// count number of neighbors
@@ -2283,3 +2345,11 @@ ccv_array_t* ccv_icf_detect_objects(ccv_dense_matrix_t* a, void* cascade, int co
 
 	return result_seq;
 }
+
+ccv_array_t* ccv_icf_detect_objects(ccv_dense_matrix_t* a, void* cascade, int count, ccv_icf_param_t params)
+{
+	ccv_pyramid_t* pyramid = ccv_pyramid_new(a, params.interval);
+	ccv_array_t* result_seq = ccv_icf_detect_objects_with_pyramid(pyramid, cascade, count, params);
+	ccv_pyramid_free(pyramid);
+	return result_seq;
+}
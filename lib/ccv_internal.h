@@ -14,6 +14,16 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 #define ccv_descale(x, n) (((x) + (1 << ((n) - 1))) >> (n))
 #define conditional_assert(x, expr) if ((x)) { assert(expr); }
 
+/* an array allocated from an arena keeps the arena right before its header */
+#define CCV_ARRAY_ARENA_PREFIX (16)
+#define CCV_ARRAY_ARENA(array) (((ccv_arena_t**)(array))[-1])
+
+/* kernels for SIMD levels above the build flags are compiled with target attributes (or the target pragma)
+ * in the same object, and picked at runtime through a table indexed by ccv_get_simd_level() */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CCV_SIMD_X86
+#endif
+
 // dispathc_applydispatch_sync dispatch_groupĹAPI.ָĴָBlock뵽ָĶСȴвȫ.
 #ifdef USE_DISPATCH
 #define parallel_for(x, n) dispatch_apply(n, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t x) {
@@ -160,12 +170,26 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 #define _ccv_get_64s_value(ptr, i, factor) (((int64_t*)(ptr))[(i)] << factor)
 #define _ccv_get_64f_value(ptr, i, factor) ((double*)(ptr))[(i)]
 #define _ccv_get_8u_value(ptr, i, factor) (((unsigned char*)(ptr))[(i)] << factor)
+/* half precision types are widened to float on read, and narrowed on write */
+#define _ccv_get_16f_value(ptr, i, factor) ccv_half_to_float(((uint16_t*)(ptr))[(i)])
+#define _ccv_get_16bf_value(ptr, i, factor) ccv_bfloat_to_float(((uint16_t*)(ptr))[(i)])
 
 #define ccv_matrix_getter(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
 	case CCV_32S: { block(__VA_ARGS__, _ccv_get_32s_value); break; } \
 	case CCV_32F: { block(__VA_ARGS__, _ccv_get_32f_value); break; } \
 	case CCV_64S: { block(__VA_ARGS__, _ccv_get_64s_value); break; } \
 	case CCV_64F: { block(__VA_ARGS__, _ccv_get_64f_value); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision only goes through the _with_half variants"); break; } \
+	default: { block(__VA_ARGS__, _ccv_get_8u_value); } } }
+
+/* the half precision types only go through the _with_half variants, thus, they are not multiplied into every nested dispatch */
+#define ccv_matrix_getter_with_half(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
+	case CCV_32S: { block(__VA_ARGS__, _ccv_get_32s_value); break; } \
+	case CCV_32F: { block(__VA_ARGS__, _ccv_get_32f_value); break; } \
+	case CCV_64S: { block(__VA_ARGS__, _ccv_get_64s_value); break; } \
+	case CCV_64F: { block(__VA_ARGS__, _ccv_get_64f_value); break; } \
+	case CCV_16F: { block(__VA_ARGS__, _ccv_get_16f_value); break; } \
+	case CCV_16BF: { block(__VA_ARGS__, _ccv_get_16bf_value); break; } \
 	default: { block(__VA_ARGS__, _ccv_get_8u_value); } } }
 
 #define ccv_matrix_getter_a(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
@@ -173,6 +197,7 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 	case CCV_32F: { block(__VA_ARGS__, _ccv_get_32f_value); break; } \
 	case CCV_64S: { block(__VA_ARGS__, _ccv_get_64s_value); break; } \
 	case CCV_64F: { block(__VA_ARGS__, _ccv_get_64f_value); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision only goes through the _with_half variants"); break; } \
 	default: { block(__VA_ARGS__, _ccv_get_8u_value); } } }
 
 #define ccv_matrix_getter_b(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
@@ -180,6 +205,7 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 	case CCV_32F: { block(__VA_ARGS__, _ccv_get_32f_value); break; } \
 	case CCV_64S: { block(__VA_ARGS__, _ccv_get_64s_value); break; } \
 	case CCV_64F: { block(__VA_ARGS__, _ccv_get_64f_value); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision only goes through the _with_half variants"); break; } \
 	default: { block(__VA_ARGS__, _ccv_get_8u_value); } } }
 
 #define ccv_matrix_getter_integer_only(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
@@ -210,6 +236,7 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 	case CCV_32F: { block(__VA_ARGS__, float); break; } \
 	case CCV_64S: { block(__VA_ARGS__, int64_t); break; } \
 	case CCV_64F: { block(__VA_ARGS__, double); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision is a storage type"); break; } \
 	default: { block(__VA_ARGS__, unsigned char); } } }
 
 #define ccv_matrix_typeof_a(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
@@ -217,6 +244,7 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 	case CCV_32F: { block(__VA_ARGS__, float); break; } \
 	case CCV_64S: { block(__VA_ARGS__, int64_t); break; } \
 	case CCV_64F: { block(__VA_ARGS__, double); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision is a storage type"); break; } \
 	default: { block(__VA_ARGS__, unsigned char); } } }
 
 #define ccv_matrix_typeof_b(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
@@ -224,6 +252,7 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 	case CCV_32F: { block(__VA_ARGS__, float); break; } \
 	case CCV_64S: { block(__VA_ARGS__, int64_t); break; } \
 	case CCV_64F: { block(__VA_ARGS__, double); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision is a storage type"); break; } \
 	default: { block(__VA_ARGS__, unsigned char); } } }
 
 #define _ccv_set_32s_value(ptr, i, value, factor) (((int*)(ptr))[(i)] = (int)(value) >> factor)
@@ -231,12 +260,24 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 #define _ccv_set_64s_value(ptr, i, value, factor) (((int64_t*)(ptr))[(i)] = (int64_t)(value) >> factor)
 #define _ccv_set_64f_value(ptr, i, value, factor) (((double*)(ptr))[(i)] = (double)(value))
 #define _ccv_set_8u_value(ptr, i, value, factor) (((unsigned char*)(ptr))[(i)] = ccv_clamp((int)(value) >> factor, 0, 255))
+#define _ccv_set_16f_value(ptr, i, value, factor) (((uint16_t*)(ptr))[(i)] = ccv_float_to_half((float)(value)))
+#define _ccv_set_16bf_value(ptr, i, value, factor) (((uint16_t*)(ptr))[(i)] = ccv_float_to_bfloat((float)(value)))
 
 #define ccv_matrix_setter(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
 	case CCV_32S: { block(__VA_ARGS__, _ccv_set_32s_value); break; } \
 	case CCV_32F: { block(__VA_ARGS__, _ccv_set_32f_value); break; } \
 	case CCV_64S: { block(__VA_ARGS__, _ccv_set_64s_value); break; } \
 	case CCV_64F: { block(__VA_ARGS__, _ccv_set_64f_value); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision only goes through the _with_half variants"); break; } \
+	default: { block(__VA_ARGS__, _ccv_set_8u_value); } } }
+
+#define ccv_matrix_setter_with_half(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
+	case CCV_32S: { block(__VA_ARGS__, _ccv_set_32s_value); break; } \
+	case CCV_32F: { block(__VA_ARGS__, _ccv_set_32f_value); break; } \
+	case CCV_64S: { block(__VA_ARGS__, _ccv_set_64s_value); break; } \
+	case CCV_64F: { block(__VA_ARGS__, _ccv_set_64f_value); break; } \
+	case CCV_16F: { block(__VA_ARGS__, _ccv_set_16f_value); break; } \
+	case CCV_16BF: { block(__VA_ARGS__, _ccv_set_16bf_value); break; } \
 	default: { block(__VA_ARGS__, _ccv_set_8u_value); } } }
 
 #define ccv_matrix_setter_a(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
@@ -244,6 +285,7 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 	case CCV_32F: { block(__VA_ARGS__, _ccv_set_32f_value); break; } \
 	case CCV_64S: { block(__VA_ARGS__, _ccv_set_64s_value); break; } \
 	case CCV_64F: { block(__VA_ARGS__, _ccv_set_64f_value); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision only goes through the _with_half variants"); break; } \
 	default: { block(__VA_ARGS__, _ccv_set_8u_value); } } }
 
 #define ccv_matrix_setter_b(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
@@ -251,6 +293,7 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 	case CCV_32F: { block(__VA_ARGS__, _ccv_set_32f_value); break; } \
 	case CCV_64S: { block(__VA_ARGS__, _ccv_set_64s_value); break; } \
 	case CCV_64F: { block(__VA_ARGS__, _ccv_set_64f_value); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision only goes through the _with_half variants"); break; } \
 	default: { block(__VA_ARGS__, _ccv_set_8u_value); } } }
 
 #define ccv_matrix_setter_integer_only(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
@@ -269,6 +312,7 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 	case CCV_32F: { block(__VA_ARGS__, _ccv_set_32f_value, _ccv_get_32f_value); break; } \
 	case CCV_64S: { block(__VA_ARGS__, _ccv_set_64s_value, _ccv_get_64s_value); break; } \
 	case CCV_64F: { block(__VA_ARGS__, _ccv_set_64f_value, _ccv_get_64f_value); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision only goes through the _with_half variants"); break; } \
 	default: { block(__VA_ARGS__, _ccv_set_8u_value, _ccv_get_8u_value); } } }
 
 #define ccv_matrix_setter_getter_a(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
@@ -276,6 +320,7 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 	case CCV_32F: { block(__VA_ARGS__, _ccv_set_32f_value, _ccv_get_32f_value); break; } \
 	case CCV_64S: { block(__VA_ARGS__, _ccv_set_64s_value, _ccv_get_64s_value); break; } \
 	case CCV_64F: { block(__VA_ARGS__, _ccv_set_64f_value, _ccv_get_64f_value); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision only goes through the _with_half variants"); break; } \
 	default: { block(__VA_ARGS__, _ccv_set_8u_value, _ccv_get_8u_value); } } }
 
 #define ccv_matrix_setter_getter_b(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
@@ -283,6 +328,7 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 	case CCV_32F: { block(__VA_ARGS__, _ccv_set_32f_value, _ccv_get_32f_value); break; } \
 	case CCV_64S: { block(__VA_ARGS__, _ccv_set_64s_value, _ccv_get_64s_value); break; } \
 	case CCV_64F: { block(__VA_ARGS__, _ccv_set_64f_value, _ccv_get_64f_value); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision only goes through the _with_half variants"); break; } \
 	default: { block(__VA_ARGS__, _ccv_set_8u_value, _ccv_get_8u_value); } } }
 
 #define ccv_matrix_setter_getter_integer_only(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
@@ -301,6 +347,7 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 	case CCV_32F: { block(__VA_ARGS__, float, _ccv_get_32f_value); break; } \
 	case CCV_64S: { block(__VA_ARGS__, int64_t, _ccv_get_64s_value); break; } \
 	case CCV_64F: { block(__VA_ARGS__, double, _ccv_get_64f_value); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision only goes through the _with_half variants"); break; } \
 	default: { block(__VA_ARGS__, unsigned char, _ccv_get_8u_value); } } }
 
 #define ccv_matrix_typeof_getter_a(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
@@ -308,6 +355,7 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 	case CCV_32F: { block(__VA_ARGS__, float, _ccv_get_32f_value); break; } \
 	case CCV_64S: { block(__VA_ARGS__, int64_t, _ccv_get_64s_value); break; } \
 	case CCV_64F: { block(__VA_ARGS__, double, _ccv_get_64f_value); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision only goes through the _with_half variants"); break; } \
 	default: { block(__VA_ARGS__, unsigned char, _ccv_get_8u_value); } } }
 
 #define ccv_matrix_typeof_getter_b(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
@@ -315,6 +363,7 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 	case CCV_32F: { block(__VA_ARGS__, float, _ccv_get_32f_value); break; } \
 	case CCV_64S: { block(__VA_ARGS__, int64_t, _ccv_get_64s_value); break; } \
 	case CCV_64F: { block(__VA_ARGS__, double, _ccv_get_64f_value); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision only goes through the _with_half variants"); break; } \
 	default: { block(__VA_ARGS__, unsigned char, _ccv_get_8u_value); } } }
 
 #define ccv_matrix_typeof_setter(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
@@ -322,6 +371,7 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 	case CCV_32F: { block(__VA_ARGS__, float, _ccv_set_32f_value); break; } \
 	case CCV_64S: { block(__VA_ARGS__, int64_t, _ccv_set_64s_value); break; } \
 	case CCV_64F: { block(__VA_ARGS__, double, _ccv_set_64f_value); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision only goes through the _with_half variants"); break; } \
 	default: { block(__VA_ARGS__, unsigned char, _ccv_set_8u_value); } } }
 
 #define ccv_matrix_typeof_setter_a(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
@@ -329,6 +379,7 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 	case CCV_32F: { block(__VA_ARGS__, float, _ccv_set_32f_value); break; } \
 	case CCV_64S: { block(__VA_ARGS__, int64_t, _ccv_set_64s_value); break; } \
 	case CCV_64F: { block(__VA_ARGS__, double, _ccv_set_64f_value); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision only goes through the _with_half variants"); break; } \
 	default: { block(__VA_ARGS__, unsigned char, _ccv_set_8u_value); } } }
 
 #define ccv_matrix_typeof_setter_b(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
@@ -336,6 +387,7 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 	case CCV_32F: { block(__VA_ARGS__, float, _ccv_set_32f_value); break; } \
 	case CCV_64S: { block(__VA_ARGS__, int64_t, _ccv_set_64s_value); break; } \
 	case CCV_64F: { block(__VA_ARGS__, double, _ccv_set_64f_value); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision only goes through the _with_half variants"); break; } \
 	default: { block(__VA_ARGS__, unsigned char, _ccv_set_8u_value); } } }
 
 #define ccv_matrix_typeof_setter_getter(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
@@ -343,6 +395,7 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 	case CCV_32F: { block(__VA_ARGS__, float, _ccv_set_32f_value, _ccv_get_32f_value); break; } \
 	case CCV_64S: { block(__VA_ARGS__, int64_t, _ccv_set_64s_value, _ccv_get_64s_value); break; } \
 	case CCV_64F: { block(__VA_ARGS__, double, _ccv_set_64f_value, _ccv_get_64f_value); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision only goes through the _with_half variants"); break; } \
 	default: { block(__VA_ARGS__, unsigned char, _ccv_set_8u_value, _ccv_get_8u_value); } } }
 
 #define ccv_matrix_typeof_setter_getter_a(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
@@ -350,6 +403,7 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 	case CCV_32F: { block(__VA_ARGS__, float, _ccv_set_32f_value, _ccv_get_32f_value); break; } \
 	case CCV_64S: { block(__VA_ARGS__, int64_t, _ccv_set_64s_value, _ccv_get_64s_value); break; } \
 	case CCV_64F: { block(__VA_ARGS__, double, _ccv_set_64f_value, _ccv_get_64f_value); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision only goes through the _with_half variants"); break; } \
 	default: { block(__VA_ARGS__, unsigned char, _ccv_set_8u_value, _ccv_get_8u_value); } } }
 
 #define ccv_matrix_typeof_setter_getter_b(type, block, ...) { switch (CCV_GET_DATA_TYPE(type)) { \
@@ -357,6 +411,7 @@ static int _CCV_PRINT_LOOP __attribute__ ((unused)) = 0;
 	case CCV_32F: { block(__VA_ARGS__, float, _ccv_set_32f_value, _ccv_get_32f_value); break; } \
 	case CCV_64S: { block(__VA_ARGS__, int64_t, _ccv_set_64s_value, _ccv_get_64s_value); break; } \
 	case CCV_64F: { block(__VA_ARGS__, double, _ccv_set_64f_value, _ccv_get_64f_value); break; } \
+	case CCV_16F: case CCV_16BF: { assert(0 && "half precision only goes through the _with_half variants"); break; } \
 	default: { block(__VA_ARGS__, unsigned char, _ccv_set_8u_value, _ccv_get_8u_value); } } }
 
 /****************************************************************************************\
@@ -1,6 +1,10 @@
 #include "ccv.h"
 #include "ccv_internal.h"
 #include "3rdparty/sha1/sha1.h"
+#include "3rdparty/xxhash/xxhash.h"
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #ifdef __APPLE__
 #include "TargetConditionals.h"
@@ -10,9 +14,15 @@
 #endif
 #endif
 
-
-//static __thread 
-ccv_cache_t ccv_cache;
+typedef struct ccv_cache_shard_t {
+	ccv_cache_t cache;
+	uint64_t miss[2]; // per cache type, only we know what type a lookup is for
+#ifdef HAVE_PTHREAD
+	pthread_mutex_t mutex;
+	struct ccv_cache_shard_t* next;
+	int generation; // of a thread-local cache, see ccv_cache_generation
+#endif
+} ccv_cache_shard_t;
 
 /**
  * For new typed cache object:
@@ -20,9 +30,656 @@ ccv_cache_t ccv_cache;
  * ccv_array_t: type 1
  **/
 
+/* CCV_CACHE_GLOBAL only uses the first shard, CCV_CACHE_THREAD_LOCAL allocates one per thread */
+static ccv_cache_shard_t ccv_cache_shard[CCV_CACHE_SHARD_NUM];
+
 /* option to enable/disable cache */
-//static __thread 
-int ccv_cache_opt = 0;
+static int ccv_cache_opt = 0;
+static int ccv_cache_mode = CCV_CACHE_GLOBAL;
+static size_t ccv_cache_up = 0;
+
+#ifdef HAVE_PTHREAD
+static pthread_once_t ccv_cache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ccv_cache_thread_key;
+static pthread_mutex_t ccv_cache_registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ccv_cache_shard_t* ccv_cache_registry = 0; // all the thread-local caches that are still alive
+static ccv_cache_stats_t ccv_cache_retired[2]; // counters of thread-local caches whose threads already exited
+/* bumped whenever the cache is enabled or disabled, 0 until it is first enabled. A thread-local cache is only ever
+ * touched by its own thread, the one from an older generation is stale, and its thread drops it on the next use */
+static int ccv_cache_generation = 0;
+
+static void _ccv_cache_shard_stats(ccv_cache_shard_t* shard, int type, ccv_cache_stats_t* stats);
+
+static void _ccv_cache_thread_exit(void* context)
+{
+	ccv_cache_shard_t* shard = (ccv_cache_shard_t*)context;
+	pthread_mutex_lock(&ccv_cache_registry_mutex);
+	ccv_cache_shard_t** prev = &ccv_cache_registry;
+	while (*prev && *prev != shard)
+		prev = &(*prev)->next;
+	if (*prev)
+		*prev = shard->next;
+	ccv_cache_close(&shard->cache);
+	_ccv_cache_shard_stats(shard, CCV_CACHE_MATRIX, ccv_cache_retired + CCV_CACHE_MATRIX);
+	_ccv_cache_shard_stats(shard, CCV_CACHE_ARRAY, ccv_cache_retired + CCV_CACHE_ARRAY);
+	pthread_mutex_unlock(&ccv_cache_registry_mutex);
+	ccfree(shard);
+}
+
+static void _ccv_cache_once_init(void)
+{
+	int i;
+	for (i = 0; i < CCV_CACHE_SHARD_NUM; i++)
+		pthread_mutex_init(&ccv_cache_shard[i].mutex, 0);
+	pthread_key_create(&ccv_cache_thread_key, _ccv_cache_thread_exit);
+}
+#endif
+
+static int ccv_signature_mode = CCV_SIGNATURE_SHA1;
+
+/* lazy content signature is a token with a tag that generated signatures never have, the token stays as
+ * the matrix signature, and maps to the matrix through a registry (which is just another radix-tree cache)
+ * until the matrix is freed, the content signature is computed the first time a derived signature needs it */
+#define CCV_LAZY_SIGN_TAG (0xCCF0)
+#define CCV_IS_LAZY_SIGN(x) (((x) >> 48) == CCV_LAZY_SIGN_TAG)
+
+typedef struct {
+	ccv_dense_matrix_t* dmt;
+	uint64_t sig; // the content signature, 0 if not computed yet
+} ccv_lazy_sign_t;
+
+static ccv_cache_t ccv_lazy_registry;
+static uint64_t ccv_lazy_sign_count = 0;
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t ccv_lazy_registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void _ccv_lazy_registry_lock(void)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&ccv_lazy_registry_mutex);
+#endif
+}
+
+static void _ccv_lazy_registry_unlock(void)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&ccv_lazy_registry_mutex);
+#endif
+}
+
+static uint64_t _ccv_lazy_signature_new(ccv_dense_matrix_t* dmt)
+{
+	ccv_lazy_sign_t* lazy = (ccv_lazy_sign_t*)ccmalloc(sizeof(ccv_lazy_sign_t));
+	lazy->dmt = dmt;
+	lazy->sig = 0;
+	_ccv_lazy_registry_lock();
+	if (ccv_lazy_sign_count == 0)
+		ccv_cache_init(&ccv_lazy_registry, ~(size_t)0, 1, ccfree);
+	uint64_t sig = ((uint64_t)CCV_LAZY_SIGN_TAG << 48) | (++ccv_lazy_sign_count & 0xFFFFFFFFFFFFULL);
+	ccv_cache_put(&ccv_lazy_registry, sig, lazy, 0, 0);
+	_ccv_lazy_registry_unlock();
+	return sig;
+}
+
+static void _ccv_lazy_signature_forget(uint64_t sig)
+{
+	_ccv_lazy_registry_lock();
+	ccv_cache_delete(&ccv_lazy_registry, sig);
+	_ccv_lazy_registry_unlock();
+}
+
+static uint64_t _ccv_content_signature(ccv_dense_matrix_t* dmt)
+{
+	uint64_t type = (uint64_t)CCV_GET_DATA_TYPE(dmt->type) | CCV_GET_CHANNEL(dmt->type) | CCV_MATRIX_DENSE;
+	int i, width = dmt->cols * CCV_GET_CHANNEL(dmt->type) * CCV_GET_DATA_TYPE_SIZE(dmt->type);
+	if (width == dmt->step)
+		return ccv_cache_generate_signature((char*)dmt->data.u8, dmt->rows * dmt->step, type, CCV_EOF_SIGN);
+	/* a view or a padded step, the bytes between rows are not its content (or not even initialized),
+	 * only the elements are hashed, row by row, which gives the same signature as a packed matrix */
+	union {
+		uint64_t u;
+		uint8_t chr[20];
+	} sig;
+	if (ccv_signature_mode & CCV_SIGNATURE_XXHASH)
+	{
+		xxh64_ctx_t ctx;
+		xxh64_init(&ctx, 0);
+		xxh64_update(&ctx, &type, 8);
+		for (i = 0; i < dmt->rows; i++)
+			xxh64_update(&ctx, dmt->data.u8 + i * dmt->step, width);
+		sig.u = xxh64_final(&ctx);
+	} else {
+		blk_SHA_CTX ctx;
+		blk_SHA1_Init(&ctx);
+		blk_SHA1_Update(&ctx, &type, 8);
+		for (i = 0; i < dmt->rows; i++)
+			blk_SHA1_Update(&ctx, dmt->data.u8 + i * dmt->step, width);
+		blk_SHA1_Final(sig.chr, &ctx);
+	}
+	if (CCV_IS_LAZY_SIGN(sig.u))
+		sig.u ^= (uint64_t)1 << 48;
+	return sig.u;
+}
+
+/* only resolve the content signature if it is going to be used by cache, otherwise, the token itself
+ * is a valid signature for the content (it is unique in the process lifetime) */
+static uint64_t _ccv_lazy_signature_resolve(uint64_t sig)
+{
+	if (!ccv_cache_opt || !CCV_IS_LAZY_SIGN(sig))
+		return sig;
+	_ccv_lazy_registry_lock();
+	ccv_lazy_sign_t* lazy = (ccv_lazy_sign_t*)ccv_cache_get(&ccv_lazy_registry, sig, 0);
+	_ccv_lazy_registry_unlock();
+	if (!lazy)
+		return sig;
+	// hashing outside of the lock, if two threads race here, they compute the same value
+	if (!lazy->sig)
+		lazy->sig = _ccv_content_signature(lazy->dmt);
+	return lazy->sig;
+}
+
+/* the on-disk tier, dense matrices evicted from memory are spilled to it, a spilled matrix is this header
+ * followed by rows * step bytes of data */
+typedef struct {
+	int type;
+	int rows;
+	int cols;
+	int step;
+} ccv_disk_matrix_t;
+
+static ccv_disk_cache_t* ccv_disk_cache = 0;
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t ccv_disk_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void _ccv_disk_cache_lock(void)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&ccv_disk_cache_mutex);
+#endif
+}
+
+static void _ccv_disk_cache_unlock(void)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&ccv_disk_cache_mutex);
+#endif
+}
+
+static void _ccv_cache_evict(uint64_t sig, void* x, uint8_t type)
+{
+	if (type == CCV_CACHE_ARRAY)
+	{
+		ccv_array_free_immediately((ccv_array_t*)x);
+		return;
+	}
+	ccv_dense_matrix_t* mat = (ccv_dense_matrix_t*)x;
+	size_t size = (size_t)mat->rows * mat->step;
+	_ccv_disk_cache_lock();
+	ccv_disk_matrix_t* header = ccv_disk_cache ? (ccv_disk_matrix_t*)ccv_disk_cache_reserve(ccv_disk_cache, sig, sizeof(ccv_disk_matrix_t) + size) : 0;
+	if (header)
+	{
+		header->type = CCV_GET_DATA_TYPE(mat->type) | CCV_GET_CHANNEL(mat->type);
+		header->rows = mat->rows;
+		header->cols = mat->cols;
+		header->step = mat->step;
+		memcpy(header + 1, mat->data.u8, size);
+		ccv_disk_cache_commit(ccv_disk_cache);
+	}
+	_ccv_disk_cache_unlock();
+	ccv_matrix_free_immediately(mat);
+}
+
+static ccv_dense_matrix_t* _ccv_disk_cache_out(uint64_t sig)
+{
+	ccv_dense_matrix_t* mat = 0;
+	_ccv_disk_cache_lock();
+	size_t size = 0;
+	const ccv_disk_matrix_t* header = ccv_disk_cache ? (const ccv_disk_matrix_t*)ccv_disk_cache_get(ccv_disk_cache, sig, &size) : 0;
+	if (header && size >= sizeof(ccv_disk_matrix_t) + (size_t)header->rows * header->step)
+	{
+		// no signature, otherwise it will look up the cache again
+		mat = ccv_dense_matrix_new(header->rows, header->cols, header->type, 0, 0);
+		const unsigned char* data = (const unsigned char*)(header + 1);
+		if (mat->step == header->step)
+			memcpy(mat->data.u8, data, (size_t)header->rows * header->step);
+		else { // the alignment mode changed
+			int i;
+			for (i = 0; i < header->rows; i++)
+				memcpy(mat->data.u8 + i * mat->step, data + i * header->step, ccv_min(mat->step, header->step));
+		}
+		mat->sig = sig;
+	}
+	_ccv_disk_cache_unlock();
+	return mat;
+}
+
+int ccv_enable_disk_cache(const char* path, size_t size)
+{
+	ccv_disable_disk_cache();
+	ccv_disk_cache_t* disk_cache = ccv_disk_cache_open(path, size);
+	if (!disk_cache)
+		return -1;
+	_ccv_disk_cache_lock();
+	ccv_disk_cache = disk_cache;
+	_ccv_disk_cache_unlock();
+	return 0;
+}
+
+void ccv_disable_disk_cache(void)
+{
+	_ccv_disk_cache_lock();
+	if (ccv_disk_cache)
+		ccv_disk_cache_close(ccv_disk_cache);
+	ccv_disk_cache = 0;
+	_ccv_disk_cache_unlock();
+}
+
+#ifdef HAVE_PTHREAD
+/* the cache of the calling thread, if it has one, a stale one is emptied and renewed here, by its own thread */
+static ccv_cache_shard_t* _ccv_cache_thread_shard(void)
+{
+	int generation = __sync_fetch_and_add(&ccv_cache_generation, 0);
+	if (!generation) // the thread key isn't created yet
+		return 0;
+	ccv_cache_shard_t* shard = (ccv_cache_shard_t*)pthread_getspecific(ccv_cache_thread_key);
+	if (shard && shard->generation != generation)
+	{
+		ccv_cache_close(&shard->cache);
+		ccv_cache_init(&shard->cache, ccv_cache_up, 2, ccv_matrix_free_immediately, ccv_array_free_immediately);
+		shard->cache.fevict = _ccv_cache_evict;
+		shard->miss[CCV_CACHE_MATRIX] = shard->miss[CCV_CACHE_ARRAY] = 0;
+		shard->generation = generation;
+	}
+	return shard;
+}
+#endif
+
+/* find the cache to work with for a given signature, the application-wide shards are returned locked */
+static ccv_cache_shard_t* _ccv_cache_shard_acquire(uint64_t sig)
+{
+#ifdef HAVE_PTHREAD
+	ccv_cache_shard_t* shard = _ccv_cache_thread_shard();
+	if (ccv_cache_mode == CCV_CACHE_THREAD_LOCAL)
+	{
+		if (!shard)
+		{
+			shard = (ccv_cache_shard_t*)ccmalloc(sizeof(ccv_cache_shard_t));
+			ccv_cache_init(&shard->cache, ccv_cache_up, 2, ccv_matrix_free_immediately, ccv_array_free_immediately);
+			shard->cache.fevict = _ccv_cache_evict;
+			shard->miss[CCV_CACHE_MATRIX] = shard->miss[CCV_CACHE_ARRAY] = 0;
+			shard->generation = __sync_fetch_and_add(&ccv_cache_generation, 0);
+			pthread_mutex_lock(&ccv_cache_registry_mutex);
+			shard->next = ccv_cache_registry;
+			ccv_cache_registry = shard;
+			pthread_mutex_unlock(&ccv_cache_registry_mutex);
+			pthread_setspecific(ccv_cache_thread_key, shard);
+		}
+		return shard;
+	}
+	pthread_once(&ccv_cache_once, _ccv_cache_once_init);
+	// the trie in ccv_cache.c consumes the lower 60 bits, use the highest 4 bits to pick shard
+	shard = ccv_cache_shard + ((ccv_cache_mode == CCV_CACHE_SHARDED) ? ((sig >> 60) & (CCV_CACHE_SHARD_NUM - 1)) : 0);
+	pthread_mutex_lock(&shard->mutex);
+	return shard;
+#else
+	return ccv_cache_shard;
+#endif
+}
+
+static void _ccv_cache_shard_release(ccv_cache_shard_t* shard)
+{
+#ifdef HAVE_PTHREAD
+	// only the application-wide shards are locked, whatever the mode is now
+	if (shard >= ccv_cache_shard && shard < ccv_cache_shard + CCV_CACHE_SHARD_NUM)
+		pthread_mutex_unlock(&shard->mutex);
+#endif
+}
+
+static void* _ccv_cache_out(uint64_t sig, uint8_t want, uint8_t* type)
+{
+	ccv_cache_shard_t* shard = _ccv_cache_shard_acquire(sig);
+	void* x = ccv_cache_out(&shard->cache, sig, type);
+	int disk = !x && want == CCV_CACHE_MATRIX && ccv_disk_cache;
+	if (!x && !disk)
+		++shard->miss[want];
+	_ccv_cache_shard_release(shard);
+	// fault in from the on-disk tier, only count the miss if it is not there either
+	if (disk)
+	{
+		x = _ccv_disk_cache_out(sig);
+		if (x)
+			*type = CCV_CACHE_MATRIX;
+		else {
+			shard = _ccv_cache_shard_acquire(sig);
+			++shard->miss[want];
+			_ccv_cache_shard_release(shard);
+		}
+	}
+	return x;
+}
+
+static void _ccv_cache_put(uint64_t sig, void* x, uint32_t size, uint8_t type)
+{
+	ccv_cache_shard_t* shard = _ccv_cache_shard_acquire(sig);
+	// the object is larger than the shard can hold, free it now otherwise it will leak
+	if (ccv_cache_put(&shard->cache, sig, x, size, type) < 0)
+		shard->cache.ffree[type](x);
+	_ccv_cache_shard_release(shard);
+}
+
+/* matrix pool keeps freed matrices in size-class free lists, classes are 2^n and 1.5 * 2^n bytes from 64 bytes
+ * to 64MiB. A pooled block starts with a 64-byte prefix that records its class (the matrix may be reshaped
+ * in place later, thus, we cannot infer it), the matrix header sits right after the prefix. */
+#define CCV_POOL_PREFIX (64)
+#define CCV_POOL_CLASS_NUM (41)
+#define CCV_POOL_MAX_SIZE ((size_t)1 << 26)
+
+/* a thread only ever touches its own free lists, when the pool is disabled, other threads drain theirs
+ * the next time they allocate or free a dense matrix, or when they exit */
+typedef struct {
+	void* free[CCV_POOL_CLASS_NUM];
+} ccv_matrix_pool_t;
+
+static int ccv_matrix_pool_opt = 0; // if the pool has ever been enabled
+static size_t ccv_matrix_pool_up = 0; // 0 if the pool is disabled
+static size_t ccv_matrix_pool_size = 0; // bytes in free lists of all threads, only updated atomically
+
+#ifdef HAVE_PTHREAD
+static pthread_once_t ccv_matrix_pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ccv_matrix_pool_thread_key;
+#else
+static ccv_matrix_pool_t ccv_matrix_pool;
+#endif
+
+static inline int _ccv_matrix_pool_class(size_t size)
+{
+	if (size <= 64)
+		return 0;
+	int p = 64 - __builtin_clzll((unsigned long long)(size - 1)); // 2^p is the smallest power of 2 that >= size
+	return (size <= ((size_t)3 << (p - 2))) ? 2 * p - 13 : 2 * (p - 6);
+}
+
+static inline size_t _ccv_matrix_pool_class_size(int k)
+{
+	return (k & 1) ? ((size_t)3 << (k / 2 + 5)) : ((size_t)1 << (k / 2 + 6));
+}
+
+static void _ccv_matrix_pool_drain(ccv_matrix_pool_t* pool)
+{
+	int k;
+	for (k = 0; k < CCV_POOL_CLASS_NUM; k++)
+		while (pool->free[k])
+		{
+			void* block = pool->free[k];
+			pool->free[k] = *(void**)block;
+			__sync_sub_and_fetch(&ccv_matrix_pool_size, _ccv_matrix_pool_class_size(k));
+			ccfree(block);
+		}
+}
+
+#ifdef HAVE_PTHREAD
+static void _ccv_matrix_pool_thread_exit(void* context)
+{
+	ccv_matrix_pool_t* pool = (ccv_matrix_pool_t*)context;
+	_ccv_matrix_pool_drain(pool);
+	ccfree(pool);
+}
+
+static void _ccv_matrix_pool_once_init(void)
+{
+	pthread_key_create(&ccv_matrix_pool_thread_key, _ccv_matrix_pool_thread_exit);
+}
+#endif
+
+static ccv_matrix_pool_t* _ccv_matrix_pool_get(void)
+{
+#ifdef HAVE_PTHREAD
+	ccv_matrix_pool_t* pool = (ccv_matrix_pool_t*)pthread_getspecific(ccv_matrix_pool_thread_key);
+	if (!pool)
+	{
+		pool = (ccv_matrix_pool_t*)cccalloc(1, sizeof(ccv_matrix_pool_t));
+		pthread_setspecific(ccv_matrix_pool_thread_key, pool);
+	}
+	return pool;
+#else
+	return &ccv_matrix_pool;
+#endif
+}
+
+/* empty the free lists of the calling thread, if it has any */
+static void _ccv_matrix_pool_drain_self(void)
+{
+	if (!ccv_matrix_pool_opt)
+		return;
+#ifdef HAVE_PTHREAD
+	ccv_matrix_pool_t* pool = (ccv_matrix_pool_t*)pthread_getspecific(ccv_matrix_pool_thread_key);
+	if (pool)
+		_ccv_matrix_pool_drain(pool);
+#else
+	_ccv_matrix_pool_drain(&ccv_matrix_pool);
+#endif
+}
+
+static ccv_dense_matrix_t* _ccv_matrix_pool_alloc(size_t size)
+{
+	size += CCV_POOL_PREFIX;
+	if (!ccv_matrix_pool_up)
+	{
+		_ccv_matrix_pool_drain_self();
+		return 0;
+	}
+	if (size > CCV_POOL_MAX_SIZE)
+		return 0;
+	int k = _ccv_matrix_pool_class(size);
+	ccv_matrix_pool_t* pool = _ccv_matrix_pool_get();
+	unsigned char* block = (unsigned char*)pool->free[k];
+	if (block)
+	{
+		pool->free[k] = *(void**)block;
+		__sync_sub_and_fetch(&ccv_matrix_pool_size, _ccv_matrix_pool_class_size(k));
+	} else if (ccmemalign((void**)&block, CCV_POOL_PREFIX, _ccv_matrix_pool_class_size(k)) != 0)
+		return 0;
+	*(int*)block = k;
+	return (ccv_dense_matrix_t*)(block + CCV_POOL_PREFIX);
+}
+
+static void _ccv_matrix_pool_free(ccv_dense_matrix_t* mat)
+{
+	unsigned char* block = (unsigned char*)mat - CCV_POOL_PREFIX;
+	int k = *(int*)block;
+	size_t size = _ccv_matrix_pool_class_size(k);
+	if (ccv_matrix_pool_up && __sync_add_and_fetch(&ccv_matrix_pool_size, size) <= ccv_matrix_pool_up)
+	{
+		ccv_matrix_pool_t* pool = _ccv_matrix_pool_get();
+		*(void**)block = pool->free[k];
+		pool->free[k] = block;
+	} else {
+		if (ccv_matrix_pool_up)
+			__sync_sub_and_fetch(&ccv_matrix_pool_size, size);
+		else
+			_ccv_matrix_pool_drain_self();
+		ccfree(block);
+	}
+}
+
+/* a view keeps its parent right after the header */
+#define CCV_DENSE_VIEW_PARENT(mat) (((ccv_dense_matrix_t**)((mat) + 1))[0])
+
+static void _ccv_dense_matrix_dealloc(ccv_dense_matrix_t* mat)
+{
+	if (mat->type & CCV_VIEW)
+	{
+		ccv_dense_matrix_t* parent = CCV_DENSE_VIEW_PARENT(mat);
+		ccfree(mat);
+		if (parent)
+			ccv_matrix_free(parent);
+	} else if (mat->type & CCV_POOLED)
+		_ccv_matrix_pool_free(mat);
+	else
+		ccfree(mat);
+}
+
+void ccv_enable_matrix_pool(size_t size)
+{
+#ifdef HAVE_PTHREAD
+	pthread_once(&ccv_matrix_pool_once, _ccv_matrix_pool_once_init);
+#endif
+	ccv_matrix_pool_opt = 1;
+	ccv_matrix_pool_up = size;
+}
+
+void ccv_disable_matrix_pool(void)
+{
+	ccv_matrix_pool_up = 0;
+	_ccv_matrix_pool_drain_self();
+}
+
+/* arena memory starts at 64 bytes after the block header */
+#define CCV_ARENA_BLOCK_HEADER (64)
+
+typedef struct ccv_arena_scope_t {
+	struct ccv_arena_scope_t* prev;
+	ccv_arena_block_t* block;
+	size_t rnum;
+	ccv_arena_t* active; // the active arena before this scope
+} ccv_arena_scope_t;
+
+static int ccv_arena_opt = 0; // if any arena has been created
+#ifdef HAVE_PTHREAD
+static pthread_once_t ccv_arena_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ccv_arena_thread_key;
+
+static void _ccv_arena_once_init(void)
+{
+	pthread_key_create(&ccv_arena_thread_key, 0);
+}
+#else
+static ccv_arena_t* ccv_arena_active = 0;
+#endif
+
+static ccv_arena_t* _ccv_arena_active(void)
+{
+	if (!ccv_arena_opt)
+		return 0;
+#ifdef HAVE_PTHREAD
+	return (ccv_arena_t*)pthread_getspecific(ccv_arena_thread_key);
+#else
+	return ccv_arena_active;
+#endif
+}
+
+static void _ccv_arena_set_active(ccv_arena_t* arena)
+{
+#ifdef HAVE_PTHREAD
+	pthread_setspecific(ccv_arena_thread_key, arena);
+#else
+	ccv_arena_active = arena;
+#endif
+}
+
+static ccv_arena_block_t* _ccv_arena_block_new(size_t size)
+{
+	ccv_arena_block_t* block;
+	if (ccmemalign((void**)&block, CCV_ARENA_BLOCK_HEADER, CCV_ARENA_BLOCK_HEADER + size) != 0)
+		return 0;
+	block->next = 0;
+	block->size = size;
+	block->rnum = 0;
+	return block;
+}
+
+ccv_arena_t* ccv_arena_new(size_t size)
+{
+#ifdef HAVE_PTHREAD
+	pthread_once(&ccv_arena_once, _ccv_arena_once_init);
+#endif
+	ccv_arena_opt = 1;
+	ccv_arena_t* arena = (ccv_arena_t*)ccmalloc(sizeof(ccv_arena_t));
+	arena->size = (ccv_max(size, 1024) + 15) & ~(size_t)15;
+	arena->head = arena->block = _ccv_arena_block_new(arena->size);
+	assert(arena->head);
+	arena->scope = 0;
+	return arena;
+}
+
+void* ccv_arena_alloc(ccv_arena_t* arena, size_t size)
+{
+	size = (size + 15) & ~(size_t)15;
+	ccv_arena_block_t* block = arena->block;
+	while (block->rnum + size > block->size)
+	{
+		if (block->next && block->next->size >= size)
+			block = block->next;
+		else {
+			// insert a new block after the current one, the smaller free blocks after it will be used later
+			ccv_arena_block_t* next = _ccv_arena_block_new(ccv_max(arena->size, size));
+			assert(next);
+			next->next = block->next;
+			block->next = next;
+			block = next;
+		}
+		block->rnum = 0;
+	}
+	arena->block = block;
+	void* ptr = (unsigned char*)block + CCV_ARENA_BLOCK_HEADER + block->rnum;
+	block->rnum += size;
+	return ptr;
+}
+
+void ccv_arena_push(ccv_arena_t* arena)
+{
+	ccv_arena_block_t* block = arena->block;
+	size_t rnum = block->rnum;
+	ccv_arena_scope_t* scope = (ccv_arena_scope_t*)ccv_arena_alloc(arena, sizeof(ccv_arena_scope_t));
+	scope->prev = (ccv_arena_scope_t*)arena->scope;
+	scope->block = block;
+	scope->rnum = rnum;
+	scope->active = _ccv_arena_active();
+	arena->scope = scope;
+	_ccv_arena_set_active(arena);
+}
+
+void ccv_arena_pop(ccv_arena_t* arena)
+{
+	ccv_arena_scope_t* scope = (ccv_arena_scope_t*)arena->scope;
+	assert(scope);
+	// read everything out before the scope record is released with the rest
+	ccv_arena_t* active = scope->active;
+	arena->scope = scope->prev;
+	arena->block = scope->block;
+	arena->block->rnum = scope->rnum;
+	_ccv_arena_set_active(active);
+}
+
+void ccv_arena_free(ccv_arena_t* arena)
+{
+	if (_ccv_arena_active() == arena)
+		_ccv_arena_set_active(0);
+	ccv_arena_block_t* block = arena->head;
+	while (block)
+	{
+		ccv_arena_block_t* next = block->next;
+		ccfree(block);
+		block = next;
+	}
+	ccfree(arena);
+}
+
+static int ccv_matrix_alignment_mode = CCV_MATRIX_ALIGN_NONE;
+
+void ccv_set_matrix_alignment_mode(int mode)
+{
+	assert(mode == CCV_MATRIX_ALIGN_NONE || mode == CCV_MATRIX_ALIGN_DATA || mode == CCV_MATRIX_ALIGN_ROWS);
+	ccv_matrix_alignment_mode = mode;
+}
+
+/* the bytes a dense matrix takes, including the padding before its data */
+static size_t _ccv_dense_matrix_size(ccv_dense_matrix_t* mat)
+{
+	return (size_t)(mat->data.u8 - (unsigned char*)mat) + (size_t)mat->step * mat->rows;
+}
 
 ccv_dense_matrix_t* ccv_dense_matrix_new(int rows, int cols, int type, void* data, uint64_t sig)
 {
@@ -30,10 +687,10 @@ ccv_dense_matrix_t* ccv_dense_matrix_new(int rows, int cols, int type, void* dat
 	if (ccv_cache_opt && sig != 0 && !data && !(type & CCV_NO_DATA_ALLOC))
 	{
 		uint8_t type;
-		mat = (ccv_dense_matrix_t*)ccv_cache_out(&ccv_cache, sig, &type);
+		mat = (ccv_dense_matrix_t*)_ccv_cache_out(sig, CCV_CACHE_MATRIX, &type);
 		if (mat)
 		{
-			assert(type == 0);
+			assert(type == CCV_CACHE_MATRIX);
 			mat->type |= CCV_GARBAGE; // set the flag so the upper level function knows this is from recycle-bin
 			mat->refcount = 1;
 			return mat;
@@ -44,20 +701,75 @@ ccv_dense_matrix_t* ccv_dense_matrix_new(int rows, int cols, int type, void* dat
 		mat = (ccv_dense_matrix_t*)ccmalloc(sizeof(ccv_dense_matrix_t));
 		mat->type = (CCV_GET_CHANNEL(type) | CCV_GET_DATA_TYPE(type) | CCV_MATRIX_DENSE | CCV_NO_DATA_ALLOC) & ~CCV_GARBAGE;
 		mat->data.u8 = data;
+		mat->step = (cols * CCV_GET_DATA_TYPE_SIZE(type) * CCV_GET_CHANNEL(type) + 3) & -4;
 	} else {
-		mat = (ccv_dense_matrix_t*)(data ? data : ccmalloc(ccv_compute_dense_matrix_size(rows, cols, type)));
+		int from = 0;
+		ccv_arena_t* arena = _ccv_arena_active();
+		// the global alignment mode only applies to the memory we allocate, user-supplied memory is sized by the caller
+		int align = (type & CCV_ALIGNED) ? CCV_MATRIX_ALIGN_ROWS : (data ? CCV_MATRIX_ALIGN_NONE : ccv_matrix_alignment_mode);
+		if (data)
+			mat = (ccv_dense_matrix_t*)data;
+		else {
+			size_t size = (align == CCV_MATRIX_ALIGN_ROWS) ? ccv_compute_aligned_dense_matrix_size(rows, cols, type) : ccv_compute_dense_matrix_size(rows, cols, type) + (align == CCV_MATRIX_ALIGN_DATA ? CCV_MATRIX_ALIGNMENT - 1 : 0);
+			if (arena)
+			{
+				mat = (ccv_dense_matrix_t*)ccv_arena_alloc(arena, size);
+				from = CCV_ARENA;
+			} else {
+				mat = _ccv_matrix_pool_alloc(size);
+				from = mat ? CCV_POOLED : 0;
+				if (!mat)
+					mat = (ccv_dense_matrix_t*)ccmalloc(size);
+			}
+		}
 		mat->type = (CCV_GET_CHANNEL(type) | CCV_GET_DATA_TYPE(type) | CCV_MATRIX_DENSE) & ~CCV_GARBAGE;
 		mat->type |= data ? CCV_UNMANAGED : CCV_REUSABLE; // it still could be reusable because the signature could be derived one.
-		mat->data.u8 = (unsigned char*)(mat + 1);
+		if (from == CCV_ARENA)
+			mat->type = (mat->type & ~CCV_REUSABLE) | CCV_ARENA; // it cannot outlive the arena scope, therefore, cannot be cached
+		else
+			mat->type |= from;
+		if (align == CCV_MATRIX_ALIGN_NONE)
+			mat->data.u8 = (unsigned char*)(mat + 1);
+		else
+			mat->data.u8 = (unsigned char*)(((uintptr_t)(mat + 1) + CCV_MATRIX_ALIGNMENT - 1) & -CCV_MATRIX_ALIGNMENT);
+		if (align == CCV_MATRIX_ALIGN_ROWS)
+		{
+			mat->type |= CCV_ALIGNED;
+			int width = cols * CCV_GET_DATA_TYPE_SIZE(type) * CCV_GET_CHANNEL(type);
+			mat->step = (width + CCV_MATRIX_ALIGNMENT - 1) & -CCV_MATRIX_ALIGNMENT;
+			// keep the padding zero, so that content signature doesn't depend on garbage in between rows
+			if (mat->step > width)
+			{
+				int i;
+				for (i = 0; i < rows; i++)
+					memset(mat->data.u8 + i * mat->step + width, 0, mat->step - width);
+			}
+		} else
+			mat->step = (cols * CCV_GET_DATA_TYPE_SIZE(type) * CCV_GET_CHANNEL(type) + 3) & -4;
 	}
 	mat->sig = sig;
 	mat->rows = rows;
 	mat->cols = cols;
-	mat->step = (cols * CCV_GET_DATA_TYPE_SIZE(type) * CCV_GET_CHANNEL(type) + 3) & -4;
 	mat->refcount = 1;
 	return mat;
 }
 
+/* writing into a shared matrix would change what other holders see, give the caller a private copy and drop its reference to the shared one */
+static ccv_dense_matrix_t* _ccv_dense_matrix_unshare(ccv_dense_matrix_t* x)
+{
+	ccv_dense_matrix_t* y = ccv_dense_matrix_new(x->rows, x->cols, CCV_GET_DATA_TYPE(x->type) | CCV_GET_CHANNEL(x->type) | (x->type & CCV_ALIGNED), 0, 0);
+	if (y->step == x->step)
+		memcpy(y->data.u8, x->data.u8, (size_t)x->step * x->rows);
+	else {
+		int i;
+		size_t width = (size_t)x->cols * CCV_GET_DATA_TYPE_SIZE(x->type) * CCV_GET_CHANNEL(x->type);
+		for (i = 0; i < x->rows; i++)
+			memcpy(y->data.u8 + (size_t)i * y->step, x->data.u8 + (size_t)i * x->step, width);
+	}
+	ccv_matrix_free(x);
+	return y;
+}
+
 ccv_dense_matrix_t* 
 ccv_dense_matrix_renew(ccv_dense_matrix_t* x, 
 					   int rows, 
@@ -70,6 +782,8 @@ ccv_dense_matrix_renew(ccv_dense_matrix_t* x,
 	{
 		assert(x->rows == rows && x->cols == cols && (CCV_GET_DATA_TYPE(x->type) & types) && (CCV_GET_CHANNEL(x->type) == CCV_GET_CHANNEL(types)));
 		prefer_type = CCV_GET_DATA_TYPE(x->type) | CCV_GET_CHANNEL(x->type);
+		if ((x->type & CCV_VIEW) || (!(x->type & (CCV_UNMANAGED | CCV_ARENA)) && *(volatile int*)&x->refcount > 1))
+			x = _ccv_dense_matrix_unshare(x);
 	}
 	
 	if (sig != 0)
@@ -94,6 +808,8 @@ void ccv_make_matrix_mutable(ccv_matrix_t* mat)
 	if (type & CCV_MATRIX_DENSE)
 	{
 		ccv_dense_matrix_t* dmt = (ccv_dense_matrix_t*)mat;
+		if (CCV_IS_LAZY_SIGN(dmt->sig))
+			_ccv_lazy_signature_forget(dmt->sig);
 		dmt->sig = 0;
 		dmt->type &= ~CCV_REUSABLE;
 	}
@@ -110,7 +826,8 @@ void ccv_make_matrix_immutable(ccv_matrix_t* mat)
 		/* immutable matrix made this way is not reusable (collected), because its signature
 		 * only depends on the content, not the operation to generate it */
 		dmt->type &= ~CCV_REUSABLE;
-		dmt->sig = ccv_cache_generate_signature((char*)dmt->data.u8, dmt->rows * dmt->step, (uint64_t)dmt->type, CCV_EOF_SIGN);
+		// only managed matrix can be lazy, otherwise we don't know when it is gone
+		dmt->sig = ((ccv_signature_mode & CCV_SIGNATURE_LAZY) && !(dmt->type & (CCV_UNMANAGED | CCV_ARENA))) ? _ccv_lazy_signature_new(dmt) : _ccv_content_signature(dmt);
 	}
 }
 
@@ -127,6 +844,38 @@ ccv_dense_matrix_t ccv_dense_matrix(int rows, int cols, int type, void* data, ui
 	return mat;
 }
 
+ccv_dense_matrix_t* ccv_dense_matrix_view(ccv_dense_matrix_t* a, int y, int x, int rows, int cols)
+{
+	assert(y >= 0 && x >= 0 && rows > 0 && cols > 0);
+	assert(y + rows <= a->rows && x + cols <= a->cols);
+	// the same signature as ccv_slice to the same type, so that results derived from either are interchangeable
+	ccv_declare_derived_signature(sig, a->sig != 0, ccv_sign_with_format(128, "ccv_slice(%d,%d,%d,%d)", y, x, rows, cols), a->sig, CCV_EOF_SIGN);
+	if (sig != 0)
+	{
+		int type = CCV_GET_DATA_TYPE(a->type) | CCV_GET_CHANNEL(a->type);
+		sig = ccv_cache_generate_signature((const char*)&type, sizeof(int), sig, CCV_EOF_SIGN);
+	}
+	ccv_dense_matrix_t* parent = a;
+	unsigned char* data = ccv_get_dense_matrix_cell(a, y, x, 0);
+	if (a->type & CCV_VIEW) // refer to the root, so that views don't chain up
+		parent = CCV_DENSE_VIEW_PARENT(a);
+	if (parent && (parent->type & CCV_UNMANAGED)) // the caller manages its lifetime
+		parent = 0;
+	if (parent)
+		ccv_matrix_retain(parent);
+	ccv_dense_matrix_t* mat = (ccv_dense_matrix_t*)ccmalloc(sizeof(ccv_dense_matrix_t) + sizeof(ccv_dense_matrix_t*));
+	mat->type = (CCV_GET_CHANNEL(a->type) | CCV_GET_DATA_TYPE(a->type) | CCV_MATRIX_DENSE | CCV_NO_DATA_ALLOC | CCV_VIEW) & ~CCV_GARBAGE;
+	mat->sig = sig;
+	mat->refcount = 1;
+	mat->rows = rows;
+	mat->cols = cols;
+	mat->step = a->step;
+	mat->tag.i64 = 0;
+	mat->data.u8 = data;
+	CCV_DENSE_VIEW_PARENT(mat) = parent;
+	return mat;
+}
+
 // ϡ
 ccv_sparse_matrix_t* ccv_sparse_matrix_new(int rows, int cols, int type, int major, uint64_t sig)
 {
@@ -135,10 +884,25 @@ ccv_sparse_matrix_t* ccv_sparse_matrix_new(int rows, int cols, int type, int maj
 	mat->rows = rows;
 	mat->cols = cols;
 	mat->type = type | CCV_MATRIX_SPARSE | ((type & CCV_DENSE_VECTOR) ? CCV_DENSE_VECTOR : CCV_SPARSE_VECTOR);
-	mat->major = major;
+	mat->major = major & CCV_SPARSE_COL_MAJOR;
 	mat->prime = 0;
 	mat->load_factor = 0;
 	mat->refcount = 1;
+	mat->capacity = mat->size = 0;
+	mat->keys = 0;
+	mat->data.u8 = 0;
+	mat->vector = 0;
+	if (major & CCV_SPARSE_OPEN_ADDRESSING)
+	{
+		assert(!(type & CCV_DENSE_VECTOR));
+		// it is cheap to grow, start small
+		mat->capacity = 64;
+		int cell_width = CCV_GET_DATA_TYPE_SIZE(type) * CCV_GET_CHANNEL(type);
+		mat->keys = (uint64_t*)ccmalloc((sizeof(uint64_t) + cell_width) * mat->capacity);
+		memset(mat->keys, 0xff, sizeof(uint64_t) * mat->capacity);
+		mat->data.u8 = (unsigned char*)(mat->keys + mat->capacity);
+		return mat;
+	}
 
 	// ռ
 	// mat->prime == 53
@@ -155,34 +919,75 @@ ccv_sparse_matrix_t* ccv_sparse_matrix_new(int rows, int cols, int type, int maj
 	return mat;
 }
 
+static void _ccv_sparse_matrix_dealloc(ccv_sparse_matrix_t* smt)
+{
+	if (smt->capacity) // the slab is one allocation
+	{
+		ccfree(smt->keys);
+		ccfree(smt);
+		return;
+	}
+	int i;
+	for (i = 0; i < CCV_GET_SPARSE_PRIME(smt->prime); i++)
+		if (smt->vector[i].index != -1)
+		{
+			ccv_dense_vector_t* iter = &smt->vector[i];
+			ccfree(iter->data.u8);
+			iter = iter->next;
+			while (iter != 0)
+			{
+				ccv_dense_vector_t* iter_next = iter->next;
+				ccfree(iter->data.u8);
+				ccfree(iter);
+				iter = iter_next;
+			}
+		}
+	ccfree(smt->vector);
+	ccfree(smt);
+}
+
+/* drop one reference, return non-zero if it was the last one and the matrix should go */
+static int _ccv_matrix_release(ccv_matrix_t* mat)
+{
+	int type = *(int*)mat;
+	if (type & CCV_MATRIX_DENSE)
+		return __sync_sub_and_fetch(&((ccv_dense_matrix_t*)mat)->refcount, 1) <= 0;
+	else if (type & CCV_MATRIX_SPARSE)
+		return __sync_sub_and_fetch(&((ccv_sparse_matrix_t*)mat)->refcount, 1) <= 0;
+	else if ((type & CCV_MATRIX_CSR) || (type & CCV_MATRIX_CSC))
+		return __sync_sub_and_fetch(&((ccv_compressed_sparse_matrix_t*)mat)->refcount, 1) <= 0;
+	return 1;
+}
+
+void ccv_matrix_retain(ccv_matrix_t* mat)
+{
+	int type = *(int*)mat;
+	assert(!(type & CCV_UNMANAGED));
+	if (type & CCV_MATRIX_DENSE)
+		__sync_add_and_fetch(&((ccv_dense_matrix_t*)mat)->refcount, 1);
+	else if (type & CCV_MATRIX_SPARSE)
+		__sync_add_and_fetch(&((ccv_sparse_matrix_t*)mat)->refcount, 1);
+	else if ((type & CCV_MATRIX_CSR) || (type & CCV_MATRIX_CSC))
+		__sync_add_and_fetch(&((ccv_compressed_sparse_matrix_t*)mat)->refcount, 1);
+}
+
 void ccv_matrix_free_immediately(ccv_matrix_t* mat)
 {
 	int type = *(int*)mat;
 	assert(!(type & CCV_UNMANAGED));
+	if (type & CCV_ARENA) // the arena scope owns it
+		return;
+	if (!_ccv_matrix_release(mat)) // still shared
+		return;
 	if (type & CCV_MATRIX_DENSE)
 	{
 		ccv_dense_matrix_t* dmt = (ccv_dense_matrix_t*)mat;
 		dmt->refcount = 0;
-		ccfree(dmt);
+		if (CCV_IS_LAZY_SIGN(dmt->sig))
+			_ccv_lazy_signature_forget(dmt->sig);
+		_ccv_dense_matrix_dealloc(dmt);
 	} else if (type & CCV_MATRIX_SPARSE) {
-		ccv_sparse_matrix_t* smt = (ccv_sparse_matrix_t*)mat;
-		int i;
-		for (i = 0; i < CCV_GET_SPARSE_PRIME(smt->prime); i++)
-			if (smt->vector[i].index != -1)
-			{
-				ccv_dense_vector_t* iter = &smt->vector[i];
-				ccfree(iter->data.u8);
-				iter = iter->next;
-				while (iter != 0)
-				{
-					ccv_dense_vector_t* iter_next = iter->next;
-					ccfree(iter->data.u8);
-					ccfree(iter);
-					iter = iter_next;
-				}
-			}
-		ccfree(smt->vector);
-		ccfree(smt);
+		_ccv_sparse_matrix_dealloc((ccv_sparse_matrix_t*)mat);
 	} else if ((type & CCV_MATRIX_CSR) || (type & CCV_MATRIX_CSC)) {
 		ccv_compressed_sparse_matrix_t* csm = (ccv_compressed_sparse_matrix_t*)mat;
 		csm->refcount = 0;
@@ -200,43 +1005,33 @@ void ccv_matrix_free(ccv_matrix_t* mat)
 {
 	int type = *(int*)mat;
 	assert(!(type & CCV_UNMANAGED));
+	if (type & CCV_ARENA) // the arena scope owns it
+		return;
+	if (!_ccv_matrix_release(mat)) // still shared
+		return;
 	if (type & CCV_MATRIX_DENSE)
 	{
 		ccv_dense_matrix_t* dmt = (ccv_dense_matrix_t*)mat;
 		dmt->refcount = 0;
+		if (CCV_IS_LAZY_SIGN(dmt->sig))
+			_ccv_lazy_signature_forget(dmt->sig);
 		if (!ccv_cache_opt || // e don't enable cache
 			!(dmt->type & CCV_REUSABLE) || // or this is not a reusable piece
 			dmt->sig == 0 || // or this doesn't have valid signature
 			(dmt->type & CCV_NO_DATA_ALLOC)) // or this matrix is allocated as header-only, therefore we cannot cache it
-			ccfree(dmt);
+			_ccv_dense_matrix_dealloc(dmt);
 		else {
 			assert(CCV_GET_DATA_TYPE(dmt->type) == CCV_8U ||
 				   CCV_GET_DATA_TYPE(dmt->type) == CCV_32S ||
 				   CCV_GET_DATA_TYPE(dmt->type) == CCV_32F ||
 				   CCV_GET_DATA_TYPE(dmt->type) == CCV_64S ||
-				   CCV_GET_DATA_TYPE(dmt->type) == CCV_64F);
-			size_t size = ccv_compute_dense_matrix_size(dmt->rows, dmt->cols, dmt->type);
-			ccv_cache_put(&ccv_cache, dmt->sig, dmt, size, 0 /* type 0 */);
+				   CCV_GET_DATA_TYPE(dmt->type) == CCV_64F ||
+				   CCV_GET_DATA_TYPE(dmt->type) == CCV_16F ||
+				   CCV_GET_DATA_TYPE(dmt->type) == CCV_16BF);
+			_ccv_cache_put(dmt->sig, dmt, _ccv_dense_matrix_size(dmt), CCV_CACHE_MATRIX);
 		}
 	} else if (type & CCV_MATRIX_SPARSE) {
-		ccv_sparse_matrix_t* smt = (ccv_sparse_matrix_t*)mat;
-		int i;
-		for (i = 0; i < CCV_GET_SPARSE_PRIME(smt->prime); i++)
-			if (smt->vector[i].index != -1)
-			{
-				ccv_dense_vector_t* iter = &smt->vector[i];
-				ccfree(iter->data.u8);
-				iter = iter->next;
-				while (iter != 0)
-				{
-					ccv_dense_vector_t* iter_next = iter->next;
-					ccfree(iter->data.u8);
-					ccfree(iter);
-					iter = iter_next;
-				}
-			}
-		ccfree(smt->vector);
-		ccfree(smt);
+		_ccv_sparse_matrix_dealloc((ccv_sparse_matrix_t*)mat);
 	} else if ((type & CCV_MATRIX_CSR) || (type & CCV_MATRIX_CSC)) {
 		ccv_compressed_sparse_matrix_t* csm = (ccv_compressed_sparse_matrix_t*)mat;
 		csm->refcount = 0;
@@ -251,24 +1046,35 @@ ccv_array_t* ccv_array_new(int rsize, int rnum, uint64_t sig)
 	if (ccv_cache_opt && sig != 0)
 	{
 		uint8_t type;
-		array = (ccv_array_t*)ccv_cache_out(&ccv_cache, sig, &type);
-		
+		array = (ccv_array_t*)_ccv_cache_out(sig, CCV_CACHE_ARRAY, &type);
+
 		if (array)
 		{
-			assert(type == 1);
+			assert(type == CCV_CACHE_ARRAY);
 			array->type |= CCV_GARBAGE;
 			array->refcount = 1;
 			return array;
 		}
 	}
 	
-	array = (ccv_array_t*)ccmalloc(sizeof(ccv_array_t));
+	ccv_arena_t* arena = _ccv_arena_active();
+	int size = ccv_max(rnum, 2 /* allocate memory for at least 2 items */);
+	if (arena)
+	{
+		// keep the arena in front of the header, so that the array can grow from the same arena
+		array = (ccv_array_t*)((unsigned char*)ccv_arena_alloc(arena, CCV_ARRAY_ARENA_PREFIX + sizeof(ccv_array_t)) + CCV_ARRAY_ARENA_PREFIX);
+		CCV_ARRAY_ARENA(array) = arena;
+		array->type = CCV_ARENA;
+		array->data = ccv_arena_alloc(arena, (size_t)size * (size_t)rsize);
+	} else {
+		array = (ccv_array_t*)ccmalloc(sizeof(ccv_array_t));
+		array->type = CCV_REUSABLE & ~CCV_GARBAGE;
+		array->data = ccmalloc((size_t)size * (size_t)rsize);
+	}
 	array->sig = sig;
-	array->type = CCV_REUSABLE & ~CCV_GARBAGE;
 	array->rnum = 0;
 	array->rsize = rsize;
-	array->size = ccv_max(rnum, 2 /* allocate memory for at least 2 items */);
-	array->data = ccmalloc((size_t)array->size * (size_t)rsize);
+	array->size = size;
 	
 	return array;
 }
@@ -289,6 +1095,8 @@ void ccv_make_array_immutable(ccv_array_t* array)
 
 void ccv_array_free_immediately(ccv_array_t* array)
 {
+	if (array->type & CCV_ARENA)
+		return;
 	array->refcount = 0;
 	ccfree(array->data);
 	ccfree(array);
@@ -296,6 +1104,8 @@ void ccv_array_free_immediately(ccv_array_t* array)
 
 void ccv_array_free(ccv_array_t* array)
 {
+	if (array->type & CCV_ARENA)
+		return;
 	if (!ccv_cache_opt || !(array->type & CCV_REUSABLE) || array->sig == 0)
 	{
 		array->refcount = 0;
@@ -303,37 +1113,216 @@ void ccv_array_free(ccv_array_t* array)
 		ccfree(array);
 	} else {
 		size_t size = sizeof(ccv_array_t) + array->size * array->rsize;
-		ccv_cache_put(&ccv_cache, array->sig, array, size, 1 /* type 1 */);
+		_ccv_cache_put(array->sig, array, size, CCV_CACHE_ARRAY);
 	}
 }
 
 void ccv_drain_cache(void)
 {
-	if (ccv_cache.rnum > 0)
+	int i;
+	switch (ccv_cache_mode)
 	{
-		ccv_cache_cleanup(&ccv_cache);
+		case CCV_CACHE_SHARDED:
+			for (i = 0; i < CCV_CACHE_SHARD_NUM; i++)
+			{
+				ccv_cache_shard_t* shard = _ccv_cache_shard_acquire((uint64_t)i << 60);
+				if (shard->cache.rnum > 0)
+					ccv_cache_cleanup(&shard->cache);
+				_ccv_cache_shard_release(shard);
+			}
+			break;
+		default:
+		{
+			ccv_cache_shard_t* shard = _ccv_cache_shard_acquire(0);
+			if (shard->cache.rnum > 0)
+				ccv_cache_cleanup(&shard->cache);
+			_ccv_cache_shard_release(shard);
+			break;
+		}
 	}
 }
 
 void ccv_drain_cache1(void)
 {
-	if (ccv_cache.rnum > 0)
-	{
-		ccv_cache_cleanup(&ccv_cache);
-	}
+	ccv_drain_cache();
 }
 
 
 void ccv_disable_cache(void)
 {
 	ccv_cache_opt = 0;
-	ccv_cache_close(&ccv_cache);
+	int i;
+#ifdef HAVE_PTHREAD
+	__sync_synchronize();
+	pthread_once(&ccv_cache_once, _ccv_cache_once_init);
+	for (i = 0; i < CCV_CACHE_SHARD_NUM; i++)
+	{
+		pthread_mutex_lock(&ccv_cache_shard[i].mutex);
+		ccv_cache_close(&ccv_cache_shard[i].cache);
+		pthread_mutex_unlock(&ccv_cache_shard[i].mutex);
+	}
+	// other threads' caches are left to them, they become stale and are dropped by their threads
+	if (__sync_fetch_and_add(&ccv_cache_generation, 0))
+	{
+		__sync_add_and_fetch(&ccv_cache_generation, 1);
+		_ccv_cache_thread_shard();
+	}
+#else
+	for (i = 0; i < CCV_CACHE_SHARD_NUM; i++)
+		ccv_cache_close(&ccv_cache_shard[i].cache);
+#endif
 }
 
-void ccv_enable_cache(size_t size)
+void ccv_enable_cache_with_mode(size_t size, int mode)
 {
+	assert(mode == CCV_CACHE_GLOBAL || mode == CCV_CACHE_THREAD_LOCAL || mode == CCV_CACHE_SHARDED);
+	if (ccv_cache_opt)
+		ccv_disable_cache();
+#ifdef HAVE_PTHREAD
+	pthread_once(&ccv_cache_once, _ccv_cache_once_init);
+	ccv_cache_mode = mode;
+#else
+	ccv_cache_mode = CCV_CACHE_GLOBAL;
+#endif
+	ccv_cache_up = (ccv_cache_mode == CCV_CACHE_SHARDED) ? size / CCV_CACHE_SHARD_NUM : size;
+	int i;
+	for (i = 0; i < CCV_CACHE_SHARD_NUM; i++)
+	{
+#ifdef HAVE_PTHREAD
+		pthread_mutex_lock(&ccv_cache_shard[i].mutex);
+#endif
+		ccv_cache_init(&ccv_cache_shard[i].cache, ccv_cache_up, 2, ccv_matrix_free_immediately, ccv_array_free_immediately);
+		ccv_cache_shard[i].cache.fevict = _ccv_cache_evict;
+		ccv_cache_shard[i].miss[CCV_CACHE_MATRIX] = ccv_cache_shard[i].miss[CCV_CACHE_ARRAY] = 0;
+#ifdef HAVE_PTHREAD
+		pthread_mutex_unlock(&ccv_cache_shard[i].mutex);
+#endif
+	}
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&ccv_cache_registry_mutex);
+	memset(ccv_cache_retired, 0, sizeof(ccv_cache_retired));
+	pthread_mutex_unlock(&ccv_cache_registry_mutex);
+	// thread-local caches from before are stale now, their threads renew them with the new size
+	__sync_add_and_fetch(&ccv_cache_generation, 1);
+	_ccv_cache_thread_shard();
+#endif
 	ccv_cache_opt = 1;
-	ccv_cache_init(&ccv_cache, size, 2, ccv_matrix_free_immediately, ccv_array_free_immediately);
+}
+
+void ccv_enable_cache(size_t size)
+{
+	ccv_enable_cache_with_mode(size, CCV_CACHE_GLOBAL);
+}
+
+static void _ccv_cache_shard_stats(ccv_cache_shard_t* shard, int type, ccv_cache_stats_t* stats)
+{
+	ccv_cache_stats_t* x = shard->cache.stats + type;
+	stats->hit += x->hit;
+	stats->miss += shard->miss[type];
+	stats->put += x->put;
+	stats->evict += x->evict;
+	stats->rnum += x->rnum;
+	stats->size += x->size;
+}
+
+/* visit every cache the objects live in, shards are locked while visited */
+static void _ccv_cache_shard_foreach(void(*visit)(ccv_cache_shard_t*, void*), void* context)
+{
+	int i;
+	ccv_cache_shard_t* shard;
+	switch (ccv_cache_mode)
+	{
+		case CCV_CACHE_SHARDED:
+			for (i = 0; i < CCV_CACHE_SHARD_NUM; i++)
+			{
+				shard = _ccv_cache_shard_acquire((uint64_t)i << 60);
+				visit(shard, context);
+				_ccv_cache_shard_release(shard);
+			}
+			break;
+#ifdef HAVE_PTHREAD
+		case CCV_CACHE_THREAD_LOCAL:
+			// caches of other threads are visited without their cooperation, thus, numbers are only approximate, stale ones are skipped
+			pthread_mutex_lock(&ccv_cache_registry_mutex);
+			for (shard = ccv_cache_registry; shard; shard = shard->next)
+				if (shard->generation == ccv_cache_generation)
+					visit(shard, context);
+			pthread_mutex_unlock(&ccv_cache_registry_mutex);
+			break;
+#endif
+		default:
+			shard = _ccv_cache_shard_acquire(0);
+			visit(shard, context);
+			_ccv_cache_shard_release(shard);
+			break;
+	}
+}
+
+typedef struct {
+	int type;
+	ccv_cache_stats_t* stats;
+} ccv_cache_stats_visit_t;
+
+static void _ccv_cache_stats_visit(ccv_cache_shard_t* shard, void* context)
+{
+	ccv_cache_stats_visit_t* visit = (ccv_cache_stats_visit_t*)context;
+	_ccv_cache_shard_stats(shard, visit->type, visit->stats);
+}
+
+void ccv_cache_type_stats(int type, ccv_cache_stats_t* stats)
+{
+	assert(type == CCV_CACHE_MATRIX || type == CCV_CACHE_ARRAY);
+	memset(stats, 0, sizeof(ccv_cache_stats_t));
+	ccv_cache_stats_visit_t visit = {
+		.type = type,
+		.stats = stats,
+	};
+	_ccv_cache_shard_foreach(_ccv_cache_stats_visit, &visit);
+#ifdef HAVE_PTHREAD
+	if (ccv_cache_mode == CCV_CACHE_THREAD_LOCAL)
+	{
+		pthread_mutex_lock(&ccv_cache_registry_mutex);
+		ccv_cache_stats_t* retired = ccv_cache_retired + type;
+		stats->hit += retired->hit;
+		stats->miss += retired->miss;
+		stats->put += retired->put;
+		stats->evict += retired->evict;
+		pthread_mutex_unlock(&ccv_cache_registry_mutex);
+	}
+#endif
+}
+
+void ccv_cache_stats(ccv_cache_stats_t* stats)
+{
+	ccv_cache_stats_t matrix, array;
+	ccv_cache_type_stats(CCV_CACHE_MATRIX, &matrix);
+	ccv_cache_type_stats(CCV_CACHE_ARRAY, &array);
+	stats->hit = matrix.hit + array.hit;
+	stats->miss = matrix.miss + array.miss;
+	stats->put = matrix.put + array.put;
+	stats->evict = matrix.evict + array.evict;
+	stats->rnum = matrix.rnum + array.rnum;
+	stats->size = matrix.size + array.size;
+}
+
+static void _ccv_cache_stats_reset_visit(ccv_cache_shard_t* shard, void* context)
+{
+	int i;
+	for (i = 0; i < 2; i++)
+	{
+		shard->cache.stats[i].hit = shard->cache.stats[i].put = shard->cache.stats[i].evict = 0;
+		shard->miss[i] = 0;
+	}
+}
+
+void ccv_cache_stats_reset(void)
+{
+	_ccv_cache_shard_foreach(_ccv_cache_stats_reset_visit, 0);
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&ccv_cache_registry_mutex);
+	memset(ccv_cache_retired, 0, sizeof(ccv_cache_retired));
+	pthread_mutex_unlock(&ccv_cache_registry_mutex);
+#endif
 }
 
 void ccv_enable_default_cache(void)
@@ -345,21 +1334,48 @@ void ccv_enable_default_cache(void)
 	ccv_enable_cache(CCV_DEFAULT_CACHE_SIZE);
 }
 
+void ccv_set_signature_mode(int mode)
+{
+	assert((mode & ~CCV_SIGNATURE_LAZY) == CCV_SIGNATURE_SHA1 || (mode & ~CCV_SIGNATURE_LAZY) == CCV_SIGNATURE_XXHASH);
+	ccv_signature_mode = mode;
+}
+
 uint64_t ccv_cache_generate_signature(const char* msg, int len, uint64_t sig_start, ...)
 {
-	blk_SHA_CTX ctx;
-	blk_SHA1_Init(&ctx);
 	uint64_t sigi;
 	va_list arguments;
-	va_start(arguments, sig_start);
-	for (sigi = sig_start; sigi != 0; sigi = va_arg(arguments, uint64_t))
-		blk_SHA1_Update(&ctx, &sigi, 8);
-	va_end(arguments);
-	blk_SHA1_Update(&ctx, msg, len);
 	union {
 		uint64_t u;
 		uint8_t chr[20];
 	} sig;
-	blk_SHA1_Final(sig.chr, &ctx);
+	if (ccv_signature_mode & CCV_SIGNATURE_XXHASH)
+	{
+		xxh64_ctx_t ctx;
+		xxh64_init(&ctx, 0);
+		va_start(arguments, sig_start);
+		for (sigi = sig_start; sigi != 0; sigi = va_arg(arguments, uint64_t))
+		{
+			sigi = _ccv_lazy_signature_resolve(sigi);
+			xxh64_update(&ctx, &sigi, 8);
+		}
+		va_end(arguments);
+		xxh64_update(&ctx, msg, len);
+		sig.u = xxh64_final(&ctx);
+	} else {
+		blk_SHA_CTX ctx;
+		blk_SHA1_Init(&ctx);
+		va_start(arguments, sig_start);
+		for (sigi = sig_start; sigi != 0; sigi = va_arg(arguments, uint64_t))
+		{
+			sigi = _ccv_lazy_signature_resolve(sigi);
+			blk_SHA1_Update(&ctx, &sigi, 8);
+		}
+		va_end(arguments);
+		blk_SHA1_Update(&ctx, msg, len);
+		blk_SHA1_Final(sig.chr, &ctx);
+	}
+	// never collide with lazy signature tokens
+	if (CCV_IS_LAZY_SIGN(sig.u))
+		sig.u ^= (uint64_t)1 << 48;
 	return sig.u;
 }
@@ -0,0 +1,242 @@
+#include "ccv.h"
+#include "ccv_internal.h"
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#ifdef __APPLE__
+#include "TargetConditionals.h"
+#if (TARGET_OS_IPHONE || TARGET_IPHONE_SIMULATOR)
+// Temporary fix: __thread is not supported on iOS so define it to nothing.
+#define __thread
+#endif
+#endif
+
+static int ccv_parallel_thread_num = 0; // 0 means not decided yet, CCV_NUM_THREADS or the number of cores then
+
+#ifdef HAVE_PTHREAD
+/* every participant owns a range of iterations, it takes chunks from the front of its own range,
+ * and once it runs out, steals the back half of the range of another participant */
+typedef struct {
+	pthread_mutex_t mutex;
+	size_t begin;
+	size_t end;
+} __attribute__((__aligned__(64))) ccv_parallel_range_t;
+
+typedef struct {
+	pthread_mutex_t job_mutex; // held by the thread that runs a parallel_for on the pool
+	pthread_mutex_t mutex; // guards the rest
+	pthread_cond_t start;
+	pthread_cond_t done;
+	int thread_num; // participants, including the calling thread
+	pthread_t* threads;
+	uint64_t generation;
+	int quit;
+	int active; // workers that haven't finished the current job
+	int participant_num;
+	size_t chunk;
+	void (*block)(size_t, void*);
+	void* context;
+	ccv_parallel_range_t* ranges;
+} ccv_parallel_pool_t;
+
+static ccv_parallel_pool_t ccv_parallel_pool = {
+	.job_mutex = PTHREAD_MUTEX_INITIALIZER,
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.start = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+};
+
+static __thread int ccv_parallel_in_worker = 0;
+
+static int _ccv_parallel_take(ccv_parallel_range_t* range, size_t chunk, size_t* begin, size_t* end)
+{
+	pthread_mutex_lock(&range->mutex);
+	int taken = range->begin < range->end;
+	if (taken)
+	{
+		*begin = range->begin;
+		*end = ccv_min(range->begin + chunk, range->end);
+		range->begin = *end;
+	}
+	pthread_mutex_unlock(&range->mutex);
+	return taken;
+}
+
+static int _ccv_parallel_steal(ccv_parallel_pool_t* pool, int id)
+{
+	int i;
+	for (i = 1; i < pool->participant_num; i++)
+	{
+		ccv_parallel_range_t* victim = pool->ranges + (id + i) % pool->participant_num;
+		size_t begin = 0, end = 0;
+		pthread_mutex_lock(&victim->mutex);
+		if (victim->begin < victim->end)
+		{
+			size_t half = (victim->end - victim->begin + 1) / 2;
+			end = victim->end;
+			begin = victim->end = end - half;
+		}
+		pthread_mutex_unlock(&victim->mutex);
+		if (begin < end)
+		{
+			ccv_parallel_range_t* range = pool->ranges + id;
+			pthread_mutex_lock(&range->mutex);
+			range->begin = begin;
+			range->end = end;
+			pthread_mutex_unlock(&range->mutex);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void _ccv_parallel_work(ccv_parallel_pool_t* pool, int id)
+{
+	size_t begin, end;
+	do {
+		while (_ccv_parallel_take(pool->ranges + id, pool->chunk, &begin, &end))
+			for (; begin < end; begin++)
+				pool->block(begin, pool->context);
+	} while (_ccv_parallel_steal(pool, id));
+}
+
+static void* _ccv_parallel_worker(void* arg)
+{
+	ccv_parallel_pool_t* pool = &ccv_parallel_pool;
+	int id = (int)(intptr_t)arg;
+	uint64_t generation = 0;
+	// a parallel_for from within the loop body runs serially
+	ccv_parallel_in_worker = 1;
+	pthread_mutex_lock(&pool->mutex);
+	for (;;)
+	{
+		while (pool->generation == generation && !pool->quit)
+			pthread_cond_wait(&pool->start, &pool->mutex);
+		if (pool->quit)
+			break;
+		generation = pool->generation;
+		if (id >= pool->participant_num)
+			continue;
+		pthread_mutex_unlock(&pool->mutex);
+		_ccv_parallel_work(pool, id);
+		pthread_mutex_lock(&pool->mutex);
+		if (--pool->active == 0)
+			pthread_cond_signal(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return 0;
+}
+
+static int _ccv_parallel_default_thread_num(void)
+{
+	const char* env = getenv("CCV_NUM_THREADS");
+	int thread_num = env ? atoi(env) : 0;
+	if (thread_num <= 0)
+		thread_num = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	return ccv_max(thread_num, 1);
+}
+
+/* the caller holds job_mutex */
+static void _ccv_parallel_pool_start(ccv_parallel_pool_t* pool)
+{
+	if (!ccv_parallel_thread_num)
+		ccv_parallel_thread_num = _ccv_parallel_default_thread_num();
+	pool->thread_num = ccv_parallel_thread_num;
+	pool->quit = 0;
+	pool->generation = 0;
+	pool->ranges = (ccv_parallel_range_t*)ccmalloc(sizeof(ccv_parallel_range_t) * pool->thread_num);
+	pool->threads = (pthread_t*)ccmalloc(sizeof(pthread_t) * pool->thread_num);
+	int i;
+	for (i = 0; i < pool->thread_num; i++)
+		pthread_mutex_init(&pool->ranges[i].mutex, 0);
+	for (i = 1; i < pool->thread_num; i++)
+		pthread_create(pool->threads + i, 0, _ccv_parallel_worker, (void*)(intptr_t)i);
+}
+
+/* the caller holds job_mutex */
+static void _ccv_parallel_pool_stop(ccv_parallel_pool_t* pool)
+{
+	if (!pool->threads)
+		return;
+	pthread_mutex_lock(&pool->mutex);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->mutex);
+	int i;
+	for (i = 1; i < pool->thread_num; i++)
+		pthread_join(pool->threads[i], 0);
+	for (i = 0; i < pool->thread_num; i++)
+		pthread_mutex_destroy(&pool->ranges[i].mutex);
+	ccfree(pool->ranges);
+	ccfree(pool->threads);
+	pool->ranges = 0;
+	pool->threads = 0;
+}
+#endif
+
+void ccv_set_parallel_thread_num(int thread_num)
+{
+#ifdef HAVE_PTHREAD
+	ccv_parallel_pool_t* pool = &ccv_parallel_pool;
+	pthread_mutex_lock(&pool->job_mutex);
+	_ccv_parallel_pool_stop(pool);
+	ccv_parallel_thread_num = thread_num > 0 ? thread_num : _ccv_parallel_default_thread_num();
+	pthread_mutex_unlock(&pool->job_mutex);
+#else
+	ccv_parallel_thread_num = 1;
+#endif
+}
+
+int ccv_get_parallel_thread_num(void)
+{
+#ifdef HAVE_PTHREAD
+	if (!ccv_parallel_thread_num)
+		return _ccv_parallel_default_thread_num();
+	return ccv_parallel_thread_num;
+#else
+	return 1;
+#endif
+}
+
+void ccv_parallel_for(size_t n, void (*block)(size_t, void*), void* context)
+{
+	size_t i;
+#ifdef HAVE_PTHREAD
+	ccv_parallel_pool_t* pool = &ccv_parallel_pool;
+	// nested, or another thread is using the pool, run serially rather than waiting on it
+	if (n > 1 && ccv_get_parallel_thread_num() > 1 && !ccv_parallel_in_worker && pthread_mutex_trylock(&pool->job_mutex) == 0)
+	{
+		if (!pool->threads)
+			_ccv_parallel_pool_start(pool);
+		int participant_num = (int)ccv_min((size_t)pool->thread_num, n);
+		// a few chunks per participant to balance, while keeping the locking per chunk cheap
+		pool->chunk = ccv_max(n / (participant_num * 8), 1);
+		pool->block = block;
+		pool->context = context;
+		for (i = 0; i < participant_num; i++)
+		{
+			pool->ranges[i].begin = n * i / participant_num;
+			pool->ranges[i].end = n * (i + 1) / participant_num;
+		}
+		pthread_mutex_lock(&pool->mutex);
+		pool->participant_num = participant_num;
+		pool->active = participant_num - 1;
+		++pool->generation;
+		pthread_cond_broadcast(&pool->start);
+		pthread_mutex_unlock(&pool->mutex);
+		ccv_parallel_in_worker = 1;
+		_ccv_parallel_work(pool, 0);
+		ccv_parallel_in_worker = 0;
+		pthread_mutex_lock(&pool->mutex);
+		while (pool->active > 0)
+			pthread_cond_wait(&pool->done, &pool->mutex);
+		pthread_mutex_unlock(&pool->mutex);
+		pthread_mutex_unlock(&pool->job_mutex);
+		return;
+	}
+#endif
+	for (i = 0; i < n; i++)
+		block(i, context);
+}
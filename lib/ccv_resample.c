@@ -1,231 +1,488 @@
 #include "ccv.h"
 #include "ccv_internal.h"
+#if defined(HAVE_SSE2)
+#include <emmintrin.h>
+#endif
 
-/* area interpolation resample is adopted from OpenCV */
+/* area interpolation resample is adopted from OpenCV.
+ * A resample plan keeps the taps of every destination column and row: the source index, and the weight both in fixed
+ * point and in float. Thus, resampling between the same sizes again doesn't work them out again. The area kernels
+ * go row first: the source rows of a destination row are summed (every column at once), then the columns are. The
+ * fixed point one is exact in any order, thus, it is bit exact with the streaming version it replaces */
 
-typedef struct {
-	int si, di;
-	unsigned int alpha;
-} ccv_int_alpha;
-
-static void _ccv_resample_area_8u(ccv_dense_matrix_t* a, ccv_dense_matrix_t* b)
-{
-	assert(a->cols > 0 && b->cols > 0);
-	ccv_int_alpha* xofs = (ccv_int_alpha*)alloca(sizeof(ccv_int_alpha) * a->cols * 2);
-	int ch = ccv_clamp(CCV_GET_CHANNEL(a->type), 1, 4);
-	double scale_x = (double)a->cols / b->cols;
-	double scale_y = (double)a->rows / b->rows;
-	// double scale = 1.f / (scale_x * scale_y);
-	unsigned int inv_scale_256 = (int)(scale_x * scale_y * 0x10000);
-	int dx, dy, sx, sy, i, k;
-	for (dx = 0, k = 0; dx < b->cols; dx++)
+#define CCV_RESAMPLE_ROWS (16)
+/* a cubic block restarts its ring with 3 extra source rows, hence, it covers at least this many source rows */
+#define CCV_RESAMPLE_CUBIC_ROWS (64)
+
+static int _ccv_resample_method(int rows, int cols, int brows, int bcols, int type)
+{
+	if ((type & CCV_INTER_AREA) && rows >= brows && cols >= bcols)
+		return CCV_INTER_AREA;
+	if (type & CCV_INTER_CUBIC)
+		return CCV_INTER_CUBIC;
+	return 0;
+}
+
+/* the columns only keep the taps they have, ofs[i] is the first tap of column i */
+static void _ccv_init_area_coeffs(int sz, int dsz, double s, double scale, int* ofs, int* si, int* coeffs, float* fcoeffs)
+{
+	int i, k = 0, x;
+	for (i = 0; i < dsz; i++)
 	{
-		double fsx1 = dx * scale_x, fsx2 = fsx1 + scale_x;
+		double fsx1 = i * s, fsx2 = fsx1 + s;
 		int sx1 = (int)(fsx1 + 1.0 - 1e-6), sx2 = (int)(fsx2);
-		sx1 = ccv_min(sx1, a->cols - 1);
-		sx2 = ccv_min(sx2, a->cols - 1);
-
+		sx1 = ccv_min(sx1, sz - 1);
+		sx2 = ccv_min(sx2, sz - 1);
+		ofs[i] = k;
 		if (sx1 > fsx1)
 		{
-			xofs[k].di = dx * ch;
-			xofs[k].si = (sx1 - 1) * ch;
-			xofs[k++].alpha = (unsigned int)((sx1 - fsx1) * 0x100);
+			si[k] = sx1 - 1;
+			coeffs[k] = (unsigned int)((sx1 - fsx1) * 0x100);
+			fcoeffs[k++] = (float)((sx1 - fsx1) * scale);
 		}
-
-		for (sx = sx1; sx < sx2; sx++)
+		for (x = sx1; x < sx2; x++)
 		{
-			xofs[k].di = dx * ch;
-			xofs[k].si = sx * ch;
-			xofs[k++].alpha = 256;
+			si[k] = x;
+			coeffs[k] = 256;
+			fcoeffs[k++] = (float)scale;
 		}
-
 		if (fsx2 - sx2 > 1e-3)
 		{
-			xofs[k].di = dx * ch;
-			xofs[k].si = sx2 * ch;
-			xofs[k++].alpha = (unsigned int)((fsx2 - sx2) * 256);
+			si[k] = sx2;
+			coeffs[k] = (unsigned int)((fsx2 - sx2) * 256);
+			fcoeffs[k++] = (float)((fsx2 - sx2) * scale);
 		}
 	}
-	int xofs_count = k;
-	unsigned int* buf = (unsigned int*)alloca(b->cols * ch * sizeof(unsigned int));
-	unsigned int* sum = (unsigned int*)alloca(b->cols * ch * sizeof(unsigned int));
-	for (dx = 0; dx < b->cols * ch; dx++)
-		buf[dx] = sum[dx] = 0;
-	dy = 0;
-	for (sy = 0; sy < a->rows; sy++)
-	{
-		unsigned char* a_ptr = a->data.u8 + a->step * sy;
-		for (k = 0; k < xofs_count; k++)
+	ofs[dsz] = k;
+}
+
+/* the rows are summed as a stream: a row that ends a destination row is split between it and the next one */
+static void _ccv_init_area_row_coeffs(int sz, int dsz, double s, int n, int* si, int* coeffs, float* fcoeffs)
+{
+	int* count = (int*)cccalloc(dsz, sizeof(int));
+	int dy = 0, sy, k;
+#define add_tap(d, y, w, fw) \
+	if ((d) < dsz) \
+	{ \
+		assert(count[d] < n); \
+		k = (d) * n + count[d]++; \
+		si[k] = (y); \
+		coeffs[k] = (w); \
+		fcoeffs[k] = (fw); \
+	}
+	for (sy = 0; sy < sz; sy++)
+		if ((dy + 1) * s <= sy + 1 || sy == sz - 1)
 		{
-			int dxn = xofs[k].di;
-			unsigned int alpha = xofs[k].alpha;
-			for (i = 0; i < ch; i++)
-				buf[dxn + i] += a_ptr[xofs[k].si + i] * alpha;
+			unsigned int beta = (int)(ccv_max(sy + 1 - (dy + 1) * s, 0.f) * 256);
+			float fbeta = ccv_max(sy + 1 - (dy + 1) * s, 0.f);
+			add_tap(dy, sy, beta <= 0 ? 256 : 256 - beta, fabs(fbeta) < 1e-3 ? 1 : 1 - fbeta);
+			add_tap(dy + 1, sy, beta <= 0 ? 0 : beta, fabs(fbeta) < 1e-3 ? 0 : fbeta);
+			dy++;
+		} else {
+			add_tap(dy, sy, 256, 1);
 		}
-		if ((dy + 1) * scale_y <= sy + 1 || sy == a->rows - 1)
+#undef add_tap
+	for (dy = 0; dy < dsz; dy++)
+		for (k = count[dy]; k < n; k++)
 		{
-			unsigned int beta = (int)(ccv_max(sy + 1 - (dy + 1) * scale_y, 0.f) * 256);
-			unsigned int beta1 = 256 - beta;
-			unsigned char* b_ptr = b->data.u8 + b->step * dy;
-			if (beta <= 0)
-			{
-				for (dx = 0; dx < b->cols * ch; dx++)
-				{
-					b_ptr[dx] = ccv_clamp((sum[dx] + buf[dx] * 256) / inv_scale_256, 0, 255);
-					sum[dx] = buf[dx] = 0;
-				}
-			} else {
-				for (dx = 0; dx < b->cols * ch; dx++)
-				{
-					b_ptr[dx] = ccv_clamp((sum[dx] + buf[dx] * beta1) / inv_scale_256, 0, 255);
-					sum[dx] = buf[dx] * beta;
-					buf[dx] = 0;
-				}
-			}
-			dy++;
+			si[dy * n + k] = count[dy] > 0 ? si[dy * n] : 0;
+			coeffs[dy * n + k] = 0;
+			fcoeffs[dy * n + k] = 0;
 		}
-		else
+	ccfree(count);
+}
+
+static void _ccv_init_cubic_coeffs(int si, int sz, float s, int* sis, float* coeffs)
+{
+	const float A = -0.75f;
+	sis[0] = ccv_max(si - 1, 0);
+	sis[1] = si;
+	sis[2] = ccv_min(si + 1, sz - 1);
+	sis[3] = ccv_min(si + 2, sz - 1);
+	float x = s - si;
+	coeffs[0] = ((A * (x + 1) - 5 * A) * (x + 1) + 8 * A) * (x + 1) - 4 * A;
+	coeffs[1] = ((A + 2) * x - (A + 3)) * x * x + 1;
+	coeffs[2] = ((A + 2) * (1 - x) - (A + 3)) * (1 - x) * (1 - x) + 1;
+	coeffs[3] = 1.f - coeffs[0] - coeffs[1] - coeffs[2];
+}
+
+/* with these (6-bit) coefficients, a tap sum of 8-bit values stays within 16-bit */
+static void _ccv_init_cubic_integer_coeffs(int si, int sz, float s, int* coeffs)
+{
+	const float A = -0.75f;
+	float x = s - si;
+	const int W_BITS = 1 << 6;
+	coeffs[0] = (int)((((A * (x + 1) - 5 * A) * (x + 1) + 8 * A) * (x + 1) - 4 * A) * W_BITS + 0.5);
+	coeffs[1] = (int)((((A + 2) * x - (A + 3)) * x * x + 1) * W_BITS + 0.5);
+	coeffs[2] = (int)((((A + 2) * (1 - x) - (A + 3)) * (1 - x) * (1 - x) + 1) * W_BITS + 0.5);
+	coeffs[3] = W_BITS - coeffs[0] - coeffs[1] - coeffs[2];
+}
+
+ccv_resample_plan_t* ccv_resample_plan_new(int rows, int cols, int brows, int bcols, int type)
+{
+	assert(rows > 0 && cols > 0 && brows > 0 && bcols > 0);
+	int i, method = _ccv_resample_method(rows, cols, brows, bcols, type);
+	int xn = 0, yn = 0;
+	if (method == CCV_INTER_AREA)
+	{
+		xn = (int)((double)cols / bcols) + 3;
+		yn = (int)((double)rows / brows) + 3;
+	} else if (method == CCV_INTER_CUBIC)
+		xn = yn = 4;
+	ccv_resample_plan_t* plan = (ccv_resample_plan_t*)ccmalloc(sizeof(ccv_resample_plan_t) + sizeof(int) * (bcols + 1) + (sizeof(int) * 2 + sizeof(float)) * (bcols * xn + brows * yn));
+	plan->type = type;
+	plan->rows = rows;
+	plan->cols = cols;
+	plan->brows = brows;
+	plan->bcols = bcols;
+	plan->yn = yn;
+	plan->xofs = (int*)(plan + 1);
+	plan->xsi = plan->xofs + bcols + 1;
+	plan->ysi = plan->xsi + bcols * xn;
+	plan->xcoeffs = plan->ysi + brows * yn;
+	plan->ycoeffs = plan->xcoeffs + bcols * xn;
+	plan->xfcoeffs = (float*)(plan->ycoeffs + brows * yn);
+	plan->yfcoeffs = plan->xfcoeffs + bcols * xn;
+	plan->inv_scale = 0;
+	if (method == CCV_INTER_AREA)
+	{
+		double scale_x = (double)cols / bcols;
+		double scale_y = (double)rows / brows;
+		double scale = 1.f / (scale_x * scale_y);
+		plan->inv_scale = (int)(scale_x * scale_y * 0x10000);
+		_ccv_init_area_coeffs(cols, bcols, scale_x, scale, plan->xofs, plan->xsi, plan->xcoeffs, plan->xfcoeffs);
+		_ccv_init_area_row_coeffs(rows, brows, scale_y, yn, plan->ysi, plan->ycoeffs, plan->yfcoeffs);
+	} else if (method == CCV_INTER_CUBIC) {
+		float scale_x = (float)cols / bcols;
+		for (i = 0; i <= bcols; i++)
+			plan->xofs[i] = i * 4;
+		for (i = 0; i < bcols; i++)
 		{
-			for(dx = 0; dx < b->cols * ch; dx++)
-			{
-				sum[dx] += buf[dx] * 256;
-				buf[dx] = 0;
-			}
+			float sx = (i + 0.5) * scale_x - 0.5;
+			_ccv_init_cubic_coeffs((int)sx, cols, sx, plan->xsi + i * 4, plan->xfcoeffs + i * 4);
+			_ccv_init_cubic_integer_coeffs((int)sx, cols, sx, plan->xcoeffs + i * 4);
+		}
+		float scale_y = (float)rows / brows;
+		for (i = 0; i < brows; i++)
+		{
+			float sy = (i + 0.5) * scale_y - 0.5;
+			_ccv_init_cubic_coeffs((int)sy, rows, sy, plan->ysi + i * 4, plan->yfcoeffs + i * 4);
+			_ccv_init_cubic_integer_coeffs((int)sy, rows, sy, plan->ycoeffs + i * 4);
 		}
 	}
+	return plan;
+}
+
+void ccv_resample_plan_free(ccv_resample_plan_t* plan)
+{
+	ccfree(plan);
 }
 
 typedef struct {
-	int si, di;
-	float alpha;
-} ccv_area_alpha_t;
+	ccv_dense_matrix_t* a;
+	ccv_dense_matrix_t* b;
+	const ccv_resample_plan_t* plan;
+	int rows; // destination rows per block
+} ccv_resample_context_t;
+
+/* the horizontal passes are inlined with a constant channel count for the common cases */
+#define _ccv_resample_with_ch(ch, _func, ...) \
+	switch (ch) \
+	{ \
+		case 1: \
+			_func(__VA_ARGS__, 1); \
+			break; \
+		case 3: \
+			_func(__VA_ARGS__, 3); \
+			break; \
+		default: \
+			_func(__VA_ARGS__, ch); \
+	}
 
-static void _ccv_resample_area(ccv_dense_matrix_t* a, ccv_dense_matrix_t* b)
+static inline void _ccv_resample_area_row_8u(const ccv_resample_plan_t* plan, const unsigned int* sum, unsigned char* b_ptr, int ch)
 {
-	assert(a->cols > 0 && b->cols > 0);
-	ccv_area_alpha_t* xofs = (ccv_area_alpha_t*)alloca(sizeof(ccv_area_alpha_t) * a->cols * 2);
-	int ch = CCV_GET_CHANNEL(a->type);
-	double scale_x = (double)a->cols / b->cols;
-	double scale_y = (double)a->rows / b->rows;
-	double scale = 1.f / (scale_x * scale_y);
-	int dx, dy, sx, sy, i, k;
-	for (dx = 0, k = 0; dx < b->cols; dx++)
+	int j, k, t;
+	for (j = 0; j < plan->bcols; j++)
 	{
-		double fsx1 = dx * scale_x, fsx2 = fsx1 + scale_x;
-		int sx1 = (int)(fsx1 + 1.0 - 1e-6), sx2 = (int)(fsx2);
-		sx1 = ccv_min(sx1, a->cols - 1);
-		sx2 = ccv_min(sx2, a->cols - 1);
+		unsigned int v[4] = {0};
+		for (t = plan->xofs[j]; t < plan->xofs[j + 1]; t++)
+		{
+			const unsigned int* sum_ptr = sum + plan->xsi[t] * ch;
+			unsigned int alpha = plan->xcoeffs[t];
+			for (k = 0; k < ch; k++)
+				v[k] += sum_ptr[k] * alpha;
+		}
+		for (k = 0; k < ch; k++)
+			b_ptr[j * ch + k] = ccv_min(v[k] / plan->inv_scale, 255);
+	}
+}
 
-		if (sx1 > fsx1)
+static inline void _ccv_resample_area_row(const ccv_resample_plan_t* plan, const float* sum, float* row, int ch)
+{
+	int j, k, t;
+	if (ch > 4)
+	{
+		// too many channels to keep in registers, accumulate in place
+		for (j = 0; j < plan->bcols; j++)
+		{
+			float* v = row + j * ch;
+			for (k = 0; k < ch; k++)
+				v[k] = 0;
+			for (t = plan->xofs[j]; t < plan->xofs[j + 1]; t++)
+			{
+				const float* sum_ptr = sum + plan->xsi[t] * ch;
+				float alpha = plan->xfcoeffs[t];
+				for (k = 0; k < ch; k++)
+					v[k] += sum_ptr[k] * alpha;
+			}
+		}
+		return;
+	}
+	for (j = 0; j < plan->bcols; j++)
+	{
+		float v[4] = {0};
+		for (t = plan->xofs[j]; t < plan->xofs[j + 1]; t++)
 		{
-			xofs[k].di = dx * ch;
-			xofs[k].si = (sx1 - 1) * ch;
-			xofs[k++].alpha = (float)((sx1 - fsx1) * scale);
+			const float* sum_ptr = sum + plan->xsi[t] * ch;
+			float alpha = plan->xfcoeffs[t];
+			for (k = 0; k < ch; k++)
+				v[k] += sum_ptr[k] * alpha;
 		}
+		for (k = 0; k < ch; k++)
+			row[j * ch + k] = v[k];
+	}
+}
 
-		for (sx = sx1; sx < sx2; sx++)
+static void _ccv_resample_area_8u(size_t s, void* _context)
+{
+	ccv_resample_context_t* context = (ccv_resample_context_t*)_context;
+	ccv_dense_matrix_t* a = context->a;
+	ccv_dense_matrix_t* b = context->b;
+	const ccv_resample_plan_t* plan = context->plan;
+	int i, j, t, ch = CCV_GET_CHANNEL(a->type), w = a->cols * ch;
+	int i0 = s * context->rows, i1 = ccv_min(i0 + context->rows, b->rows);
+	unsigned int* sum = (unsigned int*)ccmalloc(sizeof(unsigned int) * w);
+	for (i = i0; i < i1; i++)
+	{
+		memset(sum, 0, sizeof(unsigned int) * w);
+		for (t = 0; t < plan->yn; t++)
 		{
-			xofs[k].di = dx * ch;
-			xofs[k].si = sx * ch;
-			xofs[k++].alpha = (float)scale;
+			unsigned int beta = plan->ycoeffs[i * plan->yn + t];
+			if (beta == 0)
+				continue;
+			unsigned char* a_ptr = a->data.u8 + plan->ysi[i * plan->yn + t] * a->step;
+			j = 0;
+#ifdef HAVE_SSE2
+			/* a pixel times a weight (at most 256) fits in 16-bit */
+			__m128i zero = _mm_setzero_si128();
+			__m128i beta8 = _mm_set1_epi16(beta);
+			for (; j + 16 <= w; j += 16)
+			{
+				__m128i x = _mm_loadu_si128((const __m128i*)(a_ptr + j));
+				__m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(x, zero), beta8);
+				__m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(x, zero), beta8);
+				_mm_storeu_si128((__m128i*)(sum + j), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(sum + j)), _mm_unpacklo_epi16(lo, zero)));
+				_mm_storeu_si128((__m128i*)(sum + j + 4), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(sum + j + 4)), _mm_unpackhi_epi16(lo, zero)));
+				_mm_storeu_si128((__m128i*)(sum + j + 8), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(sum + j + 8)), _mm_unpacklo_epi16(hi, zero)));
+				_mm_storeu_si128((__m128i*)(sum + j + 12), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(sum + j + 12)), _mm_unpackhi_epi16(hi, zero)));
+			}
+#endif
+			for (; j < w; j++)
+				sum[j] += a_ptr[j] * beta;
 		}
+		_ccv_resample_with_ch(ch, _ccv_resample_area_row_8u, plan, sum, b->data.u8 + i * b->step);
+	}
+	ccfree(sum);
+}
 
-		if (fsx2 - sx2 > 1e-3)
+static void _ccv_resample_area(size_t s, void* _context)
+{
+	ccv_resample_context_t* context = (ccv_resample_context_t*)_context;
+	ccv_dense_matrix_t* a = context->a;
+	ccv_dense_matrix_t* b = context->b;
+	const ccv_resample_plan_t* plan = context->plan;
+	int i, j, t, ch = CCV_GET_CHANNEL(a->type), w = a->cols * ch;
+	int i0 = s * context->rows, i1 = ccv_min(i0 + context->rows, b->rows);
+	float* sum = (float*)ccmalloc(sizeof(float) * (w + b->cols * ch));
+	float* row = sum + w;
+	for (i = i0; i < i1; i++)
+	{
+		memset(sum, 0, sizeof(float) * w);
+		for (t = 0; t < plan->yn; t++)
 		{
-			xofs[k].di = dx * ch;
-			xofs[k].si = sx2 * ch;
-			xofs[k++].alpha = (float)((fsx2 - sx2) * scale);
+			float beta = plan->yfcoeffs[i * plan->yn + t];
+			if (beta == 0)
+				continue;
+			unsigned char* a_ptr = a->data.u8 + plan->ysi[i * plan->yn + t] * a->step;
+			j = 0;
+#ifdef HAVE_SSE2
+			__m128 beta4 = _mm_set1_ps(beta);
+			if (a->type & CCV_32F)
+			{
+				for (; j + 4 <= w; j += 4)
+					_mm_storeu_ps(sum + j, _mm_add_ps(_mm_loadu_ps(sum + j), _mm_mul_ps(_mm_loadu_ps((const float*)a_ptr + j), beta4)));
+			} else if (a->type & CCV_8U) {
+				__m128i zero = _mm_setzero_si128();
+				for (; j + 8 <= w; j += 8)
+				{
+					__m128i x = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(a_ptr + j)), zero);
+					_mm_storeu_ps(sum + j, _mm_add_ps(_mm_loadu_ps(sum + j), _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(x, zero)), beta4)));
+					_mm_storeu_ps(sum + j + 4, _mm_add_ps(_mm_loadu_ps(sum + j + 4), _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(x, zero)), beta4)));
+				}
+			}
+#endif
+#define for_block(_, _for_get) \
+			for (; j < w; j++) \
+				sum[j] += _for_get(a_ptr, j, 0) * beta;
+			ccv_matrix_getter(a->type, for_block);
+#undef for_block
+		}
+		unsigned char* b_ptr = b->data.u8 + i * b->step;
+		if (b->type & CCV_32F)
+		{
+			_ccv_resample_with_ch(ch, _ccv_resample_area_row, plan, sum, (float*)b_ptr);
+		} else {
+			_ccv_resample_with_ch(ch, _ccv_resample_area_row, plan, sum, row);
+#define for_block(_, _for_set) \
+			for (j = 0; j < b->cols * ch; j++) \
+				_for_set(b_ptr, j, row[j], 0);
+			ccv_matrix_setter(b->type, for_block);
+#undef for_block
 		}
 	}
-	int xofs_count = k;
-	float* buf = (float*)alloca(b->cols * ch * sizeof(float));
-	float* sum = (float*)alloca(b->cols * ch * sizeof(float));
-	for (dx = 0; dx < b->cols * ch; dx++)
-		buf[dx] = sum[dx] = 0;
-	dy = 0;
-#define for_block(_for_get, _for_set) \
-	for (sy = 0; sy < a->rows; sy++) \
+	ccfree(sum);
+}
+
+static inline void _ccv_resample_cubic_row_32f(const ccv_resample_plan_t* plan, const unsigned char* a_ptr, int type, float* row, int ch)
+{
+	int j, k;
+#define for_block(_for_type) \
+	for (j = 0; j < plan->bcols; j++) \
 	{ \
-		unsigned char* a_ptr = a->data.u8 + a->step * sy; \
-		for (k = 0; k < xofs_count; k++) \
-		{ \
-			int dxn = xofs[k].di; \
-			float alpha = xofs[k].alpha; \
-			for (i = 0; i < ch; i++) \
-				buf[dxn + i] += _for_get(a_ptr, xofs[k].si + i, 0) * alpha; \
-		} \
-		if ((dy + 1) * scale_y <= sy + 1 || sy == a->rows - 1) \
-		{ \
-			float beta = ccv_max(sy + 1 - (dy + 1) * scale_y, 0.f); \
-			float beta1 = 1 - beta; \
-			unsigned char* b_ptr = b->data.u8 + b->step * dy; \
-			if (fabs(beta) < 1e-3) \
-			{ \
-				for (dx = 0; dx < b->cols * ch; dx++) \
-				{ \
-					_for_set(b_ptr, dx, sum[dx] + buf[dx], 0); \
-					sum[dx] = buf[dx] = 0; \
-				} \
-			} else { \
-				for (dx = 0; dx < b->cols * ch; dx++) \
-				{ \
-					_for_set(b_ptr, dx, sum[dx] + buf[dx] * beta1, 0); \
-					sum[dx] = buf[dx] * beta; \
-					buf[dx] = 0; \
-				} \
-			} \
-			dy++; \
-		} \
-		else \
-		{ \
-			for(dx = 0; dx < b->cols * ch; dx++) \
-			{ \
-				sum[dx] += buf[dx]; \
-				buf[dx] = 0; \
-			} \
-		} \
+		const _for_type* x0 = (const _for_type*)a_ptr + plan->xsi[j * 4] * ch; \
+		const _for_type* x1 = (const _for_type*)a_ptr + plan->xsi[j * 4 + 1] * ch; \
+		const _for_type* x2 = (const _for_type*)a_ptr + plan->xsi[j * 4 + 2] * ch; \
+		const _for_type* x3 = (const _for_type*)a_ptr + plan->xsi[j * 4 + 3] * ch; \
+		const float* alpha = plan->xfcoeffs + j * 4; \
+		for (k = 0; k < ch; k++) \
+			row[j * ch + k] = x0[k] * alpha[0] + x1[k] * alpha[1] + x2[k] * alpha[2] + x3[k] * alpha[3]; \
 	}
-	ccv_matrix_getter(a->type, ccv_matrix_setter, b->type, for_block);
+	if (type & CCV_8U)
+		for_block(unsigned char)
+	else
+		for_block(float)
 #undef for_block
 }
 
-typedef struct {
-	int si[4];
-	float coeffs[4];
-} ccv_cubic_coeffs_t;
+static inline void _ccv_resample_cubic_row_8u(const ccv_resample_plan_t* plan, const unsigned char* a_ptr, short* row, int ch)
+{
+	int j, k;
+	for (j = 0; j < plan->bcols; j++)
+	{
+		const unsigned char* x0 = a_ptr + plan->xsi[j * 4] * ch;
+		const unsigned char* x1 = a_ptr + plan->xsi[j * 4 + 1] * ch;
+		const unsigned char* x2 = a_ptr + plan->xsi[j * 4 + 2] * ch;
+		const unsigned char* x3 = a_ptr + plan->xsi[j * 4 + 3] * ch;
+		const int* alpha = plan->xcoeffs + j * 4;
+		for (k = 0; k < ch; k++)
+			row[j * ch + k] = x0[k] * alpha[0] + x1[k] * alpha[1] + x2[k] * alpha[2] + x3[k] * alpha[3];
+	}
+}
 
-typedef struct {
-	int si[4];
-	int coeffs[4];
-} ccv_cubic_integer_coeffs_t;
+/* the 4 rows of the horizontal pass are kept in a ring, indexed by the source row, a block of destination rows
+ * starts its ring from the first source row it needs */
+static void _ccv_resample_cubic_32f(size_t s, void* _context)
+{
+	ccv_resample_context_t* context = (ccv_resample_context_t*)_context;
+	ccv_dense_matrix_t* a = context->a;
+	ccv_dense_matrix_t* b = context->b;
+	const ccv_resample_plan_t* plan = context->plan;
+	int i, j, ch = CCV_GET_CHANNEL(a->type), w = b->cols * ch;
+	int i0 = s * context->rows, i1 = ccv_min(i0 + context->rows, b->rows);
+	float* buf = (float*)ccmalloc(sizeof(float) * w * 4);
+	int siy = 0;
+	for (i = i0; i < i1; i++)
+	{
+		const int* sy = plan->ysi + i * 4;
+		const float* beta = plan->yfcoeffs + i * 4;
+		for (siy = ccv_max(siy, sy[0]); siy <= sy[3]; siy++)
+			_ccv_resample_with_ch(ch, _ccv_resample_cubic_row_32f, plan, a->data.u8 + siy * a->step, a->type, buf + (siy & 0x3) * w);
+		const float* row[4] = {
+			buf + (sy[0] & 0x3) * w,
+			buf + (sy[1] & 0x3) * w,
+			buf + (sy[2] & 0x3) * w,
+			buf + (sy[3] & 0x3) * w,
+		};
+		float* b_ptr = (float*)(b->data.u8 + i * b->step);
+		j = 0;
+#ifdef HAVE_SSE2
+		__m128 beta0 = _mm_set1_ps(beta[0]), beta1 = _mm_set1_ps(beta[1]), beta2 = _mm_set1_ps(beta[2]), beta3 = _mm_set1_ps(beta[3]);
+		for (; j + 4 <= w; j += 4)
+		{
+			__m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(row[0] + j), beta0), _mm_mul_ps(_mm_loadu_ps(row[1] + j), beta1));
+			v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(row[2] + j), beta2));
+			_mm_storeu_ps(b_ptr + j, _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(row[3] + j), beta3)));
+		}
+#endif
+		for (; j < w; j++)
+			b_ptr[j] = row[0][j] * beta[0] + row[1][j] * beta[1] + row[2][j] * beta[2] + row[3][j] * beta[3];
+	}
+	ccfree(buf);
+}
 
-static void _ccv_init_cubic_coeffs(int si, int sz, float s, ccv_cubic_coeffs_t* coeff)
+static void _ccv_resample_cubic_8u(size_t s, void* _context)
 {
-	const float A = -0.75f;
-	coeff->si[0] = ccv_max(si - 1, 0);
-	coeff->si[1] = si;
-	coeff->si[2] = ccv_min(si + 1, sz - 1);
-	coeff->si[3] = ccv_min(si + 2, sz - 1);
-	float x = s - si;
-	coeff->coeffs[0] = ((A * (x + 1) - 5 * A) * (x + 1) + 8 * A) * (x + 1) - 4 * A;
-	coeff->coeffs[1] = ((A + 2) * x - (A + 3)) * x * x + 1;
-	coeff->coeffs[2] = ((A + 2) * (1 - x) - (A + 3)) * (1 - x) * (1 - x) + 1;
-	coeff->coeffs[3] = 1.f - coeff->coeffs[0] - coeff->coeffs[1] - coeff->coeffs[2];
+	ccv_resample_context_t* context = (ccv_resample_context_t*)_context;
+	ccv_dense_matrix_t* a = context->a;
+	ccv_dense_matrix_t* b = context->b;
+	const ccv_resample_plan_t* plan = context->plan;
+	int i, j, ch = CCV_GET_CHANNEL(a->type), w = b->cols * ch;
+	int i0 = s * context->rows, i1 = ccv_min(i0 + context->rows, b->rows);
+	short* buf = (short*)ccmalloc(sizeof(short) * w * 4);
+	int siy = 0;
+	for (i = i0; i < i1; i++)
+	{
+		const int* sy = plan->ysi + i * 4;
+		const int* beta = plan->ycoeffs + i * 4;
+		for (siy = ccv_max(siy, sy[0]); siy <= sy[3]; siy++)
+			_ccv_resample_with_ch(ch, _ccv_resample_cubic_row_8u, plan, a->data.u8 + siy * a->step, buf + (siy & 0x3) * w);
+		const short* row[4] = {
+			buf + (sy[0] & 0x3) * w,
+			buf + (sy[1] & 0x3) * w,
+			buf + (sy[2] & 0x3) * w,
+			buf + (sy[3] & 0x3) * w,
+		};
+		unsigned char* b_ptr = b->data.u8 + i * b->step;
+		j = 0;
+#ifdef HAVE_SSE2
+		__m128i beta01 = _mm_set1_epi32((beta[0] & 0xffff) | (beta[1] << 16));
+		__m128i beta23 = _mm_set1_epi32((beta[2] & 0xffff) | (beta[3] << 16));
+		__m128i half = _mm_set1_epi32(1 << 11);
+		for (; j + 8 <= w; j += 8)
+		{
+			__m128i r0 = _mm_loadu_si128((const __m128i*)(row[0] + j));
+			__m128i r1 = _mm_loadu_si128((const __m128i*)(row[1] + j));
+			__m128i r2 = _mm_loadu_si128((const __m128i*)(row[2] + j));
+			__m128i r3 = _mm_loadu_si128((const __m128i*)(row[3] + j));
+			__m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(r0, r1), beta01), _mm_madd_epi16(_mm_unpacklo_epi16(r2, r3), beta23));
+			__m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(r0, r1), beta01), _mm_madd_epi16(_mm_unpackhi_epi16(r2, r3), beta23));
+			lo = _mm_srai_epi32(_mm_add_epi32(lo, half), 12);
+			hi = _mm_srai_epi32(_mm_add_epi32(hi, half), 12);
+			lo = _mm_packs_epi32(lo, hi);
+			_mm_storel_epi64((__m128i*)(b_ptr + j), _mm_packus_epi16(lo, lo));
+		}
+#endif
+		for (; j < w; j++)
+			b_ptr[j] = ccv_clamp(ccv_descale(row[0][j] * beta[0] + row[1][j] * beta[1] + row[2][j] * beta[2] + row[3][j] * beta[3], 12), 0, 255);
+	}
+	ccfree(buf);
 }
 
-static void _ccv_resample_cubic_float_only(ccv_dense_matrix_t* a, ccv_dense_matrix_t* b)
+static void _ccv_resample_cubic_float_only(ccv_dense_matrix_t* a, ccv_dense_matrix_t* b, const ccv_resample_plan_t* plan)
 {
 	assert(CCV_GET_DATA_TYPE(b->type) == CCV_32F || CCV_GET_DATA_TYPE(b->type) == CCV_64F);
 	int i, j, k, ch = CCV_GET_CHANNEL(a->type);
 	assert(b->cols > 0 && b->step > 0);
-	ccv_cubic_coeffs_t* xofs = (ccv_cubic_coeffs_t*)alloca(sizeof(ccv_cubic_coeffs_t) * b->cols);
-	float scale_x = (float)a->cols / b->cols;
-	for (i = 0; i < b->cols; i++)
-	{
-		float sx = (i + 0.5) * scale_x - 0.5;
-		_ccv_init_cubic_coeffs((int)sx, a->cols, sx, xofs + i);
-	}
-	float scale_y = (float)a->rows / b->rows;
 	unsigned char* buf = (unsigned char*)alloca(b->step * 4);
 #ifdef __clang_analyzer__
 	memset(buf, 0, b->step * 4);
@@ -236,68 +493,48 @@ static void _ccv_resample_cubic_float_only(ccv_dense_matrix_t* a, ccv_dense_matr
 #define for_block(_for_get, _for_set_b, _for_get_b) \
 	for (i = 0; i < b->rows; i++) \
 	{ \
-		ccv_cubic_coeffs_t yofs; \
-		float sy = (i + 0.5) * scale_y - 0.5; \
-		_ccv_init_cubic_coeffs((int)sy, a->rows, sy, &yofs); \
-		if (yofs.si[3] > psi) \
+		const int* sy = plan->ysi + i * 4; \
+		const float* beta = plan->yfcoeffs + i * 4; \
+		if (sy[3] > psi) \
 		{ \
-			for (; siy <= yofs.si[3]; siy++) \
+			for (; siy <= sy[3]; siy++) \
 			{ \
 				unsigned char* row = buf + (siy & 0x3) * b->step; \
 				for (j = 0; j < b->cols; j++) \
+				{ \
+					const int* sx = plan->xsi + j * 4; \
+					const float* alpha = plan->xfcoeffs + j * 4; \
 					for (k = 0; k < ch; k++) \
-						_for_set_b(row, j * ch + k, _for_get(a_ptr, xofs[j].si[0] * ch + k, 0) * xofs[j].coeffs[0] + \
-													_for_get(a_ptr, xofs[j].si[1] * ch + k, 0) * xofs[j].coeffs[1] + \
-													_for_get(a_ptr, xofs[j].si[2] * ch + k, 0) * xofs[j].coeffs[2] + \
-													_for_get(a_ptr, xofs[j].si[3] * ch + k, 0) * xofs[j].coeffs[3], 0); \
+						_for_set_b(row, j * ch + k, _for_get(a_ptr, sx[0] * ch + k, 0) * alpha[0] + \
+													_for_get(a_ptr, sx[1] * ch + k, 0) * alpha[1] + \
+													_for_get(a_ptr, sx[2] * ch + k, 0) * alpha[2] + \
+													_for_get(a_ptr, sx[3] * ch + k, 0) * alpha[3], 0); \
+				} \
 				a_ptr += a->step; \
 			} \
-			psi = yofs.si[3]; \
+			psi = sy[3]; \
 		} \
 		unsigned char* row[4] = { \
-			buf + (yofs.si[0] & 0x3) * b->step, \
-			buf + (yofs.si[1] & 0x3) * b->step, \
-			buf + (yofs.si[2] & 0x3) * b->step, \
-			buf + (yofs.si[3] & 0x3) * b->step, \
+			buf + (sy[0] & 0x3) * b->step, \
+			buf + (sy[1] & 0x3) * b->step, \
+			buf + (sy[2] & 0x3) * b->step, \
+			buf + (sy[3] & 0x3) * b->step, \
 		}; \
 		for (j = 0; j < b->cols * ch; j++) \
-			_for_set_b(b_ptr, j, _for_get_b(row[0], j, 0) * yofs.coeffs[0] + _for_get_b(row[1], j, 0) * yofs.coeffs[1] + \
-								 _for_get_b(row[2], j, 0) * yofs.coeffs[2] + _for_get_b(row[3], j, 0) * yofs.coeffs[3], 0); \
+			_for_set_b(b_ptr, j, _for_get_b(row[0], j, 0) * beta[0] + _for_get_b(row[1], j, 0) * beta[1] + \
+								 _for_get_b(row[2], j, 0) * beta[2] + _for_get_b(row[3], j, 0) * beta[3], 0); \
 		b_ptr += b->step; \
 	}
 	ccv_matrix_getter(a->type, ccv_matrix_setter_getter_float_only, b->type, for_block);
 #undef for_block
 }
 
-static void _ccv_init_cubic_integer_coeffs(int si, int sz, float s, ccv_cubic_integer_coeffs_t* coeff)
-{
-	const float A = -0.75f;
-	coeff->si[0] = ccv_max(si - 1, 0);
-	coeff->si[1] = si;
-	coeff->si[2] = ccv_min(si + 1, sz - 1);
-	coeff->si[3] = ccv_min(si + 2, sz - 1);
-	float x = s - si;
-	const int W_BITS = 1 << 6;
-	coeff->coeffs[0] = (int)((((A * (x + 1) - 5 * A) * (x + 1) + 8 * A) * (x + 1) - 4 * A) * W_BITS + 0.5);
-	coeff->coeffs[1] = (int)((((A + 2) * x - (A + 3)) * x * x + 1) * W_BITS + 0.5);
-	coeff->coeffs[2] = (int)((((A + 2) * (1 - x) - (A + 3)) * (1 - x) * (1 - x) + 1) * W_BITS + 0.5);
-	coeff->coeffs[3] = W_BITS - coeff->coeffs[0] - coeff->coeffs[1] - coeff->coeffs[2];
-}
-
-static void _ccv_resample_cubic_integer_only(ccv_dense_matrix_t* a, ccv_dense_matrix_t* b)
+static void _ccv_resample_cubic_integer_only(ccv_dense_matrix_t* a, ccv_dense_matrix_t* b, const ccv_resample_plan_t* plan)
 {
 	assert(CCV_GET_DATA_TYPE(b->type) == CCV_8U || CCV_GET_DATA_TYPE(b->type) == CCV_32S || CCV_GET_DATA_TYPE(b->type) == CCV_64S);
 	int i, j, k, ch = CCV_GET_CHANNEL(a->type);
 	int no_8u_type = (b->type & CCV_8U) ? CCV_32S : b->type;
 	assert(b->cols > 0);
-	ccv_cubic_integer_coeffs_t* xofs = (ccv_cubic_integer_coeffs_t*)alloca(sizeof(ccv_cubic_integer_coeffs_t) * b->cols);
-	float scale_x = (float)a->cols / b->cols;
-	for (i = 0; i < b->cols; i++)
-	{
-		float sx = (i + 0.5) * scale_x - 0.5;
-		_ccv_init_cubic_integer_coeffs((int)sx, a->cols, sx, xofs + i);
-	}
-	float scale_y = (float)a->rows / b->rows;
 	int bufstep = b->cols * ch * CCV_GET_DATA_TYPE_SIZE(no_8u_type);
 	unsigned char* buf = (unsigned char*)alloca(bufstep * 4);
 #ifdef __clang_analyzer__
@@ -309,39 +546,98 @@ static void _ccv_resample_cubic_integer_only(ccv_dense_matrix_t* a, ccv_dense_ma
 #define for_block(_for_get_a, _for_set, _for_get, _for_set_b) \
 	for (i = 0; i < b->rows; i++) \
 	{ \
-		ccv_cubic_integer_coeffs_t yofs; \
-		float sy = (i + 0.5) * scale_y - 0.5; \
-		_ccv_init_cubic_integer_coeffs((int)sy, a->rows, sy, &yofs); \
-		if (yofs.si[3] > psi) \
+		const int* sy = plan->ysi + i * 4; \
+		const int* beta = plan->ycoeffs + i * 4; \
+		if (sy[3] > psi) \
 		{ \
-			for (; siy <= yofs.si[3]; siy++) \
+			for (; siy <= sy[3]; siy++) \
 			{ \
 				unsigned char* row = buf + (siy & 0x3) * bufstep; \
 				for (j = 0; j < b->cols; j++) \
+				{ \
+					const int* sx = plan->xsi + j * 4; \
+					const int* alpha = plan->xcoeffs + j * 4; \
 					for (k = 0; k < ch; k++) \
-						_for_set(row, j * ch + k, _for_get_a(a_ptr, xofs[j].si[0] * ch + k, 0) * xofs[j].coeffs[0] + \
-												  _for_get_a(a_ptr, xofs[j].si[1] * ch + k, 0) * xofs[j].coeffs[1] + \
-												  _for_get_a(a_ptr, xofs[j].si[2] * ch + k, 0) * xofs[j].coeffs[2] + \
-												  _for_get_a(a_ptr, xofs[j].si[3] * ch + k, 0) * xofs[j].coeffs[3], 0); \
+						_for_set(row, j * ch + k, _for_get_a(a_ptr, sx[0] * ch + k, 0) * alpha[0] + \
+												  _for_get_a(a_ptr, sx[1] * ch + k, 0) * alpha[1] + \
+												  _for_get_a(a_ptr, sx[2] * ch + k, 0) * alpha[2] + \
+												  _for_get_a(a_ptr, sx[3] * ch + k, 0) * alpha[3], 0); \
+				} \
 				a_ptr += a->step; \
 			} \
-			psi = yofs.si[3]; \
+			psi = sy[3]; \
 		} \
 		unsigned char* row[4] = { \
-			buf + (yofs.si[0] & 0x3) * bufstep, \
-			buf + (yofs.si[1] & 0x3) * bufstep, \
-			buf + (yofs.si[2] & 0x3) * bufstep, \
-			buf + (yofs.si[3] & 0x3) * bufstep, \
+			buf + (sy[0] & 0x3) * bufstep, \
+			buf + (sy[1] & 0x3) * bufstep, \
+			buf + (sy[2] & 0x3) * bufstep, \
+			buf + (sy[3] & 0x3) * bufstep, \
 		}; \
 		for (j = 0; j < b->cols * ch; j++) \
-			_for_set_b(b_ptr, j, ccv_descale(_for_get(row[0], j, 0) * yofs.coeffs[0] + _for_get(row[1], j, 0) * yofs.coeffs[1] + \
-											 _for_get(row[2], j, 0) * yofs.coeffs[2] + _for_get(row[3], j, 0) * yofs.coeffs[3], 12), 0); \
+			_for_set_b(b_ptr, j, ccv_descale(_for_get(row[0], j, 0) * beta[0] + _for_get(row[1], j, 0) * beta[1] + \
+											 _for_get(row[2], j, 0) * beta[2] + _for_get(row[3], j, 0) * beta[3], 12), 0); \
 		b_ptr += b->step; \
 	}
 	ccv_matrix_getter(a->type, ccv_matrix_setter_getter_integer_only, no_8u_type, ccv_matrix_setter_integer_only, b->type, for_block);
 #undef for_block
 }
 
+static void _ccv_resample_copy(ccv_dense_matrix_t* a, ccv_dense_matrix_t* db)
+{
+	if (CCV_GET_CHANNEL(a->type) == CCV_GET_CHANNEL(db->type) && CCV_GET_DATA_TYPE(db->type) == CCV_GET_DATA_TYPE(a->type))
+	{
+		if (a->step == db->step)
+			memcpy(db->data.u8, a->data.u8, a->rows * a->step);
+		else { // a view has the step of its parent
+			int i;
+			for (i = 0; i < a->rows; i++)
+				memcpy(db->data.u8 + i * db->step, a->data.u8 + i * a->step, a->cols * CCV_GET_DATA_TYPE_SIZE(a->type) * CCV_GET_CHANNEL(a->type));
+		}
+	} else 
+	{
+		ccv_shift(a, (ccv_matrix_t**)&db, 0, 0, 0);
+	}
+}
+
+static void _ccv_resample_with_plan(ccv_dense_matrix_t* a, ccv_dense_matrix_t* db, const ccv_resample_plan_t* plan)
+{
+	int method = _ccv_resample_method(plan->rows, plan->cols, plan->brows, plan->bcols, plan->type);
+	ccv_resample_context_t context;
+	context.a = a;
+	context.b = db;
+	context.plan = plan;
+	context.rows = method == CCV_INTER_CUBIC ? ccv_max(CCV_RESAMPLE_ROWS, (CCV_RESAMPLE_CUBIC_ROWS * db->rows + a->rows - 1) / a->rows) : CCV_RESAMPLE_ROWS;
+	size_t count = (db->rows + context.rows - 1) / context.rows;
+	// ԴдڵĿ
+	if (method == CCV_INTER_AREA)
+	{
+		/* using the fast alternative (fix point scale, 0x100 to avoid overflow), it keeps up to 4 channels in registers */
+		if (CCV_GET_DATA_TYPE(a->type) == CCV_8U && CCV_GET_DATA_TYPE(db->type) == CCV_8U && CCV_GET_CHANNEL(a->type) <= 4 && a->rows * a->cols / (db->rows * db->cols) < 0x100)
+			ccv_parallel_for(count, _ccv_resample_area_8u, &context);
+		else
+			ccv_parallel_for(count, _ccv_resample_area, &context);
+	}
+	else if (method == CCV_INTER_CUBIC)
+	{
+		if (CCV_GET_DATA_TYPE(db->type) == CCV_32F && (a->type & (CCV_8U | CCV_32F)))
+			ccv_parallel_for(count, _ccv_resample_cubic_32f, &context);
+		else if (CCV_GET_DATA_TYPE(db->type) == CCV_8U && CCV_GET_DATA_TYPE(a->type) == CCV_8U)
+			ccv_parallel_for(count, _ccv_resample_cubic_8u, &context);
+		else if (CCV_GET_DATA_TYPE(db->type) == CCV_32F || CCV_GET_DATA_TYPE(db->type) == CCV_64F)
+			_ccv_resample_cubic_float_only(a, db, plan);
+		else
+			_ccv_resample_cubic_integer_only(a, db, plan);
+	}
+	else if (plan->type & CCV_INTER_LINEAR)
+	{
+		assert(0 && "CCV_INTER_LINEAR is not implemented");
+	}
+	else if (plan->type & CCV_INTER_LANCZOS)
+	{
+		assert(0 && "CCV_INTER_LANCZOS is not implemented");
+	}
+}
+
 void 
 ccv_resample(ccv_dense_matrix_t* a, 
 			 ccv_dense_matrix_t** b, 
@@ -359,40 +655,25 @@ ccv_resample(ccv_dense_matrix_t* a,
 	// ԴĿֱӿ
 	if (a->rows == db->rows && a->cols == db->cols)
 	{
-		if (CCV_GET_CHANNEL(a->type) == CCV_GET_CHANNEL(db->type) && CCV_GET_DATA_TYPE(db->type) == CCV_GET_DATA_TYPE(a->type))
-			memcpy(db->data.u8, a->data.u8, a->rows * a->step);
-		else 
-		{
-			ccv_shift(a, (ccv_matrix_t**)&db, 0, 0, 0);
-		}
-		
+		_ccv_resample_copy(a, db);
 		return;
 	}
+	ccv_resample_plan_t* plan = ccv_resample_plan_new(a->rows, a->cols, rows, cols, type);
+	_ccv_resample_with_plan(a, db, plan);
+	ccv_resample_plan_free(plan);
+}
 
-	// ԴдڵĿ
-	if ((type & CCV_INTER_AREA) && a->rows >= db->rows && a->cols >= db->cols)
-	{
-		/* using the fast alternative (fix point scale, 0x100 to avoid overflow) */
-		if (CCV_GET_DATA_TYPE(a->type) == CCV_8U && CCV_GET_DATA_TYPE(db->type) == CCV_8U && a->rows * a->cols / (db->rows * db->cols) < 0x100)
-			_ccv_resample_area_8u(a, db);
-		else
-			_ccv_resample_area(a, db);
-	} 
-	else if (type & CCV_INTER_CUBIC) 
-	{
-		if (CCV_GET_DATA_TYPE(db->type) == CCV_32F || CCV_GET_DATA_TYPE(db->type) == CCV_64F)
-			_ccv_resample_cubic_float_only(a, db);
-		else
-			_ccv_resample_cubic_integer_only(a, db);
-	} 
-	else if (type & CCV_INTER_LINEAR) 
-	{
-		assert(0 && "CCV_INTER_LINEAR is not implemented");
-	} 
-	else if (type & CCV_INTER_LINEAR) 
-	{
-		assert(0 && "CCV_INTER_LANCZOS is not implemented");
-	}
+void ccv_resample_with_plan(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int btype, const ccv_resample_plan_t* plan)
+{
+	assert(a->rows == plan->rows && a->cols == plan->cols);
+	ccv_declare_derived_signature(sig, a->sig != 0, ccv_sign_with_format(64, "ccv_resample(%d,%d,%d)", plan->brows, plan->bcols, plan->type), a->sig, CCV_EOF_SIGN);
+	btype = (btype == 0) ? CCV_GET_DATA_TYPE(a->type) | CCV_GET_CHANNEL(a->type) : CCV_GET_DATA_TYPE(btype) | CCV_GET_CHANNEL(a->type);
+	ccv_dense_matrix_t* db = *b = ccv_dense_matrix_renew(*b, plan->brows, plan->bcols, CCV_ALL_DATA_TYPE | CCV_GET_CHANNEL(a->type), btype, sig);
+	ccv_object_return_if_cached(, db);
+	if (a->rows == db->rows && a->cols == db->cols)
+		_ccv_resample_copy(a, db);
+	else
+		_ccv_resample_with_plan(a, db, plan);
 }
 
 /* the following code is adopted from OpenCV cvPyrDown */
@@ -463,6 +744,228 @@ void ccv_sample_down(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, in
 #undef for_block
 }
 
+/* ccv_sample_down_octaves keeps the 5-row ring of ccv_sample_down for every octave, and an octave filters the rows of
+ * the one above as soon as they are written, thus, all of them are done in one pass over the source, reading rows
+ * that are still in cache. The arithmetic is in the same order as ccv_sample_down, it is bit exact with the chain */
+typedef struct {
+	ccv_dense_matrix_t* a;
+	ccv_dense_matrix_t* b;
+	unsigned char* buf;
+	int bufstep;
+	int sy; // the next source row to filter horizontally
+	int dy; // the next output row
+} ccv_sample_down_octave_t;
+
+static inline void _ccv_sample_down_row_8u(const unsigned char* a_ptr, int* row, int cols, int dcols, int ch)
+{
+	int dx = 1, k;
+	for (k = 0; k < ch; k++)
+		row[k] = a_ptr[k] * 10 + a_ptr[ch + k] * 5 + a_ptr[ch * 2 + k];
+#ifdef HAVE_SSE2
+	if (ch == 1)
+	{
+		/* 16-bit lanes, the even bytes are the low half, the odd bytes are the high half. The sum is at most 255 * 16,
+		 * it doesn't overflow unsigned 16-bit */
+		__m128i mask = _mm_set1_epi16(0xff);
+		__m128i z = _mm_setzero_si128();
+		for (; dx + 8 <= dcols - 1 && dx * 2 + 18 <= cols; dx += 8)
+		{
+			__m128i w0 = _mm_loadu_si128((const __m128i*)(a_ptr + dx * 2 - 2));
+			__m128i w2 = _mm_loadu_si128((const __m128i*)(a_ptr + dx * 2));
+			__m128i w4 = _mm_loadu_si128((const __m128i*)(a_ptr + dx * 2 + 2));
+			__m128i e2 = _mm_and_si128(w2, mask);
+			__m128i s = _mm_add_epi16(_mm_slli_epi16(e2, 2), _mm_slli_epi16(e2, 1));
+			s = _mm_add_epi16(s, _mm_slli_epi16(_mm_add_epi16(_mm_srli_epi16(w0, 8), _mm_srli_epi16(w2, 8)), 2));
+			s = _mm_add_epi16(s, _mm_add_epi16(_mm_and_si128(w0, mask), _mm_and_si128(w4, mask)));
+			_mm_storeu_si128((__m128i*)(row + dx), _mm_unpacklo_epi16(s, z));
+			_mm_storeu_si128((__m128i*)(row + dx + 4), _mm_unpackhi_epi16(s, z));
+		}
+	}
+#endif
+	for (; dx < dcols - 1; dx++)
+		for (k = 0; k < ch; k++)
+		{
+			const unsigned char* p = a_ptr + dx * 2 * ch + k;
+			row[dx * ch + k] = p[0] * 6 + (p[-ch] + p[ch]) * 4 + p[-ch * 2] + p[ch * 2];
+		}
+	for (k = 0; k < ch; k++)
+		row[(dcols - 1) * ch + k] = a_ptr[(cols - 1) * ch + k] * 10 + a_ptr[(cols - 2) * ch + k] * 5 + a_ptr[(cols - 3) * ch + k];
+}
+
+static inline void _ccv_sample_down_row_32f(const float* a_ptr, float* row, int cols, int dcols, int ch)
+{
+	int dx = 1, k;
+	for (k = 0; k < ch; k++)
+		row[k] = a_ptr[k] * 10 + a_ptr[ch + k] * 5 + a_ptr[ch * 2 + k];
+#ifdef HAVE_SSE2
+	if (ch == 1)
+	{
+		__m128 six = _mm_set1_ps(6);
+		__m128 four = _mm_set1_ps(4);
+		for (; dx + 4 <= dcols - 1 && dx * 2 + 10 <= cols; dx += 4)
+		{
+			const float* p = a_ptr + dx * 2 - 2;
+			__m128 x0 = _mm_loadu_ps(p);
+			__m128 x2 = _mm_loadu_ps(p + 2);
+			__m128 x4 = _mm_loadu_ps(p + 4);
+			__m128 x6 = _mm_loadu_ps(p + 6);
+			__m128 x8 = _mm_loadu_ps(p + 8);
+			__m128 e0 = _mm_shuffle_ps(x0, x4, _MM_SHUFFLE(2, 0, 2, 0));
+			__m128 o0 = _mm_shuffle_ps(x0, x4, _MM_SHUFFLE(3, 1, 3, 1));
+			__m128 e2 = _mm_shuffle_ps(x2, x6, _MM_SHUFFLE(2, 0, 2, 0));
+			__m128 o2 = _mm_shuffle_ps(x2, x6, _MM_SHUFFLE(3, 1, 3, 1));
+			__m128 e4 = _mm_shuffle_ps(x4, x8, _MM_SHUFFLE(2, 0, 2, 0));
+			__m128 s = _mm_add_ps(_mm_mul_ps(e2, six), _mm_mul_ps(_mm_add_ps(o0, o2), four));
+			_mm_storeu_ps(row + dx, _mm_add_ps(_mm_add_ps(s, e0), e4));
+		}
+	}
+#endif
+	for (; dx < dcols - 1; dx++)
+		for (k = 0; k < ch; k++)
+		{
+			const float* p = a_ptr + dx * 2 * ch + k;
+			row[dx * ch + k] = p[0] * 6 + (p[-ch] + p[ch]) * 4 + p[-ch * 2] + p[ch * 2];
+		}
+	for (k = 0; k < ch; k++)
+		row[(dcols - 1) * ch + k] = a_ptr[(cols - 1) * ch + k] * 10 + a_ptr[(cols - 2) * ch + k] * 5 + a_ptr[(cols - 3) * ch + k];
+}
+
+static void _ccv_sample_down_column_8u(int* const* rows, unsigned char* b_ptr, int n)
+{
+	int i = 0;
+#ifdef HAVE_SSE2
+	for (; i + 8 <= n; i += 8)
+	{
+		__m128i s[2];
+		int k;
+		for (k = 0; k < 2; k++)
+		{
+			__m128i r2 = _mm_loadu_si128((const __m128i*)(rows[2] + i + k * 4));
+			__m128i r13 = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(rows[1] + i + k * 4)), _mm_loadu_si128((const __m128i*)(rows[3] + i + k * 4)));
+			__m128i v = _mm_add_epi32(_mm_add_epi32(_mm_slli_epi32(r2, 2), _mm_slli_epi32(r2, 1)), _mm_slli_epi32(r13, 2));
+			v = _mm_add_epi32(v, _mm_add_epi32(_mm_loadu_si128((const __m128i*)(rows[0] + i + k * 4)), _mm_loadu_si128((const __m128i*)(rows[4] + i + k * 4))));
+			s[k] = _mm_srai_epi32(v, 8);
+		}
+		__m128i w = _mm_packs_epi32(s[0], s[1]);
+		_mm_storel_epi64((__m128i*)(b_ptr + i), _mm_packus_epi16(w, w));
+	}
+#endif
+	for (; i < n; i++)
+		b_ptr[i] = ccv_clamp((rows[2][i] * 6 + (rows[1][i] + rows[3][i]) * 4 + rows[0][i] + rows[4][i]) / 256, 0, 255);
+}
+
+static void _ccv_sample_down_column_32f(float* const* rows, float* b_ptr, int n)
+{
+	int i = 0;
+#ifdef HAVE_SSE2
+	__m128 six = _mm_set1_ps(6);
+	__m128 four = _mm_set1_ps(4);
+	// multiplying by 1 / 256 is exact as dividing by it
+	__m128 scale = _mm_set1_ps(1. / 256);
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(rows[2] + i), six), _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(rows[1] + i), _mm_loadu_ps(rows[3] + i)), four));
+		v = _mm_add_ps(_mm_add_ps(v, _mm_loadu_ps(rows[0] + i)), _mm_loadu_ps(rows[4] + i));
+		_mm_storeu_ps(b_ptr + i, _mm_mul_ps(v, scale));
+	}
+#endif
+	for (; i < n; i++)
+		b_ptr[i] = (rows[2][i] * 6 + (rows[1][i] + rows[3][i]) * 4 + rows[0][i] + rows[4][i]) / 256;
+}
+
+/* filter as many rows as the source rows ready allow, but no more than limit rows */
+static void _ccv_sample_down_octave(ccv_sample_down_octave_t* octave, int ready, int limit)
+{
+	ccv_dense_matrix_t* a = octave->a;
+	ccv_dense_matrix_t* b = octave->b;
+	int ch = CCV_GET_CHANNEL(a->type);
+	int k;
+	for (; octave->dy < b->rows && limit > 0; limit--)
+	{
+		for (; octave->sy <= octave->dy * 2 + 2; octave->sy++)
+		{
+			int sy = octave->sy;
+			int _sy = (sy < 0) ? -1 - sy : (sy >= a->rows) ? a->rows * 2 - 1 - sy : sy;
+			if (_sy >= ready)
+				return;
+			unsigned char* row = octave->buf + ((sy + 2) % 5) * octave->bufstep;
+			if (CCV_GET_DATA_TYPE(a->type) == CCV_8U)
+			{
+				_ccv_resample_with_ch(ch, _ccv_sample_down_row_8u, a->data.u8 + a->step * _sy, (int*)row, a->cols, b->cols);
+			} else {
+				_ccv_resample_with_ch(ch, _ccv_sample_down_row_32f, (float*)(a->data.u8 + a->step * _sy), (float*)row, a->cols, b->cols);
+			}
+		}
+		unsigned char* rows[5];
+		for (k = 0; k < 5; k++)
+			rows[k] = octave->buf + ((octave->dy * 2 + k) % 5) * octave->bufstep;
+		unsigned char* b_ptr = b->data.u8 + b->step * octave->dy;
+		if (CCV_GET_DATA_TYPE(a->type) == CCV_8U)
+			_ccv_sample_down_column_8u((int* const*)rows, b_ptr, b->cols * ch);
+		else
+			_ccv_sample_down_column_32f((float* const*)rows, (float*)b_ptr, b->cols * ch);
+		octave->dy++;
+	}
+}
+
+void ccv_sample_down_octaves(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, int count)
+{
+	assert(count > 0);
+	type = (type == 0) ? CCV_GET_DATA_TYPE(a->type) | CCV_GET_CHANNEL(a->type) : CCV_GET_DATA_TYPE(type) | CCV_GET_CHANNEL(a->type);
+	int ch = CCV_GET_CHANNEL(a->type);
+	int i, rows = a->rows, cols = a->cols;
+	// the borders read 3 columns and 2 rows of the source of every octave
+	for (i = 0; i < count; i++)
+	{
+		assert(rows >= 2 && cols >= 3);
+		rows /= 2;
+		cols /= 2;
+	}
+	/* the octaves are fused for 8U and 32F without type conversion, the others are chained ccv_sample_down */
+	int n = (CCV_GET_DATA_TYPE(a->type) == CCV_GET_DATA_TYPE(type) && (CCV_GET_DATA_TYPE(type) == CCV_8U || CCV_GET_DATA_TYPE(type) == CCV_32F)) ? count : 0;
+	if (n > 0)
+	{
+		ccv_sample_down_octave_t* octaves = (ccv_sample_down_octave_t*)alloca(sizeof(ccv_sample_down_octave_t) * n);
+		ccv_dense_matrix_t* sa = a;
+		int cached = 1;
+		size_t bufsize = 0;
+		for (i = 0; i < n; i++)
+		{
+			// the same signature as ccv_sample_down(sa, b + i, type, 0, 0)
+			ccv_declare_derived_signature(sig, sa->sig != 0, ccv_sign_with_format(64, "ccv_sample_down(%d,%d)", 0, 0), sa->sig, CCV_EOF_SIGN);
+			ccv_dense_matrix_t* db = b[i] = ccv_dense_matrix_renew(b[i], sa->rows / 2, sa->cols / 2, CCV_ALL_DATA_TYPE | ch, type, sig);
+			if (!(db->type & CCV_GARBAGE))
+				cached = 0;
+			octaves[i].a = sa;
+			octaves[i].b = db;
+			octaves[i].bufstep = db->cols * ch * ccv_max(CCV_GET_DATA_TYPE_SIZE(db->type), sizeof(int));
+			octaves[i].sy = -2;
+			octaves[i].dy = 0;
+			bufsize += 5 * octaves[i].bufstep;
+			sa = db;
+		}
+		for (i = 0; i < n; i++)
+			b[i]->type &= ~CCV_GARBAGE;
+		if (!cached)
+		{
+			unsigned char* buf = (unsigned char*)ccmalloc(bufsize);
+			octaves[0].buf = buf;
+			for (i = 1; i < n; i++)
+				octaves[i].buf = octaves[i - 1].buf + 5 * octaves[i - 1].bufstep;
+			// every source row of the first octave is read once, the ones below pick up the rows just written
+			while (octaves[0].dy < octaves[0].b->rows)
+			{
+				_ccv_sample_down_octave(octaves, a->rows, 1);
+				for (i = 1; i < n; i++)
+					_ccv_sample_down_octave(octaves + i, octaves[i - 1].dy, octaves[i].b->rows);
+			}
+			ccfree(buf);
+		}
+	}
+	for (i = n; i < count; i++)
+		ccv_sample_down(i > 0 ? b[i - 1] : a, b + i, type, 0, 0);
+}
+
 void ccv_sample_up(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, int src_x, int src_y)
 {
 	assert(src_x >= 0 && src_y >= 0);
@@ -602,3 +1105,107 @@ void ccv_sample_up(ccv_dense_matrix_t* a, ccv_dense_matrix_t** b, int type, int
 	}
 #undef for_block
 }
+
+/* the size of a pyramid level without building it: the first interval + 1 levels are resampled from the base, the
+ * rest are sampled down from the level one octave above */
+static void _ccv_pyramid_level_size(int rows, int cols, double scale, int next, int i, int* level_rows, int* level_cols)
+{
+	int k = i % next, octave = i / next;
+	rows = (int)(rows / pow(scale, k));
+	cols = (int)(cols / pow(scale, k));
+	for (; octave > 0; octave--)
+		rows /= 2, cols /= 2;
+	*level_rows = rows;
+	*level_cols = cols;
+}
+
+ccv_pyramid_t* ccv_pyramid_new(ccv_dense_matrix_t* a, int interval)
+{
+	assert(interval >= 0);
+	int next = interval + 1;
+	double scale = pow(2., 1. / next);
+	int count, rows, cols;
+	/* ccv_sample_down reads 3 columns and 2 rows of its source at the borders, the pyramid stops at the first level
+	 * sampled down from a source smaller than that */
+	for (count = 0;; count++)
+	{
+		if (count < next)
+		{
+			_ccv_pyramid_level_size(a->rows, a->cols, scale, next, count, &rows, &cols);
+			if (rows < 1 || cols < 1)
+				break;
+		} else {
+			_ccv_pyramid_level_size(a->rows, a->cols, scale, next, count - next, &rows, &cols);
+			if (rows < 2 || cols < 3)
+				break;
+		}
+	}
+	assert(count > 0);
+	ccv_pyramid_t* pyramid = (ccv_pyramid_t*)ccmalloc(sizeof(ccv_pyramid_t) + sizeof(ccv_dense_matrix_t*) * count * 4);
+	pyramid->interval = interval;
+	pyramid->scale = scale;
+	pyramid->count = count;
+	pyramid->levels = (ccv_dense_matrix_t**)(pyramid + 1);
+	memset(pyramid->levels, 0, sizeof(ccv_dense_matrix_t*) * count * 4);
+	if (!(a->type & CCV_UNMANAGED))
+		ccv_matrix_retain(a);
+	pyramid->levels[0] = a;
+	return pyramid;
+}
+
+ccv_dense_matrix_t* ccv_pyramid_level(ccv_pyramid_t* pyramid, int i)
+{
+	assert(i >= 0 && i < pyramid->count);
+	ccv_dense_matrix_t** level = pyramid->levels + i * 4;
+	if (!*level)
+	{
+		int next = pyramid->interval + 1;
+		if (i < next)
+		{
+			ccv_dense_matrix_t* a = pyramid->levels[0];
+			ccv_resample(a, level, 0, (int)(a->rows / pow(pyramid->scale, i)), (int)(a->cols / pow(pyramid->scale, i)), CCV_INTER_AREA);
+		} else {
+			/* sample down from the closest level built to this one in one pass */
+			int j, k;
+			for (j = i - next; j >= next && !pyramid->levels[j * 4]; j -= next);
+			ccv_dense_matrix_t* a = ccv_pyramid_level(pyramid, j);
+			int n = (i - j) / next;
+			ccv_dense_matrix_t** octaves = (ccv_dense_matrix_t**)alloca(sizeof(ccv_dense_matrix_t*) * n);
+			for (k = 0; k < n; k++)
+				octaves[k] = pyramid->levels[(j + next * (k + 1)) * 4];
+			ccv_sample_down_octaves(a, octaves, 0, n);
+			for (k = 0; k < n; k++)
+				pyramid->levels[(j + next * (k + 1)) * 4] = octaves[k];
+		}
+	}
+	return *level;
+}
+
+ccv_dense_matrix_t* ccv_pyramid_level_with_offset(ccv_pyramid_t* pyramid, int i, int src_x, int src_y)
+{
+	assert((src_x == 0 || src_x == 1) && (src_y == 0 || src_y == 1));
+	if (src_x == 0 && src_y == 0)
+		return ccv_pyramid_level(pyramid, i);
+	int next = pyramid->interval + 1;
+	assert(i >= next && i < pyramid->count);
+	ccv_dense_matrix_t** level = pyramid->levels + i * 4 + src_x + src_y * 2;
+	if (!*level)
+	{
+		ccv_dense_matrix_t* a = ccv_pyramid_level(pyramid, i - next);
+		// with the offset, ccv_sample_down reads 3 more columns at the borders
+		assert(a->cols >= 3 + src_x * 3);
+		ccv_sample_down(a, level, 0, src_x, src_y);
+	}
+	return *level;
+}
+
+void ccv_pyramid_free(ccv_pyramid_t* pyramid)
+{
+	int i;
+	if (!(pyramid->levels[0]->type & CCV_UNMANAGED))
+		ccv_matrix_free(pyramid->levels[0]);
+	for (i = 1; i < pyramid->count * 4; i++)
+		if (pyramid->levels[i])
+			ccv_matrix_free(pyramid->levels[i]);
+	ccfree(pyramid);
+}
@@ -385,54 +385,84 @@ static float* _ccv_scd_get_surf_at(float* fv, int feature_no, int example_no, in
 	return fv + ((off_t)example_no + feature_no * (positive_count + negative_count)) * 32;
 }
 
-static void _ccv_scd_precompute_feature_vectors(const ccv_array_t* features, const ccv_array_t* positives, const ccv_array_t* negatives, float* fv)
+typedef struct {
+	const ccv_array_t* features;
+	const ccv_array_t* positives;
+	const ccv_array_t* negatives;
+	float* fv;
+} ccv_scd_precompute_context_t;
+
+static void _ccv_scd_precompute_positive_feature_vectors(size_t _i, void* _context)
 {
-	parallel_for(i, positives->rnum) {
-		int j;
-		if ((i + 1) % 4031 == 1)
-			FLUSH(CCV_CLI_INFO, " - precompute feature vectors of example %d / %d over %d features", (int)(i + 1), positives->rnum + negatives->rnum, features->rnum);
-		ccv_dense_matrix_t* a = (ccv_dense_matrix_t*)ccv_array_get(positives, i);
-		a->data.u8 = (unsigned char*)(a + 1);
-		ccv_dense_matrix_t* b = 0;
-		ccv_scd(a, &b, 0);
-		ccv_dense_matrix_t* sat = 0;
-		ccv_sat(b, &sat, 0, CCV_PADDING_ZERO);
-		ccv_matrix_free(b);
-		for (j = 0; j < features->rnum; j++)
-		{
-			ccv_scd_stump_feature_t* feature = (ccv_scd_stump_feature_t*)ccv_array_get(features, j);
-			// save to fv
+	ccv_scd_precompute_context_t* context = (ccv_scd_precompute_context_t*)_context;
+	const ccv_array_t* features = context->features;
+	const ccv_array_t* positives = context->positives;
+	const ccv_array_t* negatives = context->negatives;
+	float* fv = context->fv;
+	int i = (int)_i;
+	int j;
+	if ((i + 1) % 4031 == 1)
+		FLUSH(CCV_CLI_INFO, " - precompute feature vectors of example %d / %d over %d features", (int)(i + 1), positives->rnum + negatives->rnum, features->rnum);
+	ccv_dense_matrix_t* a = (ccv_dense_matrix_t*)ccv_array_get(positives, i);
+	a->data.u8 = (unsigned char*)(a + 1);
+	ccv_dense_matrix_t* b = 0;
+	ccv_scd(a, &b, 0);
+	ccv_dense_matrix_t* sat = 0;
+	ccv_sat(b, &sat, 0, CCV_PADDING_ZERO);
+	ccv_matrix_free(b);
+	for (j = 0; j < features->rnum; j++)
+	{
+		ccv_scd_stump_feature_t* feature = (ccv_scd_stump_feature_t*)ccv_array_get(features, j);
+		// save to fv
 #if defined(HAVE_SSE2)
-			_ccv_scd_run_feature_at_sse2(sat->data.f32, sat->cols, feature, (__m128*)_ccv_scd_get_surf_at(fv, j, i, positives->rnum, negatives->rnum));
+		_ccv_scd_run_feature_at_sse2(sat->data.f32, sat->cols, feature, (__m128*)_ccv_scd_get_surf_at(fv, j, i, positives->rnum, negatives->rnum));
 #else
-			_ccv_scd_run_feature_at(sat->data.f32, sat->cols, feature, _ccv_scd_get_surf_at(fv, j, i, positives->rnum, negatives->rnum));
+		_ccv_scd_run_feature_at(sat->data.f32, sat->cols, feature, _ccv_scd_get_surf_at(fv, j, i, positives->rnum, negatives->rnum));
 #endif
-		}
-		ccv_matrix_free(sat);
-	} parallel_endfor
-	parallel_for(i, negatives->rnum) {
-		int j;
-		if ((i + 1) % 731 == 1 || (i + 1) == negatives->rnum)
-			FLUSH(CCV_CLI_INFO, " - precompute feature vectors of example %d / %d over %d features", (int)(i + positives->rnum + 1), positives->rnum + negatives->rnum, features->rnum);
-		ccv_dense_matrix_t* a = (ccv_dense_matrix_t*)ccv_array_get(negatives, i);
-		a->data.u8 = (unsigned char*)(a + 1);
-		ccv_dense_matrix_t* b = 0;
-		ccv_scd(a, &b, 0);
-		ccv_dense_matrix_t* sat = 0;
-		ccv_sat(b, &sat, 0, CCV_PADDING_ZERO);
-		ccv_matrix_free(b);
-		for (j = 0; j < features->rnum; j++)
-		{
-			ccv_scd_stump_feature_t* feature = (ccv_scd_stump_feature_t*)ccv_array_get(features, j);
-			// save to fv
+	}
+	ccv_matrix_free(sat);
+}
+
+static void _ccv_scd_precompute_negative_feature_vectors(size_t _i, void* _context)
+{
+	ccv_scd_precompute_context_t* context = (ccv_scd_precompute_context_t*)_context;
+	const ccv_array_t* features = context->features;
+	const ccv_array_t* positives = context->positives;
+	const ccv_array_t* negatives = context->negatives;
+	float* fv = context->fv;
+	int i = (int)_i;
+	int j;
+	if ((i + 1) % 731 == 1 || (i + 1) == negatives->rnum)
+		FLUSH(CCV_CLI_INFO, " - precompute feature vectors of example %d / %d over %d features", (int)(i + positives->rnum + 1), positives->rnum + negatives->rnum, features->rnum);
+	ccv_dense_matrix_t* a = (ccv_dense_matrix_t*)ccv_array_get(negatives, i);
+	a->data.u8 = (unsigned char*)(a + 1);
+	ccv_dense_matrix_t* b = 0;
+	ccv_scd(a, &b, 0);
+	ccv_dense_matrix_t* sat = 0;
+	ccv_sat(b, &sat, 0, CCV_PADDING_ZERO);
+	ccv_matrix_free(b);
+	for (j = 0; j < features->rnum; j++)
+	{
+		ccv_scd_stump_feature_t* feature = (ccv_scd_stump_feature_t*)ccv_array_get(features, j);
+		// save to fv
 #if defined(HAVE_SSE2)
-			_ccv_scd_run_feature_at_sse2(sat->data.f32, sat->cols, feature, (__m128*)_ccv_scd_get_surf_at(fv, j, i + positives->rnum, positives->rnum, negatives->rnum));
+		_ccv_scd_run_feature_at_sse2(sat->data.f32, sat->cols, feature, (__m128*)_ccv_scd_get_surf_at(fv, j, i + positives->rnum, positives->rnum, negatives->rnum));
 #else
-			_ccv_scd_run_feature_at(sat->data.f32, sat->cols, feature, _ccv_scd_get_surf_at(fv, j, i + positives->rnum, positives->rnum, negatives->rnum));
+		_ccv_scd_run_feature_at(sat->data.f32, sat->cols, feature, _ccv_scd_get_surf_at(fv, j, i + positives->rnum, positives->rnum, negatives->rnum));
 #endif
-		}
-		ccv_matrix_free(sat);
-	} parallel_endfor
+	}
+	ccv_matrix_free(sat);
+}
+
+static void _ccv_scd_precompute_feature_vectors(const ccv_array_t* features, const ccv_array_t* positives, const ccv_array_t* negatives, float* fv)
+{
+	ccv_scd_precompute_context_t context;
+	context.features = features;
+	context.positives = positives;
+	context.negatives = negatives;
+	context.fv = fv;
+	ccv_parallel_for(positives->rnum, _ccv_scd_precompute_positive_feature_vectors, &context);
+	ccv_parallel_for(negatives->rnum, _ccv_scd_precompute_negative_feature_vectors, &context);
 }
 
 typedef struct {
@@ -515,6 +545,59 @@ static int _ccv_scd_weight_trimming(ccv_scd_value_index_t* idx, int count, doubl
 	return active_count;
 }
 
+typedef struct {
+	ccv_array_t* features;
+	int positive_count;
+	int negative_count;
+	int active_positive_count;
+	int active_negative_count;
+	ccv_scd_value_index_t* pwidx;
+	ccv_scd_value_index_t* nwidx;
+	float* fv;
+	double C;
+	float* x0;
+} ccv_scd_supervised_train_context_t;
+
+// minimize the loss of the i-th feature from the initial guess drawn for it
+static void _ccv_scd_stump_feature_supervised_train_block(size_t _i, void* _context)
+{
+	ccv_scd_supervised_train_context_t* train = (ccv_scd_supervised_train_context_t*)_context;
+	ccv_array_t* features = train->features;
+	int positive_count = train->positive_count;
+	int negative_count = train->negative_count;
+	int active_positive_count = train->active_positive_count;
+	int active_negative_count = train->active_negative_count;
+	ccv_scd_value_index_t* pwidx = train->pwidx;
+	ccv_scd_value_index_t* nwidx = train->nwidx;
+	float* fv = train->fv;
+	double C = train->C;
+	float* x0 = train->x0;
+	int i = (int)_i;
+	if ((i + 1) % 31 == 1 || (i + 1) == features->rnum)
+		FLUSH(CCV_CLI_INFO, " - supervised train feature %d / %d with logistic regression, active set {%d, %d}", (int)(i + 1), features->rnum, active_positive_count, active_negative_count);
+	ccv_scd_stump_feature_t* feature = (ccv_scd_stump_feature_t*)ccv_array_get(features, i);
+	ccv_loss_minimize_context_t context = {
+		.feature_no = i,
+		.C = C,
+		.positive_count = positive_count,
+		.negative_count = negative_count,
+		.active_positive_count = active_positive_count,
+		.active_negative_count = active_negative_count,
+		.pwidx = pwidx,
+		.nwidx = nwidx,
+		.fv = fv,
+	};
+	ccv_dense_matrix_t* x = ccv_dense_matrix_new(1, 33, CCV_32F | CCV_C1, 0, 0);
+	int j;
+	for (j = 0; j < 33; j++)
+		x->data.f32[j] = x0[i * 33 + j];
+	ccv_minimize(x, 10, 1.0, _ccv_scd_stump_feature_gentle_adaboost_loss, ccv_minimize_default_params, &context);
+	for (j = 0; j < 32; j++)
+		feature->w[j] = x->data.f32[j];
+	feature->bias = x->data.f32[32];
+	ccv_matrix_free(x);
+}
+
 static void _ccv_scd_stump_feature_supervised_train(gsl_rng* rng, ccv_array_t* features, int positive_count, int negative_count, double* pw, double* nw, float* fv, double C, double weight_trimming)
 {
 	int i;
@@ -530,31 +613,23 @@ static void _ccv_scd_stump_feature_supervised_train(gsl_rng* rng, ccv_array_t* f
 	int active_negative_count = _ccv_scd_weight_trimming(nwidx, negative_count, weight_trimming * 0.5); // the sum of negative weights is 0.5
 	_ccv_scd_value_index_sortby_index(pwidx, active_positive_count, 0);
 	_ccv_scd_value_index_sortby_index(nwidx, active_negative_count, 0);
-	parallel_for(i, features->rnum) {
-		if ((i + 1) % 31 == 1 || (i + 1) == features->rnum)
-			FLUSH(CCV_CLI_INFO, " - supervised train feature %d / %d with logistic regression, active set {%d, %d}", (int)(i + 1), features->rnum, active_positive_count, active_negative_count);
-		ccv_scd_stump_feature_t* feature = (ccv_scd_stump_feature_t*)ccv_array_get(features, i);
-		ccv_loss_minimize_context_t context = {
-			.feature_no = i,
-			.C = C,
-			.positive_count = positive_count,
-			.negative_count = negative_count,
-			.active_positive_count = active_positive_count,
-			.active_negative_count = active_negative_count,
-			.pwidx = pwidx,
-			.nwidx = nwidx,
-			.fv = fv,
-		};
-		ccv_dense_matrix_t* x = ccv_dense_matrix_new(1, 33, CCV_32F | CCV_C1, 0, 0);
-		int j;
-		for (j = 0; j < 33; j++)
-			x->data.f32[j] = gsl_rng_uniform_pos(rng) * 2 - 1.0;
-		ccv_minimize(x, 10, 1.0, _ccv_scd_stump_feature_gentle_adaboost_loss, ccv_minimize_default_params, &context);
-		for (j = 0; j < 32; j++)
-			feature->w[j] = x->data.f32[j];
-		feature->bias = x->data.f32[32];
-		ccv_matrix_free(x);
-	} parallel_endfor
+	// gsl_rng isn't thread-safe, draw the initial guesses in the order a serial loop does
+	float* x0 = (float*)ccmalloc(sizeof(float) * features->rnum * 33);
+	for (i = 0; i < features->rnum * 33; i++)
+		x0[i] = gsl_rng_uniform_pos(rng) * 2 - 1.0;
+	ccv_scd_supervised_train_context_t train;
+	train.features = features;
+	train.positive_count = positive_count;
+	train.negative_count = negative_count;
+	train.active_positive_count = active_positive_count;
+	train.active_negative_count = active_negative_count;
+	train.pwidx = pwidx;
+	train.nwidx = nwidx;
+	train.fv = fv;
+	train.C = C;
+	train.x0 = x0;
+	ccv_parallel_for(features->rnum, _ccv_scd_stump_feature_supervised_train_block, &train);
+	ccfree(x0);
 	ccfree(pwidx);
 	ccfree(nwidx);
 }
@@ -607,37 +682,68 @@ static int _ccv_scd_find_match_feature(ccv_scd_stump_feature_t* value, ccv_array
 	return -1;
 }
 
+typedef struct {
+	ccv_array_t* features;
+	double* pw;
+	double* nw;
+	int positive_count;
+	int negative_count;
+	float* fv;
+	double* error_rate;
+} ccv_scd_gentle_adaboost_context_t;
+
+// the weighted error of the i-th feature
+static void _ccv_scd_best_feature_gentle_adaboost_block(size_t _i, void* _context)
+{
+	ccv_scd_gentle_adaboost_context_t* context = (ccv_scd_gentle_adaboost_context_t*)_context;
+	ccv_array_t* features = context->features;
+	double* pw = context->pw;
+	double* nw = context->nw;
+	int positive_count = context->positive_count;
+	int negative_count = context->negative_count;
+	float* fv = context->fv;
+	double* error_rate = context->error_rate;
+	int i = (int)_i;
+	int j, k;
+	if ((i + 1) % 331 == 1 || (i + 1) == features->rnum)
+		FLUSH(CCV_CLI_INFO, " - go through %d / %d (%.1f%%) for adaboost", (int)(i + 1), features->rnum, (float)(i + 1) * 100 / features->rnum);
+	ccv_scd_stump_feature_t* feature = (ccv_scd_stump_feature_t*)ccv_array_get(features, i);
+	for (j = 0; j < positive_count; j++)
+	{
+		float* surf = _ccv_scd_get_surf_at(fv, i, j, positive_count, negative_count);
+		float v = feature->bias;
+		for (k = 0; k < 32; k++)
+			v += surf[k] * feature->w[k];
+		v = expf(v);
+		v = (v - 1) / (v + 1); // probability
+		error_rate[i] += pw[j] * (1 - v) * (1 - v);
+	}
+	for (j = 0; j < negative_count; j++)
+	{
+		float* surf = _ccv_scd_get_surf_at(fv, i, j + positive_count, positive_count, negative_count);
+		float v = feature->bias;
+		for (k = 0; k < 32; k++)
+			v += surf[k] * feature->w[k];
+		v = expf(v);
+		v = (v - 1) / (v + 1); // probability
+		error_rate[i] += nw[j] * (-1 - v) * (-1 - v);
+	}
+}
+
 static int _ccv_scd_best_feature_gentle_adaboost(double* s, ccv_array_t* features, double* pw, double* nw, int positive_count, int negative_count, float* fv)
 {
 	int i;
 	double* error_rate = (double*)cccalloc(features->rnum, sizeof(double));
 	assert(positive_count + negative_count > 0);
-	parallel_for(i, features->rnum) {
-		int j, k;
-		if ((i + 1) % 331 == 1 || (i + 1) == features->rnum)
-			FLUSH(CCV_CLI_INFO, " - go through %d / %d (%.1f%%) for adaboost", (int)(i + 1), features->rnum, (float)(i + 1) * 100 / features->rnum);
-		ccv_scd_stump_feature_t* feature = (ccv_scd_stump_feature_t*)ccv_array_get(features, i);
-		for (j = 0; j < positive_count; j++)
-		{
-			float* surf = _ccv_scd_get_surf_at(fv, i, j, positive_count, negative_count);
-			float v = feature->bias;
-			for (k = 0; k < 32; k++)
-				v += surf[k] * feature->w[k];
-			v = expf(v);
-			v = (v - 1) / (v + 1); // probability
-			error_rate[i] += pw[j] * (1 - v) * (1 - v);
-		}
-		for (j = 0; j < negative_count; j++)
-		{
-			float* surf = _ccv_scd_get_surf_at(fv, i, j + positive_count, positive_count, negative_count);
-			float v = feature->bias;
-			for (k = 0; k < 32; k++)
-				v += surf[k] * feature->w[k];
-			v = expf(v);
-			v = (v - 1) / (v + 1); // probability
-			error_rate[i] += nw[j] * (-1 - v) * (-1 - v);
-		}
-	} parallel_endfor
+	ccv_scd_gentle_adaboost_context_t context;
+	context.features = features;
+	context.pw = pw;
+	context.nw = nw;
+	context.positive_count = positive_count;
+	context.negative_count = negative_count;
+	context.fv = fv;
+	context.error_rate = error_rate;
+	ccv_parallel_for(features->rnum, _ccv_scd_best_feature_gentle_adaboost_block, &context);
 	double min_error_rate = error_rate[0];
 	int j = 0;
 	for (i = 1; i < features->rnum; i++)
@@ -1343,28 +1449,27 @@ static int _ccv_is_equal_same_class(const void* _r1, const void* _r2, void* data
 	return i >= 0.3 * m; // IoM > 0.3 like HeadHunter does
 }
 
-ccv_array_t* ccv_scd_detect_objects(ccv_dense_matrix_t* a, ccv_scd_classifier_cascade_t** cascades, int count, ccv_scd_param_t params)
+static float _ccv_scd_up_ratio(ccv_scd_classifier_cascade_t** cascades, int count, ccv_scd_param_t params)
 {
-	int i, j, k, x, y, p, q;
-	int scale_upto = 1;
+	int i;
 	float up_ratio = 1.0;
 	for (i = 0; i < count; i++)
 		up_ratio = ccv_max(up_ratio, ccv_max((float)cascades[i]->size.width / params.size.width, (float)cascades[i]->size.height / params.size.height));
-	if (up_ratio - 1.0 > 1e-4)
-	{
-		ccv_dense_matrix_t* resized = 0;
-		ccv_resample(a, &resized, 0, (int)(a->rows * up_ratio + 0.5), (int)(a->cols * up_ratio + 0.5), CCV_INTER_CUBIC);
-		a = resized;
-	}
+	return up_ratio;
+}
+
+ccv_array_t* ccv_scd_detect_objects_with_pyramid(ccv_pyramid_t* pyramid, ccv_scd_classifier_cascade_t** cascades, int count, ccv_scd_param_t params)
+{
+	int i, j, k, x, y, p, q;
+	int scale_upto = 1;
+	float up_ratio = _ccv_scd_up_ratio(cascades, count, params);
+	ccv_dense_matrix_t* a = ccv_pyramid_level(pyramid, 0);
 	for (i = 0; i < count; i++)
 		scale_upto = ccv_max(scale_upto, (int)(log(ccv_min((double)a->rows / (cascades[i]->size.height - cascades[i]->margin.top - cascades[i]->margin.bottom), (double)a->cols / (cascades[i]->size.width - cascades[i]->margin.left - cascades[i]->margin.right))) / log(2.) - DBL_MIN) + 1);
+	/* only the octaves of the pyramid, the scales in between are resampled from them */
 	ccv_dense_matrix_t** pyr = (ccv_dense_matrix_t**)alloca(sizeof(ccv_dense_matrix_t*) * scale_upto);
-	pyr[0] = a;
-	for (i = 1; i < scale_upto; i++)
-	{
-		pyr[i] = 0;
-		ccv_sample_down(pyr[i - 1], &pyr[i], 0, 0, 0);
-	}
+	for (i = 0; i < scale_upto; i++)
+		pyr[i] = ccv_pyramid_level(pyramid, i * (pyramid->interval + 1));
 #if defined(HAVE_SSE2)
 	__m128 surf[8];
 #else
@@ -1478,10 +1583,6 @@ ccv_array_t* ccv_scd_detect_objects(ccv_dense_matrix_t* a, ccv_scd_classifier_ca
 		}
 	}
 
-	for (i = 1; i < scale_upto; i++)
-		ccv_matrix_free(pyr[i]);
-	if (up_ratio - 1.0 > 1e-4)
-		ccv_matrix_free(a);
 
 	ccv_array_t* result_seq = ccv_array_new(sizeof(ccv_comp_t), 64, 0);
 	for (k = 0; k < count; k++)
@@ -1498,7 +1599,7 @@ ccv_array_t* ccv_scd_detect_objects(ccv_dense_matrix_t* a, ccv_scd_classifier_ca
 		} else {
 			ccv_array_t* idx_seq = 0;
 			// group retrieved rectangles in order to filter out noise
-			int ncomp = ccv_array_group(seq[k], &idx_seq, _ccv_is_equal_same_class, 0);
+			int ncomp = ccv_array_group_rect(seq[k], &idx_seq, _ccv_is_equal_same_class, ccv_comp_extent, 0);
 			ccv_comp_t* comps = (ccv_comp_t*)cccalloc(ncomp + 1, sizeof(ccv_comp_t));
 
 			// count number of neighbors
@@ -1532,3 +1633,17 @@ ccv_array_t* ccv_scd_detect_objects(ccv_dense_matrix_t* a, ccv_scd_classifier_ca
 
 	return result_seq;
 }
+
+ccv_array_t* ccv_scd_detect_objects(ccv_dense_matrix_t* a, ccv_scd_classifier_cascade_t** cascades, int count, ccv_scd_param_t params)
+{
+	float up_ratio = _ccv_scd_up_ratio(cascades, count, params);
+	ccv_dense_matrix_t* resized = 0;
+	if (up_ratio - 1.0 > 1e-4)
+		ccv_resample(a, &resized, 0, (int)(a->rows * up_ratio + 0.5), (int)(a->cols * up_ratio + 0.5), CCV_INTER_CUBIC);
+	ccv_pyramid_t* pyramid = ccv_pyramid_new(resized ? resized : a, params.interval);
+	ccv_array_t* result_seq = ccv_scd_detect_objects_with_pyramid(pyramid, cascades, count, params);
+	ccv_pyramid_free(pyramid);
+	if (resized)
+		ccv_matrix_free(resized);
+	return result_seq;
+}
@@ -0,0 +1,65 @@
+#include "ccv.h"
+#include "ccv_internal.h"
+#ifdef CCV_SIMD_X86
+#include <cpuid.h>
+#endif
+
+static int ccv_simd_level = -1; // not detected yet
+
+#ifdef CCV_SIMD_X86
+static uint64_t _ccv_xgetbv(uint32_t index)
+{
+	uint32_t eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+	return ((uint64_t)edx << 32) | eax;
+}
+#endif
+
+static int _ccv_simd_detect(void)
+{
+	int level = CCV_SIMD_NONE;
+#ifdef CCV_SIMD_X86
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return level;
+	if (edx & bit_SSE2)
+		level = CCV_SIMD_SSE2;
+	// the wider registers are only usable if the OS saves them on context switch, which is what XCR0 tells
+	if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX) || !(ecx & bit_FMA) || !(ecx & bit_F16C))
+		return level;
+	uint64_t xcr0 = _ccv_xgetbv(0);
+	if ((xcr0 & 0x6) != 0x6 || !__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) || !(ebx & bit_AVX2))
+		return level;
+	level = CCV_SIMD_AVX2;
+	if ((xcr0 & 0xe6) == 0xe6 && (ebx & bit_AVX512F))
+		level = CCV_SIMD_AVX512;
+#endif
+	return level;
+}
+
+static int _ccv_simd_level_from_env(int level)
+{
+	const char* env = getenv("CCV_SIMD");
+	if (!env)
+		return level;
+	static const char* names[] = { "none", "sse2", "avx2", "avx512" };
+	int i;
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+		if (strcmp(env, names[i]) == 0)
+			return ccv_min(i, level);
+	return level;
+}
+
+int ccv_get_simd_level(void)
+{
+	// racing threads all come up with the same answer
+	if (ccv_simd_level < 0)
+		ccv_simd_level = _ccv_simd_level_from_env(_ccv_simd_detect());
+	return ccv_simd_level;
+}
+
+void ccv_set_simd_level(int level)
+{
+	int detected = _ccv_simd_detect();
+	ccv_simd_level = (level < 0) ? _ccv_simd_level_from_env(detected) : ccv_min(level, detected);
+}
@@ -47,41 +47,16 @@ static float _ccv_tld_norm_cross_correlate(ccv_dense_matrix_t* r0, ccv_dense_mat
 	assert(CCV_GET_CHANNEL(r0->type) == CCV_C1 && CCV_GET_DATA_TYPE(r0->type) == CCV_8U);
 	assert(CCV_GET_CHANNEL(r1->type) == CCV_C1 && CCV_GET_DATA_TYPE(r1->type) == CCV_8U);
 	assert(r0->rows == r1->rows && r0->cols == r1->cols);
-	int x, y;
-	int sum0 = 0, sum1 = 0;
-	unsigned char* r0_ptr = r0->data.u8;
-	unsigned char* r1_ptr = r1->data.u8;
-	for (y = 0; y < r0->rows; y++)
-	{
-		for (x = 0; x < r0->cols; x++)
-		{
-			sum0 += r0_ptr[x];
-			sum1 += r1_ptr[x];
-		}
-		r0_ptr += r0->step;
-		r1_ptr += r1->step;
-	}
-	r0_ptr = r0->data.u8;
-	r1_ptr = r1->data.u8;
-	float mr0 = (float)sum0 / (r0->rows * r0->cols);
-	float mr1 = (float)sum1 / (r1->rows * r1->cols);
-	float r0r1 = 0, r0r0 = 0, r1r1 = 0;
-	for (y = 0; y < r0->rows; y++)
-	{
-		for (x = 0; x < r0->cols; x++)
-		{
-			float r0f = r0_ptr[x] - mr0;
-			float r1f = r1_ptr[x] - mr1;
-			r0r1 += r0f * r1f;
-			r0r0 += r0f * r0f;
-			r1r1 += r1f * r1f;
-		}
-		r0_ptr += r0->step;
-		r1_ptr += r1->step;
-	}
+	ccv_matrix_stat_t s0, s1;
+	ccv_stat(r0, &s0);
+	ccv_stat(r1, &s1);
+	// the sums of 8U are exact, thus, centering them afterwards is as good as centering the elements
+	double r0r1 = ccv_dot(r0, r1) - s0.sum * s1.sum / s0.count;
+	double r0r0 = s0.sumsq - s0.sum * s0.sum / s0.count;
+	double r1r1 = s1.sumsq - s1.sum * s1.sum / s1.count;
 	if (r0r0 * r1r1 < 1e-6)
 		return 0;
-	return r0r1 / sqrtf(r0r0 * r1r1);
+	return (float)(r0r1 / sqrt(r0r0 * r1r1));
 }
 
 static ccv_rect_t _ccv_tld_short_term_track(ccv_dense_matrix_t* a, ccv_dense_matrix_t* b, ccv_rect_t box, ccv_tld_param_t params)
@@ -444,7 +419,11 @@ static void _ccv_tld_fetch_patch(ccv_tld_t* tld, ccv_dense_matrix_t* a, ccv_dens
 		assert((box.width >= tld->patch.width && box.height >= tld->patch.height) ||
 			   (box.width <= tld->patch.width && box.height <= tld->patch.height));
 		ccv_dense_matrix_t* c = 0;
-		ccv_slice(a, (ccv_matrix_t**)&c, type, box.y, box.x, box.height, box.width);
+		// the region is only read by ccv_resample, take a view rather than a copy if it is within the frame
+		if (box.x >= 0 && box.y >= 0 && box.x + box.width <= a->cols && box.y + box.height <= a->rows)
+			c = ccv_dense_matrix_view(a, box.y, box.x, box.height, box.width);
+		else
+			ccv_slice(a, (ccv_matrix_t**)&c, type, box.y, box.x, box.height, box.width);
 		ccv_resample(c, b, type, tld->patch.height, tld->patch.width, CCV_INTER_AREA | CCV_INTER_CUBIC);
 		ccv_matrix_free(c);
 	}
@@ -651,12 +630,8 @@ ccv_tld_t* ccv_tld_new(ccv_dense_matrix_t* a, ccv_rect_t box, ccv_tld_param_t pa
 	tld->var_thres = ccv_variance(b) * 0.5;
 	ccv_array_push(tld->sv[1], &b);
 	ccv_dense_matrix_t* sat = 0;
-	ccv_sat(a, &sat, 0, CCV_NO_PADDING);
-	ccv_dense_matrix_t* sq = 0;
-	ccv_multiply(a, a, (ccv_matrix_t**)&sq, 0);
 	ccv_dense_matrix_t* sqsat = 0;
-	ccv_sat(sq, &sqsat, 0, CCV_NO_PADDING);
-	ccv_matrix_free(sq);
+	ccv_sat_square(a, &sat, &sqsat, CCV_NO_PADDING);
 	dsfmt_t* dsfmt = (dsfmt_t*)tld->dsfmt;
 	dsfmt_init_gen_rand(dsfmt, (uint32_t)tld);
 	{ // save stack fr alloca
@@ -919,12 +894,8 @@ ccv_comp_t ccv_tld_track_object(ccv_tld_t* tld, ccv_dense_matrix_t* a, ccv_dense
 	if (info)
 		info->track_success = tracked;
 	ccv_dense_matrix_t* sat = 0;
-	ccv_sat(b, &sat, 0, CCV_NO_PADDING);
-	ccv_dense_matrix_t* sq = 0;
-	ccv_multiply(b, b, (ccv_matrix_t**)&sq, 0);
 	ccv_dense_matrix_t* sqsat = 0;
-	ccv_sat(sq, &sqsat, 0, CCV_NO_PADDING);
-	ccv_matrix_free(sq);
+	ccv_sat_square(b, &sat, &sqsat, CCV_NO_PADDING);
 	ccv_array_t* dd = _ccv_tld_long_term_detect(tld, gb, sat, sqsat, info);
 	if (info)
 	{
@@ -937,7 +908,7 @@ ccv_comp_t ccv_tld_track_object(ccv_tld_t* tld, ccv_dense_matrix_t* a, ccv_dense
 	{
 		ccv_array_t* idx_dd = 0;
 		// group retrieved rectangles in order to filter out noise
-		int ncomp = ccv_array_group(dd, &idx_dd, _ccv_is_equal, 0);
+		int ncomp = ccv_array_group_rect(dd, &idx_dd, _ccv_is_equal, ccv_comp_extent, 0);
 		ccv_comp_t* comps = (ccv_comp_t*)ccmalloc(ncomp * sizeof(ccv_comp_t));
 		memset(comps, 0, ncomp * sizeof(ccv_comp_t));
 		for (i = 0; i < dd->rnum; i++)
@@ -1,5 +1,11 @@
 #include "ccv.h"
 #include "ccv_internal.h"
+#if defined(HAVE_SSE2)
+#include <emmintrin.h>
+#if defined(CCV_SIMD_X86)
+#include <immintrin.h>
+#endif
+#endif
 
 int _ccv_get_sparse_prime[] = { 53, 97, 193, 389, 769, 1543, 3079, 6151, 12289, 24593, 49157, 98317, 196613, 393241, 786433, 1572869 };
 
@@ -54,7 +60,7 @@ void ccv_visualize(ccv_matrix_t* a, ccv_matrix_t** b, int type)
 		aptr += da->step; \
 		bptr += db->step; \
 	}
-	ccv_matrix_getter(da->type, for_block);
+	ccv_matrix_getter_with_half(da->type, for_block);
 #undef for_block
 	if (dc != 0)
 		ccv_matrix_free(dc);
@@ -93,7 +99,7 @@ void ccv_flatten(ccv_matrix_t* a, ccv_matrix_t** b, int type, int flag)
 {
 	ccv_dense_matrix_t* da = ccv_get_dense_matrix(a);
 	ccv_declare_derived_signature(sig, da->sig != 0, ccv_sign_with_format(64, "ccv_flatten(%d)", flag), da->sig, CCV_EOF_SIGN);
-	int no_8u_type = (da->type & CCV_8U) ? CCV_32S : da->type;
+	int no_8u_type = (da->type & CCV_8U) ? CCV_32S : ((da->type & CCV_HALF_DATA_TYPE) ? CCV_32F : da->type);
 	type = (type == 0) ? CCV_GET_DATA_TYPE(no_8u_type) | CCV_C1 : CCV_GET_DATA_TYPE(type) | CCV_C1;
 	ccv_dense_matrix_t* db = *b = ccv_dense_matrix_renew(*b, da->rows, da->cols, CCV_ALL_DATA_TYPE | CCV_C1, type, sig);
 	ccv_object_return_if_cached(, db);
@@ -114,7 +120,7 @@ void ccv_flatten(ccv_matrix_t* a, ccv_matrix_t** b, int type, int flag)
 		aptr += da->step; \
 		bptr += db->step; \
 	}
-	ccv_matrix_getter(da->type, ccv_matrix_typeof_setter, db->type, for_block);
+	ccv_matrix_getter_with_half(da->type, ccv_matrix_typeof_setter, db->type, for_block);
 #undef for_block
 }
 
@@ -161,11 +167,24 @@ void ccv_shift(ccv_matrix_t* a, ccv_matrix_t** b, int type, int lr, int rr)
 	ccv_dense_matrix_t* da = ccv_get_dense_matrix(a);
 	ccv_declare_derived_signature(sig, da->sig != 0, ccv_sign_with_format(64, "ccv_shift(%d,%d)", lr, rr), da->sig, CCV_EOF_SIGN);
 	type = (type == 0) ? CCV_GET_DATA_TYPE(da->type) | CCV_GET_CHANNEL(da->type) : CCV_GET_DATA_TYPE(type) | CCV_GET_CHANNEL(da->type);
-	ccv_dense_matrix_t* db = *b = ccv_dense_matrix_renew(*b, da->rows, da->cols, CCV_ALL_DATA_TYPE | CCV_GET_CHANNEL(da->type), type, sig); 
+	ccv_dense_matrix_t* db = *b = ccv_dense_matrix_renew(*b, da->rows, da->cols, CCV_ALL_DATA_TYPE | CCV_HALF_DATA_TYPE | CCV_GET_CHANNEL(da->type), type, sig); 
 	ccv_object_return_if_cached(, db);
 	int i, j, ch = CCV_GET_CHANNEL(da->type);
 	unsigned char* aptr = da->data.u8;
 	unsigned char* bptr = db->data.u8;
+	// between half precision and float, a row at a time with the vectorized converters (shifts do nothing to floats)
+	if (CCV_GET_DATA_TYPE(da->type) == CCV_16F && CCV_GET_DATA_TYPE(db->type) == CCV_32F)
+	{
+		for (i = 0; i < da->rows; i++)
+			ccv_half_precision_to_float((uint16_t*)(aptr + i * da->step), (float*)(bptr + i * db->step), da->cols * ch);
+		return;
+	}
+	if (CCV_GET_DATA_TYPE(da->type) == CCV_32F && CCV_GET_DATA_TYPE(db->type) == CCV_16F)
+	{
+		for (i = 0; i < da->rows; i++)
+			ccv_float_to_half_precision((float*)(aptr + i * da->step), (uint16_t*)(bptr + i * db->step), da->cols * ch);
+		return;
+	}
 #define for_block(_for_get, _for_set) \
 	for (i = 0; i < da->rows; i++) \
 	{ \
@@ -176,13 +195,129 @@ void ccv_shift(ccv_matrix_t* a, ccv_matrix_t** b, int type, int lr, int rr)
 		aptr += da->step; \
 		bptr += db->step; \
 	}
-	ccv_matrix_getter(da->type, ccv_matrix_setter, db->type, for_block);
+	ccv_matrix_getter_with_half(da->type, ccv_matrix_setter_with_half, db->type, for_block);
 #undef for_block
 }
 
+/* the open addressing backend, the key of a cell is its index (the row for row major) in the high 32 bits and its
+ * vidx in the low 32 bits, empty slots are all ones, it is linear probing with a multiplicative hash */
+#define CCV_SPARSE_EMPTY_KEY (~(uint64_t)0)
+
+static inline uint64_t _ccv_sparse_key(int index, int vidx)
+{
+	return ((uint64_t)(uint32_t)index << 32) | (uint32_t)vidx;
+}
+
+static inline int _ccv_sparse_slot(ccv_sparse_matrix_t* mat, uint64_t key)
+{
+	int mask = mat->capacity - 1;
+	int i = (int)((key * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+	while (mat->keys[i] != key && mat->keys[i] != CCV_SPARSE_EMPTY_KEY)
+		i = (i + 1) & mask;
+	return i;
+}
+
+static void _ccv_sparse_slab_expand(ccv_sparse_matrix_t* mat)
+{
+	int cell_width = CCV_GET_DATA_TYPE_SIZE(mat->type) * CCV_GET_CHANNEL(mat->type);
+	int i, capacity = mat->capacity;
+	uint64_t* keys = mat->keys;
+	unsigned char* data = mat->data.u8;
+	mat->capacity = capacity * 2;
+	mat->keys = (uint64_t*)ccmalloc((sizeof(uint64_t) + cell_width) * mat->capacity);
+	memset(mat->keys, 0xff, sizeof(uint64_t) * mat->capacity);
+	mat->data.u8 = (unsigned char*)(mat->keys + mat->capacity);
+	for (i = 0; i < capacity; i++)
+		if (keys[i] != CCV_SPARSE_EMPTY_KEY)
+		{
+			int j = _ccv_sparse_slot(mat, keys[i]);
+			mat->keys[j] = keys[i];
+			memcpy(mat->data.u8 + j * cell_width, data + i * cell_width, cell_width);
+		}
+	ccfree(keys);
+}
+
+static ccv_matrix_cell_t _ccv_sparse_slab_get(ccv_sparse_matrix_t* mat, int index, int vidx)
+{
+	ccv_matrix_cell_t cell;
+	int i = _ccv_sparse_slot(mat, _ccv_sparse_key(index, vidx));
+	cell.u8 = (mat->keys[i] != CCV_SPARSE_EMPTY_KEY) ? mat->data.u8 + i * CCV_GET_DATA_TYPE_SIZE(mat->type) * CCV_GET_CHANNEL(mat->type) : 0;
+	return cell;
+}
+
+static void _ccv_sparse_slab_set(ccv_sparse_matrix_t* mat, int index, int vidx, void* data)
+{
+	int cell_width = CCV_GET_DATA_TYPE_SIZE(mat->type) * CCV_GET_CHANNEL(mat->type);
+	uint64_t key = _ccv_sparse_key(index, vidx);
+	int i = _ccv_sparse_slot(mat, key);
+	if (mat->keys[i] == CCV_SPARSE_EMPTY_KEY)
+	{
+		// keep the load under 3/4, the probes are short then
+		if ((mat->size + 1) * 4 > mat->capacity * 3)
+		{
+			_ccv_sparse_slab_expand(mat);
+			i = _ccv_sparse_slot(mat, key);
+		}
+		mat->keys[i] = key;
+		++mat->size;
+		if (data == 0)
+			memset(mat->data.u8 + i * cell_width, 0, cell_width);
+	}
+	if (data != 0)
+		memcpy(mat->data.u8 + i * cell_width, data, cell_width);
+}
+
+/* two stable counting sorts, first by vidx, then by index, thus, the cells come out in CSR / CSC order without any
+ * comparison sort */
+static void _ccv_sparse_slab_compress(ccv_sparse_matrix_t* mat, ccv_compressed_sparse_matrix_t** csm)
+{
+	int i;
+	int nnz = mat->size;
+	int major_length = (mat->major == CCV_SPARSE_COL_MAJOR) ? mat->cols : mat->rows;
+	int minor_length = (mat->major == CCV_SPARSE_COL_MAJOR) ? mat->rows : mat->cols;
+	int size = CCV_GET_DATA_TYPE_SIZE(mat->type);
+	int cell_width = size * CCV_GET_CHANNEL(mat->type);
+	ccv_compressed_sparse_matrix_t* cm = *csm = (ccv_compressed_sparse_matrix_t*)ccmalloc(sizeof(ccv_compressed_sparse_matrix_t) + nnz * sizeof(int) + nnz * size + (major_length + 1) * sizeof(int));
+	cm->type = (mat->type & ~CCV_MATRIX_SPARSE & ~CCV_SPARSE_VECTOR & ~CCV_DENSE_VECTOR) | ((mat->major == CCV_SPARSE_COL_MAJOR) ? CCV_MATRIX_CSC : CCV_MATRIX_CSR);
+	cm->nnz = nnz;
+	cm->rows = mat->rows;
+	cm->cols = mat->cols;
+	cm->index = (int*)(cm + 1);
+	cm->offset = cm->index + nnz;
+	cm->data.i32 = cm->offset + major_length + 1;
+	int* count = (int*)cccalloc(minor_length + 1, sizeof(int));
+	int* order = (int*)ccmalloc(sizeof(int) * ccv_max(nnz, 1));
+	for (i = 0; i < mat->capacity; i++)
+		if (mat->keys[i] != CCV_SPARSE_EMPTY_KEY)
+			++count[(uint32_t)mat->keys[i] + 1];
+	for (i = 0; i < minor_length; i++)
+		count[i + 1] += count[i];
+	for (i = 0; i < mat->capacity; i++)
+		if (mat->keys[i] != CCV_SPARSE_EMPTY_KEY)
+			order[count[(uint32_t)mat->keys[i]]++] = i;
+	ccfree(count);
+	memset(cm->offset, 0, sizeof(int) * (major_length + 1));
+	for (i = 0; i < nnz; i++)
+		++cm->offset[(mat->keys[order[i]] >> 32) + 1];
+	for (i = 0; i < major_length; i++)
+		cm->offset[i + 1] += cm->offset[i];
+	int* cursor = (int*)ccmalloc(sizeof(int) * ccv_max(major_length, 1));
+	memcpy(cursor, cm->offset, sizeof(int) * major_length);
+	for (i = 0; i < nnz; i++)
+	{
+		uint64_t key = mat->keys[order[i]];
+		int k = cursor[key >> 32]++;
+		cm->index[k] = (uint32_t)key;
+		memcpy(cm->data.u8 + k * size, mat->data.u8 + order[i] * cell_width, size);
+	}
+	ccfree(cursor);
+	ccfree(order);
+}
+
 // ȡϡ
 ccv_dense_vector_t* ccv_get_sparse_matrix_vector(ccv_sparse_matrix_t* mat, int index)
 {
+	assert(!mat->capacity);
 	if (mat->vector[(index * 33) % CCV_GET_SPARSE_PRIME(mat->prime)].index != -1)
 	{
 		ccv_dense_vector_t* vector = &mat->vector[(index * 33) % CCV_GET_SPARSE_PRIME(mat->prime)];
@@ -197,6 +332,8 @@ ccv_dense_vector_t* ccv_get_sparse_matrix_vector(ccv_sparse_matrix_t* mat, int i
 // ȡϡԪ
 ccv_matrix_cell_t ccv_get_sparse_matrix_cell(ccv_sparse_matrix_t* mat, int row, int col)
 {
+	if (mat->capacity)
+		return (mat->major == CCV_SPARSE_COL_MAJOR) ? _ccv_sparse_slab_get(mat, col, row) : _ccv_sparse_slab_get(mat, row, col);
 	// ȡϡvector
 	ccv_dense_vector_t* vector 
 		= ccv_get_sparse_matrix_vector(mat, (mat->major == CCV_SPARSE_COL_MAJOR) ? col : row);
@@ -328,6 +465,11 @@ void ccv_set_sparse_matrix_cell(ccv_sparse_matrix_t* mat, int row, int col, void
 	int i;
 	int index = (mat->major == CCV_SPARSE_COL_MAJOR) ? col : row;
 	int vidx = (mat->major == CCV_SPARSE_COL_MAJOR) ? row : col;
+	if (mat->capacity)
+	{
+		_ccv_sparse_slab_set(mat, index, vidx, data);
+		return;
+	}
 	int length = CCV_GET_SPARSE_PRIME(mat->prime);
 	ccv_dense_vector_t* vector = ccv_get_sparse_matrix_vector(mat, index);
 	
@@ -436,6 +578,11 @@ static CCV_IMPLEMENT_QSORT_EX(_ccv_indice_double_sort, int, _ccv_indice_less_tha
 // ѹϡ
 void ccv_compress_sparse_matrix(ccv_sparse_matrix_t* mat, ccv_compressed_sparse_matrix_t** csm)
 {
+	if (mat->capacity)
+	{
+		_ccv_sparse_slab_compress(mat, csm);
+		return;
+	}
 	int i, j;
 	int nnz = 0;
 	int length = CCV_GET_SPARSE_PRIME(mat->prime);
@@ -814,14 +961,61 @@ static uint8_t _ccv_shift_table[512] = {
 	0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0xd,
 };
 
-void ccv_float_to_half_precision(float* f, uint16_t* h, size_t len)
+static void _ccv_float_to_half_precision(const uint32_t* u, uint16_t* h, size_t len)
 {
-	int i;
-	uint32_t* u = (uint32_t*)f;
+	size_t i;
 	for (i = 0; i < len; i++)
 		h[i] = _ccv_base_table[(u[i] >> 23) & 0x1ff] + ((u[i] & 0x007fffff) >> _ccv_shift_table[(u[i] >> 23) & 0x1ff]);
 }
 
+#if defined(HAVE_SSE2) && defined(CCV_SIMD_X86)
+#define CCV_HALF_F16C
+/* the table truncates, so does vcvtps2ph with round to zero. The table also maps anything at or above 65536
+ * to infinity and keeps the top mantissa bits of a NaN, where the instruction saturates to 65504 and quiets
+ * signaling NaNs, these lanes are patched up afterwards to stay bit exact with the table */
+__attribute__((target("avx2,f16c"))) static void _ccv_float_to_half_precision_f16c(const uint32_t* u, uint16_t* h, size_t len)
+{
+	size_t i;
+	const __m256i abs_mask = _mm256_set1_epi32(0x7fffffff);
+	const __m256i big = _mm256_set1_epi32(0x477fffff);
+	const __m256i finite = _mm256_set1_epi32(0x7f7fffff);
+	const __m256i inf = _mm256_set1_epi32(0x7c00);
+	const __m256i zero = _mm256_setzero_si256();
+	for (i = 0; i + 8 <= len; i += 8)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i*)(u + i));
+		__m256i a = _mm256_and_si256(x, abs_mask);
+		__m256i special = _mm256_or_si256(_mm256_or_si256(_mm256_srli_epi32(_mm256_andnot_si256(abs_mask, x), 16), inf),
+			_mm256_and_si256(_mm256_cmpgt_epi32(a, finite), _mm256_srli_epi32(_mm256_and_si256(a, _mm256_set1_epi32(0x007fffff)), 13)));
+		__m256i mask = _mm256_cmpgt_epi32(a, big);
+		special = _mm256_permute4x64_epi64(_mm256_packus_epi32(special, zero), 0xd8);
+		mask = _mm256_permute4x64_epi64(_mm256_packs_epi32(mask, zero), 0xd8);
+		__m128i y = _mm256_cvtps_ph(_mm256_castsi256_ps(x), _MM_FROUND_TO_ZERO);
+		y = _mm_blendv_epi8(y, _mm256_castsi256_si128(special), _mm256_castsi256_si128(mask));
+		_mm_storeu_si128((__m128i*)(h + i), y);
+	}
+	_ccv_float_to_half_precision(u + i, h + i, len - i);
+}
+#endif
+
+typedef void(*ccv_float_to_half_precision_f)(const uint32_t*, uint16_t*, size_t);
+
+#ifdef CCV_HALF_F16C
+#define CCV_FLOAT_TO_HALF_F16C _ccv_float_to_half_precision_f16c
+#else
+#define CCV_FLOAT_TO_HALF_F16C _ccv_float_to_half_precision
+#endif
+
+/* there is no packing instruction before F16C, with SSE2 the table lookups are as fast as anything */
+static const ccv_float_to_half_precision_f ccv_float_to_half_precision_kernel[CCV_SIMD_LEVEL_NUM] = {
+	_ccv_float_to_half_precision, _ccv_float_to_half_precision, CCV_FLOAT_TO_HALF_F16C, CCV_FLOAT_TO_HALF_F16C,
+};
+
+void ccv_float_to_half_precision(float* f, uint16_t* h, size_t len)
+{
+	ccv_float_to_half_precision_kernel[ccv_get_simd_level()]((const uint32_t*)f, h, len);
+}
+
 static uint32_t _ccv_mantissa_table[2048] = {
 	0x0, 0x33800000, 0x34000000, 0x34400000, 0x34800000, 0x34a00000, 0x34c00000, 0x34e00000,
 	0x35000000, 0x35100000, 0x35200000, 0x35300000, 0x35400000, 0x35500000, 0x35600000, 0x35700000,
@@ -1103,14 +1297,110 @@ static uint16_t _ccv_offset_table[64] = {
 	0x400, 0x400, 0x400, 0x400, 0x400, 0x400, 0x400, 0x400,
 };
 
-void ccv_half_precision_to_float(uint16_t* h, float* f, size_t len)
+static void _ccv_half_precision_to_float(const uint16_t* h, uint32_t* u, size_t len)
 {
-	int i;
-	uint32_t* u = (uint32_t*)f;
+	size_t i;
 	for (i = 0; i < len; i++)
 		u[i] = _ccv_mantissa_table[_ccv_offset_table[h[i] >> 10] + (h[i] & 0x3ff)] + _ccv_exponent_table[h[i] >> 10];
 }
 
+/* shifting exponent and mantissa into place and adding 112 to the exponent does it for normal numbers,
+ * infinities and NaNs get the exponent of all ones instead. Denormals are normalized with a float subtract
+ * of 2^-14 that never sees a denormal operand (these are very slow). Unlike vcvtph2ps this leaves signaling
+ * NaNs alone, thus it is bit exact with the table */
+#ifdef HAVE_SSE2
+#define CCV_HALF_SSE2
+static void _ccv_half_precision_to_float_sse2(const uint16_t* h, uint32_t* u, size_t len)
+{
+	size_t i;
+	const __m128i expmant = _mm_set1_epi32(0x7fff);
+	const __m128i max = _mm_set1_epi32(0x7bff);
+	const __m128i min = _mm_set1_epi32(0x0400);
+	const __m128i bias = _mm_set1_epi32((127 - 15) << 23);
+	const __m128i one = _mm_set1_epi32(1 << 23);
+	const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((127 - 14) << 23));
+	const __m128i zero = _mm_setzero_si128();
+	for (i = 0; i + 8 <= len; i += 8)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i*)(h + i));
+		__m128i x0 = _mm_unpacklo_epi16(x, zero);
+		__m128i x1 = _mm_unpackhi_epi16(x, zero);
+		__m128i a0 = _mm_and_si128(x0, expmant);
+		__m128i a1 = _mm_and_si128(x1, expmant);
+		__m128i y0 = _mm_add_epi32(_mm_slli_epi32(a0, 13), bias);
+		__m128i y1 = _mm_add_epi32(_mm_slli_epi32(a1, 13), bias);
+		y0 = _mm_add_epi32(y0, _mm_and_si128(_mm_cmpgt_epi32(a0, max), bias));
+		y1 = _mm_add_epi32(y1, _mm_and_si128(_mm_cmpgt_epi32(a1, max), bias));
+		__m128i d0 = _mm_castps_si128(_mm_sub_ps(_mm_castsi128_ps(_mm_add_epi32(y0, one)), magic));
+		__m128i d1 = _mm_castps_si128(_mm_sub_ps(_mm_castsi128_ps(_mm_add_epi32(y1, one)), magic));
+		__m128i m0 = _mm_cmplt_epi32(a0, min);
+		__m128i m1 = _mm_cmplt_epi32(a1, min);
+		y0 = _mm_or_si128(_mm_and_si128(m0, d0), _mm_andnot_si128(m0, y0));
+		y1 = _mm_or_si128(_mm_and_si128(m1, d1), _mm_andnot_si128(m1, y1));
+		y0 = _mm_or_si128(y0, _mm_slli_epi32(_mm_xor_si128(x0, a0), 16));
+		y1 = _mm_or_si128(y1, _mm_slli_epi32(_mm_xor_si128(x1, a1), 16));
+		_mm_storeu_si128((__m128i*)(u + i), y0);
+		_mm_storeu_si128((__m128i*)(u + i + 4), y1);
+	}
+	_ccv_half_precision_to_float(h + i, u + i, len - i);
+}
+#endif
+
+#if defined(HAVE_SSE2) && defined(CCV_SIMD_X86)
+__attribute__((target("avx2"))) static void _ccv_half_precision_to_float_avx2(const uint16_t* h, uint32_t* u, size_t len)
+{
+	size_t i;
+	const __m256i expmant = _mm256_set1_epi32(0x7fff);
+	const __m256i max = _mm256_set1_epi32(0x7bff);
+	const __m256i min = _mm256_set1_epi32(0x0400);
+	const __m256i bias = _mm256_set1_epi32((127 - 15) << 23);
+	const __m256i one = _mm256_set1_epi32(1 << 23);
+	const __m256 magic = _mm256_castsi256_ps(_mm256_set1_epi32((127 - 14) << 23));
+	for (i = 0; i + 16 <= len; i += 16)
+	{
+		__m256i x0 = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(h + i)));
+		__m256i x1 = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(h + i + 8)));
+		__m256i a0 = _mm256_and_si256(x0, expmant);
+		__m256i a1 = _mm256_and_si256(x1, expmant);
+		__m256i y0 = _mm256_add_epi32(_mm256_slli_epi32(a0, 13), bias);
+		__m256i y1 = _mm256_add_epi32(_mm256_slli_epi32(a1, 13), bias);
+		y0 = _mm256_add_epi32(y0, _mm256_and_si256(_mm256_cmpgt_epi32(a0, max), bias));
+		y1 = _mm256_add_epi32(y1, _mm256_and_si256(_mm256_cmpgt_epi32(a1, max), bias));
+		__m256i d0 = _mm256_castps_si256(_mm256_sub_ps(_mm256_castsi256_ps(_mm256_add_epi32(y0, one)), magic));
+		__m256i d1 = _mm256_castps_si256(_mm256_sub_ps(_mm256_castsi256_ps(_mm256_add_epi32(y1, one)), magic));
+		y0 = _mm256_blendv_epi8(y0, d0, _mm256_cmpgt_epi32(min, a0));
+		y1 = _mm256_blendv_epi8(y1, d1, _mm256_cmpgt_epi32(min, a1));
+		y0 = _mm256_or_si256(y0, _mm256_slli_epi32(_mm256_xor_si256(x0, a0), 16));
+		y1 = _mm256_or_si256(y1, _mm256_slli_epi32(_mm256_xor_si256(x1, a1), 16));
+		_mm256_storeu_si256((__m256i*)(u + i), y0);
+		_mm256_storeu_si256((__m256i*)(u + i + 8), y1);
+	}
+	_ccv_half_precision_to_float(h + i, u + i, len - i);
+}
+#define CCV_HALF_TO_FLOAT_AVX2 _ccv_half_precision_to_float_avx2
+#elif defined(CCV_HALF_SSE2)
+#define CCV_HALF_TO_FLOAT_AVX2 _ccv_half_precision_to_float_sse2
+#else
+#define CCV_HALF_TO_FLOAT_AVX2 _ccv_half_precision_to_float
+#endif
+
+#ifdef CCV_HALF_SSE2
+#define CCV_HALF_TO_FLOAT_SSE2 _ccv_half_precision_to_float_sse2
+#else
+#define CCV_HALF_TO_FLOAT_SSE2 _ccv_half_precision_to_float
+#endif
+
+typedef void(*ccv_half_precision_to_float_f)(const uint16_t*, uint32_t*, size_t);
+
+static const ccv_half_precision_to_float_f ccv_half_precision_to_float_kernel[CCV_SIMD_LEVEL_NUM] = {
+	_ccv_half_precision_to_float, CCV_HALF_TO_FLOAT_SSE2, CCV_HALF_TO_FLOAT_AVX2, CCV_HALF_TO_FLOAT_AVX2,
+};
+
+void ccv_half_precision_to_float(uint16_t* h, float* f, size_t len)
+{
+	ccv_half_precision_to_float_kernel[ccv_get_simd_level()](h, (uint32_t*)f, len);
+}
+
 void ccv_array_push(ccv_array_t* array, const void* r)
 {
 	array->rnum++;
@@ -1118,7 +1408,14 @@ void ccv_array_push(ccv_array_t* array, const void* r)
 	if (array->rnum > array->size)
 	{
 		array->size = ccv_max(array->size * 3 / 2, array->size + 1);
-		array->data = ccrealloc(array->data, (size_t)array->size * (size_t)array->rsize);
+		if (array->type & CCV_ARENA)
+		{
+			// the old data will be released together with the arena scope
+			void* data = ccv_arena_alloc(CCV_ARRAY_ARENA(array), (size_t)array->size * (size_t)array->rsize);
+			memcpy(data, array->data, (size_t)(array->rnum - 1) * (size_t)array->rsize);
+			array->data = data;
+		} else
+			array->data = ccrealloc(array->data, (size_t)array->size * (size_t)array->rsize);
 	}
 	
 	memcpy(ccv_array_get(array, array->rnum - 1), r, array->rsize);
@@ -1141,10 +1438,49 @@ typedef struct ccv_ptree_node_t
 	int rank;
 } ccv_ptree_node_t;
 
-/* the code for grouping array is adopted from OpenCV's cvSeqPartition func, it is essentially a find-union algorithm */
-int ccv_array_group(ccv_array_t* array, ccv_array_t** index, ccv_array_group_f gfunc, void* data)
+/* merge the trees of node i and node j, root is the root of node i, return the new root */
+static ccv_ptree_node_t* _ccv_ptree_union(ccv_ptree_node_t* node, ccv_ptree_node_t* root, int i, int j)
 {
-	int i, j;
+	ccv_ptree_node_t* root2 = node + j;
+
+	while(root2->parent)
+		root2 = root2->parent;
+
+	if(root2 != root)
+	{
+		if(root->rank > root2->rank)
+			root2->parent = root;
+		else
+		{
+			root->parent = root2;
+			root2->rank += root->rank == root2->rank;
+			root = root2;
+		}
+
+		/* compress path from node2 to the root: */
+		ccv_ptree_node_t* node2 = node + j;
+		while(node2->parent)
+		{
+			ccv_ptree_node_t* temp = node2;
+			node2 = node2->parent;
+			temp->parent = root;
+		}
+
+		/* compress path from node to the root: */
+		node2 = node + i;
+		while(node2->parent)
+		{
+			ccv_ptree_node_t* temp = node2;
+			node2 = node2->parent;
+			temp->parent = root;
+		}
+	}
+	return root;
+}
+
+static ccv_ptree_node_t* _ccv_ptree_new(ccv_array_t* array)
+{
+	int i;
 	ccv_ptree_node_t* node = (ccv_ptree_node_t*)ccmalloc(array->rnum * sizeof(ccv_ptree_node_t));
 	for (i = 0; i < array->rnum; i++)
 	{
@@ -1152,54 +1488,13 @@ int ccv_array_group(ccv_array_t* array, ccv_array_t** index, ccv_array_group_f g
 		node[i].element = ccv_array_get(array, i);
 		node[i].rank = 0;
 	}
-	for (i = 0; i < array->rnum; i++)
-	{
-		if (!node[i].element)
-			continue;
-		ccv_ptree_node_t* root = node + i;
-		while (root->parent)
-			root = root->parent;
-		for (j = 0; j < array->rnum; j++)
-		{
-			if( i != j && node[j].element && gfunc(node[i].element, node[j].element, data))
-			{
-				ccv_ptree_node_t* root2 = node + j;
-
-				while(root2->parent)
-					root2 = root2->parent;
-
-				if(root2 != root)
-				{
-					if(root->rank > root2->rank)
-						root2->parent = root;
-					else
-					{
-						root->parent = root2;
-						root2->rank += root->rank == root2->rank;
-						root = root2;
-					}
-
-					/* compress path from node2 to the root: */
-					ccv_ptree_node_t* node2 = node + j;
-					while(node2->parent)
-					{
-						ccv_ptree_node_t* temp = node2;
-						node2 = node2->parent;
-						temp->parent = root;
-					}
+	return node;
+}
 
-					/* compress path from node to the root: */
-					node2 = node + i;
-					while(node2->parent)
-					{
-						ccv_ptree_node_t* temp = node2;
-						node2 = node2->parent;
-						temp->parent = root;
-					}
-				}
-			}
-		}
-	}
+/* number the trees in the order of their first element, and free the nodes */
+static int _ccv_ptree_index(ccv_array_t* array, ccv_ptree_node_t* node, ccv_array_t** index)
+{
+	int i, j;
 	if (*index == 0)
 		*index = ccv_array_new(sizeof(int), array->rnum, 0);
 	else
@@ -1225,6 +1520,84 @@ int ccv_array_group(ccv_array_t* array, ccv_array_t** index, ccv_array_group_f g
 	return class_idx;
 }
 
+/* the code for grouping array is adopted from OpenCV's cvSeqPartition func, it is essentially a find-union algorithm */
+int ccv_array_group(ccv_array_t* array, ccv_array_t** index, ccv_array_group_f gfunc, void* data)
+{
+	int i, j;
+	ccv_ptree_node_t* node = _ccv_ptree_new(array);
+	for (i = 0; i < array->rnum; i++)
+	{
+		if (!node[i].element)
+			continue;
+		ccv_ptree_node_t* root = node + i;
+		while (root->parent)
+			root = root->parent;
+		for (j = 0; j < array->rnum; j++)
+			if( i != j && node[j].element && gfunc(node[i].element, node[j].element, data))
+				root = _ccv_ptree_union(node, root, i, j);
+	}
+	return _ccv_ptree_index(array, node, index);
+}
+
+typedef struct {
+	ccv_rect_t rect;
+	int i;
+} ccv_array_extent_t;
+
+#define less_than(e1, e2, aux) ((e1).rect.x < (e2).rect.x)
+static CCV_IMPLEMENT_QSORT(_ccv_array_extent_qsort, ccv_array_extent_t, less_than)
+#undef less_than
+
+/* sort and sweep, the extents are sorted by their left side, and every extent is only compared with the ones that
+ * start before it ends, the pairs that overlap on x are then checked on y before calling gfunc */
+int ccv_array_group_rect(ccv_array_t* array, ccv_array_t** index, ccv_array_group_f gfunc, ccv_array_rect_f rfunc, void* data)
+{
+	int i, j, n = 0;
+	ccv_ptree_node_t* node = _ccv_ptree_new(array);
+	ccv_array_extent_t* extent = (ccv_array_extent_t*)ccmalloc(sizeof(ccv_array_extent_t) * ccv_max(array->rnum, 1));
+	for (i = 0; i < array->rnum; i++)
+		if (node[i].element)
+		{
+			extent[n].rect = rfunc(node[i].element, data);
+			extent[n].i = i;
+			++n;
+		}
+	_ccv_array_extent_qsort(extent, n, 0);
+	for (i = 0; i < n; i++)
+	{
+		ccv_rect_t r1 = extent[i].rect;
+		for (j = i + 1; j < n && extent[j].rect.x < r1.x + r1.width; j++)
+		{
+			ccv_rect_t r2 = extent[j].rect;
+			if (r2.y >= r1.y + r1.height || r1.y >= r2.y + r2.height)
+				continue;
+			int a = extent[i].i, b = extent[j].i;
+			// gfunc is not necessarily symmetric, ccv_array_group tries both orders too
+			if (gfunc(node[a].element, node[b].element, data) || gfunc(node[b].element, node[a].element, data))
+			{
+				ccv_ptree_node_t* root = node + a;
+				while (root->parent)
+					root = root->parent;
+				_ccv_ptree_union(node, root, a, b);
+			}
+		}
+	}
+	ccfree(extent);
+	return _ccv_ptree_index(array, node, index);
+}
+
+/* the detectors group a rectangle with another either if they intersect, or if the corner of the other is within
+ * factor * the size of this one from its corner, the extents cover these cases, max(width, height) keeps it an
+ * upper bound whichever side the detector takes the size from */
+ccv_rect_t ccv_comp_extent(const void* _r, void* data)
+{
+	const ccv_rect_t* r = (const ccv_rect_t*)_r;
+	if (!data)
+		return *r;
+	int distance = (int)(ccv_max(r->width, r->height) * *(float*)data + 0.5);
+	return ccv_rect(r->x - distance, r->y - distance, distance * 2 + 1, distance * 2 + 1);
+}
+
 ccv_contour_t* ccv_contour_new(int set)
 {
 	ccv_contour_t* contour = (ccv_contour_t*)ccmalloc(sizeof(ccv_contour_t));
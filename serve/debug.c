@@ -0,0 +1,41 @@
+#include "uri.h"
+#include "ccv.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+static int uri_debug_cache_stats_print(char* data, size_t len, const ccv_cache_stats_t* stats)
+{
+	return snprintf(data, len, "{\"hit\":%llu,\"miss\":%llu,\"put\":%llu,\"evict\":%llu,\"rnum\":%llu,\"size\":%zu}",
+		(unsigned long long)stats->hit, (unsigned long long)stats->miss, (unsigned long long)stats->put,
+		(unsigned long long)stats->evict, (unsigned long long)stats->rnum, stats->size);
+}
+
+int uri_debug_cache_stats(const void* context, const void* parsed, ebb_buf* buf)
+{
+	ccv_cache_stats_t matrix, array;
+	ccv_cache_type_stats(CCV_CACHE_MATRIX, &matrix);
+	ccv_cache_type_stats(CCV_CACHE_ARRAY, &array);
+	char body[512];
+	size_t len = snprintf(body, 512, "{\"matrix\":");
+	len += uri_debug_cache_stats_print(body + len, 512 - len, &matrix);
+	len += snprintf(body + len, 512 - len, ",\"array\":");
+	len += uri_debug_cache_stats_print(body + len, 512 - len, &array);
+	len += snprintf(body + len, 512 - len, "}\n");
+	char* data = (char*)malloc(192 /* the head start for http header */ + len);
+	snprintf(data, 192, ebb_http_header, len);
+	buf->written = strnlen(data, 192);
+	memcpy(data + buf->written, body, len);
+	buf->written += len;
+	buf->data = data;
+	buf->len = buf->written;
+	buf->on_release = uri_ebb_buf_free;
+	return 0;
+}
+
+int uri_debug_cache_stats_reset(const void* context, const void* parsed, ebb_buf* buf)
+{
+	ccv_cache_stats_reset();
+	buf->data = (void*)ebb_http_ok_true;
+	buf->len = sizeof(ebb_http_ok_true) - 1;
+	return 0;
+}
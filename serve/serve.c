@@ -217,6 +217,8 @@ int main(int argc, char** argv)
 	ebb_server_init(&server, EV_DEFAULT);
 	server.new_connection = new_connection;
 	ebb_server_listen_on_port(&server, 3350);
+	// requests run concurrently, use the lock-striped cache, its stats are at /debug/cache
+	ccv_enable_cache_with_mode(CCV_DEFAULT_CACHE_SIZE, CCV_CACHE_SHARDED);
 	uri_init();
 	main_async_init();
 	main_async_start(EV_DEFAULT);
@@ -42,6 +42,15 @@ static uri_dispatch_t uri_map[] = {
 		.delete = 0,
 		.destroy = uri_convnet_classify_destroy,
 	},
+	{
+		.uri = "/debug/cache",
+		.init = 0,
+		.parse = 0,
+		.get = uri_debug_cache_stats,
+		.post = 0,
+		.delete = uri_debug_cache_stats_reset,
+		.destroy = 0,
+	},
 	{
 		.uri = "/dpm/detect.objects",
 		.init = uri_dpm_detect_objects_init,
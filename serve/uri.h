@@ -216,6 +216,9 @@ void* uri_bbf_detect_objects_parse(const void* context, void* parsed, int resour
 int uri_bbf_detect_objects_intro(const void* context, const void* parsed, ebb_buf* buf);
 int uri_bbf_detect_objects(const void* context, const void* parsed, ebb_buf* buf);
 
+int uri_debug_cache_stats(const void* context, const void* parsed, ebb_buf* buf);
+int uri_debug_cache_stats_reset(const void* context, const void* parsed, ebb_buf* buf);
+
 void* uri_dpm_detect_objects_init(void);
 void uri_dpm_detect_objects_destroy(void* context);
 void* uri_dpm_detect_objects_parse(const void* context, void* parsed, int resource_id, const char* buf, size_t len, uri_parse_state_t state, int header_index);
@@ -2,6 +2,7 @@
 #include "case.h"
 #include "ccv_case.h"
 #include "3rdparty/sfmt/SFMT.h"
+#include "3rdparty/xxhash/xxhash.h"
 
 TEST_CASE("SFMT shuffle")
 {
@@ -16,4 +17,18 @@ TEST_CASE("SFMT shuffle")
 	REQUIRE_ARRAY_EQ(int, r, t, 10, "SFMT shuffle error for int of 10");
 }
 
+TEST_CASE("xxHash 64-bit")
+{
+	const char* text = "Nobody inspects the spammish repetition";
+	REQUIRE_EQ(0xEF46DB3751D8E999ULL, xxh64("", 0, 0), "xxHash of empty string");
+	REQUIRE_EQ(0x44BC2CF5AD770999ULL, xxh64("abc", 3, 0), "xxHash of abc");
+	REQUIRE_EQ(0xFBCEA83C8A378BF1ULL, xxh64(text, strlen(text), 0), "xxHash of a sentence");
+	xxh64_ctx_t ctx;
+	xxh64_init(&ctx, 0);
+	int i;
+	for (i = 0; i < strlen(text); i++)
+		xxh64_update(&ctx, text + i, 1);
+	REQUIRE_EQ(0xFBCEA83C8A378BF1ULL, xxh64_final(&ctx), "xxHash of a sentence streamed byte by byte");
+}
+
 #include "case_main.h"
@@ -26,6 +26,113 @@ TEST_CASE("matrix multiplication")
 	ccv_matrix_free(y);
 }
 
+TEST_CASE("blocked matrix multiplication with transpose, alpha and beta")
+{
+	// large enough to go through more than one block in every direction
+	int m = 131, n = 300, k = 517, transpose;
+	for (transpose = 0; transpose < 4; transpose++)
+	{
+		ccv_dense_matrix_t* a = (transpose & CCV_A_TRANSPOSE) ? ccv_dense_matrix_new(k, m, CCV_32F | CCV_C1, 0, 0) : ccv_dense_matrix_new(m, k, CCV_32F | CCV_C1, 0, 0);
+		ccv_dense_matrix_t* b = (transpose & CCV_B_TRANSPOSE) ? ccv_dense_matrix_new(n, k, CCV_32F | CCV_C1, 0, 0) : ccv_dense_matrix_new(k, n, CCV_32F | CCV_C1, 0, 0);
+		ccv_dense_matrix_t* c = ccv_dense_matrix_new(m, n, CCV_32F | CCV_C1, 0, 0);
+		int i, j, p;
+		for (i = 0; i < m * k; i++)
+			a->data.f32[i] = (float)((i * 7) % 13) / 13 - 0.5;
+		for (i = 0; i < k * n; i++)
+			b->data.f32[i] = (float)((i * 5) % 11) / 11 - 0.5;
+		for (i = 0; i < m * n; i++)
+			c->data.f32[i] = (float)(i % 3);
+		ccv_dense_matrix_t* d = 0;
+		ccv_gemm(a, b, 0.5, c, 2, transpose, (ccv_matrix_t**)&d, 0);
+		float* hd = (float*)ccmalloc(sizeof(float) * m * n);
+		for (i = 0; i < m; i++)
+			for (j = 0; j < n; j++)
+			{
+				double v = 0;
+				for (p = 0; p < k; p++)
+					v += ((transpose & CCV_A_TRANSPOSE) ? a->data.f32[p * m + i] : a->data.f32[i * k + p]) * ((transpose & CCV_B_TRANSPOSE) ? b->data.f32[j * k + p] : b->data.f32[p * n + j]);
+				hd[i * n + j] = 0.5 * v + 2 * c->data.f32[i * n + j];
+			}
+		REQUIRE_ARRAY_EQ_WITH_TOLERANCE(float, hd, d->data.f32, m * n, 1e-3, "blocked gemm should match the naive one for transpose %d", transpose);
+		ccfree(hd);
+		ccv_matrix_free(a);
+		ccv_matrix_free(b);
+		ccv_matrix_free(c);
+		ccv_matrix_free(d);
+	}
+}
+
+TEST_CASE("matrix multiplication of half precision matrices")
+{
+	// odd k, thus, rows of the half precision matrices are padded
+	int m = 37, n = 41, k = 133, transpose;
+	for (transpose = 0; transpose < 4; transpose++)
+	{
+		ccv_dense_matrix_t* a = (transpose & CCV_A_TRANSPOSE) ? ccv_dense_matrix_new(k, m, CCV_32F | CCV_C1, 0, 0) : ccv_dense_matrix_new(m, k, CCV_32F | CCV_C1, 0, 0);
+		ccv_dense_matrix_t* b = (transpose & CCV_B_TRANSPOSE) ? ccv_dense_matrix_new(n, k, CCV_32F | CCV_C1, 0, 0) : ccv_dense_matrix_new(k, n, CCV_32F | CCV_C1, 0, 0);
+		int i;
+		for (i = 0; i < m * k; i++)
+			a->data.f32[i] = (float)((i * 7) % 13) / 13 - 0.5;
+		for (i = 0; i < k * n; i++)
+			b->data.f32[i] = (float)((i * 5) % 11) / 11 - 0.5;
+		ccv_dense_matrix_t* ha = 0;
+		ccv_shift(a, (ccv_matrix_t**)&ha, CCV_16F, 0, 0);
+		ccv_dense_matrix_t* hb = 0;
+		ccv_shift(b, (ccv_matrix_t**)&hb, CCV_16BF, 0, 0);
+		// the same values in float
+		ccv_dense_matrix_t* fa = 0;
+		ccv_shift(ha, (ccv_matrix_t**)&fa, CCV_32F, 0, 0);
+		ccv_dense_matrix_t* fb = 0;
+		ccv_shift(hb, (ccv_matrix_t**)&fb, CCV_32F, 0, 0);
+		ccv_dense_matrix_t* d = 0;
+		ccv_gemm(ha, hb, 1, 0, 0, transpose, (ccv_matrix_t**)&d, 0);
+		REQUIRE_EQ(CCV_32F, CCV_GET_DATA_TYPE(d->type), "half precision multiplies into float");
+		ccv_dense_matrix_t* e = 0;
+		ccv_gemm(fa, fb, 1, 0, 0, transpose, (ccv_matrix_t**)&e, 0);
+		REQUIRE_ARRAY_EQ(float, e->data.f32, d->data.f32, m * n, "gemm of half precision should match the one of the same values in float for transpose %d", transpose);
+		ccv_matrix_free(d);
+		d = 0;
+		ccv_gemm(ha, fb, 1, 0, 0, transpose, (ccv_matrix_t**)&d, 0);
+		REQUIRE_ARRAY_EQ(float, e->data.f32, d->data.f32, m * n, "gemm of half precision and float should match too for transpose %d", transpose);
+		ccv_matrix_free(a);
+		ccv_matrix_free(b);
+		ccv_matrix_free(ha);
+		ccv_matrix_free(hb);
+		ccv_matrix_free(fa);
+		ccv_matrix_free(fb);
+		ccv_matrix_free(d);
+		ccv_matrix_free(e);
+	}
+}
+
+TEST_CASE("matrix multiplication at every SIMD level")
+{
+	ccv_dense_matrix_t* a = ccv_dense_matrix_new(37, 45, CCV_64F | CCV_C1, 0, 0);
+	ccv_dense_matrix_t* b = ccv_dense_matrix_new(45, 29, CCV_64F | CCV_C1, 0, 0);
+	int i, level;
+	for (i = 0; i < 37 * 45; i++)
+		a->data.f64[i] = (double)((i * 7) % 13) / 13 - 0.5;
+	for (i = 0; i < 45 * 29; i++)
+		b->data.f64[i] = (double)((i * 5) % 11) / 11 - 0.5;
+	ccv_set_simd_level(CCV_SIMD_NONE);
+	REQUIRE_EQ(CCV_SIMD_NONE, ccv_get_simd_level(), "SIMD level should be lowered");
+	ccv_dense_matrix_t* y = 0;
+	ccv_gemm(a, b, 1, 0, 0, 0, (ccv_matrix_t**)&y, 0);
+	for (level = CCV_SIMD_SSE2; level < CCV_SIMD_LEVEL_NUM; level++)
+	{
+		ccv_set_simd_level(level);
+		REQUIRE(ccv_get_simd_level() <= level, "SIMD level should never be raised beyond the given one");
+		ccv_dense_matrix_t* z = 0;
+		ccv_gemm(a, b, 1, 0, 0, 0, (ccv_matrix_t**)&z, 0);
+		REQUIRE_ARRAY_EQ_WITH_TOLERANCE(double, y->data.f64, z->data.f64, 37 * 29, 1e-10, "gemm at level %d should match the one without SIMD", level);
+		ccv_matrix_free(z);
+	}
+	ccv_set_simd_level(-1);
+	ccv_matrix_free(a);
+	ccv_matrix_free(b);
+	ccv_matrix_free(y);
+}
+
 TEST_CASE("matrix addition")
 {
 	ccv_dense_matrix_t* a = ccv_dense_matrix_new(3, 2, CCV_64F | CCV_C1, 0, 0);
@@ -51,6 +158,59 @@ TEST_CASE("matrix addition")
 	ccv_matrix_free(y);
 }
 
+TEST_CASE("same type element-wise operations saturate and work in place")
+{
+	ccv_dense_matrix_t* a = ccv_dense_matrix_new(2, 37, CCV_8U | CCV_C1, 0, 0);
+	ccv_dense_matrix_t* b = ccv_dense_matrix_new(2, 37, CCV_8U | CCV_C1, 0, 0);
+	int i, j;
+	for (i = 0; i < 2; i++)
+		for (j = 0; j < 37; j++)
+			a->data.u8[i * a->step + j] = (i * 37 + j) * 7, b->data.u8[i * b->step + j] = 255 - (i * 37 + j) * 3;
+	ccv_dense_matrix_t* sum = 0;
+	ccv_add(a, b, (ccv_matrix_t**)&sum, CCV_8U);
+	ccv_dense_matrix_t* diff = 0;
+	ccv_subtract(a, b, (ccv_matrix_t**)&diff, CCV_8U);
+	ccv_dense_matrix_t* prod = 0;
+	ccv_multiply(a, b, (ccv_matrix_t**)&prod, CCV_8U);
+	uint8_t hsum[2 * 37], hdiff[2 * 37], hprod[2 * 37];
+	for (i = 0; i < 2; i++)
+		for (j = 0; j < 37; j++)
+		{
+			int x = a->data.u8[i * a->step + j], y = b->data.u8[i * b->step + j];
+			hsum[i * 37 + j] = ccv_min(x + y, 255);
+			hdiff[i * 37 + j] = ccv_max(x - y, 0);
+			hprod[i * 37 + j] = ccv_min(x * y, 255);
+		}
+	for (i = 0; i < 2; i++)
+	{
+		REQUIRE_ARRAY_EQ(uint8_t, hsum + i * 37, sum->data.u8 + i * sum->step, 37, "8U addition should saturate");
+		REQUIRE_ARRAY_EQ(uint8_t, hdiff + i * 37, diff->data.u8 + i * diff->step, 37, "8U subtraction should saturate");
+		REQUIRE_ARRAY_EQ(uint8_t, hprod + i * 37, prod->data.u8 + i * prod->step, 37, "8U multiplication should saturate");
+	}
+	ccv_matrix_free(a);
+	ccv_matrix_free(b);
+	ccv_matrix_free(sum);
+	ccv_matrix_free(diff);
+	ccv_matrix_free(prod);
+	ccv_dense_matrix_t* x = ccv_dense_matrix_new(3, 11, CCV_32F | CCV_C1, 0, 0);
+	ccv_dense_matrix_t* y = ccv_dense_matrix_new(3, 11, CCV_32F | CCV_C1, 0, 0);
+	float hx[3 * 11];
+	for (i = 0; i < 3 * 11; i++)
+	{
+		x->data.f32[i] = i * 0.5;
+		y->data.f32[i] = 1 - i * 0.25;
+		hx[i] = (x->data.f32[i] + y->data.f32[i]) * 3;
+	}
+	ccv_dense_matrix_t* z = x;
+	ccv_add(x, y, (ccv_matrix_t**)&z, 0);
+	REQUIRE(z == x, "in place addition should keep the output matrix");
+	ccv_scale(x, (ccv_matrix_t**)&z, 0, 3);
+	REQUIRE(z == x, "in place scale should keep the output matrix");
+	REQUIRE_ARRAY_EQ_WITH_TOLERANCE(float, hx, x->data.f32, 3 * 11, 1e-5, "in place 32F addition and scale failure");
+	ccv_matrix_free(x);
+	ccv_matrix_free(y);
+}
+
 TEST_CASE("matrix scale with overflow")
 {
 	ccv_dense_matrix_t* a = ccv_dense_matrix_new(1, 4, CCV_8U | CCV_C1, 0, 0);
@@ -97,6 +257,43 @@ TEST_CASE("vector sum")
 	REQUIRE_EQ_WITH_TOLERANCE(sum, 1.02, 1e-6, "3x2 vector sum failure");
 }
 
+TEST_CASE("matrix statistics, norm and dot product in one pass")
+{
+	ccv_dense_matrix_t* a = ccv_dense_matrix_new(3, 301, CCV_8U | CCV_C1, 0, 0);
+	ccv_dense_matrix_t* b = ccv_dense_matrix_new(3, 301, CCV_32F | CCV_C1, 0, 0);
+	ccv_dense_matrix_t* c = ccv_dense_matrix_new(3, 301, CCV_32F | CCV_C1, 0, 0);
+	int i, j;
+	double sum = 0, sumsq = 0, l1 = 0, fmin = DBL_MAX, fmax = -DBL_MAX, dot = 0;
+	int umin = 255, umax = 0, usum = 0, usumsq = 0;
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 301; j++)
+		{
+			int u = a->data.u8[i * a->step + j] = (i * 301 + j) * 37 % 251 + 2;
+			usum += u, usumsq += u * u;
+			umin = ccv_min(umin, u), umax = ccv_max(umax, u);
+			float x = b->data.f32[i * 301 + j] = sinf(i * 301 + j) * 10;
+			float y = c->data.f32[i * 301 + j] = cosf(i * 301 + j);
+			sum += x, sumsq += (double)x * x, l1 += fabs(x);
+			fmin = ccv_min(fmin, x), fmax = ccv_max(fmax, x);
+			dot += (double)x * y;
+		}
+	ccv_matrix_stat_t stat;
+	ccv_stat(a, &stat);
+	REQUIRE_EQ(stat.count, 3 * 301, "8U element count");
+	REQUIRE(stat.sum == usum && stat.l1 == usum && stat.sumsq == usumsq, "8U sums should be exact");
+	REQUIRE(stat.min == umin && stat.max == umax, "8U min and max");
+	ccv_stat(b, &stat);
+	REQUIRE_EQ_WITH_TOLERANCE(stat.sum, sum, 1e-8, "32F sum");
+	REQUIRE_EQ_WITH_TOLERANCE(stat.sumsq, sumsq, 1e-8, "32F sum of squares");
+	REQUIRE_EQ_WITH_TOLERANCE(stat.l1, l1, 1e-8, "32F sum of absolute values");
+	REQUIRE(stat.min == fmin && stat.max == fmax, "32F min and max");
+	REQUIRE_EQ_WITH_TOLERANCE(ccv_norm(b, CCV_L2_NORM), sqrt(sumsq), 1e-8, "32F L2 norm");
+	REQUIRE_EQ_WITH_TOLERANCE(ccv_dot(b, c), dot, 1e-8, "32F dot product");
+	ccv_matrix_free(a);
+	ccv_matrix_free(b);
+	ccv_matrix_free(c);
+}
+
 TEST_CASE("vector L2 normalize")
 {
 	int i;
@@ -164,4 +361,88 @@ TEST_CASE("summed area table with padding")
 	ccv_matrix_free(b);
 }
 
+TEST_CASE("summed area table from wider type to narrower type")
+{
+	int i, j;
+	ccv_dense_matrix_t* dmt = ccv_dense_matrix_new(3, 4, CCV_32S | CCV_C1, 0, 0);
+	for (i = 0; i < dmt->rows; i++)
+		for (j = 0; j < dmt->cols; j++)
+			dmt->data.i32[i * dmt->cols + j] = 1;
+	ccv_dense_matrix_t* b = 0;
+	ccv_sat(dmt, &b, CCV_8U, CCV_NO_PADDING);
+	unsigned char sat[12] = { 1, 2, 3,  4,
+							  2, 4, 6,  8,
+							  3, 6, 9, 12 };
+	for (i = 0; i < 3; i++)
+		REQUIRE_ARRAY_EQ(unsigned char, sat + i * 4, b->data.u8 + i * b->step, 4, "32S to 8U summed area table shouldn't take the 8U to 32S path");
+	ccv_matrix_free(dmt);
+	ccv_matrix_free(b);
+}
+
+TEST_CASE("summed area table of many channels and rows, with squares")
+{
+	static const int chs[] = {1, 2, 3, 8, 10};
+	int c, i, j, k;
+	for (c = 0; c < sizeof(chs) / sizeof(chs[0]); c++)
+	{
+		int ch = chs[c];
+		ccv_dense_matrix_t* a = ccv_dense_matrix_new(71, 37, CCV_8U | ch, 0, 0);
+		for (i = 0; i < a->rows; i++)
+			for (j = 0; j < a->cols * ch; j++)
+				a->data.u8[i * a->step + j] = (i * 131 + j * 17) % 256;
+		ccv_dense_matrix_t* b = 0;
+		ccv_sat(a, &b, 0, CCV_PADDING_ZERO);
+		ccv_dense_matrix_t* s = 0;
+		ccv_dense_matrix_t* sq = 0;
+		ccv_sat_square(a, &s, &sq, CCV_NO_PADDING);
+		REQUIRE(CCV_GET_DATA_TYPE(b->type) == CCV_32S && CCV_GET_DATA_TYPE(s->type) == CCV_32S && CCV_GET_DATA_TYPE(sq->type) == CCV_64S, "8U summed area tables should be 32S and 64S");
+		int* sum = (int*)ccmalloc(sizeof(int) * a->cols * ch);
+		int64_t* sumsq = (int64_t*)ccmalloc(sizeof(int64_t) * a->cols * ch);
+		memset(sum, 0, sizeof(int) * a->cols * ch);
+		memset(sumsq, 0, sizeof(int64_t) * a->cols * ch);
+		int fail = 0;
+		for (i = 0; i < a->rows; i++)
+		{
+			int row[10] = {0};
+			int64_t rowsq[10] = {0};
+			for (j = 0; j < a->cols; j++)
+				for (k = 0; k < ch; k++)
+				{
+					int x = a->data.u8[i * a->step + j * ch + k];
+					row[k] += x;
+					rowsq[k] += x * x;
+					sum[j * ch + k] += row[k];
+					sumsq[j * ch + k] += rowsq[k];
+					if (b->data.i32[(i + 1) * b->cols * ch + (j + 1) * ch + k] != sum[j * ch + k] ||
+						s->data.i32[i * s->cols * ch + j * ch + k] != sum[j * ch + k] ||
+						sq->data.i64[i * sq->cols * ch + j * ch + k] != sumsq[j * ch + k])
+						++fail;
+				}
+		}
+		for (j = 0; j < b->cols * ch; j++)
+			fail += (b->data.i32[j] != 0);
+		for (i = 0; i < b->rows; i++)
+			for (k = 0; k < ch; k++)
+				fail += (b->data.i32[i * b->cols * ch + k] != 0);
+		REQUIRE_EQ(fail, 0, "summed area table of %d channels mismatches", ch);
+		ccfree(sum);
+		ccfree(sumsq);
+		ccv_matrix_free(a);
+		ccv_matrix_free(b);
+		ccv_matrix_free(s);
+		ccv_matrix_free(sq);
+	}
+	ccv_dense_matrix_t* a = ccv_dense_matrix_new(67, 9, CCV_32F | CCV_C1, 0, 0);
+	for (i = 0; i < a->rows * a->cols; i++)
+		a->data.f32[i] = (i % 7) * 0.5;
+	ccv_dense_matrix_t* b = 0;
+	ccv_sat(a, &b, 0, CCV_NO_PADDING);
+	double sum = 0;
+	for (i = 0; i < a->rows * a->cols; i++)
+		sum += a->data.f32[i];
+	REQUIRE_EQ_WITH_TOLERANCE(b->data.f32[a->rows * a->cols - 1], sum, 1e-3, "32F summed area table should sum up every element at the bottom right");
+	ccv_matrix_free(a);
+	ccv_matrix_free(b);
+}
+
 #include "case_main.h"
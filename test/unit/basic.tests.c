@@ -41,6 +41,51 @@ TEST_CASE("sobel operation")
 	ccv_matrix_free(y5);
 }
 
+TEST_CASE("gradient operation agrees with sobel operation")
+{
+	ccv_dense_matrix_t* image = 0;
+	ccv_read("../../samples/nature.png", &image, CCV_IO_ANY_FILE);
+	ccv_dense_matrix_t* theta = 0;
+	ccv_dense_matrix_t* m = 0;
+	ccv_gradient(image, &theta, 0, &m, 0, 1, 1);
+	ccv_dense_matrix_t* dx = 0;
+	ccv_dense_matrix_t* dy = 0;
+	ccv_sobel(image, &dx, CCV_32F, 1, 0);
+	ccv_sobel(image, &dy, CCV_32F, 0, 1);
+	ccv_dense_matrix_t* bins = 0;
+	ccv_gradient_bins(image, &bins, 18);
+	int i, j, k, ch = CCV_GET_CHANNEL(image->type);
+	double terr = 0, merr = 0, berr = 0;
+	for (i = 0; i < image->rows; i++)
+		for (j = 0; j < image->cols; j++)
+		{
+			int d = 0;
+			for (k = 0; k < ch; k++)
+			{
+				float x = dx->data.f32[(i * image->cols + j) * ch + k];
+				float y = dy->data.f32[(i * image->cols + j) * ch + k];
+				double angle = atan2(y, x) * 180 / CCV_PI;
+				double t = fabs(theta->data.f32[(i * image->cols + j) * ch + k] - (angle < 0 ? angle + 360 : angle));
+				if (x * x + y * y > 0)
+					terr = ccv_max(terr, ccv_min(t, 360 - t));
+				merr = ccv_max(merr, fabs(m->data.f32[(i * image->cols + j) * ch + k] - sqrt(x * x + y * y)));
+				if (m->data.f32[(i * image->cols + j) * ch + k] > m->data.f32[(i * image->cols + j) * ch + d])
+					d = k;
+			}
+			berr = ccv_max(berr, fabs(bins->data.f32[(i * image->cols + j) * 2] - ccv_clamp(theta->data.f32[(i * image->cols + j) * ch + d], 0, 359.99) / 20));
+			berr = ccv_max(berr, fabs(bins->data.f32[(i * image->cols + j) * 2 + 1] - m->data.f32[(i * image->cols + j) * ch + d]));
+		}
+	REQUIRE(terr < 0.5, "angle should be within 0.5 degree to the one from sobel, it is %lf", terr);
+	REQUIRE(merr < 1e-3, "magnitude should be the one from sobel, it is %lf", merr);
+	REQUIRE(berr < 1e-3, "bins should be the angle and the magnitude of the strongest channel, it is %lf", berr);
+	ccv_matrix_free(image);
+	ccv_matrix_free(theta);
+	ccv_matrix_free(m);
+	ccv_matrix_free(dx);
+	ccv_matrix_free(dy);
+	ccv_matrix_free(bins);
+}
+
 TEST_CASE("resample operation of CCV_INTER_AREA")
 {
 	ccv_dense_matrix_t* image = 0;
@@ -52,6 +97,63 @@ TEST_CASE("resample operation of CCV_INTER_AREA")
 	ccv_matrix_free(x);
 }
 
+TEST_CASE("resample operation of CCV_INTER_AREA with more than 4 channels")
+{
+	ccv_dense_matrix_t* image = ccv_dense_matrix_new(40, 40, CCV_32F | 6, 0, 0);
+	int i, j, k;
+	for (i = 0; i < 40 * 40 * 6; i++)
+		image->data.f32[i] = (i * 37) % 101;
+	ccv_dense_matrix_t* x = 0;
+	ccv_resample(image, &x, 0, 20, 20, CCV_INTER_AREA);
+	for (k = 0; k < 6; k++)
+	{
+		ccv_dense_matrix_t* channel = ccv_dense_matrix_new(40, 40, CCV_32F | CCV_C1, 0, 0);
+		for (i = 0; i < 40 * 40; i++)
+			channel->data.f32[i] = image->data.f32[i * 6 + k];
+		ccv_dense_matrix_t* y = 0;
+		ccv_resample(channel, &y, 0, 20, 20, CCV_INTER_AREA);
+		for (i = 0; i < 20; i++)
+			for (j = 0; j < 20; j++)
+				REQUIRE_EQ(x->data.f32[(i * 20 + j) * 6 + k], y->data.f32[i * 20 + j], "channel %d at (%d, %d) should be resampled as a single channel one", k, j, i);
+		ccv_matrix_free(channel);
+		ccv_matrix_free(y);
+	}
+	ccv_matrix_free(image);
+	ccv_matrix_free(x);
+}
+
+TEST_CASE("resample operation with a plan reused across images")
+{
+	ccv_dense_matrix_t* image = 0;
+	ccv_read("../../samples/nature.png", &image, CCV_IO_ANY_FILE);
+	ccv_dense_matrix_t* flipped = 0;
+	ccv_flip(image, &flipped, 0, CCV_FLIP_X);
+	ccv_resample_plan_t* area = ccv_resample_plan_new(image->rows, image->cols, image->rows * 3 / 7, image->cols * 3 / 7, CCV_INTER_AREA);
+	ccv_resample_plan_t* cubic = ccv_resample_plan_new(image->rows, image->cols, image->rows * 5 / 3, image->cols * 5 / 3, CCV_INTER_CUBIC);
+	int i;
+	for (i = 0; i < 2; i++)
+	{
+		ccv_dense_matrix_t* source = i == 0 ? image : flipped;
+		ccv_dense_matrix_t* x = 0;
+		ccv_dense_matrix_t* y = 0;
+		ccv_resample(source, &x, 0, area->brows, area->bcols, CCV_INTER_AREA);
+		ccv_resample_with_plan(source, &y, 0, area);
+		REQUIRE_MATRIX_EQ(x, y, "area resample with a plan should be identical to the one without");
+		ccv_matrix_free(x);
+		ccv_matrix_free(y);
+		x = y = 0;
+		ccv_resample(source, &x, CCV_32F, cubic->brows, cubic->bcols, CCV_INTER_CUBIC);
+		ccv_resample_with_plan(source, &y, CCV_32F, cubic);
+		REQUIRE_MATRIX_EQ(x, y, "cubic resample with a plan should be identical to the one without");
+		ccv_matrix_free(x);
+		ccv_matrix_free(y);
+	}
+	ccv_resample_plan_free(area);
+	ccv_resample_plan_free(cubic);
+	ccv_matrix_free(image);
+	ccv_matrix_free(flipped);
+}
+
 TEST_CASE("sample down operation with source offset (10, 10)")
 {
 	ccv_dense_matrix_t* image = 0;
@@ -63,6 +165,39 @@ TEST_CASE("sample down operation with source offset (10, 10)")
 	ccv_matrix_free(x);
 }
 
+TEST_CASE("sample down by octaves in one pass is identical to chained sample down")
+{
+	ccv_dense_matrix_t* image = 0;
+	ccv_read("../../samples/chessbox.png", &image, CCV_IO_ANY_FILE);
+	ccv_dense_matrix_t* gray = 0;
+	ccv_read("../../samples/chessbox.png", &gray, CCV_IO_GRAY | CCV_IO_ANY_FILE);
+	ccv_dense_matrix_t* fgray = 0;
+	ccv_shift((ccv_matrix_t*)gray, (ccv_matrix_t**)&fgray, CCV_32F, 0, 0);
+	ccv_dense_matrix_t* sources[] = { image, gray, fgray };
+	int i, j;
+	for (i = 0; i < 3; i++)
+	{
+		ccv_dense_matrix_t* x[5] = {0};
+		ccv_sample_down_octaves(sources[i], x, 0, 5);
+		ccv_dense_matrix_t* y = 0;
+		ccv_sample_down(sources[i], &y, 0, 0, 0);
+		for (j = 0; j < 5; j++)
+		{
+			REQUIRE_MATRIX_EQ(x[j], y, "octave %d should be the same as sampled down %d times", j, j + 1);
+			ccv_dense_matrix_t* z = 0;
+			ccv_sample_down(y, &z, 0, 0, 0);
+			ccv_matrix_free(y);
+			y = z;
+		}
+		ccv_matrix_free(y);
+		for (j = 0; j < 5; j++)
+			ccv_matrix_free(x[j]);
+	}
+	ccv_matrix_free(image);
+	ccv_matrix_free(gray);
+	ccv_matrix_free(fgray);
+}
+
 TEST_CASE("sample up operation with source offset (10, 10)")
 {
 	ccv_dense_matrix_t* image = 0;
@@ -74,6 +209,38 @@ TEST_CASE("sample up operation with source offset (10, 10)")
 	ccv_matrix_free(x);
 }
 
+TEST_CASE("pyramid levels are resampled then sampled down by octave")
+{
+	ccv_dense_matrix_t* image = 0;
+	ccv_read("../../samples/chessbox.png", &image, CCV_IO_ANY_FILE);
+	ccv_pyramid_t* pyramid = ccv_pyramid_new(image, 2);
+	REQUIRE(ccv_pyramid_level(pyramid, 0) == image, "the base of the pyramid should be the image itself");
+	ccv_dense_matrix_t* x = 0;
+	ccv_resample(image, &x, 0, (int)(image->rows / pow(pyramid->scale, 2)), (int)(image->cols / pow(pyramid->scale, 2)), CCV_INTER_AREA);
+	REQUIRE_MATRIX_EQ(ccv_pyramid_level(pyramid, 2), x, "level 2 should be resampled from the base");
+	ccv_dense_matrix_t* y = 0;
+	ccv_sample_down(x, &y, 0, 0, 0);
+	REQUIRE_MATRIX_EQ(ccv_pyramid_level(pyramid, 5), y, "level 5 should be sampled down from level 2");
+	REQUIRE(pyramid->levels[8 * 4] == 0, "level 8 shouldn't be built before it is asked for");
+	ccv_matrix_free(y);
+	y = 0;
+	ccv_sample_down(x, &y, 0, 1, 1);
+	REQUIRE_MATRIX_EQ(ccv_pyramid_level_with_offset(pyramid, 5, 1, 1), y, "level 5 with offset should be sampled down from level 2 with offset");
+	ccv_dense_matrix_t* last = ccv_pyramid_level(pyramid, pyramid->count - 1);
+	REQUIRE(last->rows >= 1 && last->cols >= 1, "the last level should be at least 1x1");
+	ccv_dense_matrix_t* above = ccv_pyramid_level(pyramid, pyramid->count - 4);
+	REQUIRE(above->rows >= 2 && above->cols >= 3, "the last level should be sampled down from at least 3 columns and 2 rows");
+	above = ccv_pyramid_level(pyramid, pyramid->count - 3);
+	REQUIRE(above->rows < 2 || above->cols < 3, "the level after the last would be sampled down from less than 3 columns or 2 rows");
+	ccv_matrix_retain(last);
+	ccv_pyramid_free(pyramid);
+	REQUIRE(last->rows >= 1 && last->refcount == 1, "a retained level should outlive the pyramid");
+	ccv_matrix_free(last);
+	ccv_matrix_free(x);
+	ccv_matrix_free(y);
+	ccv_matrix_free(image);
+}
+
 TEST_CASE("blur operation with sigma 10")
 {
 	ccv_dense_matrix_t* image = 0;
@@ -85,6 +252,37 @@ TEST_CASE("blur operation with sigma 10")
 	ccv_matrix_free(x);
 }
 
+TEST_CASE("recursive blur operation approximates Gaussian filter")
+{
+	ccv_dense_matrix_t* image = 0;
+	ccv_read("../../samples/nature.png", &image, CCV_IO_ANY_FILE);
+	ccv_dense_matrix_t* x = 0;
+	ccv_blur(image, &x, CCV_32F, 3.2);
+	ccv_dense_matrix_t* y = 0;
+	ccv_blur_with_mode(image, &y, CCV_32F, 3.2, CCV_BLUR_RECURSIVE);
+	REQUIRE(CCV_GET_DATA_TYPE(y->type) == CCV_32F && CCV_GET_CHANNEL(y->type) == CCV_C3, "the output should be 32F with the input channels");
+	int i;
+	double err = 0;
+	for (i = 0; i < x->rows * x->cols * 3; i++)
+		err += fabs(x->data.f32[i] - y->data.f32[i]);
+	err /= x->rows * x->cols * 3;
+	REQUIRE(err < 1, "recursive blur should be within 1 on average to the Gaussian filter, it is %lf", err);
+	ccv_matrix_free(image);
+	ccv_matrix_free(x);
+	ccv_matrix_free(y);
+	ccv_dense_matrix_t* flat = ccv_dense_matrix_new(37, 53, CCV_32F | CCV_C1, 0, 0);
+	for (i = 0; i < 37 * 53; i++)
+		flat->data.f32[i] = 100;
+	ccv_dense_matrix_t* z = 0;
+	ccv_blur_with_mode(flat, &z, 0, 5, CCV_BLUR_RECURSIVE);
+	for (i = 0; i < 37 * 53; i++)
+		if (fabsf(z->data.f32[i] - 100) > 1e-3)
+			break;
+	REQUIRE_EQ(i, 37 * 53, "recursive blur should keep a constant image constant, up to the boundary");
+	ccv_matrix_free(flat);
+	ccv_matrix_free(z);
+}
+
 TEST_CASE("flip operation")
 {
 	ccv_dense_matrix_t* image = 0;
@@ -1,6 +1,9 @@
 #include "ccv.h"
 #include "ccv_internal.h"
 #include "case.h"
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 uint64_t uniqid()
 {
@@ -71,6 +74,33 @@ TEST_CASE("random cache put/delete/get")
 	ccfree(sigs);
 }
 
+TEST_CASE("cache evicts least recently put objects in batch")
+{
+	ccv_cache_t cache;
+	ccv_cache_init(&cache, 100, 1, ccfree);
+	ccv_cache_set_watermark(&cache, 60);
+	uint64_t sigs[101];
+	int i;
+	for (i = 0; i < 100; i++)
+	{
+		sigs[i] = uniqid();
+		ccv_cache_put(&cache, sigs[i], ccmalloc(1), 1, 0);
+	}
+	// put the first one again, it is now the most recently put
+	ccv_cache_put(&cache, sigs[0], ccmalloc(1), 1, 0);
+	REQUIRE_EQ(100, cache.size, "cache should be full");
+	sigs[100] = uniqid();
+	ccv_cache_put(&cache, sigs[100], ccmalloc(1), 1, 0);
+	REQUIRE_EQ(60, cache.size, "cache should be evicted to the low watermark");
+	REQUIRE(ccv_cache_get(&cache, sigs[0], 0) != 0, "the most recently put one should stay");
+	REQUIRE(ccv_cache_get(&cache, sigs[1], 0) == 0, "the least recently put one should be evicted");
+	REQUIRE(ccv_cache_get(&cache, sigs[42], 0) != 0, "the recent ones should stay");
+	REQUIRE_EQ(20, ccv_cache_evict(&cache, 60), "should evict until 60 bytes free");
+	REQUIRE_EQ(40, cache.size, "cache should have 40 bytes left");
+	REQUIRE(ccv_cache_get(&cache, sigs[100], 0) != 0, "the last put one should stay");
+	ccv_cache_close(&cache);
+}
+
 TEST_CASE("garbage collector 95\% hit rate")
 {
 	int i;
@@ -173,4 +203,373 @@ TEST_CASE("multi-type garbage collector 92\% hit rate")
 	ccv_disable_cache();
 }
 
+TEST_CASE("matrix pool reuses freed matrices")
+{
+	ccv_enable_matrix_pool(1024 * 1024);
+	ccv_dense_matrix_t* a = ccv_dense_matrix_new(100, 100, CCV_8U | CCV_C1, 0, 0);
+	REQUIRE(a->type & CCV_POOLED, "matrix should be allocated from pool");
+	REQUIRE_EQ(0, (uintptr_t)a->data.u8 & 0xf, "matrix data should be 16-byte aligned");
+	ccv_matrix_free(a);
+	ccv_dense_matrix_t* b = ccv_dense_matrix_new(100, 100, CCV_8U | CCV_C1, 0, 0);
+	REQUIRE_EQ((uintptr_t)a, (uintptr_t)b, "same-sized matrix should reuse the freed one");
+	ccv_dense_matrix_t* c = ccv_dense_matrix_new(98, 101, CCV_8U | CCV_C1, 0, 0);
+	REQUIRE(c != a, "the freed one is in use");
+	ccv_matrix_free(c);
+	ccv_dense_matrix_t* d = ccv_dense_matrix_new(99, 100, CCV_8U | CCV_C1, 0, 0);
+	REQUIRE_EQ((uintptr_t)c, (uintptr_t)d, "matrix of the same size class should reuse the freed one");
+	ccv_matrix_free(b);
+	ccv_matrix_free(d);
+	ccv_dense_matrix_t* e = ccv_dense_matrix_new(1024, 1024, CCV_8U | CCV_C1, 0, 0);
+	ccv_matrix_free(e); // this is larger than the pool, should be freed
+	ccv_disable_matrix_pool();
+	ccv_dense_matrix_t* f = ccv_dense_matrix_new(100, 100, CCV_8U | CCV_C1, 0, 0);
+	REQUIRE(!(f->type & CCV_POOLED), "matrix shouldn't be allocated from disabled pool");
+	ccv_matrix_free(f);
+}
+
+TEST_CASE("arena scope releases matrices and arrays at once")
+{
+	ccv_arena_t* arena = ccv_arena_new(4096);
+	ccv_arena_push(arena);
+	ccv_dense_matrix_t* a = ccv_dense_matrix_new(10, 10, CCV_32F | CCV_C1, 0, 0);
+	REQUIRE(a->type & CCV_ARENA, "matrix should be allocated from arena");
+	ccv_matrix_free(a); // no-op
+	ccv_array_t* array = ccv_array_new(sizeof(int), 2, 0);
+	REQUIRE(array->type & CCV_ARENA, "array should be allocated from arena");
+	int i;
+	for (i = 0; i < 2000; i++) // grows out of the first block
+		ccv_array_push(array, &i);
+	for (i = 0; i < 2000; i++)
+		if (*(int*)ccv_array_get(array, i) != i)
+			break;
+	REQUIRE_EQ(2000, i, "array should keep its content when grows in arena");
+	ccv_arena_push(arena);
+	ccv_dense_matrix_t* b = ccv_dense_matrix_new(10, 10, CCV_32F | CCV_C1, 0, 0);
+	ccv_arena_pop(arena);
+	ccv_arena_push(arena);
+	ccv_dense_matrix_t* c = ccv_dense_matrix_new(10, 10, CCV_32F | CCV_C1, 0, 0);
+	REQUIRE_EQ((uintptr_t)b, (uintptr_t)c, "matrix should reuse the memory of the popped scope");
+	ccv_arena_pop(arena);
+	ccv_array_free(array); // no-op
+	ccv_arena_pop(arena);
+	ccv_dense_matrix_t* d = ccv_dense_matrix_new(10, 10, CCV_32F | CCV_C1, 0, 0);
+	REQUIRE(!(d->type & CCV_ARENA), "matrix shouldn't be allocated from arena out of scope");
+	ccv_matrix_free(d);
+	ccv_arena_push(arena);
+	ccv_dense_matrix_t* e = ccv_dense_matrix_new(10, 10, CCV_32F | CCV_C1, 0, 0);
+	REQUIRE_EQ((uintptr_t)a, (uintptr_t)e, "arena should be reset by pop");
+	ccv_arena_pop(arena);
+	ccv_arena_free(arena);
+}
+
+TEST_CASE("aligned dense matrix layout")
+{
+	ccv_dense_matrix_t* a = ccv_dense_matrix_new(10, 13, CCV_8U | CCV_C3 | CCV_ALIGNED, 0, 0);
+	REQUIRE(a->type & CCV_ALIGNED, "matrix should be aligned");
+	REQUIRE_EQ(0, (uintptr_t)a->data.u8 & (CCV_MATRIX_ALIGNMENT - 1), "matrix data should be 64-byte aligned");
+	REQUIRE_EQ(64, a->step, "matrix step should be padded to 64 bytes");
+	int i, j;
+	for (i = 0; i < a->rows; i++)
+		for (j = 0; j < a->cols * 3; j++)
+			a->data.u8[i * a->step + j] = i * 39 + j;
+	ccv_dense_matrix_t* b = 0;
+	ccv_slice(a, (ccv_matrix_t**)&b, 0, 2, 3, 5, 7);
+	REQUIRE_EQ(2 * 39 + 9, b->data.u8[0], "slice of aligned matrix should honor its step");
+	REQUIRE_EQ((6 * 39 + 9 + 20) & 0xff, b->data.u8[4 * b->step + 20], "slice of aligned matrix should honor its step");
+	ccv_matrix_free(b);
+	ccv_matrix_free(a);
+	ccv_set_matrix_alignment_mode(CCV_MATRIX_ALIGN_DATA);
+	ccv_dense_matrix_t* c = ccv_dense_matrix_new(10, 13, CCV_8U | CCV_C3, 0, 0);
+	REQUIRE_EQ(0, (uintptr_t)c->data.u8 & (CCV_MATRIX_ALIGNMENT - 1), "matrix data should be 64-byte aligned");
+	REQUIRE_EQ(40, c->step, "matrix step should be unchanged");
+	ccv_matrix_free(c);
+	ccv_set_matrix_alignment_mode(CCV_MATRIX_ALIGN_ROWS);
+	ccv_dense_matrix_t* d = ccv_dense_matrix_new(10, 13, CCV_32F | CCV_C1, 0, 0);
+	REQUIRE(d->type & CCV_ALIGNED, "matrix should be aligned in global mode");
+	REQUIRE_EQ(64, d->step, "matrix step should be padded to 64 bytes");
+	ccv_matrix_free(d);
+	ccv_set_matrix_alignment_mode(CCV_MATRIX_ALIGN_NONE);
+}
+
+TEST_CASE("cache stats per type")
+{
+	ccv_enable_cache(ccv_compute_dense_matrix_size(10, 10, CCV_8U | CCV_C1) + sizeof(ccv_array_t) + 8 * sizeof(int));
+	ccv_dense_matrix_t* a = ccv_dense_matrix_new(10, 10, CCV_8U | CCV_C1, 0, 1); // miss
+	ccv_matrix_free(a); // put
+	a = ccv_dense_matrix_new(10, 10, CCV_8U | CCV_C1, 0, 1); // hit
+	ccv_dense_matrix_t* b = ccv_dense_matrix_new(10, 10, CCV_8U | CCV_C1, 0, 2); // miss
+	ccv_matrix_free(a); // put
+	ccv_array_t* c = ccv_array_new(sizeof(int), 8, 3); // miss
+	ccv_array_free(c); // put
+	ccv_matrix_free(b); // put, evict a
+	ccv_cache_stats_t matrix, array, stats;
+	ccv_cache_type_stats(CCV_CACHE_MATRIX, &matrix);
+	ccv_cache_type_stats(CCV_CACHE_ARRAY, &array);
+	REQUIRE_EQ(1, matrix.hit, "should have 1 matrix hit");
+	REQUIRE_EQ(2, matrix.miss, "should have 2 matrix misses");
+	REQUIRE_EQ(3, matrix.put, "should have 3 matrix puts");
+	REQUIRE_EQ(1, matrix.evict, "should have 1 matrix evicted");
+	REQUIRE_EQ(1, matrix.rnum, "should have 1 matrix in cache");
+	REQUIRE_EQ(ccv_compute_dense_matrix_size(10, 10, CCV_8U | CCV_C1), matrix.size, "should have 1 matrix in cache");
+	REQUIRE_EQ(0, array.hit, "should have no array hit");
+	REQUIRE_EQ(1, array.miss, "should have 1 array miss");
+	REQUIRE_EQ(1, array.rnum, "should have 1 array in cache");
+	REQUIRE_EQ(sizeof(ccv_array_t) + 8 * sizeof(int), array.size, "should have 1 array in cache");
+	ccv_cache_stats_reset();
+	ccv_cache_stats(&stats);
+	REQUIRE(stats.hit == 0 && stats.miss == 0 && stats.put == 0 && stats.evict == 0, "counters should be reset");
+	REQUIRE_EQ(2, stats.rnum, "resident objects should be kept");
+	ccv_disable_cache();
+}
+
+TEST_CASE("disk cache spills evicted matrices and faults them back")
+{
+	const char* path = "disk-cache.tmp";
+	ccv_enable_cache(ccv_compute_dense_matrix_size(64, 64, CCV_32F | CCV_C1));
+	REQUIRE_EQ(0, ccv_enable_disk_cache(path, 1024 * 1024), "disk cache should be opened");
+	ccv_dense_matrix_t* a = ccv_dense_matrix_new(64, 64, CCV_32F | CCV_C1, 0, 0x1234);
+	int i;
+	for (i = 0; i < 64 * 64; i++)
+		a->data.f32[i] = i;
+	ccv_matrix_free(a); // put
+	ccv_dense_matrix_t* b = ccv_dense_matrix_new(64, 64, CCV_32F | CCV_C1, 0, 0x5678);
+	ccv_matrix_free(b); // put, evict a to disk
+	ccv_dense_matrix_t* c = ccv_dense_matrix_new(64, 64, CCV_32F | CCV_C1, 0, 0x1234);
+	REQUIRE(c->type & CCV_GARBAGE, "matrix should be found from disk");
+	REQUIRE_EQ(0x1234, c->sig, "matrix should have its signature");
+	for (i = 0; i < 64 * 64; i++)
+		if (c->data.f32[i] != i)
+			break;
+	REQUIRE_EQ(64 * 64, i, "matrix should be the same");
+	ccv_matrix_free(c);
+	// reopen as a new process would do
+	ccv_disable_disk_cache();
+	ccv_disable_cache();
+	ccv_enable_cache(ccv_compute_dense_matrix_size(64, 64, CCV_32F | CCV_C1));
+	REQUIRE_EQ(0, ccv_enable_disk_cache(path, 1024 * 1024), "disk cache should be reopened");
+	ccv_cache_stats_reset();
+	ccv_cache_stats_t stats;
+	ccv_dense_matrix_t* d = ccv_dense_matrix_new(64, 64, CCV_32F | CCV_C1, 0, 0x1234);
+	REQUIRE(d->type & CCV_GARBAGE, "matrix should be found from disk after reopen");
+	REQUIRE_EQ(64 * 64 - 1, d->data.f32[64 * 64 - 1], "matrix should be the same");
+	ccv_matrix_free(d);
+	ccv_cache_stats(&stats);
+	REQUIRE_EQ(0, stats.miss, "matrix found from disk should not be a miss");
+	ccv_dense_matrix_t* e = ccv_dense_matrix_new(64, 64, CCV_32F | CCV_C1, 0, 0x9abc);
+	REQUIRE(!(e->type & CCV_GARBAGE), "matrix never computed should not be found");
+	ccv_cache_stats(&stats);
+	REQUIRE_EQ(1, stats.miss, "matrix found nowhere should be a miss");
+	ccv_matrix_free(e);
+	ccv_disable_disk_cache();
+	ccv_disable_cache();
+	remove(path);
+}
+
+TEST_CASE("shared matrix is copied on write")
+{
+	ccv_dense_matrix_t* a = ccv_dense_matrix_new(3, 5, CCV_8U | CCV_C1, 0, 0);
+	int i;
+	for (i = 0; i < 3 * a->step; i++)
+		a->data.u8[i] = i;
+	ccv_matrix_retain(a);
+	REQUIRE_EQ(2, a->refcount, "matrix should have 2 references");
+	ccv_dense_matrix_t* b = a;
+	b = ccv_dense_matrix_renew(b, 3, 5, CCV_8U | CCV_C1, CCV_8U | CCV_C1, 0);
+	REQUIRE(a != b, "shared matrix shouldn't be written to");
+	REQUIRE_EQ(1, a->refcount, "the reference of the shared matrix should be dropped");
+	REQUIRE_ARRAY_EQ(unsigned char, a->data.u8, b->data.u8, 3 * a->step, "the copy should have the same content");
+	ccv_dense_matrix_t* c = ccv_dense_matrix_renew(b, 3, 5, CCV_8U | CCV_C1, CCV_8U | CCV_C1, 0);
+	REQUIRE(b == c, "private matrix should be written in place");
+	ccv_matrix_free(a);
+	ccv_matrix_free(b);
+}
+
+TEST_CASE("lazy content signature with xxHash")
+{
+	ccv_set_signature_mode(CCV_SIGNATURE_XXHASH | CCV_SIGNATURE_LAZY);
+	ccv_dense_matrix_t* a = ccv_dense_matrix_new(10, 10, CCV_8U | CCV_C1, 0, 0);
+	ccv_dense_matrix_t* b = ccv_dense_matrix_new(10, 10, CCV_8U | CCV_C1, 0, 0);
+	int i, j;
+	for (i = 0; i < 10; i++)
+		for (j = 0; j < 10; j++)
+			a->data.u8[i * a->step + j] = b->data.u8[i * b->step + j] = i * 10 + j;
+	ccv_make_matrix_immutable(a);
+	ccv_make_matrix_immutable(b);
+	REQUIRE(a->sig != 0 && b->sig != 0, "matrices should have signature");
+	REQUIRE(a->sig != b->sig, "without cache, content signature is not computed");
+	REQUIRE(ccv_cache_generate_signature("op", 2, a->sig, CCV_EOF_SIGN) != ccv_cache_generate_signature("op", 2, b->sig, CCV_EOF_SIGN), "without cache, derived signature is not from content");
+	ccv_enable_default_cache();
+	REQUIRE_EQ(ccv_cache_generate_signature("op", 2, a->sig, CCV_EOF_SIGN), ccv_cache_generate_signature("op", 2, b->sig, CCV_EOF_SIGN), "with cache, derived signature is from content");
+	ccv_disable_cache();
+	ccv_matrix_free(a);
+	ccv_matrix_free(b);
+	ccv_set_signature_mode(CCV_SIGNATURE_SHA1);
+}
+
+TEST_CASE("half precision matrix with signature goes into cache")
+{
+	ccv_enable_default_cache();
+	ccv_dense_matrix_t* a = ccv_dense_matrix_new(4, 5, CCV_32F | CCV_C1, 0, 0);
+	int i;
+	for (i = 0; i < 4 * 5; i++)
+		a->data.f32[i] = i * 0.5;
+	ccv_make_matrix_immutable(a);
+	ccv_dense_matrix_t* b = 0;
+	ccv_shift(a, (ccv_matrix_t**)&b, CCV_16F, 0, 0);
+	REQUIRE(b->sig != 0, "half precision output should have derived signature");
+	uint64_t sig = b->sig;
+	ccv_matrix_free(b);
+	ccv_dense_matrix_t* c = 0;
+	ccv_shift(a, (ccv_matrix_t**)&c, CCV_16F, 0, 0);
+	REQUIRE_EQ(c->sig, sig, "the same shift should have the same signature");
+	REQUIRE_EQ(CCV_GET_DATA_TYPE(c->type), CCV_16F, "the matrix from cache should still be half precision");
+	ccv_matrix_free(c);
+	ccv_matrix_free(a);
+	ccv_disable_cache();
+}
+
+TEST_CASE("content signature of a view only covers its elements")
+{
+	ccv_dense_matrix_t* a = ccv_dense_matrix_new(10, 10, CCV_8U | CCV_C1, 0, 0);
+	ccv_dense_matrix_t* b = ccv_dense_matrix_new(4, 5, CCV_8U | CCV_C1, 0, 0);
+	int i, j;
+	for (i = 0; i < 10; i++)
+		for (j = 0; j < 10; j++)
+			a->data.u8[i * a->step + j] = i * 10 + j;
+	for (i = 0; i < 4; i++)
+		for (j = 0; j < 5; j++)
+			b->data.u8[i * b->step + j] = a->data.u8[(i + 2) * a->step + j + 3];
+	ccv_dense_matrix_t* v = ccv_dense_matrix_view(a, 2, 3, 4, 5);
+	ccv_make_matrix_immutable(v);
+	ccv_make_matrix_immutable(b);
+	REQUIRE_EQ(v->sig, b->sig, "a view should have the same content signature as a packed copy");
+	a->data.u8[2 * a->step + 8] = 255; // right outside of the view
+	ccv_dense_matrix_t* w = ccv_dense_matrix_view(a, 2, 3, 4, 5);
+	ccv_make_matrix_immutable(w);
+	REQUIRE_EQ(w->sig, b->sig, "elements outside of the view shouldn't change its signature");
+	ccv_matrix_free(v);
+	ccv_matrix_free(w);
+	ccv_matrix_free(a);
+	ccv_matrix_free(b);
+}
+
+#ifdef HAVE_PTHREAD
+#define TN (4)
+#define TM (100000)
+
+static void* cache_worker(void* context)
+{
+	int i, hit = 0, offset = (int)(intptr_t)context;
+	for (i = offset; i < offset + TM; i++)
+	{
+		ccv_dense_matrix_t* dmt = ccv_dense_matrix_new(1, 1, CCV_32S | CCV_C1, 0, 0);
+		dmt->data.i32[0] = i;
+		dmt->sig = ccv_cache_generate_signature((const char*)&i, 4, CCV_EOF_SIGN);
+		dmt->type |= CCV_REUSABLE;
+		ccv_matrix_free(dmt);
+	}
+	for (i = offset + TM - 1; i >= offset; i--)
+	{
+		uint64_t sig = ccv_cache_generate_signature((const char*)&i, 4, CCV_EOF_SIGN);
+		ccv_dense_matrix_t* dmt = ccv_dense_matrix_new(1, 1, CCV_32S | CCV_C1, 0, sig);
+		if ((dmt->type & CCV_GARBAGE) && i == dmt->data.i32[0])
+			++hit;
+		ccv_matrix_free_immediately(dmt);
+	}
+	return (void*)(intptr_t)hit;
+}
+
+static int run_cache_workers(void)
+{
+	pthread_t threads[TN];
+	int i, hit = 0;
+	for (i = 0; i < TN; i++)
+		pthread_create(threads + i, 0, cache_worker, (void*)(intptr_t)(i * TM));
+	for (i = 0; i < TN; i++)
+	{
+		void* result;
+		pthread_join(threads[i], &result);
+		hit += (int)(intptr_t)result;
+	}
+	return hit;
+}
+
+TEST_CASE("thread-local garbage collector from multiple threads")
+{
+	ccv_enable_cache_with_mode((sizeof(ccv_dense_matrix_t) + 4) * TM * 2, CCV_CACHE_THREAD_LOCAL);
+	int hit = run_cache_workers();
+	REQUIRE_EQ(TN * TM, hit, "every thread should get back all its matrices");
+	ccv_cache_stats_t stats;
+	ccv_cache_stats(&stats);
+	REQUIRE_EQ(TN * TM, stats.hit, "cache stats should count all the hits");
+	REQUIRE_EQ(0, stats.miss, "cache stats should have no miss");
+	ccv_disable_cache();
+}
+
+static pthread_mutex_t stale_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stale_cond = PTHREAD_COND_INITIALIZER;
+static int stale_step = 0;
+
+static void stale_wait(int step)
+{
+	pthread_mutex_lock(&stale_mutex);
+	while (stale_step < step)
+		pthread_cond_wait(&stale_cond, &stale_mutex);
+	pthread_mutex_unlock(&stale_mutex);
+}
+
+static void stale_signal(int step)
+{
+	pthread_mutex_lock(&stale_mutex);
+	stale_step = step;
+	pthread_cond_broadcast(&stale_cond);
+	pthread_mutex_unlock(&stale_mutex);
+}
+
+static void* stale_cache_worker(void* context)
+{
+	int i = 7;
+	uint64_t sig = ccv_cache_generate_signature((const char*)&i, 4, CCV_EOF_SIGN);
+	ccv_dense_matrix_t* dmt = ccv_dense_matrix_new(1, 1, CCV_32S | CCV_C1, 0, 0);
+	dmt->data.i32[0] = i;
+	dmt->sig = sig;
+	dmt->type |= CCV_REUSABLE;
+	ccv_matrix_free(dmt);
+	stale_signal(1);
+	stale_wait(2); // the cache is disabled and enabled again from the main thread
+	dmt = ccv_dense_matrix_new(1, 1, CCV_32S | CCV_C1, 0, sig);
+	int hit = !!(dmt->type & CCV_GARBAGE);
+	ccv_matrix_free_immediately(dmt);
+	return (void*)(intptr_t)hit;
+}
+
+TEST_CASE("thread-local caches are dropped by their own threads after re-enabling")
+{
+	ccv_enable_cache_with_mode(1024 * 1024, CCV_CACHE_THREAD_LOCAL);
+	pthread_t thread;
+	stale_step = 0;
+	pthread_create(&thread, 0, stale_cache_worker, 0);
+	stale_wait(1);
+	ccv_disable_cache();
+	ccv_enable_cache_with_mode(1024 * 1024, CCV_CACHE_THREAD_LOCAL);
+	stale_signal(2);
+	void* result;
+	pthread_join(thread, &result);
+	REQUIRE_EQ(0, (int)(intptr_t)result, "the matrix cached before disabling shouldn't come back");
+	ccv_disable_cache();
+}
+
+TEST_CASE("sharded garbage collector from multiple threads")
+{
+	ccv_enable_cache_with_mode((sizeof(ccv_dense_matrix_t) + 4) * TM * TN * 2, CCV_CACHE_SHARDED);
+	int hit = run_cache_workers();
+	REQUIRE_EQ(TN * TM, hit, "every thread should get back all its matrices");
+	ccv_cache_stats_t stats;
+	ccv_cache_stats(&stats);
+	REQUIRE_EQ(TN * TM, stats.hit, "cache stats should count all the hits");
+	REQUIRE_EQ(0, stats.rnum, "all matrices should be out of cache");
+	ccv_disable_cache();
+}
+#endif
+
 #include "case_main.h"
@@ -9,6 +9,8 @@ TEST_CASE("type size macro")
 	REQUIRE_EQ(CCV_GET_DATA_TYPE_SIZE(CCV_32F), 4, "CCV_32F should have size 4");
 	REQUIRE_EQ(CCV_GET_DATA_TYPE_SIZE(CCV_64S), 8, "CCV_64S should have size 8");
 	REQUIRE_EQ(CCV_GET_DATA_TYPE_SIZE(CCV_64F), 8, "CCV_64F should have size 8");
+	REQUIRE_EQ(CCV_GET_DATA_TYPE_SIZE(CCV_16F), 2, "CCV_16F should have size 2");
+	REQUIRE_EQ(CCV_GET_DATA_TYPE_SIZE(CCV_16BF), 2, "CCV_16BF should have size 2");
 }
 
 TEST_CASE("dynamic array")
@@ -87,6 +89,50 @@ TEST_CASE("group array with is_equal function")
 	ccv_array_free(idx);
 }
 
+int is_near(const void* _r1, const void* _r2, void* data)
+{
+	const ccv_comp_t* r1 = (const ccv_comp_t*)_r1;
+	const ccv_comp_t* r2 = (const ccv_comp_t*)_r2;
+	int distance = (int)(r1->rect.width * 0.25 + 0.5);
+	return abs(r2->rect.x - r1->rect.x) <= distance && abs(r2->rect.y - r1->rect.y) <= distance;
+}
+
+ccv_rect_t near_extent(const void* _r, void* data)
+{
+	const ccv_comp_t* r = (const ccv_comp_t*)_r;
+	int distance = (int)(r->rect.width * 0.25 + 0.5);
+	return ccv_rect(r->rect.x - distance, r->rect.y - distance, distance * 2 + 1, distance * 2 + 1);
+}
+
+TEST_CASE("group array with extents is the same as without")
+{
+	ccv_array_t* array = ccv_array_new(sizeof(ccv_comp_t), 2000, 0);
+	int i;
+	unsigned int seed = 7;
+	for (i = 0; i < 2000; i++)
+	{
+		ccv_comp_t comp;
+		seed = seed * 1103515245 + 12345;
+		int width = 8 + (seed >> 16) % 56;
+		seed = seed * 1103515245 + 12345;
+		int x = (seed >> 16) % 1000;
+		seed = seed * 1103515245 + 12345;
+		int y = (seed >> 16) % 1000;
+		comp.rect = ccv_rect(x, y, width, width);
+		ccv_array_push(array, &comp);
+	}
+	ccv_array_t* idx = 0;
+	int ncomp = ccv_array_group(array, &idx, is_near, 0);
+	ccv_array_t* idx_rect = 0;
+	int ncomp_rect = ccv_array_group_rect(array, &idx_rect, is_near, near_extent, 0);
+	REQUIRE(ncomp > 1 && ncomp < 2000, "should have some groups with more than one element");
+	REQUIRE_EQ(ncomp, ncomp_rect, "should have the same number of groups");
+	REQUIRE_ARRAY_EQ(int, idx->data, idx_rect->data, 2000, "should have the same groups");
+	ccv_array_free(array);
+	ccv_array_free(idx);
+	ccv_array_free(idx_rect);
+}
+
 // ϡ
 TEST_CASE("sparse matrix basic insertion")
 {
@@ -161,6 +207,46 @@ TEST_CASE("compress sparse matrix")
 	ccv_matrix_free(csm);
 }
 
+TEST_CASE("open addressing sparse matrix compresses the same as the hash of vectors")
+{
+	int major;
+	for (major = CCV_SPARSE_ROW_MAJOR; major <= CCV_SPARSE_COL_MAJOR; major++)
+	{
+		ccv_sparse_matrix_t* mat = ccv_sparse_matrix_new(500, 300, CCV_32F | CCV_C1, major, 0);
+		ccv_sparse_matrix_t* slab = ccv_sparse_matrix_new(500, 300, CCV_32F | CCV_C1, major | CCV_SPARSE_OPEN_ADDRESSING, 0);
+		int i;
+		for (i = 0; i < 20000; i++)
+		{
+			// 7919 is coprime with 500 * 300, thus, every cell is set once
+			int k = (i * 7919) % (500 * 300);
+			float cell = i + 1;
+			ccv_set_sparse_matrix_cell(mat, k / 300, k % 300, &cell);
+			ccv_set_sparse_matrix_cell(slab, k / 300, k % 300, &cell);
+		}
+		REQUIRE_EQ(slab->size, 20000, "should have 20000 cells set");
+		float cell = -1;
+		ccv_set_sparse_matrix_cell(slab, 7919 / 300, 7919 % 300, &cell);
+		REQUIRE_EQ(slab->size, 20000, "setting a cell again should not add a cell");
+		REQUIRE_EQ(ccv_get_sparse_matrix_cell(slab, 7919 / 300, 7919 % 300).f32[0], -1, "setting a cell again should overwrite it");
+		cell = 2; // restore the value of i = 1
+		ccv_set_sparse_matrix_cell(slab, 7919 / 300, 7919 % 300, &cell);
+		REQUIRE(ccv_get_sparse_matrix_cell(slab, 0, 1).u8 == 0, "cell (0, 1) is not set");
+		ccv_compressed_sparse_matrix_t* csm = 0;
+		ccv_compress_sparse_matrix(mat, &csm);
+		ccv_compressed_sparse_matrix_t* slab_csm = 0;
+		ccv_compress_sparse_matrix(slab, &slab_csm);
+		REQUIRE_EQ(csm->nnz, slab_csm->nnz, "should have the same number of non-zero cells");
+		REQUIRE_EQ(csm->type, slab_csm->type, "should be compressed to the same type");
+		REQUIRE_ARRAY_EQ(int, csm->offset, slab_csm->offset, (major == CCV_SPARSE_COL_MAJOR ? 300 : 500) + 1, "should have the same offsets");
+		REQUIRE_ARRAY_EQ(int, csm->index, slab_csm->index, csm->nnz, "should have the same indices");
+		REQUIRE_ARRAY_EQ(float, csm->data.f32, slab_csm->data.f32, csm->nnz, "should have the same values");
+		ccv_matrix_free(csm);
+		ccv_matrix_free(slab_csm);
+		ccv_matrix_free(mat);
+		ccv_matrix_free(slab);
+	}
+}
+
 TEST_CASE("matrix slice")
 {
 	ccv_dense_matrix_t* image = 0;
@@ -172,6 +258,25 @@ TEST_CASE("matrix slice")
 	ccv_matrix_free(b);
 }
 
+TEST_CASE("matrix view")
+{
+	ccv_dense_matrix_t* image = 0;
+	ccv_read("../../samples/chessbox.png", &image, CCV_IO_ANY_FILE);
+	ccv_dense_matrix_t* view = ccv_dense_matrix_view(image, 33, 41, 111, 91);
+	ccv_matrix_free(image); // the view holds the image
+	ccv_dense_matrix_t* b = 0;
+	ccv_resample(view, &b, 0, 111, 91, CCV_INTER_AREA);
+	REQUIRE_MATRIX_FILE_EQ(b, "data/chessbox.slice.bin", "should have data/chessbox.png viewed at (33, 41) with 111 x 91");
+	ccv_dense_matrix_t* c = view;
+	ccv_zero(b);
+	ccv_resample(b, &c, 0, 111, 91, CCV_INTER_AREA);
+	REQUIRE(c != view, "view should be copied on write");
+	REQUIRE_EQ(0, c->data.u8[0], "the copy should be written");
+	// the reference to the view (and the image) is dropped by copy on write
+	ccv_matrix_free(b);
+	ccv_matrix_free(c);
+}
+
 TEST_CASE("matrix flatten")
 {
 	ccv_dense_matrix_t* dmt = ccv_dense_matrix_new(2, 2, CCV_8U | CCV_C2, 0, 0);
@@ -266,4 +371,116 @@ TEST_CASE("half precision and float-point conversion")
 	ccfree(c);
 }
 
+TEST_CASE("half precision conversion is bit exact at every simd level")
+{
+	uint16_t* h = (uint16_t*)ccmalloc(sizeof(uint16_t) * 0x10001);
+	uint32_t* u = (uint32_t*)ccmalloc(sizeof(uint32_t) * 0x10001);
+	uint16_t* hb = (uint16_t*)ccmalloc(sizeof(uint16_t) * 0x10001);
+	uint32_t* ub = (uint32_t*)ccmalloc(sizeof(uint32_t) * 0x10001);
+	uint16_t* hc = (uint16_t*)ccmalloc(sizeof(uint16_t) * 0x10001);
+	uint32_t* uc = (uint32_t*)ccmalloc(sizeof(uint32_t) * 0x10001);
+	int i, level;
+	for (i = 0; i < 0x10001; i++)
+		h[i] = i * 40503; // visits every half, the odd length goes through the tail too
+	// random bit patterns, and the edges of half precision range (65504, 65520, 65536), infinity and signaling NaN
+	uint32_t seed = 1;
+	for (i = 0; i < 0x10001; i++)
+		u[i] = seed = seed * 1664525 + 1013904223;
+	static const uint32_t edges[] = { 0x477fe000, 0x477ff000, 0x477fffff, 0x47800000, 0xc7800000, 0x7f800000, 0x7f800001, 0xffc00001, 0x33000000, 0x387fc000, 0x00000001 };
+	for (i = 0; i < sizeof(edges) / sizeof(edges[0]); i++)
+		u[i * 7] = edges[i];
+	ccv_set_simd_level(CCV_SIMD_NONE);
+	ccv_half_precision_to_float(h, (float*)ub, 0x10001);
+	ccv_float_to_half_precision((float*)u, hb, 0x10001);
+	for (level = CCV_SIMD_SSE2; level < CCV_SIMD_LEVEL_NUM; level++)
+	{
+		ccv_set_simd_level(level);
+		ccv_half_precision_to_float(h, (float*)uc, 0x10001);
+		ccv_float_to_half_precision((float*)u, hc, 0x10001);
+		REQUIRE_ARRAY_EQ(uint32_t, ub, uc, 0x10001, "half precision to float should match the table at level %d", level);
+		REQUIRE_ARRAY_EQ(uint16_t, hb, hc, 0x10001, "float to half precision should match the table at level %d", level);
+	}
+	ccv_set_simd_level(-1);
+	ccfree(h);
+	ccfree(u);
+	ccfree(hb);
+	ccfree(ub);
+	ccfree(hc);
+	ccfree(uc);
+}
+
+TEST_CASE("half precision matrix types convert with ccv_shift")
+{
+	ccv_dense_matrix_t* a = ccv_dense_matrix_new(7, 5, CCV_32F | CCV_C3, 0, 0);
+	int i, j, k;
+	for (i = 0; i < 7 * 5 * 3; i++)
+		a->data.f32[i] = (i - 50) * 0.37;
+	ccv_dense_matrix_t* h = 0;
+	ccv_shift(a, (ccv_matrix_t**)&h, CCV_16F, 0, 0);
+	REQUIRE_EQ(h->step, 32, "rows of 15 half precision floats should be padded to 32 bytes");
+	ccv_dense_matrix_t* bf = 0;
+	ccv_shift(a, (ccv_matrix_t**)&bf, CCV_16BF, 0, 0);
+	ccv_dense_matrix_t* b = 0;
+	ccv_shift(h, (ccv_matrix_t**)&b, CCV_32F, 0, 0);
+	REQUIRE_ARRAY_EQ_WITH_TOLERANCE(float, a->data.f32, b->data.f32, 7 * 5 * 3, 0.02, "half precision keeps about 3 digits");
+	ccv_dense_matrix_t* d = 0;
+	ccv_shift(h, (ccv_matrix_t**)&d, CCV_64F, 0, 0);
+	ccv_dense_matrix_t* c = 0;
+	ccv_shift(bf, (ccv_matrix_t**)&c, CCV_32F, 0, 0);
+	REQUIRE_ARRAY_EQ_WITH_TOLERANCE(float, a->data.f32, c->data.f32, 7 * 5 * 3, 0.2, "bfloat16 keeps about 2 digits");
+	int same = 1;
+	for (i = 0; i < 7; i++)
+		for (j = 0; j < 5; j++)
+			for (k = 0; k < 3; k++)
+			{
+				float x = ccv_get_dense_matrix_cell_value(a, i, j, k);
+				if (ccv_get_dense_matrix_cell_value(h, i, j, k) != ccv_half_to_float(ccv_float_to_half(x)) ||
+					ccv_get_dense_matrix_cell_value(bf, i, j, k) != ccv_bfloat_to_float(ccv_float_to_bfloat(x)) ||
+					ccv_get_dense_matrix_cell_value(d, i, j, k) != ccv_get_dense_matrix_cell_value(b, i, j, k))
+					same = 0;
+			}
+	REQUIRE(same, "element access of half precision types should read them as float");
+	ccv_dense_matrix_t* x = 0;
+	ccv_visualize(h, (ccv_matrix_t**)&x, 0);
+	ccv_dense_matrix_t* y = 0;
+	ccv_visualize(b, (ccv_matrix_t**)&y, 0);
+	REQUIRE_MATRIX_EQ(x, y, "visualize half precision should be the same as the float");
+	ccv_matrix_free(a);
+	ccv_matrix_free(h);
+	ccv_matrix_free(bf);
+	ccv_matrix_free(b);
+	ccv_matrix_free(c);
+	ccv_matrix_free(d);
+	ccv_matrix_free(x);
+	ccv_matrix_free(y);
+}
+
+static void _ccv_parallel_nested_count(size_t i, void* context)
+{
+	__sync_add_and_fetch((int*)context + i, 1);
+}
+
+static void _ccv_parallel_count(size_t i, void* context)
+{
+	int* counts = (int*)context;
+	__sync_add_and_fetch(counts + i, 1);
+	if (i == 0) // nested one runs serially
+		ccv_parallel_for(1000, _ccv_parallel_nested_count, counts + 10007);
+}
+
+TEST_CASE("parallel for visits every index once")
+{
+	int* counts = (int*)cccalloc(10007 + 1000, sizeof(int));
+	ccv_set_parallel_thread_num(4);
+	ccv_parallel_for(10007, _ccv_parallel_count, counts);
+	ccv_parallel_for(3, _ccv_parallel_count, counts);
+	ccv_set_parallel_thread_num(0);
+	int i, once = 1;
+	for (i = 0; i < 10007 + 1000; i++)
+		if (counts[i] != ((i < 3 || i >= 10007) ? 2 : 1))
+			once = 0;
+	REQUIRE(once, "every index should be visited exactly once per call");
+	ccfree(counts);
+}
+
 #include "case_main.h"